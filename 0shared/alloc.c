@@ -0,0 +1,245 @@
+/*--------------------------------------------------------------------*/
+/* alloc.c                                                            */
+/* Author: Christopher Moretti                                        */
+/*--------------------------------------------------------------------*/
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "alloc.h"
+
+/* The standard allocator's functions, called rather than pointed to
+   so that gcc217m's meminfo sees each call */
+static void *Alloc_stdMalloc(size_t ulSize) {
+   return malloc(ulSize);
+}
+
+static void *Alloc_stdCalloc(size_t ulCount, size_t ulSize) {
+   return calloc(ulCount, ulSize);
+}
+
+static void *Alloc_stdRealloc(void *pvBlock, size_t ulSize) {
+   return realloc(pvBlock, ulSize);
+}
+
+static void Alloc_stdFree(void *pvBlock) {
+   free(pvBlock);
+}
+
+/* The standard allocator */
+static const struct Alloc_Functions sStandard =
+   {Alloc_stdMalloc, Alloc_stdCalloc, Alloc_stdRealloc, Alloc_stdFree};
+
+/* The allocator in use */
+static struct Alloc_Functions sFunctions =
+   {Alloc_stdMalloc, Alloc_stdCalloc, Alloc_stdRealloc, Alloc_stdFree};
+
+/* The module and name of each site */
+static const struct {
+   enum Alloc_Module eModule;
+   const char *pcName;
+} asSites[ALLOC_SITES] = {
+   {ALLOC_PATH, "struct"}, {ALLOC_PATH, "pathname"},
+   {ALLOC_PATH, "component"},
+   {ALLOC_DYNARRAY, "struct"}, {ALLOC_DYNARRAY, "array"},
+   {ALLOC_NODE, "struct"}, {ALLOC_NODE, "toString"},
+   {ALLOC_NODE, "counts"},
+   {ALLOC_CONTENTS, "loaded"}, {ALLOC_CONTENTS, "shared"},
+   {ALLOC_CONTENTS, "blob"}, {ALLOC_CONTENTS, "table"},
+   {ALLOC_CONTENTS, "rope"}, {ALLOC_CONTENTS, "chunk"},
+   {ALLOC_CONTENTS, "mapping"},
+   {ALLOC_TREE, "toString"}, {ALLOC_TREE, "pathname"},
+   {ALLOC_TREE, "cursor"}, {ALLOC_TREE, "snapshot"},
+   {ALLOC_TREE, "save"}, {ALLOC_TREE, "load"},
+   {ALLOC_TREE, "import"}, {ALLOC_TREE, "find"},
+   {ALLOC_JOURNAL, "struct"}, {ALLOC_JOURNAL, "replay"}};
+
+/* The name of each module */
+static const char *apcModules[ALLOC_MODULES] =
+   {"Path", "DynArray", "Node", "Contents", "Tree", "Journal"};
+
+/* The counts for each site, and for each module */
+static struct Alloc_Stats asSiteStats[ALLOC_SITES];
+static struct Alloc_Stats asModuleStats[ALLOC_MODULES];
+
+
+/*
+  Adds to *psStats ulAllocs blocks allocated and ulFrees blocks freed,
+  which together added ulAdded live bytes and removed ulRemoved.
+*/
+static void Alloc_addTo(struct Alloc_Stats *psStats, size_t ulAllocs,
+                        size_t ulFrees, size_t ulAdded,
+                        size_t ulRemoved) {
+   size_t ulLive, ulPeak;
+
+   assert(psStats != NULL);
+
+   if(ulAllocs != 0)
+      (void) __atomic_add_fetch(&psStats->ulAllocs, ulAllocs,
+                                __ATOMIC_RELAXED);
+   if(ulFrees != 0)
+      (void) __atomic_add_fetch(&psStats->ulFrees, ulFrees,
+                                __ATOMIC_RELAXED);
+   if(ulAdded == ulRemoved)
+      return;
+   if(ulAdded < ulRemoved) {
+      (void) __atomic_sub_fetch(&psStats->ulLiveBytes,
+                                ulRemoved - ulAdded, __ATOMIC_RELAXED);
+      return;
+   }
+
+   ulLive = __atomic_add_fetch(&psStats->ulLiveBytes,
+                               ulAdded - ulRemoved, __ATOMIC_RELAXED);
+   ulPeak = __atomic_load_n(&psStats->ulPeakBytes, __ATOMIC_RELAXED);
+   while(ulLive > ulPeak &&
+         !__atomic_compare_exchange_n(&psStats->ulPeakBytes, &ulPeak,
+                                      ulLive, 1, __ATOMIC_RELAXED,
+                                      __ATOMIC_RELAXED))
+      ;
+}
+
+/* Adds the counts as Alloc_addTo does to site eSite and its module. */
+static void Alloc_count(enum Alloc_Site eSite, size_t ulAllocs,
+                        size_t ulFrees, size_t ulAdded,
+                        size_t ulRemoved) {
+   assert((size_t) eSite < ALLOC_SITES);
+
+   Alloc_addTo(&asSiteStats[eSite], ulAllocs, ulFrees, ulAdded,
+               ulRemoved);
+   Alloc_addTo(&asModuleStats[asSites[eSite].eModule], ulAllocs,
+               ulFrees, ulAdded, ulRemoved);
+}
+
+/* Copies *psFrom into *psTo, reading each count atomically. */
+static void Alloc_load(const struct Alloc_Stats *psFrom,
+                       struct Alloc_Stats *psTo) {
+   assert(psFrom != NULL);
+   assert(psTo != NULL);
+
+   psTo->ulAllocs = __atomic_load_n(&psFrom->ulAllocs,
+                                    __ATOMIC_RELAXED);
+   psTo->ulFrees = __atomic_load_n(&psFrom->ulFrees, __ATOMIC_RELAXED);
+   psTo->ulLiveBytes = __atomic_load_n(&psFrom->ulLiveBytes,
+                                       __ATOMIC_RELAXED);
+   psTo->ulPeakBytes = __atomic_load_n(&psFrom->ulPeakBytes,
+                                       __ATOMIC_RELAXED);
+}
+
+/* Writes to psFile a line of the counts in *psStats, labelled with
+   pcLabel. */
+static void Alloc_writeStats(FILE *psFile, const char *pcLabel,
+                             const struct Alloc_Stats *psStats) {
+   assert(psFile != NULL);
+   assert(pcLabel != NULL);
+   assert(psStats != NULL);
+
+   fprintf(psFile, "%s: %lu allocs, %lu frees, %lu live bytes, "
+           "%lu peak bytes\n", pcLabel,
+           (unsigned long) psStats->ulAllocs,
+           (unsigned long) psStats->ulFrees,
+           (unsigned long) psStats->ulLiveBytes,
+           (unsigned long) psStats->ulPeakBytes);
+}
+
+
+void Alloc_setFunctions(const struct Alloc_Functions *psFunctions) {
+   if(psFunctions == NULL)
+      psFunctions = &sStandard;
+
+   assert(psFunctions->pfMalloc != NULL);
+   assert(psFunctions->pfCalloc != NULL);
+   assert(psFunctions->pfRealloc != NULL);
+   assert(psFunctions->pfFree != NULL);
+
+   sFunctions = *psFunctions;
+}
+
+void *Alloc_malloc(enum Alloc_Site eSite, size_t ulSize) {
+   void *pvBlock = (*sFunctions.pfMalloc)(ulSize);
+
+   if(pvBlock != NULL)
+      Alloc_count(eSite, 1, 0, ulSize, 0);
+   return pvBlock;
+}
+
+void *Alloc_calloc(enum Alloc_Site eSite, size_t ulCount,
+                   size_t ulSize) {
+   void *pvBlock = (*sFunctions.pfCalloc)(ulCount, ulSize);
+
+   if(pvBlock != NULL)
+      Alloc_count(eSite, 1, 0, ulCount * ulSize, 0);
+   return pvBlock;
+}
+
+void *Alloc_realloc(enum Alloc_Site eSite, void *pvBlock,
+                    size_t ulOldSize, size_t ulSize) {
+   void *pvResized;
+
+   assert(pvBlock != NULL || ulOldSize == 0);
+
+   pvResized = (*sFunctions.pfRealloc)(pvBlock, ulSize);
+   if(pvResized != NULL)
+      Alloc_count(eSite, 1, pvBlock != NULL, ulSize, ulOldSize);
+   return pvResized;
+}
+
+void Alloc_free(enum Alloc_Site eSite, void *pvBlock, size_t ulSize) {
+   if(pvBlock == NULL)
+      return;
+
+   (*sFunctions.pfFree)(pvBlock);
+   Alloc_count(eSite, 0, 1, 0, ulSize);
+}
+
+void Alloc_noteAlloc(enum Alloc_Site eSite, size_t ulSize) {
+   Alloc_count(eSite, 1, 0, ulSize, 0);
+}
+
+void Alloc_noteFree(enum Alloc_Site eSite, size_t ulSize) {
+   Alloc_count(eSite, 0, 1, 0, ulSize);
+}
+
+void Alloc_getSiteStats(enum Alloc_Site eSite,
+                        struct Alloc_Stats *psStats) {
+   assert((size_t) eSite < ALLOC_SITES);
+   assert(psStats != NULL);
+
+   Alloc_load(&asSiteStats[eSite], psStats);
+}
+
+void Alloc_getModuleStats(enum Alloc_Module eModule,
+                          struct Alloc_Stats *psStats) {
+   assert((size_t) eModule < ALLOC_MODULES);
+   assert(psStats != NULL);
+
+   Alloc_load(&asModuleStats[eModule], psStats);
+}
+
+enum Alloc_Module Alloc_getModule(enum Alloc_Site eSite) {
+   assert((size_t) eSite < ALLOC_SITES);
+
+   return asSites[eSite].eModule;
+}
+
+void Alloc_write(FILE *psFile) {
+   struct Alloc_Stats sStats;
+   size_t ulModule, ulSite;
+
+   assert(psFile != NULL);
+
+   for(ulModule = 0; ulModule < ALLOC_MODULES; ulModule++) {
+      Alloc_load(&asModuleStats[ulModule], &sStats);
+      if(sStats.ulAllocs == 0)
+         continue;
+      Alloc_writeStats(psFile, apcModules[ulModule], &sStats);
+      for(ulSite = 0; ulSite < ALLOC_SITES; ulSite++) {
+         if((size_t) asSites[ulSite].eModule != ulModule)
+            continue;
+         Alloc_load(&asSiteStats[ulSite], &sStats);
+         if(sStats.ulAllocs == 0)
+            continue;
+         fprintf(psFile, "   ");
+         Alloc_writeStats(psFile, asSites[ulSite].pcName, &sStats);
+      }
+   }
+}
@@ -0,0 +1,153 @@
+/*--------------------------------------------------------------------*/
+/* alloc.h                                                            */
+/* Author: Christopher Moretti                                        */
+/*--------------------------------------------------------------------*/
+
+#ifndef ALLOC_INCLUDED
+#define ALLOC_INCLUDED
+
+#include <stddef.h>
+#include <stdio.h>
+
+/*
+  The Path and DynArray modules, the nodes and the trees get their
+  memory through the Alloc functions, which pass each request on to
+  an allocator that a client may replace, and count it against the
+  site it was made for. A site is a kind of block, such as the struct
+  of a Path or the pathname string in it, so that the block is counted
+  against the same site when it is freed; each site belongs to one of
+  the modules below.
+
+  Blocks are freed with their sizes, so that no size need be kept with
+  each block, and blocks from the standard allocator can be freed with
+  free. Blocks that are handed to the client to free, such as the
+  strings from DT_toString, always come from malloc; the modules only
+  note them with Alloc_noteAlloc and Alloc_noteFree.
+
+  The counters are updated atomically, so the functions may be called
+  from several threads at once.
+*/
+
+/* The modules that sites belong to */
+enum Alloc_Module {ALLOC_PATH, ALLOC_DYNARRAY, ALLOC_NODE,
+                   ALLOC_CONTENTS, ALLOC_TREE, ALLOC_JOURNAL,
+                   ALLOC_MODULES};
+
+/* The sites that blocks are counted against */
+enum Alloc_Site {
+   /* Path: the struct, its pathname and its component strings */
+   ALLOC_PATH_STRUCT, ALLOC_PATH_NAME, ALLOC_PATH_COMPONENT,
+   /* DynArray: the struct and its array of elements */
+   ALLOC_DYNARRAY_STRUCT, ALLOC_DYNARRAY_ARRAY,
+   /* Node: the struct, the strings from Node_toString, and the
+      cumulative subtree sizes of a node's children */
+   ALLOC_NODE_STRUCT, ALLOC_NODE_STRING, ALLOC_NODE_COUNTS,
+   /* Contents: file contents that FT_load allocates, the bytes,
+      structs and hash table of the blob store that shares them, the
+      structs and chunks of the ropes holding contents changed by
+      range, and the structs of the files mapped for contents */
+   ALLOC_CONTENTS_LOADED, ALLOC_CONTENTS_SHARED, ALLOC_CONTENTS_BLOB,
+   ALLOC_CONTENTS_TABLE, ALLOC_CONTENTS_ROPE, ALLOC_CONTENTS_CHUNK,
+   ALLOC_CONTENTS_MAPPING,
+   /* Tree: the strings from toString, pathnames built while loading
+      or moving, cursors, snapshots, the buffers for saving and
+      loading images, the workers, names and pathnames of an import,
+      and the sets of pattern positions a find keeps */
+   ALLOC_TREE_STRING, ALLOC_TREE_KEY, ALLOC_TREE_ITER,
+   ALLOC_TREE_SNAPSHOT, ALLOC_TREE_OUT, ALLOC_TREE_IMAGE,
+   ALLOC_TREE_IMPORT, ALLOC_TREE_FIND,
+   /* Journal: the struct, and the buffer Journal_replay reads into */
+   ALLOC_JOURNAL_STRUCT, ALLOC_JOURNAL_REPLAY,
+   ALLOC_SITES};
+
+/* The counts for a site or a module. A realloc counts as freeing the
+   old block and allocating the new one. */
+struct Alloc_Stats {
+   /* the number of blocks allocated */
+   size_t ulAllocs;
+   /* the number of blocks freed */
+   size_t ulFrees;
+   /* the number of bytes in blocks allocated and not yet freed */
+   size_t ulLiveBytes;
+   /* the greatest that ulLiveBytes has been */
+   size_t ulPeakBytes;
+};
+
+/* An allocator, whose functions behave as malloc, calloc, realloc and
+   free do */
+struct Alloc_Functions {
+   void *(*pfMalloc)(size_t ulSize);
+   void *(*pfCalloc)(size_t ulCount, size_t ulSize);
+   void *(*pfRealloc)(void *pvBlock, size_t ulSize);
+   void (*pfFree)(void *pvBlock);
+};
+
+/*
+  Makes *psFunctions the allocator that the Alloc functions use, or
+  the standard one if psFunctions is NULL. No block that the current
+  allocator allocated may be freed afterwards, so this should only be
+  called when none is in use, such as before DT_init or FT_init.
+*/
+void Alloc_setFunctions(const struct Alloc_Functions *psFunctions);
+
+/*
+  Returns a block of ulSize bytes from the allocator, counted against
+  site eSite, or NULL if memory could not be allocated.
+*/
+void *Alloc_malloc(enum Alloc_Site eSite, size_t ulSize);
+
+/*
+  Returns a zeroed block of ulCount elements of ulSize bytes from the
+  allocator, counted against site eSite, or NULL if memory could not
+  be allocated.
+*/
+void *Alloc_calloc(enum Alloc_Site eSite, size_t ulCount,
+                   size_t ulSize);
+
+/*
+  Resizes pvBlock, of ulOldSize bytes and counted against site eSite,
+  to ulSize bytes as realloc does, returning the resized block or NULL
+  if memory could not be allocated, in which case pvBlock is
+  unchanged. pvBlock may be NULL, when ulOldSize must be 0.
+*/
+void *Alloc_realloc(enum Alloc_Site eSite, void *pvBlock,
+                    size_t ulOldSize, size_t ulSize);
+
+/*
+  Returns pvBlock, of ulSize bytes and counted against site eSite, to
+  the allocator. Does nothing if pvBlock is NULL.
+*/
+void Alloc_free(enum Alloc_Site eSite, void *pvBlock, size_t ulSize);
+
+/*
+  Counts a block of ulSize bytes against site eSite that the caller
+  got from malloc itself.
+*/
+void Alloc_noteAlloc(enum Alloc_Site eSite, size_t ulSize);
+
+/*
+  Counts a block of ulSize bytes against site eSite, that was noted
+  with Alloc_noteAlloc, as freed: the caller has freed it, or handed
+  it to the client to free.
+*/
+void Alloc_noteFree(enum Alloc_Site eSite, size_t ulSize);
+
+/* Stores the counts for site eSite in *psStats. */
+void Alloc_getSiteStats(enum Alloc_Site eSite,
+                        struct Alloc_Stats *psStats);
+
+/* Stores the counts for all the sites of module eModule, together,
+   in *psStats. */
+void Alloc_getModuleStats(enum Alloc_Module eModule,
+                          struct Alloc_Stats *psStats);
+
+/* Returns the module that site eSite belongs to. */
+enum Alloc_Module Alloc_getModule(enum Alloc_Site eSite);
+
+/*
+  Writes to psFile a line of counts for each module that has allocated
+  anything, followed by a line for each of its sites that has.
+*/
+void Alloc_write(FILE *psFile);
+
+#endif
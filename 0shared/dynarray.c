@@ -6,6 +6,7 @@
 #include "dynarray.h"
 #include <assert.h>
 #include <stdlib.h>
+#include "alloc.h"
 
 /*--------------------------------------------------------------------*/
 
@@ -66,7 +67,9 @@ static int DynArray_grow(DynArray_T oDynArray)
    uNewLength = GROWTH_FACTOR * oDynArray->uPhysLength;
 
    ppvNewArray = (const void**)
-      realloc(oDynArray->ppvArray, sizeof(void*) * uNewLength);
+      Alloc_realloc(ALLOC_DYNARRAY_ARRAY, (void*)oDynArray->ppvArray,
+                    sizeof(void*) * oDynArray->uPhysLength,
+                    sizeof(void*) * uNewLength);
    if (ppvNewArray == NULL)
       return 0;
 
@@ -81,7 +84,8 @@ DynArray_T DynArray_new(size_t uLength)
 {
    DynArray_T oDynArray;
 
-   oDynArray = (struct DynArray*)malloc(sizeof(struct DynArray));
+   oDynArray = (struct DynArray*)
+      Alloc_malloc(ALLOC_DYNARRAY_STRUCT, sizeof(struct DynArray));
    if (oDynArray == NULL)
       return NULL;
 
@@ -92,10 +96,12 @@ DynArray_T DynArray_new(size_t uLength)
       oDynArray->uPhysLength = MIN_PHYS_LENGTH;
 
    oDynArray->ppvArray =
-      (const void**)calloc(oDynArray->uPhysLength, sizeof(void*));
+      (const void**)Alloc_calloc(ALLOC_DYNARRAY_ARRAY,
+                                 oDynArray->uPhysLength, sizeof(void*));
    if (oDynArray->ppvArray == NULL)
    {
-      free(oDynArray);
+      Alloc_free(ALLOC_DYNARRAY_STRUCT, oDynArray,
+                 sizeof(struct DynArray));
       return NULL;
    }
 
@@ -109,8 +115,10 @@ void DynArray_free(DynArray_T oDynArray)
    assert(oDynArray != NULL);
    assert(DynArray_isValid(oDynArray));
 
-   free(oDynArray->ppvArray);
-   free(oDynArray);
+   Alloc_free(ALLOC_DYNARRAY_ARRAY, (void*)oDynArray->ppvArray,
+              sizeof(void*) * oDynArray->uPhysLength);
+   Alloc_free(ALLOC_DYNARRAY_STRUCT, oDynArray,
+              sizeof(struct DynArray));
 }
 
 /*--------------------------------------------------------------------*/
@@ -125,6 +133,16 @@ size_t DynArray_getLength(DynArray_T oDynArray)
 
 /*--------------------------------------------------------------------*/
 
+size_t DynArray_getPhysLength(DynArray_T oDynArray)
+{
+   assert(oDynArray != NULL);
+   assert(DynArray_isValid(oDynArray));
+
+   return oDynArray->uPhysLength;
+}
+
+/*--------------------------------------------------------------------*/
+
 void *DynArray_get(DynArray_T oDynArray, size_t uIndex)
 {
    assert(oDynArray != NULL);
@@ -34,6 +34,13 @@ size_t DynArray_getLength(DynArray_T oDynArray);
 
 /*--------------------------------------------------------------------*/
 
+/* Return the number of elements that oDynArray has room for before
+   it must grow, which is at least its length. */
+
+size_t DynArray_getPhysLength(DynArray_T oDynArray);
+
+/*--------------------------------------------------------------------*/
+
 /* Return the uIndex'th element of oDynArray. */
 
 void *DynArray_get(DynArray_T oDynArray, size_t uIndex);
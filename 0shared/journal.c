@@ -0,0 +1,322 @@
+/*--------------------------------------------------------------------*/
+/* journal.c                                                          */
+/* Author: Christopher Moretti                                        */
+/*--------------------------------------------------------------------*/
+
+/* write, read and fdatasync are POSIX.1-2001 interfaces */
+#define _POSIX_C_SOURCE 200112L
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "journal.h"
+#include "alloc.h"
+
+/* The sizes in bytes of the numbers in a record */
+enum {OP_BYTES = 1, PATH_BYTES = 4, DATA_BYTES = 8};
+/* The size in bytes of a record's fixed-length fields */
+enum {FIXED_BYTES = OP_BYTES + PATH_BYTES + DATA_BYTES};
+/* The size of the buffer gathering a batch of records */
+enum {BATCH_BYTES = 65536};
+
+/* A journal being appended to a file descriptor */
+struct Journal {
+   /* the file descriptor being appended to */
+   int iFd;
+   /* the number of records between syncs, or 0 */
+   size_t ulSyncEvery;
+   /* the number of records appended since the last sync */
+   size_t ulUnsynced;
+   /* SUCCESS, or IO_ERROR once a write or sync has failed */
+   int iStatus;
+   /* the number of records, batches written and syncs so far; a batch
+      carries every record gathered since the one before it, in as
+      many write calls as the file takes */
+   size_t ulRecords;
+   size_t ulBatches;
+   size_t ulSyncs;
+   /* the number of bytes of aucBatch waiting to be written */
+   size_t ulUsed;
+   /* the records waiting to be written */
+   unsigned char aucBatch[BATCH_BYTES];
+};
+
+
+/* Writes out the batch waiting in oJJournal, if it has not already
+   failed. */
+static void Journal_write(Journal_T oJJournal) {
+   size_t ulDone = 0;
+
+   assert(oJJournal != NULL);
+
+   if(oJJournal->ulUsed == 0)
+      return;
+   while(oJJournal->iStatus == SUCCESS && ulDone < oJJournal->ulUsed) {
+      ssize_t lWritten = write(oJJournal->iFd,
+                               oJJournal->aucBatch + ulDone,
+                               oJJournal->ulUsed - ulDone);
+      if(lWritten > 0)
+         ulDone += (size_t) lWritten;
+      else if(lWritten < 0 && errno == EINTR)
+         continue;
+      else
+         oJJournal->iStatus = IO_ERROR;
+   }
+   oJJournal->ulBatches++;
+   oJJournal->ulUsed = 0;
+}
+
+/* Appends the ulLength bytes at pvBytes to oJJournal's batch, writing
+   the batch out whenever it fills. */
+static void Journal_addBytes(Journal_T oJJournal, const void *pvBytes,
+                             size_t ulLength) {
+   const unsigned char *pucBytes = pvBytes;
+
+   assert(oJJournal != NULL);
+   assert(pvBytes != NULL || ulLength == 0);
+
+   while(ulLength > 0) {
+      size_t ulChunk = BATCH_BYTES - oJJournal->ulUsed;
+      if(ulChunk > ulLength)
+         ulChunk = ulLength;
+      memcpy(oJJournal->aucBatch + oJJournal->ulUsed, pucBytes, ulChunk);
+      oJJournal->ulUsed += ulChunk;
+      pucBytes += ulChunk;
+      ulLength -= ulChunk;
+      if(oJJournal->ulUsed == BATCH_BYTES)
+         Journal_write(oJJournal);
+   }
+}
+
+/* Appends ulValue to oJJournal's batch as a number of ulBytes bytes. */
+static void Journal_addNumber(Journal_T oJJournal, size_t ulValue,
+                              size_t ulBytes) {
+   unsigned char aucNumber[DATA_BYTES];
+   size_t i;
+
+   assert(oJJournal != NULL);
+   assert(ulBytes <= DATA_BYTES);
+
+   for(i = ulBytes; i > 0; i--) {
+      aucNumber[i - 1] = (unsigned char) (ulValue & 0xFF);
+      ulValue >>= 8;
+   }
+   assert(ulValue == 0);
+   Journal_addBytes(oJJournal, aucNumber, ulBytes);
+}
+
+/* Reads a number of ulBytes bytes at pucBytes. Sets *pulValue to it
+   and returns TRUE, or returns FALSE if it does not fit a size_t. */
+static boolean Journal_getNumber(const unsigned char *pucBytes,
+                                 size_t ulBytes, size_t *pulValue) {
+   size_t ulValue = 0;
+   size_t i;
+
+   assert(pucBytes != NULL);
+   assert(pulValue != NULL);
+
+   for(i = 0; i < ulBytes; i++) {
+      if(ulValue > ((size_t) -1) >> 8)
+         return FALSE;
+      ulValue = (ulValue << 8) | pucBytes[i];
+   }
+   *pulValue = ulValue;
+   return TRUE;
+}
+
+
+/*
+  Appends a record of operation iOp on pcPath to oJJournal, whose data
+  is ulNumber as a number of DATA_BYTES bytes, if bNumbered, followed
+  by the ulLength bytes at pvData. Returns as Journal_append does.
+*/
+static int Journal_addRecord(Journal_T oJJournal, int iOp,
+                             const char *pcPath, boolean bNumbered,
+                             size_t ulNumber, const void *pvData,
+                             size_t ulLength) {
+   unsigned char ucOp;
+   size_t ulPathLength;
+
+   assert(oJJournal != NULL);
+   assert(iOp > 0 && iOp <= 0xFF);
+   assert(pcPath != NULL);
+
+   if(oJJournal->iStatus != SUCCESS)
+      return oJJournal->iStatus;
+
+   ucOp = (unsigned char) iOp;
+   ulPathLength = strlen(pcPath);
+   Journal_addBytes(oJJournal, &ucOp, OP_BYTES);
+   Journal_addNumber(oJJournal, ulPathLength, PATH_BYTES);
+   Journal_addBytes(oJJournal, pcPath, ulPathLength);
+   Journal_addNumber(oJJournal, bNumbered ? ulLength + DATA_BYTES :
+                                            ulLength, DATA_BYTES);
+   if(bNumbered)
+      Journal_addNumber(oJJournal, ulNumber, DATA_BYTES);
+   Journal_addBytes(oJJournal, pvData, ulLength);
+   oJJournal->ulRecords++;
+
+   /* group commit: one sync covers the last ulSyncEvery records */
+   oJJournal->ulUnsynced++;
+   if(oJJournal->ulSyncEvery != 0 &&
+      oJJournal->ulUnsynced >= oJJournal->ulSyncEvery)
+      return Journal_sync(oJJournal);
+   return oJJournal->iStatus;
+}
+
+
+Journal_T Journal_new(int iFd, size_t ulSyncEvery) {
+   Journal_T oJJournal;
+
+   oJJournal = Alloc_malloc(ALLOC_JOURNAL_STRUCT,
+                            sizeof(struct Journal));
+   if(oJJournal == NULL)
+      return NULL;
+
+   oJJournal->iFd = iFd;
+   oJJournal->ulSyncEvery = ulSyncEvery;
+   oJJournal->ulUnsynced = 0;
+   oJJournal->iStatus = SUCCESS;
+   oJJournal->ulRecords = 0;
+   oJJournal->ulBatches = 0;
+   oJJournal->ulSyncs = 0;
+   oJJournal->ulUsed = 0;
+   return oJJournal;
+}
+
+int Journal_append(Journal_T oJJournal, int iOp, const char *pcPath,
+                   const void *pvData, size_t ulLength) {
+   return Journal_addRecord(oJJournal, iOp, pcPath, FALSE, 0, pvData,
+                            ulLength);
+}
+
+int Journal_appendNumbered(Journal_T oJJournal, int iOp,
+                           const char *pcPath, size_t ulNumber,
+                           const void *pvData, size_t ulLength) {
+   return Journal_addRecord(oJJournal, iOp, pcPath, TRUE, ulNumber,
+                            pvData, ulLength);
+}
+
+int Journal_sync(Journal_T oJJournal) {
+   assert(oJJournal != NULL);
+
+   Journal_write(oJJournal);
+   if(oJJournal->iStatus == SUCCESS) {
+      if(fdatasync(oJJournal->iFd) != 0)
+         oJJournal->iStatus = IO_ERROR;
+      oJJournal->ulSyncs++;
+   }
+   oJJournal->ulUnsynced = 0;
+   return oJJournal->iStatus;
+}
+
+int Journal_free(Journal_T oJJournal) {
+   int iStatus;
+
+   assert(oJJournal != NULL);
+
+   iStatus = Journal_sync(oJJournal);
+   Alloc_free(ALLOC_JOURNAL_STRUCT, oJJournal, sizeof(struct Journal));
+   return iStatus;
+}
+
+void Journal_getStats(Journal_T oJJournal, size_t *pulRecords,
+                      size_t *pulBatches, size_t *pulSyncs) {
+   assert(oJJournal != NULL);
+   assert(pulRecords != NULL);
+   assert(pulBatches != NULL);
+   assert(pulSyncs != NULL);
+
+   *pulRecords = oJJournal->ulRecords;
+   *pulBatches = oJJournal->ulBatches;
+   *pulSyncs = oJJournal->ulSyncs;
+}
+
+int Journal_replay(int iFd,
+                   int (*pfApply)(int iOp, const char *pcPath,
+                                  const void *pvData, size_t ulLength,
+                                  void *pvExtra),
+                   void *pvExtra) {
+   unsigned char *pucBuffer = NULL;
+   size_t ulCapacity = 0;
+   size_t ulHeld = 0;
+   boolean bAtEnd = FALSE;
+   int iStatus = SUCCESS;
+
+   assert(pfApply != NULL);
+
+   /* read a buffer at a time, applying every whole record in it */
+   while(iStatus == SUCCESS && !bAtEnd) {
+      size_t ulStart = 0;
+      ssize_t lRead;
+
+      if(ulHeld == ulCapacity) {
+         unsigned char *pucGrown;
+         size_t ulGrown =
+            ulCapacity == 0 ? BATCH_BYTES : 2 * ulCapacity;
+         pucGrown = Alloc_realloc(ALLOC_JOURNAL_REPLAY, pucBuffer,
+                                  ulCapacity, ulGrown);
+         if(pucGrown == NULL) {
+            iStatus = MEMORY_ERROR;
+            break;
+         }
+         pucBuffer = pucGrown;
+         ulCapacity = ulGrown;
+      }
+      lRead = read(iFd, pucBuffer + ulHeld, ulCapacity - ulHeld);
+      if(lRead < 0) {
+         if(errno != EINTR)
+            iStatus = IO_ERROR;
+         continue;
+      }
+      bAtEnd = (boolean) (lRead == 0);
+      ulHeld += (size_t) lRead;
+
+      while(iStatus == SUCCESS && ulHeld - ulStart >= FIXED_BYTES) {
+         unsigned char *pucRecord = pucBuffer + ulStart;
+         size_t ulAvailable = ulHeld - ulStart;
+         size_t ulPathLength, ulLength;
+         char *pcPath;
+         unsigned char ucSaved;
+
+         if(*pucRecord == 0 ||
+            !Journal_getNumber(pucRecord + OP_BYTES, PATH_BYTES,
+                               &ulPathLength)) {
+            iStatus = BAD_FORMAT;
+            break;
+         }
+         if(ulAvailable - FIXED_BYTES < ulPathLength)
+            break;
+         if(!Journal_getNumber(pucRecord + OP_BYTES + PATH_BYTES +
+                                  ulPathLength, DATA_BYTES, &ulLength)) {
+            iStatus = BAD_FORMAT;
+            break;
+         }
+         if(ulAvailable - FIXED_BYTES - ulPathLength < ulLength)
+            break;
+
+         /* the path is terminated in place, over the data's length
+            field, which has been read already */
+         pcPath = (char *) pucRecord + OP_BYTES + PATH_BYTES;
+         ucSaved = (unsigned char) pcPath[ulPathLength];
+         pcPath[ulPathLength] = '\0';
+         if(strlen(pcPath) != ulPathLength ||
+            (*pfApply)(*pucRecord, pcPath,
+                       pucRecord + FIXED_BYTES + ulPathLength,
+                       ulLength, pvExtra) != SUCCESS)
+            iStatus = BAD_FORMAT;
+         pcPath[ulPathLength] = (char) ucSaved;
+         ulStart += FIXED_BYTES + ulPathLength + ulLength;
+      }
+
+      /* keep the unfinished record for the next read */
+      memmove(pucBuffer, pucBuffer + ulStart, ulHeld - ulStart);
+      ulHeld -= ulStart;
+   }
+
+   Alloc_free(ALLOC_JOURNAL_REPLAY, pucBuffer, ulCapacity);
+   return iStatus;
+}
@@ -0,0 +1,90 @@
+/*--------------------------------------------------------------------*/
+/* journal.h                                                          */
+/* Author: Christopher Moretti                                        */
+/*--------------------------------------------------------------------*/
+
+#ifndef JOURNAL_INCLUDED
+#define JOURNAL_INCLUDED
+
+#include <stddef.h>
+#include "a4def.h"
+
+/*
+  A Journal_T appends records of changes to a tree to a file, so that
+  the changes can be replayed after a crash. A record is an operation
+  code (one byte), the length of a pathname (4 bytes) and the
+  pathname, then the length of some data (8 bytes) and the data, with
+  numbers big-endian. Records are gathered in memory and written out
+  in batches, and the file is only synced every so many records, so
+  that many changes share the cost of each write and each sync.
+
+  A Journal_T is not safe to use from several threads at once.
+*/
+typedef struct Journal *Journal_T;
+
+/*
+  Returns a new journal appending to file descriptor iFd, which it
+  syncs after every ulSyncEvery records, or only in Journal_sync if
+  ulSyncEvery is 0. Returns NULL if memory could not be allocated.
+*/
+Journal_T Journal_new(int iFd, size_t ulSyncEvery);
+
+/*
+  Appends a record of operation iOp (from 1 to 255) on pcPath with the
+  ulLength bytes at pvData to oJJournal. Returns SUCCESS, or IO_ERROR
+  if this or an earlier write or sync of oJJournal failed, after
+  which nothing more is written.
+*/
+int Journal_append(Journal_T oJJournal, int iOp, const char *pcPath,
+                   const void *pvData, size_t ulLength);
+
+/*
+  Appends a record to oJJournal as Journal_append does, but whose data
+  is ulNumber, as a number of 8 bytes, followed by the ulLength bytes
+  at pvData, so a change to part of some bytes, at an offset, need not
+  gather the two into one buffer first.
+*/
+int Journal_appendNumbered(Journal_T oJJournal, int iOp,
+                           const char *pcPath, size_t ulNumber,
+                           const void *pvData, size_t ulLength);
+
+/*
+  Writes out every record gathered so far and syncs the file, making
+  them all durable. Returns SUCCESS, or IO_ERROR if this or an
+  earlier write or sync of oJJournal failed.
+*/
+int Journal_sync(Journal_T oJJournal);
+
+/*
+  Syncs oJJournal as Journal_sync does, then frees it, leaving its
+  file descriptor open. Returns the status of the sync.
+*/
+int Journal_free(Journal_T oJJournal);
+
+/*
+  Stores in *pulRecords the number of records appended to oJJournal,
+  in *pulBatches the number of batches they were gathered into and
+  written to the file in, however many write calls each took, and
+  in *pulSyncs the number of times the file was synced.
+*/
+void Journal_getStats(Journal_T oJJournal, size_t *pulRecords,
+                      size_t *pulBatches, size_t *pulSyncs);
+
+/*
+  Reads the journal in the file open on iFd to its end, calling
+  (*pfApply)(iOp, pcPath, pvData, ulLength, pvExtra) for each record
+  in order. pcPath and pvData are borrowed for the call only. A record
+  cut off at the end of the file, as by a crash while it was being
+  written, is ignored. Returns SUCCESS, or:
+  * IO_ERROR if reading from iFd fails
+  * BAD_FORMAT if a record is malformed or pfApply does not return
+               SUCCESS for it, after which no more are applied
+  * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+int Journal_replay(int iFd,
+                   int (*pfApply)(int iOp, const char *pcPath,
+                                  const void *pvData, size_t ulLength,
+                                  void *pvExtra),
+                   void *pvExtra);
+
+#endif
@@ -0,0 +1,188 @@
+/*--------------------------------------------------------------------*/
+/* latency.c                                                          */
+/* Author: Christopher Moretti                                        */
+/*--------------------------------------------------------------------*/
+
+/* clock_gettime is a POSIX.1-2001 interface */
+#define _POSIX_C_SOURCE 200112L
+
+#include <assert.h>
+#include <time.h>
+
+#include "latency.h"
+
+/* The time in nanoseconds over which the counter's rate is measured */
+enum {CALIBRATION_NS = 2000000};
+
+/* The names of the statuses in a4def.h */
+static const char *apcStatusNames[LATENCY_STATUSES] =
+   {"SUCCESS", "INITIALIZATION_ERROR", "ALREADY_IN_TREE",
+    "NO_SUCH_PATH", "CONFLICTING_PATH", "BAD_PATH", "NOT_A_DIRECTORY",
+    "NOT_A_FILE", "MEMORY_ERROR", "IO_ERROR", "BAD_FORMAT"};
+
+/* The number of nanoseconds per tick, or 0 until it is measured */
+static double dNsPerTick = 0.0;
+
+
+/* Returns the time in nanoseconds of CLOCK_MONOTONIC. */
+static double Latency_clockNs(void) {
+   struct timespec sTime;
+
+   (void) clock_gettime(CLOCK_MONOTONIC, &sTime);
+   return (double) sTime.tv_sec * 1e9 + (double) sTime.tv_nsec;
+}
+
+/* Returns the number of nanoseconds per tick of Latency_now, measuring
+   it against CLOCK_MONOTONIC the first time. */
+static double Latency_nsPerTick(void) {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__aarch64__))
+   double dStartNs, dEndNs;
+   unsigned long ulStart;
+
+   if(dNsPerTick == 0.0) {
+      dStartNs = Latency_clockNs();
+      ulStart = Latency_now();
+      do
+         dEndNs = Latency_clockNs();
+      while(dEndNs - dStartNs < CALIBRATION_NS);
+      dNsPerTick = (dEndNs - dStartNs) /
+                   (double) (Latency_now() - ulStart);
+   }
+#else
+   dNsPerTick = 1.0;
+#endif
+   return dNsPerTick;
+}
+
+/* Returns the longest duration in ticks that bucket ulBucket of a
+   latency histogram counts, which must not be LATENCY_OVERFLOW. */
+static unsigned long Latency_bucketTop(size_t ulBucket) {
+   size_t ulShift;
+
+   assert(ulBucket < LATENCY_OVERFLOW);
+
+   if(ulBucket < LATENCY_SUB_BUCKETS)
+      return (unsigned long) ulBucket;
+   ulShift = ulBucket / LATENCY_SUB_BUCKETS - 1;
+   return (((unsigned long) (ulBucket % LATENCY_SUB_BUCKETS) +
+            LATENCY_SUB_BUCKETS + 1) << ulShift) - 1;
+}
+
+/* Returns the bucket under whose longest duration fraction dFraction
+   of the ulTotal calls counted in aulCounts fall. */
+static size_t Latency_percentile(const size_t aulCounts[],
+                                 size_t ulTotal, double dFraction) {
+   size_t ulBucket;
+   size_t ulSeen = 0;
+   double dRank = dFraction * (double) ulTotal;
+
+   assert(aulCounts != NULL);
+
+   for(ulBucket = 0; ulBucket < LATENCY_OVERFLOW; ulBucket++) {
+      ulSeen += aulCounts[ulBucket];
+      if((double) ulSeen >= dRank && ulSeen != 0)
+         break;
+   }
+   return ulBucket;
+}
+
+/* Writes to psFile the longest duration that bucket ulBucket counts,
+   in nanoseconds, or "> " and that of the bucket before it if it is
+   LATENCY_OVERFLOW, which has no longest. */
+static void Latency_writeTop(FILE *psFile, size_t ulBucket) {
+   assert(psFile != NULL);
+   assert(ulBucket < LATENCY_BUCKETS);
+
+   if(ulBucket == LATENCY_OVERFLOW)
+      fprintf(psFile, "> %.0f ns",
+              (double) Latency_bucketTop(ulBucket - 1) *
+              Latency_nsPerTick());
+   else
+      fprintf(psFile, "%.0f ns",
+              (double) Latency_bucketTop(ulBucket) *
+              Latency_nsPerTick());
+}
+
+
+unsigned long Latency_now(void) {
+#if defined(__GNUC__) && defined(__x86_64__)
+   unsigned int uLow, uHigh;
+
+   __asm__ __volatile__("rdtsc" : "=a" (uLow), "=d" (uHigh));
+   return ((unsigned long) uHigh << 32) | uLow;
+#elif defined(__GNUC__) && defined(__aarch64__)
+   unsigned long ulTicks;
+
+   __asm__ __volatile__("mrs %0, cntvct_el0" : "=r" (ulTicks));
+   return ulTicks;
+#else
+   return (unsigned long) Latency_clockNs();
+#endif
+}
+
+size_t Latency_bucketSince(unsigned long ulStart) {
+   unsigned long ulTicks = Latency_now() - ulStart;
+   size_t ulRange;
+
+   if(ulTicks < LATENCY_SUB_BUCKETS)
+      return (size_t) ulTicks;
+
+   /* ulRange is the position of the highest set bit of ulTicks */
+#ifdef __GNUC__
+   ulRange = (size_t) (sizeof(unsigned long) * 8 - 1 -
+                       (size_t) __builtin_clzl(ulTicks));
+#else
+   for(ulRange = 0; (ulTicks >> ulRange) > 1; ulRange++)
+      ;
+#endif
+   if(ulRange >= LATENCY_RANGES + LATENCY_SUB_BITS)
+      return LATENCY_OVERFLOW;
+   return (ulRange - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS +
+          (size_t) ((ulTicks >> (ulRange - LATENCY_SUB_BITS)) &
+                    (LATENCY_SUB_BUCKETS - 1));
+}
+
+void Latency_write(FILE *psFile, const char *pcOp, int iStatus,
+                   const size_t aulCounts[LATENCY_BUCKETS]) {
+   size_t ulBucket;
+   size_t ulTotal = 0;
+   size_t ulLast = 0;
+
+   assert(psFile != NULL);
+   assert(pcOp != NULL);
+   assert(iStatus >= 0 && iStatus < LATENCY_STATUSES);
+   assert(aulCounts != NULL);
+
+   for(ulBucket = 0; ulBucket < LATENCY_BUCKETS; ulBucket++) {
+      ulTotal += aulCounts[ulBucket];
+      if(aulCounts[ulBucket] != 0)
+         ulLast = ulBucket;
+   }
+   if(ulTotal == 0)
+      return;
+
+   fprintf(psFile, "%s %s: %lu calls, p50 ", pcOp,
+           apcStatusNames[iStatus], (unsigned long) ulTotal);
+   Latency_writeTop(psFile,
+                    Latency_percentile(aulCounts, ulTotal, 0.50));
+   fprintf(psFile, ", p90 ");
+   Latency_writeTop(psFile,
+                    Latency_percentile(aulCounts, ulTotal, 0.90));
+   fprintf(psFile, ", p99 ");
+   Latency_writeTop(psFile,
+                    Latency_percentile(aulCounts, ulTotal, 0.99));
+   fprintf(psFile, ", p99.9 ");
+   Latency_writeTop(psFile,
+                    Latency_percentile(aulCounts, ulTotal, 0.999));
+   fprintf(psFile, ", max ");
+   Latency_writeTop(psFile, ulLast);
+   fprintf(psFile, "\n");
+   for(ulBucket = 0; ulBucket < LATENCY_BUCKETS; ulBucket++)
+      if(aulCounts[ulBucket] != 0) {
+         fprintf(psFile, "%s",
+                 ulBucket == LATENCY_OVERFLOW ? "   " : "   <= ");
+         Latency_writeTop(psFile, ulBucket);
+         fprintf(psFile, ": %lu\n",
+                 (unsigned long) aulCounts[ulBucket]);
+      }
+}
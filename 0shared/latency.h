@@ -0,0 +1,59 @@
+/*--------------------------------------------------------------------*/
+/* latency.h                                                          */
+/* Author: Christopher Moretti                                        */
+/*--------------------------------------------------------------------*/
+
+#ifndef LATENCY_INCLUDED
+#define LATENCY_INCLUDED
+
+#include <stddef.h>
+#include <stdio.h>
+#include "a4def.h"
+
+/*
+  A latency histogram counts the durations of calls in log-linear
+  buckets, as HDR histograms do: each power-of-two range of durations
+  is split into LATENCY_SUB_BUCKETS equal buckets, so a duration is
+  known to within 1 / LATENCY_SUB_BUCKETS of itself however long it
+  is. A histogram is just an array of LATENCY_BUCKETS counts, which
+  its owner updates itself, so that recording a call costs no more
+  than two reads of the clock and an increment.
+
+  Durations are measured in ticks of the processor's constant-rate
+  counter where there is one, which is much cheaper to read than
+  clock_gettime, and in nanoseconds of CLOCK_MONOTONIC otherwise.
+  Latency_write reports them in nanoseconds either way.
+*/
+enum {LATENCY_SUB_BITS = 3};
+enum {LATENCY_SUB_BUCKETS = 1 << LATENCY_SUB_BITS};
+/* The number of powers of two whose durations are told apart */
+enum {LATENCY_RANGES = 40};
+/* The bucket of its own that counts the durations longer than all
+   those told apart, after the last of the others */
+enum {LATENCY_OVERFLOW = (LATENCY_RANGES + 1) * LATENCY_SUB_BUCKETS};
+enum {LATENCY_BUCKETS = LATENCY_OVERFLOW + 1};
+
+/* The number of statuses in a4def.h, by which calls are told apart */
+enum {LATENCY_STATUSES = BAD_FORMAT + 1};
+
+/* Returns the current time in ticks, from an arbitrary start. */
+unsigned long Latency_now(void);
+
+/* Returns the bucket of a latency histogram that counts a call that
+   started at ulStart ticks and has just returned. */
+size_t Latency_bucketSince(unsigned long ulStart);
+
+/*
+  Writes to psFile a line giving the number of calls counted in the
+  latency histogram aulCounts and their 50th, 90th, 99th and 99.9th
+  percentile and greatest durations, labelled with pcOp and the name
+  of status iStatus, then a line for each bucket that counted any.
+  Each duration is the longest that its bucket could have counted,
+  except that one in LATENCY_OVERFLOW is written as "> " and the
+  longest that the bucket before it could have counted. Writes
+  nothing if aulCounts counted no calls.
+*/
+void Latency_write(FILE *psFile, const char *pcOp, int iStatus,
+                   const size_t aulCounts[LATENCY_BUCKETS]);
+
+#endif
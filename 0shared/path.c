@@ -10,6 +10,7 @@
 
 #include "dynarray.h"
 #include "path.h"
+#include "alloc.h"
 
 /* An absolute path */
 struct path {
@@ -29,7 +30,8 @@ struct path {
 static void Path_freeString(char *pcStr, void *pvExtra) {
    /* pcStr may be NULL, as this is a no-op to free.
       pvExtra may be NULL, as it is unused. */
-   free(pcStr);
+   if(pcStr != NULL)
+      Alloc_free(ALLOC_PATH_COMPONENT, pcStr, strlen(pcStr) + 1);
 }
 
 /*
@@ -88,7 +90,8 @@ static int Path_split(const char *pcPath, DynArray_T *poDComponents) {
          return BAD_PATH;
       }
 
-      pcCopy = calloc((size_t)(pcEnd-pcStart+1), sizeof(char));
+      pcCopy = Alloc_calloc(ALLOC_PATH_COMPONENT,
+                            (size_t)(pcEnd-pcStart+1), sizeof(char));
       if(pcCopy == NULL) {
          DynArray_map(oDSubstrings,
                       (void (*)(void*, void*)) Path_freeString, NULL);
@@ -126,7 +129,7 @@ int Path_new(const char *pcPath, Path_T *poPResult) {
    assert(pcPath != NULL);
    assert(poPResult != NULL);
 
-   psNew = calloc(1, sizeof(struct path));
+   psNew = Alloc_calloc(ALLOC_PATH_STRUCT, 1, sizeof(struct path));
    if(psNew == NULL) {
       *poPResult = NULL;
       return MEMORY_ERROR;
@@ -141,7 +144,7 @@ int Path_new(const char *pcPath, Path_T *poPResult) {
    }
 
    psNew->ulLength = strlen(pcPath);
-   psNew->pcPath = malloc(psNew->ulLength+1);
+   psNew->pcPath = Alloc_malloc(ALLOC_PATH_NAME, psNew->ulLength+1);
    if(psNew->pcPath == NULL) {
       Path_free(psNew);
       *poPResult = NULL;
@@ -176,7 +179,7 @@ int Path_prefix(Path_T oPPath, size_t ulDepth, Path_T *poPResult) {
       return NO_SUCH_PATH;
    }
 
-   psNew = calloc(1, sizeof(struct path));
+   psNew = Alloc_calloc(ALLOC_PATH_STRUCT, 1, sizeof(struct path));
    if(psNew == NULL) {
       *poPResult = NULL;
       return MEMORY_ERROR;
@@ -189,7 +192,8 @@ int Path_prefix(Path_T oPPath, size_t ulDepth, Path_T *poPResult) {
       return MEMORY_ERROR;
    }
 
-   pcBuild = calloc(Path_getStrLength(oPPath)+1, sizeof(char));
+   pcBuild = Alloc_calloc(ALLOC_PATH_NAME, Path_getStrLength(oPPath)+1,
+                          sizeof(char));
    if(pcBuild == NULL) {
       Path_free(psNew);
       *poPResult = NULL;
@@ -203,9 +207,11 @@ int Path_prefix(Path_T oPPath, size_t ulDepth, Path_T *poPResult) {
       /* deep copy each component to new DynArray */
       pcComponent = Path_getComponent(oPPath, ulIndex);
       ulLength = strlen(pcComponent);
-      pcCopy = calloc(ulLength + 1, sizeof(char));
+      pcCopy = Alloc_calloc(ALLOC_PATH_COMPONENT, ulLength + 1,
+                            sizeof(char));
       if(pcCopy == NULL) {
-         free(pcBuild);
+         Alloc_free(ALLOC_PATH_NAME, pcBuild,
+                    Path_getStrLength(oPPath)+1);
          Path_free(psNew);
          *poPResult = NULL;
          return MEMORY_ERROR;
@@ -221,9 +227,10 @@ int Path_prefix(Path_T oPPath, size_t ulDepth, Path_T *poPResult) {
    pcBuild[ulSum-1] = '\0';
 
    /* shrink allocation to fit prefix's pathname string if needed */
-   pcInsert = realloc(pcBuild, ulSum);
+   pcInsert = Alloc_realloc(ALLOC_PATH_NAME, pcBuild,
+                            Path_getStrLength(oPPath)+1, ulSum);
    if(pcInsert == NULL) {
-      free(pcBuild);
+      Alloc_free(ALLOC_PATH_NAME, pcBuild, Path_getStrLength(oPPath)+1);
       Path_free(psNew);
       *poPResult = NULL;
       return MEMORY_ERROR;
@@ -242,9 +249,96 @@ int Path_dup(Path_T oPPath, Path_T *poPResult) {
    return Path_prefix(oPPath, Path_getDepth(oPPath), poPResult);
 }
 
+int Path_newChild(Path_T oPParent, const char *pcName,
+                  size_t ulNameLength, Path_T *poPResult) {
+   struct path *psNew;
+   size_t ulDepth = 0;
+   size_t ulParentLength = 0;
+   size_t ulIndex;
+   const char *pcComponent;
+   char *pcCopy;
+   char *pcBuild;
+
+   assert(pcName != NULL);
+   assert(poPResult != NULL);
+
+   /* a component is a nonempty run of characters other than '/' */
+   if(ulNameLength == 0 ||
+      memchr(pcName, '/', ulNameLength) != NULL ||
+      memchr(pcName, '\0', ulNameLength) != NULL) {
+      *poPResult = NULL;
+      return BAD_PATH;
+   }
+
+   if(oPParent != NULL) {
+      ulDepth = Path_getDepth(oPParent);
+      ulParentLength = oPParent->ulLength;
+   }
+
+   psNew = Alloc_calloc(ALLOC_PATH_STRUCT, 1, sizeof(struct path));
+   if(psNew == NULL) {
+      *poPResult = NULL;
+      return MEMORY_ERROR;
+   }
+
+   psNew->oDComponents = DynArray_new(ulDepth + 1);
+   if(psNew->oDComponents == NULL) {
+      Path_free(psNew);
+      *poPResult = NULL;
+      return MEMORY_ERROR;
+   }
+
+   /* deep copy the parent's components, then add the new one */
+   for(ulIndex = 0; ulIndex < ulDepth; ulIndex++) {
+      pcComponent = Path_getComponent(oPParent, ulIndex);
+      pcCopy = Alloc_malloc(ALLOC_PATH_COMPONENT,
+                            strlen(pcComponent) + 1);
+      if(pcCopy == NULL) {
+         Path_free(psNew);
+         *poPResult = NULL;
+         return MEMORY_ERROR;
+      }
+      strcpy(pcCopy, pcComponent);
+      (void) DynArray_set(psNew->oDComponents, ulIndex, pcCopy);
+   }
+   pcCopy = Alloc_malloc(ALLOC_PATH_COMPONENT, ulNameLength + 1);
+   if(pcCopy == NULL) {
+      Path_free(psNew);
+      *poPResult = NULL;
+      return MEMORY_ERROR;
+   }
+   memcpy(pcCopy, pcName, ulNameLength);
+   pcCopy[ulNameLength] = '\0';
+   (void) DynArray_set(psNew->oDComponents, ulDepth, pcCopy);
+
+   /* the pathname is the parent's and a delimiter, if there is a
+      parent, then the new name */
+   psNew->ulLength = ulNameLength;
+   if(oPParent != NULL)
+      psNew->ulLength += ulParentLength + 1;
+   pcBuild = Alloc_malloc(ALLOC_PATH_NAME, psNew->ulLength + 1);
+   if(pcBuild == NULL) {
+      Path_free(psNew);
+      *poPResult = NULL;
+      return MEMORY_ERROR;
+   }
+   if(oPParent != NULL) {
+      memcpy(pcBuild, oPParent->pcPath, ulParentLength);
+      pcBuild[ulParentLength] = '/';
+   }
+   memcpy(pcBuild + psNew->ulLength - ulNameLength, pcName,
+          ulNameLength);
+   pcBuild[psNew->ulLength] = '\0';
+   psNew->pcPath = pcBuild;
+
+   *poPResult = psNew;
+   return SUCCESS;
+}
+
 void Path_free(Path_T oPPath) {
    if(oPPath != NULL) {
-      free((char *)oPPath->pcPath);
+      Alloc_free(ALLOC_PATH_NAME, (char *)oPPath->pcPath,
+                 oPPath->ulLength+1);
 
       if(oPPath->oDComponents != NULL) {
          DynArray_map(oPPath->oDComponents,
@@ -253,7 +347,8 @@ void Path_free(Path_T oPPath) {
       }
    }
 
-   free((struct path*) oPPath);
+   Alloc_free(ALLOC_PATH_STRUCT, (struct path*) oPPath,
+              sizeof(struct path));
 }
 
 const char *Path_getPathname(Path_T oPPath) {
@@ -268,6 +363,15 @@ size_t Path_getStrLength(Path_T oPPath) {
    return oPPath->ulLength;
 }
 
+size_t Path_getBytes(Path_T oPPath) {
+   assert(oPPath != NULL);
+
+   /* the components are copies of the pathname's, and with their
+      '\0's take exactly as many bytes as it does */
+   return sizeof(struct path) + 2 * (oPPath->ulLength + 1) +
+      DynArray_getPhysLength(oPPath->oDComponents) * sizeof(void *);
+}
+
 int Path_comparePath(Path_T oPPath1, Path_T oPPath2) {
    assert(oPPath1 != NULL);
    assert(oPPath2 != NULL);
@@ -316,3 +420,96 @@ const char *Path_getComponent(Path_T oPPath, size_t ulLevel) {
 
    return DynArray_get(oPPath->oDComponents, ulLevel);
 }
+
+/*
+  Matches character c against the set that starts just after a '['
+  at pcClass. Returns a pointer to the closing ']' and sets *pbMatched
+  to whether c is in the set, or returns NULL if the set is not
+  closed.
+*/
+static const char *Path_matchClass(const char *pcClass, char c,
+                                   boolean *pbMatched) {
+   boolean bNegated = FALSE;
+   boolean bFound = FALSE;
+   const char *pcCurr = pcClass;
+
+   assert(pcClass != NULL);
+   assert(pbMatched != NULL);
+
+   if(*pcCurr == '!' || *pcCurr == '^') {
+      bNegated = TRUE;
+      pcCurr++;
+   }
+   /* a ']' leading the set is a member, not the end of it */
+   do {
+      if(*pcCurr == '\0')
+         return NULL;
+      if(pcCurr[1] == '-' && pcCurr[2] != ']' && pcCurr[2] != '\0') {
+         if((unsigned char) pcCurr[0] <= (unsigned char) c &&
+            (unsigned char) c <= (unsigned char) pcCurr[2])
+            bFound = TRUE;
+         pcCurr += 3;
+      }
+      else {
+         if(*pcCurr == c)
+            bFound = TRUE;
+         pcCurr++;
+      }
+   } while(*pcCurr != ']');
+
+   *pbMatched = (boolean) (bFound != bNegated);
+   return pcCurr;
+}
+
+boolean Path_matchComponent(const char *pcPattern,
+                            const char *pcComponent) {
+   /* where to resume after the most recent '*' if a later part fails */
+   const char *pcStarPattern = NULL;
+   const char *pcStarComponent = NULL;
+   const char *pcClassEnd;
+   boolean bMatched;
+
+   assert(pcPattern != NULL);
+   assert(pcComponent != NULL);
+
+   while(*pcComponent != '\0') {
+      if(*pcPattern == '*') {
+         /* first try matching the empty run */
+         pcStarPattern = ++pcPattern;
+         pcStarComponent = pcComponent;
+         continue;
+      }
+      if(*pcPattern == '[') {
+         pcClassEnd = Path_matchClass(pcPattern + 1, *pcComponent,
+                                      &bMatched);
+         if(pcClassEnd != NULL) {
+            if(bMatched) {
+               pcPattern = pcClassEnd + 1;
+               pcComponent++;
+               continue;
+            }
+         }
+         else if(*pcComponent == '[') {
+            pcPattern++;
+            pcComponent++;
+            continue;
+         }
+      }
+      else if(*pcPattern != '\0' &&
+              (*pcPattern == '?' || *pcPattern == *pcComponent)) {
+         pcPattern++;
+         pcComponent++;
+         continue;
+      }
+
+      /* mismatch: let the last '*' swallow one more character */
+      if(pcStarPattern == NULL)
+         return FALSE;
+      pcPattern = pcStarPattern;
+      pcComponent = ++pcStarComponent;
+   }
+
+   while(*pcPattern == '*')
+      pcPattern++;
+   return (boolean) (*pcPattern == '\0');
+}
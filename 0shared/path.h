@@ -43,6 +43,19 @@ int Path_dup(Path_T oPPath, Path_T *poPResult);
 */
 int Path_prefix(Path_T oPPath, size_t ulDepth, Path_T *poPResult);
 
+/*
+  Creates a new path object for the child of oPParent whose last
+  component is the ulNameLength characters at pcName, which need not
+  be followed by a '\0'. With oPParent NULL, the new path has depth 1.
+  The parent's components are copied rather than parsed again.
+  Returns an int SUCCESS status and sets *poPResult to be the new path
+  if successful. Otherwise, sets *poPResult to NULL and returns status:
+  * MEMORY_ERROR if memory could not be allocated to complete request
+  * BAD_PATH if the name is empty or contains a '/' or a '\0'
+*/
+int Path_newChild(Path_T oPParent, const char *pcName,
+                  size_t ulNameLength, Path_T *poPResult);
+
 /* Destroys and frees all memory allocated for oPPath. */
 void Path_free(Path_T oPPath);
 
@@ -55,6 +68,13 @@ const char *Path_getPathname(Path_T oPPath);
 */
 size_t Path_getStrLength(Path_T oPPath);
 
+/*
+  Returns the number of bytes of memory that oPPath occupies: its
+  pathname, its separately stored components and the arrays holding
+  them, not counting the allocator's own overhead.
+*/
+size_t Path_getBytes(Path_T oPPath);
+
 /*
   Compares oPPath1 and oPPath2 lexicographically based on pathname.
   Returns <0, 0, or >0 if oPPath1 is "less than", "equal to", or
@@ -93,4 +113,16 @@ size_t Path_getSharedPrefixDepth(Path_T oPPath1, Path_T oPPath2);
 */
 const char *Path_getComponent(Path_T oPPath, size_t ulLevel);
 
+/*
+  Returns TRUE if the single component pcComponent matches the glob
+  pattern pcPattern, and FALSE otherwise. In pcPattern, '*' matches
+  any run of characters, '?' matches any one character, and "[...]"
+  matches one character from the set, which may contain ranges like
+  "a-z" and is negated by a leading '!' or '^'. A ']' right after the
+  '[' (or its negation) is part of the set, and a '[' without a
+  closing ']' matches itself. Every other character matches itself.
+*/
+boolean Path_matchComponent(const char *pcPattern,
+                            const char *pcComponent);
+
 #endif
@@ -124,32 +124,38 @@ static boolean check_lexOrder(Node_T oNNode) {
 }
 
 
-/* Count the number of valid nodes in a tree rooted at oNRoot
-* recursively. Is not affected by the length field of the DT */
-static size_t countValidNodes(Node_T oNRoot) {
-    size_t count = 0;
-    size_t i;
-
-    if (oNRoot == NULL) {
-        return 0;
-    }
-
-    /* Check if the current node is valid */
-    if (CheckerDT_Node_isValid(oNRoot)) {
-        count++;
-    }
+/* Validate the subtree size of oNNode locally
+* Return TRUE if oNNode counts itself and exactly the nodes counted
+* by its children, and the counts it keeps of the nodes before each
+* child agree, return FALSE otherwise */
+static boolean check_subtreeSize(Node_T oNNode) {
+    size_t ulExpected = 1;
+    size_t ulIndex;
 
-    /* Recursively count the valid nodes in each child subtree */
-    for (i = 0; i < Node_getNumChildren(oNRoot); i++) {
+    for (ulIndex = 0; ulIndex < Node_getNumChildren(oNNode);
+         ulIndex++) {
         Node_T oNChild = NULL;
-        int iStatus = Node_getChild(oNRoot, i, &oNChild);
-
-        if (iStatus == SUCCESS) {
-            count += countValidNodes(oNChild);
+        if (Node_countBefore(oNNode, ulIndex) != ulExpected - 1) {
+            fprintf(stderr, "%s counts %lu nodes before child %lu, "
+                    "but its children account for %lu\n",
+                    Path_getPathname(Node_getPath(oNNode)),
+                    (unsigned long) Node_countBefore(oNNode, ulIndex),
+                    (unsigned long) ulIndex,
+                    (unsigned long) (ulExpected - 1));
+            return FALSE;
         }
+        if (Node_getChild(oNNode, ulIndex, &oNChild) == SUCCESS)
+            ulExpected += Node_getSubtreeSize(oNChild);
     }
-
-    return count;
+    if (Node_getSubtreeSize(oNNode) != ulExpected) {
+        fprintf(stderr, "Subtree size of %s is %lu, but its children "
+                "account for %lu nodes\n",
+                Path_getPathname(Node_getPath(oNNode)),
+                (unsigned long) Node_getSubtreeSize(oNNode),
+                (unsigned long) ulExpected);
+        return FALSE;
+    }
+    return TRUE;
 }
 
 
@@ -168,6 +174,10 @@ static boolean CheckerDT_treeCheck(Node_T oNNode) {
         if(!CheckerDT_Node_isValid(oNNode))
             return FALSE;
 
+        /* check the node's subtree size against its children's */
+        if(!check_subtreeSize(oNNode))
+            return FALSE;
+
         /* check all getchild calls return not null */
         if (Node_getNumChildren(oNNode) > 0) {
             if(!check_GetChildNull(oNNode))
@@ -217,8 +227,6 @@ static boolean CheckerDT_treeCheck(Node_T oNNode) {
 boolean CheckerDT_isValid(boolean bIsInitialized, Node_T oNRoot,
                           size_t ulCount) {
 
-   size_t totalCount;
-
    /* Sample check on a top-level data structure invariant:
       if the DT is not initialized, its count should be 0. */
    if(!bIsInitialized)
@@ -233,13 +241,14 @@ boolean CheckerDT_isValid(boolean bIsInitialized, Node_T oNRoot,
         return FALSE;
     }
 
-    /* NEW: check length field agrees with node count */
-    totalCount = countValidNodes(oNRoot);
-    if (totalCount != ulCount) {
+    /* NEW: check length field agrees with node count; the subtree
+       sizes checked at each node below account for every node */
+    if (oNRoot != NULL && Node_getSubtreeSize(oNRoot) != ulCount) {
         fprintf(stderr, 
           "DT length does not equal total number of nodes detected \n");
         fprintf(stderr, "Length: %lu. Nodes detected: %lu\n",
-                ulCount, totalCount);
+                (unsigned long) ulCount,
+                (unsigned long) Node_getSubtreeSize(oNRoot));
         return FALSE;
     }   
 
@@ -7,6 +7,7 @@
 #define DT_INCLUDED
 
 #include <stddef.h>
+#include <stdio.h>
 #include "a4def.h"
 
 /*
@@ -44,11 +45,34 @@ boolean DT_contains(const char *pcPath);
 */
 int DT_rm(const char *pcPath);
 
+/*
+  Moves the directory with absolute path pcOldPath, with everything
+  beneath it, to absolute path pcNewPath, whose parent must exist. The
+  subtree is relinked in one step, and the paths beneath it are only
+  rewritten as they are next used, so the move takes time proportional
+  to the depth of the paths rather than to the size of the subtree,
+  except while a snapshot is live. Returns SUCCESS if moved.
+  Otherwise, returns:
+  * INITIALIZATION_ERROR if the DT is not in an initialized state
+  * BAD_PATH if pcOldPath or pcNewPath is not a well-formatted path
+  * CONFLICTING_PATH if the root exists but is not a prefix of
+                     pcOldPath or pcNewPath, or if pcNewPath is beneath
+                     pcOldPath (so the root cannot be moved)
+  * NO_SUCH_PATH if pcOldPath, or pcNewPath's parent, is not in the DT
+  * ALREADY_IN_TREE if pcNewPath is already in the DT
+  * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+int DT_mv(const char *pcOldPath, const char *pcNewPath);
+
 /*
   Sets the DT data structure to an initialized state.
   The data structure is initially empty.
   Returns INITIALIZATION_ERROR if already initialized,
-  and SUCCESS otherwise.
+  and SUCCESS otherwise. DT_MAPPED builds keep the directories in an
+  anonymous mapped region, and may also return IO_ERROR or
+  MEMORY_ERROR if it cannot be created. They also return
+  INITIALIZATION_ERROR until every snapshot of the previous DT has
+  been freed, as its region stays open until then.
 */
 int DT_init(void);
 
@@ -56,10 +80,51 @@ int DT_init(void);
   Removes all contents of the data structure and
   returns it to an uninitialized state.
   Returns INITIALIZATION_ERROR if not already initialized,
-  and SUCCESS otherwise.
+  and SUCCESS otherwise. In DT_MAPPED builds a DT from DT_open
+  leaves its file empty.
 */
 int DT_destroy(void);
 
+#ifdef DT_MAPPED
+/*
+  Sets the DT data structure to an initialized state holding the
+  directories stored in file pcFile by DT_checkpoint or DT_close, or
+  no directories if pcFile is empty or does not exist, in which case
+  it is created. The directories stay in the file, which is mapped
+  into memory: nothing is read or built up front, so opening takes
+  the same short time however large the DT is, and each change is
+  made to the file's pages directly.
+  Returns SUCCESS, or:
+  * INITIALIZATION_ERROR if already initialized, or if a snapshot of
+                         the previous DT has yet to be freed
+  * IO_ERROR if pcFile cannot be opened, created or mapped
+  * BAD_FORMAT if pcFile is not a DT file
+  * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+int DT_open(const char *pcFile);
+
+/*
+  Makes every change to the DT so far durable in the file it was
+  opened from, waiting until the file has been written. If the system
+  fails between checkpoints, the file may hold any mixture of the
+  changes made since the last one.
+  Returns SUCCESS, or:
+  * INITIALIZATION_ERROR if the DT is not in an initialized state
+  * IO_ERROR if the file cannot be written
+*/
+int DT_checkpoint(void);
+
+/*
+  Checkpoints the DT as DT_checkpoint does, then returns it to an
+  uninitialized state, leaving its directories in its file for a
+  later DT_open. Snapshots stay valid until they are freed.
+  Returns SUCCESS, or:
+  * INITIALIZATION_ERROR if the DT is not in an initialized state
+  * IO_ERROR if the file cannot be written (the DT is closed anyway)
+*/
+int DT_close(void);
+#endif
+
 /*
   Returns a string representation of the
   data structure, or NULL if the structure is
@@ -73,4 +138,285 @@ int DT_destroy(void);
 */
 char *DT_toString(void);
 
+/*
+  A DT_Iter_T walks a subtree of the DT in the same order as
+  DT_toString, one directory at a time, without building a string.
+*/
+typedef struct DT_Iter *DT_Iter_T;
+
+/*
+  Begins an iteration over the subtree rooted at the directory with
+  absolute path pcPath, or over the whole DT if pcPath is NULL.
+  Returns SUCCESS and sets *poIResult to the new iterator if
+  successful. Otherwise, sets *poIResult to NULL and returns:
+  * INITIALIZATION_ERROR if the DT is not in an initialized state
+  * BAD_PATH if pcPath does not represent a well-formatted path
+  * CONFLICTING_PATH if the root exists but is not a prefix of pcPath
+  * NO_SUCH_PATH if absolute path pcPath does not exist in the DT
+  * MEMORY_ERROR if memory could not be allocated to complete request
+
+  The DT must not be changed until DT_iterEnd. In DT_CONCURRENT
+  builds, the calling thread holds the DT's tree lock until then, so
+  other threads' changes wait (iterate a snapshot to avoid that).
+*/
+int DT_iterBegin(const char *pcPath, DT_Iter_T *poIResult);
+
+/*
+  Returns the absolute path of the next directory of oIIter, or NULL
+  once every directory has been returned. The string is borrowed from
+  the DT (or snapshot) and must not be modified or freed by the
+  client; it remains valid until that directory is removed.
+*/
+const char *DT_iterNext(DT_Iter_T oIIter);
+
+/* Ends the iteration oIIter and frees it. */
+void DT_iterEnd(DT_Iter_T oIIter);
+
+/*
+  Calls (*pfVisit)(pcDirPath, pvExtra) for each directory in the
+  subtree rooted at pcPath (the whole DT if pcPath is NULL), in the
+  order of DT_iterNext, with the same borrowed strings. pfVisit must
+  not change the DT. Returns SUCCESS, or a status as for DT_iterBegin.
+*/
+int DT_map(const char *pcPath,
+           void (*pfVisit)(const char *pcPath, void *pvExtra),
+           void *pvExtra);
+
+/*
+  Calls (*pfVisit)(pcDirPath, pvExtra) once for each directory whose
+  absolute path matches pcPattern, in the order of DT_toString, even
+  where a directory matches in several ways. The pattern is a path
+  whose components each match one component of a directory's path,
+  with '*', '?' and "[...]" as for Path_matchComponent, except that a
+  component "**" matches any number of components, including none.
+  For example, the components "a", "**" and "log-2024*" together
+  match every directory under a whose name starts with log-2024.
+  Only the branches that can match are visited. pfVisit gets the same
+  borrowed strings as for DT_map, and must not change the DT either.
+  Returns SUCCESS even if nothing matches. Otherwise returns:
+  * INITIALIZATION_ERROR if the DT is not in an initialized state
+  * BAD_PATH if pcPattern is not a well-formatted path
+  * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+int DT_find(const char *pcPattern,
+            void (*pfVisit)(const char *pcPath, void *pvExtra),
+            void *pvExtra);
+
+/*
+  Stores in *pulSize the number of directories in the subtree rooted
+  at the directory with absolute path pcPath, itself included.
+  Returns SUCCESS, or a status as for DT_iterBegin.
+*/
+int DT_subtreeSize(const char *pcPath, size_t *pulSize);
+
+/*
+  Stores in *pulRank the position of the directory with absolute path
+  pcPath in DT_toString order, counting from 0 at the root, in time
+  logarithmic in the fan-out at each level on the way down. Returns
+  SUCCESS, or a status as for DT_iterBegin.
+*/
+int DT_rankOf(const char *pcPath, size_t *pulRank);
+
+/*
+  Returns the absolute path of the directory at position ulRank in
+  DT_toString order, counting from 0 at the root, or NULL if the DT
+  is not initialized, has no more than ulRank directories, or there
+  is an allocation error. Each level on the way down to that
+  directory takes one binary search among its children, however many
+  directories come before it.
+
+  Allocates memory for the returned string,
+  which is then owned by the client!
+*/
+char *DT_select(size_t ulRank);
+
+/*
+  Stores in *pulHits the number of traversals (by insert, contains,
+  rm and the other operations on a single path) that resumed partway
+  down, from an ancestor of the directory the previous one reached,
+  and in *pulMisses the number that started from the root. Working
+  through siblings or a sorted list of paths makes nearly every
+  traversal a hit that only visits the levels where the paths differ.
+  DT_rankOf and DT_select, which count from the root, never use the
+  cursor, nor does anything while a snapshot is live or in
+  DT_CONCURRENT builds, which report zero for both; none of these
+  count as hits or misses.
+*/
+void DT_getCursorStats(size_t *pulHits, size_t *pulMisses);
+
+/*
+  Writes to psFile the latencies of the calls made so far to DT_insert,
+  DT_contains, DT_rm, DT_mv, DT_init, DT_destroy, DT_toString, DT_map,
+  DT_find, DT_subtreeSize, DT_rankOf, DT_select, DT_snapshot, DT_save
+  and DT_load, as a log-linear histogram for each operation and each
+  status it returned, in builds with DT_METRICS defined. DT_contains
+  counts as returning SUCCESS or NO_SUCH_PATH, DT_select SUCCESS or
+  NO_SUCH_PATH and DT_toString SUCCESS or MEMORY_ERROR. A call is
+  timed by reading the processor's cycle counter (or CLOCK_MONOTONIC,
+  where there is none) before and after it. Other builds do not time
+  calls, and write nothing.
+*/
+void DT_dumpMetrics(FILE *psFile);
+
+/* The number of buckets in the fan-out histogram of a DT_Stats */
+enum {DT_FANOUT_BUCKETS = 16};
+
+/* The shape of a DT and the memory it occupies, from DT_getStats */
+struct DT_Stats {
+   /* the number of directories */
+   size_t ulNodes;
+   /* the greatest depth of a directory, the root's being 1, and the
+      sum of their depths, so the average is ulDepthSum / ulNodes */
+   size_t ulMaxDepth;
+   size_t ulDepthSum;
+   /* aulFanout[0] counts the directories with no children, and
+      aulFanout[i] those with from 2^(i-1) to 2^i - 1, the last
+      bucket also counting any with more */
+   size_t aulFanout[DT_FANOUT_BUCKETS];
+   /* the bytes of memory that the paths, the nodes themselves and
+      their arrays of children occupy */
+   size_t ulPathBytes;
+   size_t ulNodeBytes;
+   size_t ulChildBytes;
+   /* the number of slots in those arrays holding no child */
+   size_t ulSlack;
+};
+
+/*
+  Fills in *psStats for the DT, in one walk of the hierarchy that
+  allocates no memory. Directories that only snapshots still hold are
+  not counted. Returns SUCCESS, or INITIALIZATION_ERROR if the DT is
+  not in an initialized state.
+*/
+int DT_getStats(struct DT_Stats *psStats);
+
+/*
+  Writes a binary image of the DT to file descriptor iFd, for DT_load.
+  The image is a 4-byte magic number "DTI1", the number of directories
+  in 8 bytes, then one record per directory in DT_toString order: the
+  length of its last path component in 4 bytes, the component itself,
+  and its number of children in 4 bytes. Numbers are big-endian.
+  Returns SUCCESS, or:
+  * INITIALIZATION_ERROR if the DT is not in an initialized state
+  * IO_ERROR if writing to iFd fails
+  * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+int DT_save(int iFd);
+
+/*
+  Replaces the contents of the DT with the image from DT_save that
+  makes up the whole of the file open on iFd. Regular files are mapped
+  into memory rather than read, and either way the directories are
+  built in a single pass over the image, without parsing a pathname
+  or traversing the DT. The DT is left unchanged unless SUCCESS is
+  returned. Otherwise returns:
+  * INITIALIZATION_ERROR if the DT is not in an initialized state
+  * IO_ERROR if reading from iFd fails
+  * BAD_FORMAT if the file is not a valid image
+  * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+int DT_load(int iFd);
+
+/*
+  Starts journaling every successful DT_insert, DT_rm and DT_mv to file
+  descriptor iFd, for DT_recover. Records are written out in batches
+  rather than one by one, and the file is synced after every
+  ulSyncEvery records, or only by DT_journalSync and DT_journalStop if
+  ulSyncEvery is 0, so that many changes share each sync. A change is
+  durable once a sync has followed it. Nothing else that changes the
+  DT is journaled, so an image from DT_save should follow it.
+  Returns SUCCESS, or:
+  * INITIALIZATION_ERROR if the DT is already being journaled
+  * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+int DT_journalStart(int iFd, size_t ulSyncEvery);
+
+/*
+  Writes out and syncs every record journaled so far.
+  Returns SUCCESS, or:
+  * INITIALIZATION_ERROR if the DT is not being journaled
+  * IO_ERROR if this or any earlier write or sync of the journal
+             failed, after which the journal records nothing more
+*/
+int DT_journalSync(void);
+
+/*
+  Syncs the journal as DT_journalSync does, then stops journaling,
+  leaving iFd open. Returns as DT_journalSync does.
+*/
+int DT_journalStop(void);
+
+/*
+  Stores in *pulRecords the number of records journaled since
+  DT_journalStart, in *pulBatches the number of batches they were
+  written to the journal in and in *pulSyncs the number of syncs
+  they took, or 0 in each if the DT is not being journaled.
+*/
+void DT_getJournalStats(size_t *pulRecords, size_t *pulBatches,
+                        size_t *pulSyncs);
+
+/*
+  Replaces the contents of the DT with the image from DT_save on
+  iImageFd, as DT_load does, then replays on top of it the journal
+  read from iJournalFd, which must have been started right after the
+  image was saved. A record cut off by a crash at the end of the
+  journal is ignored. The replayed changes are not journaled again,
+  and nothing else may change the DT meanwhile.
+  Returns SUCCESS, or:
+  * any status that DT_load returns, leaving the DT unchanged
+  * IO_ERROR if reading from iJournalFd fails
+  * BAD_FORMAT if a record is malformed or cannot be replayed, in
+               which case the DT holds the image and every change
+               journaled before that record
+  * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+int DT_recover(int iImageFd, int iJournalFd);
+
+/*
+  A DT_Snapshot_T is an immutable view of the DT as it was when the
+  snapshot was taken. Taking one is O(1): the snapshot shares nodes
+  with the DT, and DT_insert and DT_rm copy only the nodes on the
+  path from the root to the node they modify; DT_mv also copies the
+  subtree it moves. Snapshots remain valid after the DT changes, and
+  even after DT_destroy.
+*/
+typedef struct DT_Snapshot *DT_Snapshot_T;
+
+/*
+  Takes a snapshot of the DT. Returns SUCCESS and sets *poSResult to
+  the new snapshot if successful. Otherwise, sets *poSResult to NULL
+  and returns:
+  * INITIALIZATION_ERROR if the DT is not in an initialized state
+  * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+int DT_snapshot(DT_Snapshot_T *poSResult);
+
+/*
+  Returns TRUE if oSSnapshot contains a directory with absolute path
+  pcPath and FALSE if not or if there is an error while checking.
+*/
+boolean DT_Snapshot_contains(DT_Snapshot_T oSSnapshot,
+                             const char *pcPath);
+
+/*
+  Returns a string representation of oSSnapshot in the same format
+  as DT_toString, or NULL if there is an allocation error.
+
+  Allocates memory for the returned string,
+  which is then owned by client!
+*/
+char *DT_Snapshot_toString(DT_Snapshot_T oSSnapshot);
+
+/*
+  Begins an iteration over the subtree of oSSnapshot rooted at
+  pcPath, or over all of oSSnapshot if pcPath is NULL, with statuses
+  as for DT_iterBegin. Never blocks or is blocked by the DT's writers.
+  The iterator must be ended before oSSnapshot is freed.
+*/
+int DT_Snapshot_iterBegin(DT_Snapshot_T oSSnapshot, const char *pcPath,
+                          DT_Iter_T *poIResult);
+
+/* Frees oSSnapshot and any nodes only it was still sharing. */
+void DT_Snapshot_free(DT_Snapshot_T oSSnapshot);
+
 #endif
@@ -3,16 +3,32 @@
 /* Author: Christopher Moretti                                        */
 /*--------------------------------------------------------------------*/
 
+/* reader-writer locks and mmap are POSIX.1-2001 interfaces */
+#define _POSIX_C_SOURCE 200112L
+
 #include <stddef.h>
 #include <assert.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#ifdef DT_CONCURRENT
+#include <pthread.h>
+#endif
 
 #include "dynarray.h"
 #include "path.h"
 #include "nodeDT.h"
 #include "checkerDT.h"
+#include "journal.h"
+#include "alloc.h"
+#ifdef DT_METRICS
+#include "latency.h"
+#endif
 #include "dt.h"
 
 
@@ -28,6 +44,201 @@ static Node_T oNRoot;
 /* 3. a counter of the number of nodes in the hierarchy */
 static size_t ulCount;
 
+/* A snapshot is an immutable view of the hierarchy at one point in
+   time, sharing nodes with the hierarchy until writers modify them */
+struct DT_Snapshot {
+   /* the root of the hierarchy when the snapshot was taken */
+   Node_T oNRoot;
+};
+
+/* 4. the number of live snapshots; DT_mv must then rewrite the paths
+      of a moved subtree at once, so that the snapshots keep theirs */
+static size_t ulSnapshots;
+
+#ifdef DT_CONCURRENT
+/* In DT_CONCURRENT builds there are also two locks: */
+/* 5. a tree-wide lock, held shared by DT_insert, DT_contains and
+      DT_rm, and exclusively by the operations on the whole DT */
+static pthread_rwlock_t sTreeLock = PTHREAD_RWLOCK_INITIALIZER;
+/* 6. a lock guarding oNRoot, standing in for the root's parent when
+      coupling node locks down the hierarchy */
+static pthread_mutex_t sRootLock = PTHREAD_MUTEX_INITIALIZER;
+#else
+/* Single-threaded builds instead keep a traversal cursor: */
+/* 5. the node the last traversal reached, or NULL, from whose
+      ancestors the next traversal resumes; it is unused while there
+      are snapshots, as writers must then copy the path down from the
+      root */
+static Node_T oNCursor;
+/* 6. the number of traversals that resumed from the cursor */
+static size_t ulCursorHits;
+/* 7. the number of traversals that could have resumed from the
+      cursor but started from the root */
+static size_t ulCursorMisses;
+#endif
+
+#ifdef DT_MAPPED
+/* DT_MAPPED builds keep every node in a mapped region, and so: */
+/* 8. a flag for the region being open (TRUE) or not (FALSE); it stays
+      open after DT_destroy or DT_close until no snapshot uses it */
+static boolean bRegionOpen;
+#endif
+
+/* Changes to the hierarchy may also be journaled, given: */
+/* 9. the journal that DT_insert, DT_rm and DT_mv append to, or NULL */
+static Journal_T oJJournal;
+#ifdef DT_CONCURRENT
+/* 10. a lock guarding oJJournal, so records go in one at a time */
+static pthread_mutex_t sJournalLock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/* The operation codes of the records in a DT journal */
+enum {DT_LOG_INSERT = 1, DT_LOG_RM = 2, DT_LOG_MV = 3};
+
+#ifdef DT_METRICS
+/* The operations whose calls DT_METRICS builds time */
+enum DT_Op {DT_OP_INSERT, DT_OP_CONTAINS, DT_OP_RM, DT_OP_MV,
+            DT_OP_INIT, DT_OP_DESTROY, DT_OP_TOSTRING, DT_OP_MAP,
+            DT_OP_FIND, DT_OP_SUBTREE_SIZE, DT_OP_RANK_OF, DT_OP_SELECT,
+            DT_OP_SNAPSHOT, DT_OP_SAVE, DT_OP_LOAD, DT_NUM_OPS};
+static const char *apcOpNames[DT_NUM_OPS] =
+   {"DT_insert", "DT_contains", "DT_rm", "DT_mv", "DT_init",
+    "DT_destroy", "DT_toString", "DT_map", "DT_find", "DT_subtreeSize",
+    "DT_rankOf", "DT_select", "DT_snapshot", "DT_save", "DT_load"};
+
+/* DT_METRICS builds also keep: */
+/* 11. for each operation and status, a latency histogram of the
+       calls to the operation that returned the status */
+static size_t aulLatencies[DT_NUM_OPS][LATENCY_STATUSES]
+                          [LATENCY_BUCKETS];
+#endif
+
+
+/* --------------------------------------------------------------------
+
+  The following helpers compile away unless DT_CONCURRENT is defined.
+  Writers in disjoint subtrees then only contend on the locks of their
+  shared ancestors, each held just long enough to find the next child.
+  The checker walks the whole hierarchy without locks, so it is only
+  used in single-threaded builds, as is the traversal cursor: every
+  traversal must couple locks down from the root.
+*/
+#ifdef DT_CONCURRENT
+
+#define DT_readLock() ((void) pthread_rwlock_rdlock(&sTreeLock))
+#define DT_writeLock() ((void) pthread_rwlock_wrlock(&sTreeLock))
+#define DT_treeUnlock() ((void) pthread_rwlock_unlock(&sTreeLock))
+#define DT_addCount(n) \
+   ((void) __atomic_add_fetch(&ulCount, (n), __ATOMIC_RELAXED))
+#define DT_subCount(n) \
+   ((void) __atomic_sub_fetch(&ulCount, (n), __ATOMIC_RELAXED))
+#define DT_isValid() TRUE
+#define DT_setCursor(oNNode) ((void) 0)
+#define DT_snapshotTaken() ((void) ulSnapshots++)
+#define DT_snapshotFreed() ((void) ulSnapshots--)
+#define DT_journalLock() ((void) pthread_mutex_lock(&sJournalLock))
+#define DT_journalUnlock() ((void) pthread_mutex_unlock(&sJournalLock))
+
+/* Locks oNNode, or the root lock if oNNode is NULL. */
+static void DT_lock(Node_T oNNode) {
+   if(oNNode == NULL)
+      (void) pthread_mutex_lock(&sRootLock);
+   else
+      Node_lock(oNNode);
+}
+
+/* Unlocks oNNode, or the root lock if oNNode is NULL. */
+static void DT_unlock(Node_T oNNode) {
+   if(oNNode == NULL)
+      (void) pthread_mutex_unlock(&sRootLock);
+   else
+      Node_unlock(oNNode);
+}
+
+/*
+  Releases the locks left held by DT_traversePath or DT_findNode on
+  oNNode and, if bHoldParent, on its parent.
+*/
+static void DT_release(Node_T oNNode, boolean bHoldParent) {
+   if(oNNode == NULL) {
+      DT_unlock(NULL);
+      return;
+   }
+   if(bHoldParent)
+      DT_unlock(Node_getParent(oNNode));
+   DT_unlock(oNNode);
+}
+
+#else
+
+#define DT_readLock() ((void) 0)
+#define DT_writeLock() ((void) 0)
+#define DT_treeUnlock() ((void) 0)
+#define DT_addCount(n) ((void) (ulCount += (n)))
+#define DT_subCount(n) ((void) (ulCount -= (n)))
+#define DT_isValid() CheckerDT_isValid(bIsInitialized, oNRoot, ulCount)
+#define DT_setCursor(oNNode) \
+   ((void) (oNCursor = (ulSnapshots == 0) ? (oNNode) : NULL))
+#define DT_snapshotTaken() ((void) (oNCursor = NULL, ulSnapshots++))
+#define DT_snapshotFreed() ((void) ulSnapshots--)
+#define DT_lock(oNNode) ((void) 0)
+#define DT_unlock(oNNode) ((void) 0)
+#define DT_release(oNNode, bHoldParent) ((void) 0)
+#define DT_journalLock() ((void) 0)
+#define DT_journalUnlock() ((void) 0)
+
+#endif
+
+/*
+  Appends a record of operation iOp on pcPath to the journal, if there
+  is one, with the string pcOther (without its '\0') as its data unless
+  pcOther is NULL. Callers still hold the node locks that ordered the
+  change, so conflicting changes are journaled in the order they were
+  made.
+*/
+static void DT_log(int iOp, const char *pcPath, const char *pcOther) {
+   DT_journalLock();
+   if(oJJournal != NULL)
+      (void) Journal_append(oJJournal, iOp, pcPath, pcOther,
+                            pcOther == NULL ? 0 : strlen(pcOther));
+   DT_journalUnlock();
+}
+
+/* --------------------------------------------------------------------
+
+  DT_timeCall makes a call to an operation, and in DT_METRICS builds
+  counts its latency in the histogram for operation eOp and status
+  iStatus, which is evaluated once the call has returned. Other builds
+  make the call alone. Calls are counted outside the tree lock, so
+  concurrent builds count them atomically.
+*/
+#ifdef DT_METRICS
+
+#ifdef DT_CONCURRENT
+#define DT_countCall(pulCount) \
+   ((void) __atomic_add_fetch((pulCount), 1, __ATOMIC_RELAXED))
+#define DT_getCalls(pulCount) \
+   __atomic_load_n((pulCount), __ATOMIC_RELAXED)
+#else
+#define DT_countCall(pulCount) ((void) ++*(pulCount))
+#define DT_getCalls(pulCount) (*(pulCount))
+#endif
+
+#define DT_timeCall(eOp, call, iStatus) \
+   do { \
+      unsigned long ulStart = Latency_now(); \
+      (call); \
+      DT_countCall(&aulLatencies[eOp][iStatus] \
+                   [Latency_bucketSince(ulStart)]); \
+   } while(0)
+
+#else
+
+#define DT_timeCall(eOp, call, iStatus) ((void) (call))
+
+#endif
+/*--------------------------------------------------------------------*/
+
 
 
 /* --------------------------------------------------------------------
@@ -39,51 +250,142 @@ static size_t ulCount;
 */
 
 /*
-  Traverses the DT starting at the root as far as possible towards
-  absolute path oPPath. If able to traverse, returns an int SUCCESS
-  status and sets *poNFurthest to the furthest node reached (which may
-  be only a prefix of oPPath, or even NULL if the root is NULL).
-  Otherwise, sets *poNFurthest to NULL and returns with status:
+  Starts a traversal towards absolute path oPPath at the root. Returns
+  an int SUCCESS status and sets *poNRoot to the root, which may be
+  NULL. Otherwise, sets *poNRoot to NULL and returns with status:
   * CONFLICTING_PATH if the root's path is not a prefix of oPPath
   * MEMORY_ERROR if memory could not be allocated to complete request
+
+  bForWrite and the locks left held on SUCCESS are as for
+  DT_traversePath.
 */
-static int DT_traversePath(Path_T oPPath, Node_T *poNFurthest) {
-   int iStatus;
+static int DT_enterRoot(Path_T oPPath, boolean bHoldParent,
+                        boolean bForWrite, Node_T *poNRoot) {
    Path_T oPPrefix = NULL;
-   Node_T oNCurr;
-   Node_T oNChild = NULL;
-   size_t ulDepth;
-   size_t i;
-   size_t ulChildID;
+   int iStatus;
 
    assert(oPPath != NULL);
-   assert(poNFurthest != NULL);
+   assert(poNRoot != NULL);
+
+   DT_lock(NULL);
 
    /* root is NULL -> won't find anything */
    if(oNRoot == NULL) {
-      *poNFurthest = NULL;
+      *poNRoot = NULL;
       return SUCCESS;
    }
 
    iStatus = Path_prefix(oPPath, 1, &oPPrefix);
    if(iStatus != SUCCESS) {
-      *poNFurthest = NULL;
+      DT_unlock(NULL);
+      *poNRoot = NULL;
       return iStatus;
    }
 
    if(Path_comparePath(Node_getPath(oNRoot), oPPrefix)) {
+      DT_unlock(NULL);
       Path_free(oPPrefix);
-      *poNFurthest = NULL;
+      *poNRoot = NULL;
       return CONFLICTING_PATH;
    }
    Path_free(oPPrefix);
    oPPrefix = NULL;
 
-   oNCurr = oNRoot;
+   if(bForWrite) {
+      iStatus = Node_unshare(NULL, oNRoot, &oNRoot);
+      if(iStatus != SUCCESS) {
+         DT_unlock(NULL);
+         *poNRoot = NULL;
+         return iStatus;
+      }
+   }
+
+   *poNRoot = oNRoot;
+   DT_lock(*poNRoot);
+   if(!bHoldParent)
+      DT_unlock(NULL);
+   return SUCCESS;
+}
+
+/*
+  Traverses the DT from the root (or the cursor, see below) as far as
+  possible towards absolute path oPPath. If able to traverse, returns an int SUCCESS
+  status and sets *poNFurthest to the furthest node reached (which may
+  be only a prefix of oPPath, or even NULL if the root is NULL).
+  Otherwise, sets *poNFurthest to NULL and returns with status:
+  * CONFLICTING_PATH if the root's path is not a prefix of oPPath
+  * MEMORY_ERROR if memory could not be allocated to complete request
+
+  If bForWrite, every node on the way down is first unshared from
+  any snapshot, so that the caller may modify *poNFurthest and its
+  ancestors in place.
+
+  If pulRank is not NULL, the traversal starts at the root and adds to
+  *pulRank the number of directories before *poNFurthest in
+  DT_toString order, from the counts each parent keeps of the nodes
+  in its children's subtrees.
+
+  In single-threaded builds, the traversal otherwise resumes from the
+  deepest ancestor of the cursor that is also an ancestor of oPPath,
+  when that is below the root, and leaves the cursor at *poNFurthest.
+  Only traversals that consult the cursor, which are neither for a
+  rank nor made while a snapshot is live, count as hits or misses.
+
+  In DT_CONCURRENT builds, a SUCCESS return leaves *poNFurthest locked
+  (the root lock if it is NULL) and, if bHoldParent, its parent too
+  (the root lock if it is the root); DT_release drops them. No locks
+  are left held on any other status.
+*/
+static int DT_traversePath(Path_T oPPath, boolean bHoldParent,
+                           boolean bForWrite, Node_T *poNFurthest,
+                           size_t *pulRank) {
+   int iStatus;
+   Path_T oPPrefix = NULL;
+   Node_T oNCurr;
+   Node_T oNChild = NULL;
+   size_t ulDepth;
+   size_t i;
+   size_t ulChildID;
+
+   assert(oPPath != NULL);
+   assert(poNFurthest != NULL);
+
+   oNCurr = NULL;
+   i = 2;
+#ifndef DT_CONCURRENT
+   /* siblings are often visited in a row, so climb from the cursor
+      only as far as the path it shares with oPPath */
+   if(pulRank == NULL && ulSnapshots == 0) {
+      if(oNCursor != NULL && Node_getPath(oNCursor) != NULL) {
+         size_t ulShared = Path_getSharedPrefixDepth(
+                              Node_getPath(oNCursor), oPPath);
+         if(ulShared > 1) {
+            oNCurr = oNCursor;
+            for(i = Path_getDepth(Node_getPath(oNCurr));
+                i > ulShared; i--)
+               oNCurr = Node_getParent(oNCurr);
+            i = ulShared + 1;
+         }
+      }
+      if(oNCurr != NULL)
+         ulCursorHits++;
+      else
+         ulCursorMisses++;
+   }
+#endif
+   if(oNCurr == NULL) {
+      iStatus = DT_enterRoot(oPPath, bHoldParent, bForWrite, &oNCurr);
+      if(iStatus != SUCCESS || oNCurr == NULL) {
+         *poNFurthest = NULL;
+         return iStatus;
+      }
+   }
+
    ulDepth = Path_getDepth(oPPath);
-   for(i = 2; i <= ulDepth; i++) {
+   for(; i <= ulDepth; i++) {
       iStatus = Path_prefix(oPPath, i, &oPPrefix);
       if(iStatus != SUCCESS) {
+         DT_release(oNCurr, bHoldParent);
          *poNFurthest = NULL;
          return iStatus;
       }
@@ -91,11 +393,26 @@ static int DT_traversePath(Path_T oPPath, Node_T *poNFurthest) {
          /* go to that child and continue with next prefix */
          Path_free(oPPrefix);
          oPPrefix = NULL;
+         if(pulRank != NULL)
+            *pulRank += 1 + Node_countBefore(oNCurr, ulChildID);
          iStatus = Node_getChild(oNCurr, ulChildID, &oNChild);
+         if(iStatus == SUCCESS && bForWrite)
+            iStatus = Node_unshare(oNCurr, oNChild, &oNChild);
+         /* a path left stale by DT_mv is rewritten under the parent's
+            lock, so no two threads rewrite the same one */
+         if(iStatus == SUCCESS && Node_getPath(oNChild) == NULL)
+            iStatus = MEMORY_ERROR;
          if(iStatus != SUCCESS) {
+            DT_release(oNCurr, bHoldParent);
             *poNFurthest = NULL;
             return iStatus;
          }
+         /* hand-over-hand: take the child before letting go above */
+         DT_lock(oNChild);
+         if(bHoldParent)
+            DT_unlock(Node_getParent(oNCurr));
+         else
+            DT_unlock(oNCurr);
          oNCurr = oNChild;
       }
       else {
@@ -106,6 +423,7 @@ static int DT_traversePath(Path_T oPPath, Node_T *poNFurthest) {
    }
 
    Path_free(oPPrefix);
+   DT_setCursor(oNCurr);
    *poNFurthest = oNCurr;
    return SUCCESS;
 }
@@ -119,8 +437,12 @@ static int DT_traversePath(Path_T oPPath, Node_T *poNFurthest) {
   * CONFLICTING_PATH if the root's path is not a prefix of pcPath
   * NO_SUCH_PATH if no node with pcPath exists in the hierarchy
   * MEMORY_ERROR if memory could not be allocated to complete request
+
+  bForWrite and the locks left held on SUCCESS are as for
+  DT_traversePath.
  */
-static int DT_findNode(const char *pcPath, Node_T *poNResult) {
+static int DT_findNode(const char *pcPath, boolean bHoldParent,
+                       boolean bForWrite, Node_T *poNResult) {
    Path_T oPPath = NULL;
    Node_T oNFound = NULL;
    int iStatus;
@@ -139,7 +461,8 @@ static int DT_findNode(const char *pcPath, Node_T *poNResult) {
       return iStatus;
    }
 
-   iStatus = DT_traversePath(oPPath, &oNFound);
+   iStatus = DT_traversePath(oPPath, bHoldParent, bForWrite,
+                             &oNFound, NULL);
    if(iStatus != SUCCESS)
    {
       Path_free(oPPath);
@@ -148,12 +471,14 @@ static int DT_findNode(const char *pcPath, Node_T *poNResult) {
    }
 
    if(oNFound == NULL) {
+      DT_release(oNFound, bHoldParent);
       Path_free(oPPath);
       *poNResult = NULL;
       return NO_SUCH_PATH;
    }
 
    if(Path_comparePath(Node_getPath(oNFound), oPPath) != 0) {
+      DT_release(oNFound, bHoldParent);
       Path_free(oPPath);
       *poNResult = NULL;
       return NO_SUCH_PATH;
@@ -166,37 +491,49 @@ static int DT_findNode(const char *pcPath, Node_T *poNResult) {
 /*--------------------------------------------------------------------*/
 
 
-int DT_insert(const char *pcPath) {
+/* Does the work of DT_insert, which DT_METRICS builds time */
+static int DT_insertUntimed(const char *pcPath) {
    int iStatus;
    Path_T oPPath = NULL;
+   Node_T oNFurthest = NULL;
    Node_T oNFirstNew = NULL;
    Node_T oNCurr = NULL;
    size_t ulDepth, ulIndex;
    size_t ulNewNodes = 0;
 
    assert(pcPath != NULL);
-   assert(CheckerDT_isValid(bIsInitialized, oNRoot, ulCount));
+   assert(DT_isValid());
+
+   DT_readLock();
 
    /* validate pcPath and generate a Path_T for it */
-   if(!bIsInitialized)
+   if(!bIsInitialized) {
+      DT_treeUnlock();
       return INITIALIZATION_ERROR;
+   }
 
    iStatus = Path_new(pcPath, &oPPath);
-   if(iStatus != SUCCESS)
+   if(iStatus != SUCCESS) {
+      DT_treeUnlock();
       return iStatus;
+   }
 
    /* find the closest ancestor of oPPath already in the tree */
-   iStatus= DT_traversePath(oPPath, &oNCurr);
+   iStatus= DT_traversePath(oPPath, FALSE, TRUE, &oNFurthest, NULL);
    if(iStatus != SUCCESS)
    {
       Path_free(oPPath);
+      DT_treeUnlock();
       return iStatus;
    }
+   oNCurr = oNFurthest;
 
    /* no ancestor node found, so if root is not NULL,
       pcPath isn't underneath root. */
    if(oNCurr == NULL && oNRoot != NULL) {
+      DT_release(oNFurthest, FALSE);
       Path_free(oPPath);
+      DT_treeUnlock();
       return CONFLICTING_PATH;
    }
 
@@ -209,12 +546,16 @@ int DT_insert(const char *pcPath) {
       /* oNCurr is the node we're trying to insert */
       if(ulIndex == ulDepth+1 && !Path_comparePath(oPPath,
                                        Node_getPath(oNCurr))) {
+         DT_release(oNFurthest, FALSE);
          Path_free(oPPath);
+         DT_treeUnlock();
          return ALREADY_IN_TREE;
       }
    }
 
-   /* starting at oNCurr, build rest of the path one level at a time */
+   /* starting at oNCurr, build rest of the path one level at a time;
+      the new nodes are only reachable through oNFurthest, whose lock
+      is held until they are all in place */
    while(ulIndex <= ulDepth) {
       Path_T oPPrefix = NULL;
       Node_T oNNewNode = NULL;
@@ -223,9 +564,13 @@ int DT_insert(const char *pcPath) {
       iStatus = Path_prefix(oPPath, ulIndex, &oPPrefix);
       if(iStatus != SUCCESS) {
          Path_free(oPPath);
-         if(oNFirstNew != NULL)
+         if(oNFirstNew != NULL) {
+            DT_lock(oNFirstNew);
             (void) Node_free(oNFirstNew);
-         assert(CheckerDT_isValid(bIsInitialized, oNRoot, ulCount));
+         }
+         DT_release(oNFurthest, FALSE);
+         DT_treeUnlock();
+         assert(DT_isValid());
          return iStatus;
       }
 
@@ -234,9 +579,13 @@ int DT_insert(const char *pcPath) {
       if(iStatus != SUCCESS) {
          Path_free(oPPath);
          Path_free(oPPrefix);
-         if(oNFirstNew != NULL)
+         if(oNFirstNew != NULL) {
+            DT_lock(oNFirstNew);
             (void) Node_free(oNFirstNew);
-         assert(CheckerDT_isValid(bIsInitialized, oNRoot, ulCount));
+         }
+         DT_release(oNFurthest, FALSE);
+         DT_treeUnlock();
+         assert(DT_isValid());
          return iStatus;
       }
 
@@ -250,160 +599,1784 @@ int DT_insert(const char *pcPath) {
    }
 
    Path_free(oPPath);
-   /* update DT state variables to reflect insertion */
-   if(oNRoot == NULL)
+
+   /* each new node's subtree holds the new nodes below it, and each
+      existing ancestor's grows by all of them; the ancestors cannot
+      be freed meanwhile, as freeing them would need oNFurthest */
+   for(oNCurr = Node_getParent(oNCurr), ulIndex = 1;
+       oNCurr != oNFurthest;
+       oNCurr = Node_getParent(oNCurr), ulIndex++)
+      Node_growSubtree(oNCurr, ulIndex);
+   for(; oNCurr != NULL; oNCurr = Node_getParent(oNCurr))
+      Node_growSubtree(oNCurr, ulNewNodes);
+
+   /* update DT state variables to reflect insertion; a new root
+      was only built if the root lock is the one held */
+   if(oNFurthest == NULL)
       oNRoot = oNFirstNew;
-   ulCount += ulNewNodes;
+   DT_addCount(ulNewNodes);
+   DT_log(DT_LOG_INSERT, pcPath, NULL);
+
+   DT_release(oNFurthest, FALSE);
+   DT_treeUnlock();
 
-   assert(CheckerDT_isValid(bIsInitialized, oNRoot, ulCount));
+   assert(DT_isValid());
    return SUCCESS;
 }
 
-boolean DT_contains(const char *pcPath) {
+int DT_insert(const char *pcPath) {
+   int iStatus;
+
+   DT_timeCall(DT_OP_INSERT,
+               iStatus = DT_insertUntimed(pcPath),
+               iStatus);
+   return iStatus;
+}
+
+/* Does the work of DT_contains, which DT_METRICS builds time */
+static boolean DT_containsUntimed(const char *pcPath) {
    int iStatus;
    Node_T oNFound = NULL;
 
    assert(pcPath != NULL);
 
-   iStatus = DT_findNode(pcPath, &oNFound);
+   DT_readLock();
+   iStatus = DT_findNode(pcPath, FALSE, FALSE, &oNFound);
+   if(iStatus == SUCCESS)
+      DT_release(oNFound, FALSE);
+   DT_treeUnlock();
+
    return (boolean) (iStatus == SUCCESS);
 }
 
+boolean DT_contains(const char *pcPath) {
+   boolean bFound;
+
+   DT_timeCall(DT_OP_CONTAINS,
+               bFound = DT_containsUntimed(pcPath),
+               bFound ? SUCCESS : NO_SUCH_PATH);
+   return bFound;
+}
+
 
-int DT_rm(const char *pcPath) {
+/* Does the work of DT_rm, which DT_METRICS builds time */
+static int DT_rmUntimed(const char *pcPath) {
    int iStatus;
    Node_T oNFound = NULL;
+   Node_T oNParent;
+   Node_T oNAncestor;
+   size_t ulFreed;
 
    assert(pcPath != NULL);
-   assert(CheckerDT_isValid(bIsInitialized, oNRoot, ulCount));
+   assert(DT_isValid());
 
-   iStatus = DT_findNode(pcPath, &oNFound);
+   DT_readLock();
+   iStatus = DT_findNode(pcPath, TRUE, TRUE, &oNFound);
 
-   if(iStatus != SUCCESS)
-       return iStatus;
+   if(iStatus != SUCCESS) {
+      DT_treeUnlock();
+      return iStatus;
+   }
 
-   ulCount -= Node_free(oNFound);
-   if(ulCount == 0)
+   /* Node_free releases oNFound's lock, but not its parent's */
+   oNParent = Node_getParent(oNFound);
+   ulFreed = Node_free(oNFound);
+   DT_subCount(ulFreed);
+   for(oNAncestor = oNParent; oNAncestor != NULL;
+       oNAncestor = Node_getParent(oNAncestor))
+      Node_shrinkSubtree(oNAncestor, ulFreed);
+   /* the cursor was left at oNFound, so move it out of harm's way */
+   DT_setCursor(oNParent);
+   if(oNParent == NULL)
       oNRoot = NULL;
+   DT_log(DT_LOG_RM, pcPath, NULL);
+   DT_unlock(oNParent);
+   DT_treeUnlock();
 
-   assert(CheckerDT_isValid(bIsInitialized, oNRoot, ulCount));
+   assert(DT_isValid());
    return SUCCESS;
 }
 
-int DT_init(void) {
-   assert(CheckerDT_isValid(bIsInitialized, oNRoot, ulCount));
+int DT_rm(const char *pcPath) {
+   int iStatus;
+
+   DT_timeCall(DT_OP_RM, iStatus = DT_rmUntimed(pcPath), iStatus);
+   return iStatus;
+}
+
+/* Does the work of DT_mv, which DT_METRICS builds time */
+static int DT_mvUntimed(const char *pcOldPath, const char *pcNewPath) {
+   int iStatus;
+   Path_T oPNewPath = NULL;
+   Path_T oPOldPath;
+   Node_T oNFound = NULL;
+   Node_T oNParent = NULL;
+   Node_T oNOldParent;
+   Node_T oNAncestor;
+   size_t ulDepth;
+   size_t ulMoved;
+
+   assert(pcOldPath != NULL);
+   assert(pcNewPath != NULL);
+   assert(DT_isValid());
+
+   /* the locks of both parents are needed at once, which coupling
+      down the hierarchy cannot give, so take the whole DT */
+   DT_writeLock();
+   iStatus = DT_findNode(pcOldPath, FALSE, TRUE, &oNFound);
+   if(iStatus != SUCCESS) {
+      DT_treeUnlock();
+      return iStatus;
+   }
+   DT_release(oNFound, FALSE);
+
+   iStatus = Path_new(pcNewPath, &oPNewPath);
+   if(iStatus != SUCCESS) {
+      DT_treeUnlock();
+      return iStatus;
+   }
+
+   /* the new path must not be oNFound's own or one beneath it, which
+      also keeps the root in place; the new parent must exist, and
+      must not have the new path yet */
+   oPOldPath = Node_getPath(oNFound);
+   ulDepth = Path_getDepth(oPOldPath);
+   if(Path_getSharedPrefixDepth(oPOldPath, oPNewPath) == ulDepth)
+      iStatus = Path_getDepth(oPNewPath) == ulDepth ?
+                ALREADY_IN_TREE : CONFLICTING_PATH;
+   else
+      iStatus = DT_traversePath(oPNewPath, FALSE, TRUE, &oNParent,
+                                NULL);
+   if(iStatus == SUCCESS) {
+      DT_release(oNParent, FALSE);
+      ulDepth = Path_getDepth(Node_getPath(oNParent));
+      if(ulDepth == Path_getDepth(oPNewPath))
+         iStatus = ALREADY_IN_TREE;
+      else if(ulDepth + 1 != Path_getDepth(oPNewPath))
+         iStatus = NO_SUCH_PATH;
+   }
+   if(iStatus != SUCCESS) {
+      Path_free(oPNewPath);
+      DT_treeUnlock();
+      return iStatus;
+   }
+
+   ulMoved = Node_getSubtreeSize(oNFound);
+   oNOldParent = Node_getParent(oNFound);
+   iStatus = Node_move(oNFound, oNParent, oPNewPath,
+                       (boolean) (ulSnapshots != 0));
+   Path_free(oPNewPath);
+   if(iStatus != SUCCESS) {
+      DT_treeUnlock();
+      assert(DT_isValid());
+      return iStatus;
+   }
+
+   /* the subtree leaves the old ancestors and joins the new ones */
+   for(oNAncestor = oNOldParent; oNAncestor != NULL;
+       oNAncestor = Node_getParent(oNAncestor))
+      Node_shrinkSubtree(oNAncestor, ulMoved);
+   for(oNAncestor = oNParent; oNAncestor != NULL;
+       oNAncestor = Node_getParent(oNAncestor))
+      Node_growSubtree(oNAncestor, ulMoved);
+   DT_setCursor(oNParent);
+   DT_log(DT_LOG_MV, pcOldPath, pcNewPath);
+   DT_treeUnlock();
+
+   assert(DT_isValid());
+   return SUCCESS;
+}
+
+int DT_mv(const char *pcOldPath, const char *pcNewPath) {
+   int iStatus;
+
+   DT_timeCall(DT_OP_MV,
+               iStatus = DT_mvUntimed(pcOldPath, pcNewPath),
+               iStatus);
+   return iStatus;
+}
+
+#ifdef DT_MAPPED
+/*
+  Closes the region of nodes if it is open but neither the DT nor any
+  snapshot uses it any more.
+*/
+static void DT_closeRegion(void) {
+   if(bRegionOpen && !bIsInitialized && ulSnapshots == 0) {
+      Node_closeRegion();
+      bRegionOpen = FALSE;
+   }
+}
+#endif
+
+/* Does the work of DT_init, which DT_METRICS builds time */
+static int DT_initUntimed(void) {
+#ifdef DT_MAPPED
+   int iStatus;
+#endif
+
+   assert(DT_isValid());
 
-   if(bIsInitialized)
+   DT_writeLock();
+   if(bIsInitialized) {
+      DT_treeUnlock();
       return INITIALIZATION_ERROR;
+   }
 
-   bIsInitialized = TRUE;
+#ifdef DT_MAPPED
+   /* the nodes of a DT without a file live in an anonymous region,
+      but only one region can be open at a time */
+   if(bRegionOpen) {
+      DT_treeUnlock();
+      return INITIALIZATION_ERROR;
+   }
+   iStatus = Node_openRegion(NULL, &oNRoot, &ulCount);
+   if(iStatus != SUCCESS) {
+      DT_treeUnlock();
+      return iStatus;
+   }
+   bRegionOpen = TRUE;
+#else
    oNRoot = NULL;
    ulCount = 0;
+#endif
+   bIsInitialized = TRUE;
+   DT_treeUnlock();
 
-   assert(CheckerDT_isValid(bIsInitialized, oNRoot, ulCount));
+   assert(DT_isValid());
    return SUCCESS;
 }
 
-int DT_destroy(void) {
-   assert(CheckerDT_isValid(bIsInitialized, oNRoot, ulCount));
+int DT_init(void) {
+   int iStatus;
 
-   if(!bIsInitialized)
+   DT_timeCall(DT_OP_INIT, iStatus = DT_initUntimed(), iStatus);
+   return iStatus;
+}
+
+/* Does the work of DT_destroy, which DT_METRICS builds time */
+static int DT_destroyUntimed(void) {
+   assert(DT_isValid());
+
+   DT_writeLock();
+   if(!bIsInitialized) {
+      DT_treeUnlock();
       return INITIALIZATION_ERROR;
+   }
 
    if(oNRoot) {
+      DT_lock(oNRoot);
       ulCount -= Node_free(oNRoot);
       oNRoot = NULL;
    }
+   DT_setCursor(NULL);
 
    bIsInitialized = FALSE;
+#ifdef DT_MAPPED
+   /* leave the file holding an empty DT rather than freed nodes */
+   (void) Node_syncRegion(NULL, 0);
+   DT_closeRegion();
+#endif
+   DT_treeUnlock();
+
+   assert(DT_isValid());
+   return SUCCESS;
+}
+
+int DT_destroy(void) {
+   int iStatus;
+
+   DT_timeCall(DT_OP_DESTROY, iStatus = DT_destroyUntimed(), iStatus);
+   return iStatus;
+}
+
+#ifdef DT_MAPPED
+int DT_open(const char *pcFile) {
+   Node_T oNOpened = NULL;
+   size_t ulOpened = 0;
+   int iStatus;
+
+   assert(pcFile != NULL);
+   assert(DT_isValid());
+
+   if(bIsInitialized || bRegionOpen)
+      return INITIALIZATION_ERROR;
+
+   iStatus = Node_openRegion(pcFile, &oNOpened, &ulOpened);
+   if(iStatus != SUCCESS)
+      return iStatus;
+   bRegionOpen = TRUE;
+   bIsInitialized = TRUE;
+   oNRoot = oNOpened;
+   ulCount = ulOpened;
+   DT_setCursor(NULL);
 
-   assert(CheckerDT_isValid(bIsInitialized, oNRoot, ulCount));
+   assert(DT_isValid());
    return SUCCESS;
 }
 
+int DT_checkpoint(void) {
+   assert(DT_isValid());
+
+   if(!bIsInitialized)
+      return INITIALIZATION_ERROR;
+
+   return Node_syncRegion(oNRoot, ulCount);
+}
+
+int DT_close(void) {
+   int iStatus;
+
+   assert(DT_isValid());
+
+   if(!bIsInitialized)
+      return INITIALIZATION_ERROR;
+
+   iStatus = Node_syncRegion(oNRoot, ulCount);
+   bIsInitialized = FALSE;
+   oNRoot = NULL;
+   ulCount = 0;
+   DT_setCursor(NULL);
+   /* snapshots point into the region, which they keep open */
+   DT_closeRegion();
+
+   assert(DT_isValid());
+   return iStatus;
+}
+#endif
+
 
 /* --------------------------------------------------------------------
 
-  The following auxiliary functions are used for generating the
-  string representation of the DT.
+  The following auxiliary functions walk a hierarchy in pre-order,
+  depth-first with children in lexicographic order, both for the
+  iterators and for generating the string representation of the DT.
+  The walk keeps an explicit stack of the nodes still to be visited,
+  which never holds more than the children of the nodes on the path
+  down to the current one.
 */
 
+/* An iteration over a subtree of the DT or of a snapshot */
+struct DT_Iter {
+   /* the nodes still to be visited, with the next one on top */
+   DynArray_T oDStack;
+   /* TRUE if the iteration holds the tree lock until DT_iterEnd */
+   boolean bHoldsLock;
+};
+
 /*
-  Performs a pre-order traversal of the tree rooted at n,
-  inserting each payload to DynArray_T d beginning at index i.
-  Returns the next unused index in d after the insertion(s).
+  Sets up psIter to walk the subtree rooted at oNStart, which may be
+  NULL for an empty walk. Returns SUCCESS, or MEMORY_ERROR if the
+  stack could not be allocated.
 */
-static size_t DT_preOrderTraversal(Node_T n, DynArray_T d, size_t i) {
-   size_t c;
+static int DT_iterSetUp(struct DT_Iter *psIter, Node_T oNStart) {
+   assert(psIter != NULL);
 
-   assert(d != NULL);
-
-   if(n != NULL) {
-      (void) DynArray_set(d, i, n);
-      i++;
-      for(c = 0; c < Node_getNumChildren(n); c++) {
-         int iStatus;
-         Node_T oNChild = NULL;
-         iStatus = Node_getChild(n,c, &oNChild);
-         assert(iStatus == SUCCESS);
-         i = DT_preOrderTraversal(oNChild, d, i);
-      }
+   psIter->oDStack = DynArray_new(0);
+   if(psIter->oDStack == NULL)
+      return MEMORY_ERROR;
+   psIter->bHoldsLock = FALSE;
+
+   if(oNStart != NULL && !DynArray_add(psIter->oDStack, oNStart)) {
+      DynArray_free(psIter->oDStack);
+      return MEMORY_ERROR;
    }
-   return i;
+   return SUCCESS;
 }
 
 /*
-  Alternate version of strlen that uses pulAcc as an in-out parameter
-  to accumulate a string length, rather than returning the length of
-  oNNode's path, and also always adds one addition byte to the sum.
+  Returns the next node of psIter's walk, or NULL if the walk is over
+  or if its stack could not grow (which then also ends the walk).
 */
-static void DT_strlenAccumulate(Node_T oNNode, size_t *pulAcc) {
-   assert(pulAcc != NULL);
-
-   if(oNNode != NULL)
-      *pulAcc += (Path_getStrLength(Node_getPath(oNNode)) + 1);
-}
+static Node_T DT_iterNextNode(struct DT_Iter *psIter) {
+   Node_T oNNext;
+   size_t ulLength;
+   size_t c;
 
-/*
-  Alternate version of strcat that inverts the typical argument
-  order, appending oNNode's path onto pcAcc, and also always adds one
-  newline at the end of the concatenated string.
-*/
-static void DT_strcatAccumulate(Node_T oNNode, char *pcAcc) {
-   assert(pcAcc != NULL);
+   assert(psIter != NULL);
 
-   if(oNNode != NULL) {
-      strcat(pcAcc, Path_getPathname(Node_getPath(oNNode)));
-      strcat(pcAcc, "\n");
+   ulLength = DynArray_getLength(psIter->oDStack);
+   if(ulLength == 0)
+      return NULL;
+   oNNext = DynArray_removeAt(psIter->oDStack, ulLength - 1);
+
+   /* push the children last to first, so the first is visited next */
+   for(c = Node_getNumChildren(oNNext); c > 0; c--) {
+      Node_T oNChild = NULL;
+      if(Node_getChild(oNNext, c - 1, &oNChild) != SUCCESS)
+         assert(FALSE);
+      if(!DynArray_add(psIter->oDStack, oNChild)) {
+         while(DynArray_getLength(psIter->oDStack) != 0)
+            (void) DynArray_removeAt(psIter->oDStack,
+                     DynArray_getLength(psIter->oDStack) - 1);
+         return NULL;
+      }
    }
+   return oNNext;
 }
-/*--------------------------------------------------------------------*/
 
-char *DT_toString(void) {
-   DynArray_T nodes;
+/*
+  Returns the string representation of the hierarchy rooted at
+  oNTreeRoot, as described for DT_toString, or NULL if there is an
+  allocation error. The nodes are walked twice, first to size the
+  string and then to fill it, rather than being collected up front.
+*/
+static char *DT_treeToString(Node_T oNTreeRoot) {
+   struct DT_Iter sIter;
+   Node_T oNNode;
    size_t totalStrlen = 1;
+   size_t ulOffset = 0;
    char *result = NULL;
 
-   if(!bIsInitialized)
+   if(DT_iterSetUp(&sIter, oNTreeRoot) != SUCCESS)
       return NULL;
+   while((oNNode = DT_iterNextNode(&sIter)) != NULL)
+      totalStrlen += Path_getStrLength(Node_getPath(oNNode)) + 1;
+   DynArray_free(sIter.oDStack);
 
-   nodes = DynArray_new(ulCount);
-   (void) DT_preOrderTraversal(oNRoot, nodes, 0);
+   result = malloc(totalStrlen);
+   if(result == NULL)
+      return NULL;
+   Alloc_noteAlloc(ALLOC_TREE_STRING, totalStrlen);
 
-   DynArray_map(nodes, (void (*)(void *, void*)) DT_strlenAccumulate,
-                (void*) &totalStrlen);
+   if(DT_iterSetUp(&sIter, oNTreeRoot) != SUCCESS) {
+      free(result);
+      Alloc_noteFree(ALLOC_TREE_STRING, totalStrlen);
+      return NULL;
+   }
+   while((oNNode = DT_iterNextNode(&sIter)) != NULL) {
+      size_t ulLength = Path_getStrLength(Node_getPath(oNNode));
+      memcpy(result + ulOffset, Path_getPathname(Node_getPath(oNNode)),
+             ulLength);
+      ulOffset += ulLength;
+      result[ulOffset++] = '\n';
+   }
+   DynArray_free(sIter.oDStack);
 
-   result = malloc(totalStrlen);
-   if(result == NULL) {
-      DynArray_free(nodes);
+   /* a walk cut short by a failed push leaves the string short */
+   if(ulOffset + 1 != totalStrlen) {
+      free(result);
+      Alloc_noteFree(ALLOC_TREE_STRING, totalStrlen);
       return NULL;
    }
-   *result = '\0';
+   result[ulOffset] = '\0';
+   /* the string is the client's to free from here */
+   Alloc_noteFree(ALLOC_TREE_STRING, totalStrlen);
+   return result;
+}
+
+/*
+  Finds the node with absolute path pcPath in oSSnapshot. Returns an
+  int SUCCESS status and sets *poNResult to be the node, if found.
+  Otherwise, sets *poNResult to NULL and returns with status:
+  * BAD_PATH if pcPath does not represent a well-formatted path
+  * CONFLICTING_PATH if the root's path is not a prefix of pcPath
+  * NO_SUCH_PATH if no node with pcPath exists in the snapshot
+  * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+static int DT_Snapshot_findNode(DT_Snapshot_T oSSnapshot,
+                                const char *pcPath,
+                                Node_T *poNResult) {
+   Path_T oPPath = NULL;
+   Node_T oNCurr;
+   Node_T oNChild = NULL;
+   size_t ulChildID;
+   size_t ulDepth;
+   size_t i;
+   int iStatus;
+
+   assert(oSSnapshot != NULL);
+   assert(pcPath != NULL);
+   assert(poNResult != NULL);
+
+   *poNResult = NULL;
+   iStatus = Path_new(pcPath, &oPPath);
+   if(iStatus != SUCCESS)
+      return iStatus;
+
+   if(oSSnapshot->oNRoot == NULL) {
+      Path_free(oPPath);
+      return NO_SUCH_PATH;
+   }
 
-   DynArray_map(nodes, (void (*)(void *, void*)) DT_strcatAccumulate,
-                (void *) result);
+   /* nothing in a snapshot is ever modified, so no locks are needed */
+   oNCurr = oSSnapshot->oNRoot;
+   if(strcmp(Path_getComponent(oPPath, 0),
+             Path_getPathname(Node_getPath(oNCurr)))) {
+      Path_free(oPPath);
+      return CONFLICTING_PATH;
+   }
 
-   DynArray_free(nodes);
+   ulDepth = Path_getDepth(oPPath);
+   for(i = 2; i <= ulDepth; i++) {
+      Path_T oPPrefix = NULL;
+      boolean bFound;
 
-   return result;
-}
\ No newline at end of file
+      iStatus = Path_prefix(oPPath, i, &oPPrefix);
+      if(iStatus != SUCCESS) {
+         Path_free(oPPath);
+         return iStatus;
+      }
+      bFound = Node_hasChild(oNCurr, oPPrefix, &ulChildID);
+      Path_free(oPPrefix);
+      if(!bFound)
+         break;
+      (void) Node_getChild(oNCurr, ulChildID, &oNChild);
+      oNCurr = oNChild;
+   }
+
+   if(Path_comparePath(Node_getPath(oNCurr), oPPath)) {
+      Path_free(oPPath);
+      return NO_SUCH_PATH;
+   }
+
+   Path_free(oPPath);
+   *poNResult = oNCurr;
+   return SUCCESS;
+}
+
+/*
+  Returns the index of the first child of oNParent whose last path
+  component starts with the ulLength characters at pcPrefix, or the
+  index such a child would have. Children are sorted by path, so the
+  children sharing a prefix are consecutive from there. Returns
+  (size_t) -1 if memory could not be allocated to search.
+*/
+static size_t DT_findPrefixStart(Node_T oNParent, const char *pcPrefix,
+                                 size_t ulLength) {
+   Path_T oPParent;
+   Path_T oPKey = NULL;
+   char *pcKey;
+   size_t ulIndex = 0;
+   size_t ulParentLength;
+   int iStatus;
+
+   assert(oNParent != NULL);
+   assert(pcPrefix != NULL);
+
+   if(ulLength == 0)
+      return 0;
+
+   oPParent = Node_getPath(oNParent);
+   ulParentLength = Path_getStrLength(oPParent);
+   pcKey = Alloc_malloc(ALLOC_TREE_KEY,
+                        ulParentLength + 1 + ulLength + 1);
+   if(pcKey == NULL)
+      return (size_t) -1;
+   memcpy(pcKey, Path_getPathname(oPParent), ulParentLength);
+   pcKey[ulParentLength] = '/';
+   memcpy(pcKey + ulParentLength + 1, pcPrefix, ulLength);
+   pcKey[ulParentLength + 1 + ulLength] = '\0';
+
+   iStatus = Path_new(pcKey, &oPKey);
+   Alloc_free(ALLOC_TREE_KEY, pcKey, ulParentLength + 1 + ulLength + 1);
+   if(iStatus != SUCCESS)
+      return (size_t) -1;
+   (void) Node_hasChild(oNParent, oPKey, &ulIndex);
+   Path_free(oPKey);
+   return ulIndex;
+}
+
+/*
+  Adds to abLive the positions in oPPattern after each live "**", as
+  "**" may match no components at all. A run of "**" is followed
+  through, since each position is settled before the next.
+*/
+static void DT_findClose(Path_T oPPattern, boolean *abLive) {
+   size_t ulDepth = Path_getDepth(oPPattern);
+   size_t ulPos;
+
+   assert(oPPattern != NULL);
+   assert(abLive != NULL);
+
+   for(ulPos = 0; ulPos < ulDepth; ulPos++)
+      if(abLive[ulPos] &&
+         !strcmp(Path_getComponent(oPPattern, ulPos), "**"))
+         abLive[ulPos + 1] = TRUE;
+}
+
+/*
+  Sets abNext to the positions in oPPattern reached from the live
+  positions abLive by matching one more path component, pcName: a
+  "**" at a live position stays live, and any other component that
+  matches pcName makes the next position live. Adds to abNext, as
+  each live "**" may also match no components, the positions after
+  it. Returns TRUE if any position is live in abNext.
+*/
+static boolean DT_findStep(Path_T oPPattern, const boolean *abLive,
+                           const char *pcName, boolean *abNext) {
+   size_t ulDepth = Path_getDepth(oPPattern);
+   size_t ulPos;
+   boolean bAnyLive = FALSE;
+
+   assert(oPPattern != NULL);
+   assert(abLive != NULL);
+   assert(pcName != NULL);
+   assert(abNext != NULL);
+
+   for(ulPos = 0; ulPos <= ulDepth; ulPos++)
+      abNext[ulPos] = FALSE;
+   for(ulPos = 0; ulPos < ulDepth; ulPos++) {
+      const char *pcComponent;
+
+      if(!abLive[ulPos])
+         continue;
+      pcComponent = Path_getComponent(oPPattern, ulPos);
+      if(!strcmp(pcComponent, "**"))
+         abNext[ulPos] = TRUE;
+      else if(Path_matchComponent(pcComponent, pcName))
+         abNext[ulPos + 1] = TRUE;
+   }
+   DT_findClose(oPPattern, abNext);
+
+   for(ulPos = 0; ulPos <= ulDepth; ulPos++)
+      bAnyLive = bAnyLive || abNext[ulPos];
+   return bAnyLive;
+}
+
+/*
+  Calls (*pfVisit) on each node below oNParent whose path matches
+  oPPattern, in pre-order, given the live positions abLive that
+  oNParent's path leaves in oPPattern. With oNParent NULL, the root is
+  the only child. Each node is visited once, and a child is descended
+  into only while some position is live after its name. When the only
+  live position is a component other than "**", its literal prefix
+  (before any '*', '?' or '[') is binary searched among the sorted
+  children, and a fully literal component is looked up directly.
+  Returns SUCCESS, or MEMORY_ERROR if memory could not be allocated
+  to search.
+*/
+static int DT_findFrom(Node_T oNParent, Path_T oPPattern,
+                       const boolean *abLive,
+                       void (*pfVisit)(const char *pcPath,
+                                       void *pvExtra),
+                       void *pvExtra) {
+   const char *pcComponent = "";
+   size_t ulDepth = Path_getDepth(oPPattern);
+   size_t ulNumChildren;
+   size_t ulNumLive = 0;
+   size_t ulPrefix = 0;
+   size_t ulIndex = 0;
+   size_t ulPos;
+   boolean *abNext;
+   Node_T oNChild = NULL;
+   int iStatus = SUCCESS;
+
+   assert(oPPattern != NULL);
+   assert(abLive != NULL);
+   assert(pfVisit != NULL);
+
+   /* with only a finished match live, no child can match */
+   for(ulPos = 0; ulPos < ulDepth; ulPos++)
+      if(abLive[ulPos]) {
+         pcComponent = Path_getComponent(oPPattern, ulPos);
+         ulNumLive++;
+      }
+   if(ulNumLive == 0)
+      return SUCCESS;
+
+   if(oNParent == NULL)
+      ulNumChildren = (oNRoot != NULL);
+   else
+      ulNumChildren = Node_getNumChildren(oNParent);
+
+   /* with one component left to match, skip to its literal prefix */
+   if(ulNumLive == 1 && strcmp(pcComponent, "**")) {
+      ulPrefix = strcspn(pcComponent, "*?[");
+      if(oNParent != NULL) {
+         ulIndex = DT_findPrefixStart(oNParent, pcComponent, ulPrefix);
+         if(ulIndex == (size_t) -1)
+            return MEMORY_ERROR;
+      }
+   }
+   else
+      /* otherwise scan every child, as for a component "*" */
+      pcComponent = "*";
+
+   abNext = Alloc_malloc(ALLOC_TREE_FIND,
+                         (ulDepth + 1) * sizeof(boolean));
+   if(abNext == NULL)
+      return MEMORY_ERROR;
+
+   for(; ulIndex < ulNumChildren; ulIndex++) {
+      Path_T oPChild;
+      const char *pcName;
+
+      if(oNParent == NULL)
+         oNChild = oNRoot;
+      else if(Node_getChild(oNParent, ulIndex, &oNChild) != SUCCESS)
+         assert(FALSE);
+      oPChild = Node_getPath(oNChild);
+      pcName = Path_getComponent(oPChild, Path_getDepth(oPChild) - 1);
+
+      /* past the children sharing the literal prefix */
+      if(strncmp(pcName, pcComponent, ulPrefix))
+         break;
+      if(DT_findStep(oPPattern, abLive, pcName, abNext)) {
+         if(abNext[ulDepth])
+            (*pfVisit)(Path_getPathname(oPChild), pvExtra);
+         iStatus = DT_findFrom(oNChild, oPPattern, abNext,
+                               pfVisit, pvExtra);
+         if(iStatus != SUCCESS)
+            break;
+      }
+      /* a literal component matches at most one child */
+      if(pcComponent[ulPrefix] == '\0')
+         break;
+   }
+
+   Alloc_free(ALLOC_TREE_FIND, abNext, (ulDepth + 1) * sizeof(boolean));
+   return iStatus;
+}
+/*--------------------------------------------------------------------*/
+
+/* Does the work of DT_toString, which DT_METRICS builds time */
+static char *DT_toStringUntimed(void) {
+   char *result;
+
+   DT_writeLock();
+   if(!bIsInitialized || Node_settlePaths(oNRoot) != SUCCESS) {
+      DT_treeUnlock();
+      return NULL;
+   }
+
+   result = DT_treeToString(oNRoot);
+   DT_treeUnlock();
+
+   return result;
+}
+
+char *DT_toString(void) {
+   char *pcResult;
+
+   DT_timeCall(DT_OP_TOSTRING,
+               pcResult = DT_toStringUntimed(),
+               pcResult != NULL ? SUCCESS : MEMORY_ERROR);
+   return pcResult;
+}
+
+int DT_iterBegin(const char *pcPath, DT_Iter_T *poIResult) {
+   struct DT_Iter *psNew;
+   Node_T oNStart = oNRoot;
+   int iStatus;
+
+   assert(poIResult != NULL);
+
+   *poIResult = NULL;
+   psNew = Alloc_malloc(ALLOC_TREE_ITER, sizeof(struct DT_Iter));
+   if(psNew == NULL)
+      return MEMORY_ERROR;
+
+   /* the walk reads the hierarchy between calls, so nobody else may
+      change it until DT_iterEnd */
+   DT_writeLock();
+   if(!bIsInitialized) {
+      DT_treeUnlock();
+      Alloc_free(ALLOC_TREE_ITER, psNew, sizeof(struct DT_Iter));
+      return INITIALIZATION_ERROR;
+   }
+   /* rewrite any stale paths now, as DT_iterNext cannot fail */
+   if(Node_settlePaths(oNRoot) != SUCCESS) {
+      DT_treeUnlock();
+      Alloc_free(ALLOC_TREE_ITER, psNew, sizeof(struct DT_Iter));
+      return MEMORY_ERROR;
+   }
+
+   if(pcPath != NULL) {
+      iStatus = DT_findNode(pcPath, FALSE, FALSE, &oNStart);
+      if(iStatus != SUCCESS) {
+         DT_treeUnlock();
+         Alloc_free(ALLOC_TREE_ITER, psNew, sizeof(struct DT_Iter));
+         return iStatus;
+      }
+      DT_release(oNStart, FALSE);
+   }
+
+   iStatus = DT_iterSetUp(psNew, oNStart);
+   if(iStatus != SUCCESS) {
+      DT_treeUnlock();
+      Alloc_free(ALLOC_TREE_ITER, psNew, sizeof(struct DT_Iter));
+      return iStatus;
+   }
+#ifdef DT_CONCURRENT
+   psNew->bHoldsLock = TRUE;
+#else
+   DT_treeUnlock();
+#endif
+
+   *poIResult = psNew;
+   return SUCCESS;
+}
+
+const char *DT_iterNext(DT_Iter_T oIIter) {
+   Node_T oNNext;
+
+   assert(oIIter != NULL);
+
+   oNNext = DT_iterNextNode(oIIter);
+   if(oNNext == NULL)
+      return NULL;
+   return Path_getPathname(Node_getPath(oNNext));
+}
+
+void DT_iterEnd(DT_Iter_T oIIter) {
+   assert(oIIter != NULL);
+
+   if(oIIter->bHoldsLock)
+      DT_treeUnlock();
+   DynArray_free(oIIter->oDStack);
+   Alloc_free(ALLOC_TREE_ITER, oIIter, sizeof(struct DT_Iter));
+}
+
+/* Does the work of DT_map, which DT_METRICS builds time */
+static int DT_mapUntimed(const char *pcPath,
+                         void (*pfVisit)(const char *pcPath,
+                                         void *pvExtra),
+                         void *pvExtra) {
+   DT_Iter_T oIIter;
+   const char *pcNext;
+   int iStatus;
+
+   assert(pfVisit != NULL);
+
+   iStatus = DT_iterBegin(pcPath, &oIIter);
+   if(iStatus != SUCCESS)
+      return iStatus;
+   while((pcNext = DT_iterNext(oIIter)) != NULL)
+      (*pfVisit)(pcNext, pvExtra);
+   DT_iterEnd(oIIter);
+
+   return SUCCESS;
+}
+
+int DT_map(const char *pcPath,
+           void (*pfVisit)(const char *pcPath, void *pvExtra),
+           void *pvExtra) {
+   int iStatus;
+
+   DT_timeCall(DT_OP_MAP,
+               iStatus = DT_mapUntimed(pcPath, pfVisit, pvExtra),
+               iStatus);
+   return iStatus;
+}
+
+
+/* Does the work of DT_find, which DT_METRICS builds time */
+static int DT_findUntimed(const char *pcPattern,
+                          void (*pfVisit)(const char *pcPath,
+                                          void *pvExtra),
+                          void *pvExtra) {
+   Path_T oPPattern = NULL;
+   boolean *abLive;
+   size_t ulSize;
+   size_t ulPos;
+   int iStatus;
+
+   assert(pcPattern != NULL);
+   assert(pfVisit != NULL);
+
+   iStatus = Path_new(pcPattern, &oPPattern);
+   if(iStatus != SUCCESS)
+      return iStatus;
+
+   /* before the root, only the first position is live */
+   ulSize = (Path_getDepth(oPPattern) + 1) * sizeof(boolean);
+   abLive = Alloc_malloc(ALLOC_TREE_FIND, ulSize);
+   if(abLive == NULL) {
+      Path_free(oPPattern);
+      return MEMORY_ERROR;
+   }
+   for(ulPos = 0; ulPos <= Path_getDepth(oPPattern); ulPos++)
+      abLive[ulPos] = (ulPos == 0);
+   DT_findClose(oPPattern, abLive);
+
+   /* as for iterators, the walk reads the hierarchy without locking
+      each node, so nobody else may change it meanwhile */
+   DT_writeLock();
+   if(!bIsInitialized)
+      iStatus = INITIALIZATION_ERROR;
+   else if(Node_settlePaths(oNRoot) != SUCCESS)
+      iStatus = MEMORY_ERROR;
+   else
+      iStatus = DT_findFrom(NULL, oPPattern, abLive, pfVisit, pvExtra);
+   DT_treeUnlock();
+
+   Alloc_free(ALLOC_TREE_FIND, abLive, ulSize);
+   Path_free(oPPattern);
+   return iStatus;
+}
+
+int DT_find(const char *pcPattern,
+            void (*pfVisit)(const char *pcPath, void *pvExtra),
+            void *pvExtra) {
+   int iStatus;
+
+   DT_timeCall(DT_OP_FIND,
+               iStatus = DT_findUntimed(pcPattern, pfVisit, pvExtra),
+               iStatus);
+   return iStatus;
+}
+
+
+/* Does the work of DT_subtreeSize, which DT_METRICS builds time */
+static int DT_subtreeSizeUntimed(const char *pcPath, size_t *pulSize) {
+   Node_T oNFound = NULL;
+   int iStatus;
+
+   assert(pcPath != NULL);
+   assert(pulSize != NULL);
+
+   /* the counts below are only settled while no writer runs */
+   DT_writeLock();
+   if(!bIsInitialized) {
+      DT_treeUnlock();
+      return INITIALIZATION_ERROR;
+   }
+
+   iStatus = DT_findNode(pcPath, FALSE, FALSE, &oNFound);
+   if(iStatus == SUCCESS) {
+      *pulSize = Node_getSubtreeSize(oNFound);
+      DT_release(oNFound, FALSE);
+   }
+   DT_treeUnlock();
+
+   return iStatus;
+}
+
+int DT_subtreeSize(const char *pcPath, size_t *pulSize) {
+   int iStatus;
+
+   DT_timeCall(DT_OP_SUBTREE_SIZE,
+               iStatus = DT_subtreeSizeUntimed(pcPath, pulSize),
+               iStatus);
+   return iStatus;
+}
+
+/* Does the work of DT_rankOf, which DT_METRICS builds time */
+static int DT_rankOfUntimed(const char *pcPath, size_t *pulRank) {
+   Path_T oPPath = NULL;
+   Node_T oNFound = NULL;
+   size_t ulRank = 0;
+   int iStatus;
+
+   assert(pcPath != NULL);
+   assert(pulRank != NULL);
+
+   DT_readLock();
+   if(!bIsInitialized) {
+      DT_treeUnlock();
+      return INITIALIZATION_ERROR;
+   }
+
+   iStatus = Path_new(pcPath, &oPPath);
+   if(iStatus != SUCCESS) {
+      DT_treeUnlock();
+      return iStatus;
+   }
+
+   /* each ancestor precedes the directory, as do the subtrees of the
+      earlier siblings of it and of each of its ancestors, which the
+      way down adds up one binary search per level */
+   iStatus = DT_traversePath(oPPath, FALSE, FALSE, &oNFound, &ulRank);
+   if(iStatus == SUCCESS) {
+      if(oNFound == NULL ||
+         Path_comparePath(Node_getPath(oNFound), oPPath) != 0)
+         iStatus = NO_SUCH_PATH;
+      DT_release(oNFound, FALSE);
+   }
+   DT_treeUnlock();
+
+   Path_free(oPPath);
+   if(iStatus == SUCCESS)
+      *pulRank = ulRank;
+   return iStatus;
+}
+
+int DT_rankOf(const char *pcPath, size_t *pulRank) {
+   int iStatus;
+
+   DT_timeCall(DT_OP_RANK_OF,
+               iStatus = DT_rankOfUntimed(pcPath, pulRank),
+               iStatus);
+   return iStatus;
+}
+
+/* Does the work of DT_select, which DT_METRICS builds time */
+static char *DT_selectUntimed(size_t ulRank) {
+   Node_T oNCurr;
+   Node_T oNChild = NULL;
+   size_t ulIndex;
+   size_t ulBefore;
+   char *result = NULL;
+
+   DT_readLock();
+   if(!bIsInitialized) {
+      DT_treeUnlock();
+      return NULL;
+   }
+
+   DT_lock(NULL);
+   oNCurr = oNRoot;
+   if(oNCurr == NULL || ulRank >= Node_getSubtreeSize(oNCurr)) {
+      DT_unlock(NULL);
+      DT_treeUnlock();
+      return NULL;
+   }
+   DT_lock(oNCurr);
+   DT_unlock(NULL);
+
+   /* skip whole subtrees of children until one holds the rank, each
+      level a binary search of the counts before its children; a path
+      left stale by DT_mv is rewritten under the parent's lock */
+   while(ulRank != 0) {
+      ulIndex = Node_findRank(oNCurr, ulRank - 1, &ulBefore);
+      ulRank -= 1 + ulBefore;
+      if(Node_getChild(oNCurr, ulIndex, &oNChild) != SUCCESS ||
+         Node_getPath(oNChild) == NULL) {
+         DT_unlock(oNCurr);
+         DT_treeUnlock();
+         return NULL;
+      }
+      DT_lock(oNChild);
+      DT_unlock(oNCurr);
+      oNCurr = oNChild;
+   }
+
+   result = Node_toString(oNCurr);
+   DT_unlock(oNCurr);
+   DT_treeUnlock();
+
+   return result;
+}
+
+char *DT_select(size_t ulRank) {
+   char *pcResult;
+
+   DT_timeCall(DT_OP_SELECT,
+               pcResult = DT_selectUntimed(ulRank),
+               pcResult != NULL ? SUCCESS : NO_SUCH_PATH);
+   return pcResult;
+}
+
+void DT_getCursorStats(size_t *pulHits, size_t *pulMisses) {
+   assert(pulHits != NULL);
+   assert(pulMisses != NULL);
+
+#ifdef DT_CONCURRENT
+   *pulHits = 0;
+   *pulMisses = 0;
+#else
+   *pulHits = ulCursorHits;
+   *pulMisses = ulCursorMisses;
+#endif
+}
+
+/*
+  Returns the bucket of the fan-out histogram of a DT_Stats that
+  counts a directory with ulChildren children.
+*/
+static size_t DT_fanoutBucket(size_t ulChildren) {
+   size_t ulBucket = 0;
+
+   while(ulChildren != 0 && ulBucket < DT_FANOUT_BUCKETS - 1) {
+      ulChildren >>= 1;
+      ulBucket++;
+   }
+   return ulBucket;
+}
+
+/* Adds the subtree rooted at oNNode, of depth ulDepth, to *psStats. */
+static void DT_addStats(Node_T oNNode, size_t ulDepth,
+                        struct DT_Stats *psStats) {
+   size_t ulNodeBytes, ulPathBytes, ulChildBytes, ulSlack;
+   size_t ulIndex;
+
+   assert(oNNode != NULL);
+   assert(psStats != NULL);
+
+   Node_getFootprint(oNNode, &ulNodeBytes, &ulPathBytes, &ulChildBytes,
+                     &ulSlack);
+   psStats->ulNodes++;
+   if(ulDepth > psStats->ulMaxDepth)
+      psStats->ulMaxDepth = ulDepth;
+   psStats->ulDepthSum += ulDepth;
+   psStats->aulFanout[DT_fanoutBucket(Node_getNumChildren(oNNode))]++;
+   psStats->ulPathBytes += ulPathBytes;
+   psStats->ulNodeBytes += ulNodeBytes;
+   psStats->ulChildBytes += ulChildBytes;
+   psStats->ulSlack += ulSlack;
+
+   for(ulIndex = 0; ulIndex < Node_getNumChildren(oNNode); ulIndex++) {
+      Node_T oNChild = NULL;
+      (void) Node_getChild(oNNode, ulIndex, &oNChild);
+      DT_addStats(oNChild, ulDepth + 1, psStats);
+   }
+}
+
+void DT_dumpMetrics(FILE *psFile) {
+#ifdef DT_METRICS
+   size_t aulCounts[LATENCY_BUCKETS];
+   int iOp, iStatus;
+   size_t ulBucket;
+#endif
+
+   assert(psFile != NULL);
+
+#ifdef DT_METRICS
+   /* the write lock keeps dumps from interleaving */
+   DT_writeLock();
+   for(iOp = 0; iOp < DT_NUM_OPS; iOp++)
+      for(iStatus = 0; iStatus < LATENCY_STATUSES; iStatus++) {
+         for(ulBucket = 0; ulBucket < LATENCY_BUCKETS; ulBucket++)
+            aulCounts[ulBucket] =
+               DT_getCalls(&aulLatencies[iOp][iStatus][ulBucket]);
+         Latency_write(psFile, apcOpNames[iOp], iStatus, aulCounts);
+      }
+   DT_treeUnlock();
+#else
+   (void) psFile;
+#endif
+}
+
+int DT_getStats(struct DT_Stats *psStats) {
+   assert(psStats != NULL);
+
+   /* the walk reads every node without locking it */
+   DT_writeLock();
+   if(!bIsInitialized) {
+      DT_treeUnlock();
+      return INITIALIZATION_ERROR;
+   }
+
+   memset(psStats, 0, sizeof(struct DT_Stats));
+   if(oNRoot != NULL)
+      DT_addStats(oNRoot, 1, psStats);
+   DT_treeUnlock();
+
+   assert(psStats->ulNodes == ulCount);
+   return SUCCESS;
+}
+
+/* Does the work of DT_snapshot, which DT_METRICS builds time */
+static int DT_snapshotUntimed(DT_Snapshot_T *poSResult) {
+   struct DT_Snapshot *psNew;
+
+   assert(poSResult != NULL);
+
+   DT_writeLock();
+   if(!bIsInitialized) {
+      DT_treeUnlock();
+      *poSResult = NULL;
+      return INITIALIZATION_ERROR;
+   }
+
+   /* the snapshot's paths must never change, so none may be left
+      for DT_mv's lazy rewriting */
+   psNew = Alloc_malloc(ALLOC_TREE_SNAPSHOT,
+                        sizeof(struct DT_Snapshot));
+   if(psNew == NULL || Node_settlePaths(oNRoot) != SUCCESS) {
+      DT_treeUnlock();
+      Alloc_free(ALLOC_TREE_SNAPSHOT, psNew,
+                 sizeof(struct DT_Snapshot));
+      *poSResult = NULL;
+      return MEMORY_ERROR;
+   }
+
+   /* sharing the root shares everything beneath it; writers copy the
+      nodes they change on their way down from the root */
+   psNew->oNRoot = NULL;
+   if(oNRoot != NULL)
+      psNew->oNRoot = Node_share(oNRoot);
+   DT_snapshotTaken();
+   DT_treeUnlock();
+
+   *poSResult = psNew;
+   return SUCCESS;
+}
+
+int DT_snapshot(DT_Snapshot_T *poSResult) {
+   int iStatus;
+
+   DT_timeCall(DT_OP_SNAPSHOT,
+               iStatus = DT_snapshotUntimed(poSResult),
+               iStatus);
+   return iStatus;
+}
+
+boolean DT_Snapshot_contains(DT_Snapshot_T oSSnapshot,
+                             const char *pcPath) {
+   Node_T oNFound = NULL;
+
+   assert(oSSnapshot != NULL);
+   assert(pcPath != NULL);
+
+   return (boolean) (DT_Snapshot_findNode(oSSnapshot, pcPath,
+                                          &oNFound) == SUCCESS);
+}
+
+char *DT_Snapshot_toString(DT_Snapshot_T oSSnapshot) {
+   assert(oSSnapshot != NULL);
+
+   return DT_treeToString(oSSnapshot->oNRoot);
+}
+
+int DT_Snapshot_iterBegin(DT_Snapshot_T oSSnapshot, const char *pcPath,
+                          DT_Iter_T *poIResult) {
+   struct DT_Iter *psNew;
+   Node_T oNStart = oSSnapshot->oNRoot;
+   int iStatus;
+
+   assert(oSSnapshot != NULL);
+   assert(poIResult != NULL);
+
+   *poIResult = NULL;
+   if(pcPath != NULL) {
+      iStatus = DT_Snapshot_findNode(oSSnapshot, pcPath, &oNStart);
+      if(iStatus != SUCCESS)
+         return iStatus;
+   }
+
+   psNew = Alloc_malloc(ALLOC_TREE_ITER, sizeof(struct DT_Iter));
+   if(psNew == NULL)
+      return MEMORY_ERROR;
+
+   iStatus = DT_iterSetUp(psNew, oNStart);
+   if(iStatus != SUCCESS) {
+      Alloc_free(ALLOC_TREE_ITER, psNew, sizeof(struct DT_Iter));
+      return iStatus;
+   }
+
+   *poIResult = psNew;
+   return SUCCESS;
+}
+
+void DT_Snapshot_free(DT_Snapshot_T oSSnapshot) {
+   assert(oSSnapshot != NULL);
+
+   /* writers may be unsharing nodes from this snapshot's tree */
+   DT_writeLock();
+   if(oSSnapshot->oNRoot != NULL)
+      Node_release(oSSnapshot->oNRoot);
+   DT_snapshotFreed();
+#ifdef DT_MAPPED
+   DT_closeRegion();
+#endif
+   DT_treeUnlock();
+
+   Alloc_free(ALLOC_TREE_SNAPSHOT, oSSnapshot,
+              sizeof(struct DT_Snapshot));
+}
+
+
+/* --------------------------------------------------------------------
+
+  The following auxiliary functions write and read the binary image
+  of a hierarchy described for DT_save. Numbers are stored with their
+  most significant byte first, so images move between machines.
+*/
+
+/* The bytes that start every DT image */
+static const char acImageMagic[4] = {'D', 'T', 'I', '1'};
+
+/* The sizes in bytes of the numbers in an image */
+enum {COUNT_BYTES = 8, NAME_BYTES = 4, CHILDREN_BYTES = 4};
+
+/* The smallest possible record of a directory in an image */
+enum {MIN_RECORD_BYTES = NAME_BYTES + 1 + CHILDREN_BYTES};
+
+/* The size of the buffer gathering an image on its way out */
+enum {OUT_BUFFER_BYTES = 8192};
+
+/* An image being written to a file descriptor */
+struct DT_Out {
+   /* the file descriptor being written */
+   int iFd;
+   /* SUCCESS, or IO_ERROR once a write has failed */
+   int iStatus;
+   /* the number of bytes of aucBuffer waiting to be written */
+   size_t ulUsed;
+   /* the bytes waiting to be written */
+   unsigned char aucBuffer[OUT_BUFFER_BYTES];
+};
+
+/* An image being read, from its next unread byte up to pucEnd */
+struct DT_In {
+   const unsigned char *pucNext;
+   const unsigned char *pucEnd;
+};
+
+/* Writes out the bytes waiting in psOut's buffer, if it has not
+   already failed. */
+static void DT_outFlush(struct DT_Out *psOut) {
+   size_t ulDone = 0;
+
+   assert(psOut != NULL);
+
+   while(psOut->iStatus == SUCCESS && ulDone < psOut->ulUsed) {
+      ssize_t lWritten = write(psOut->iFd, psOut->aucBuffer + ulDone,
+                               psOut->ulUsed - ulDone);
+      if(lWritten > 0)
+         ulDone += (size_t) lWritten;
+      else if(lWritten < 0 && errno == EINTR)
+         continue;
+      else
+         psOut->iStatus = IO_ERROR;
+   }
+   psOut->ulUsed = 0;
+}
+
+/* Appends the ulLength bytes at pvBytes to psOut. */
+static void DT_outBytes(struct DT_Out *psOut, const void *pvBytes,
+                        size_t ulLength) {
+   const unsigned char *pucBytes = pvBytes;
+
+   assert(psOut != NULL);
+   assert(pvBytes != NULL || ulLength == 0);
+
+   while(ulLength > 0) {
+      size_t ulChunk = OUT_BUFFER_BYTES - psOut->ulUsed;
+      if(ulChunk > ulLength)
+         ulChunk = ulLength;
+      memcpy(psOut->aucBuffer + psOut->ulUsed, pucBytes, ulChunk);
+      psOut->ulUsed += ulChunk;
+      pucBytes += ulChunk;
+      ulLength -= ulChunk;
+      if(psOut->ulUsed == OUT_BUFFER_BYTES)
+         DT_outFlush(psOut);
+   }
+}
+
+/* Appends ulValue to psOut as a number of ulBytes bytes. */
+static void DT_outNumber(struct DT_Out *psOut, size_t ulValue,
+                         size_t ulBytes) {
+   unsigned char aucNumber[COUNT_BYTES];
+   size_t i;
+
+   assert(psOut != NULL);
+   assert(ulBytes <= COUNT_BYTES);
+
+   for(i = ulBytes; i > 0; i--) {
+      aucNumber[i - 1] = (unsigned char) (ulValue & 0xFF);
+      ulValue >>= 8;
+   }
+   /* every length and count in the hierarchy fits its field */
+   assert(ulValue == 0);
+   DT_outBytes(psOut, aucNumber, ulBytes);
+}
+
+/* Appends the records of the subtree rooted at oNNode to psOut in
+   pre-order. */
+static void DT_saveSubtree(struct DT_Out *psOut, Node_T oNNode) {
+   Path_T oPPath;
+   const char *pcName;
+   size_t ulLength;
+   size_t ulIndex;
+
+   assert(psOut != NULL);
+   assert(oNNode != NULL);
+
+   oPPath = Node_getPath(oNNode);
+   pcName = Path_getComponent(oPPath, Path_getDepth(oPPath) - 1);
+   ulLength = strlen(pcName);
+   DT_outNumber(psOut, ulLength, NAME_BYTES);
+   DT_outBytes(psOut, pcName, ulLength);
+   DT_outNumber(psOut, Node_getNumChildren(oNNode), CHILDREN_BYTES);
+
+   for(ulIndex = 0; ulIndex < Node_getNumChildren(oNNode); ulIndex++) {
+      Node_T oNChild = NULL;
+      (void) Node_getChild(oNNode, ulIndex, &oNChild);
+      DT_saveSubtree(psOut, oNChild);
+   }
+}
+
+/*
+  Reads a number of ulBytes bytes from psIn into *pulValue. Returns
+  FALSE if the image ends first or the number does not fit a size_t.
+*/
+static boolean DT_inNumber(struct DT_In *psIn, size_t ulBytes,
+                           size_t *pulValue) {
+   size_t ulValue = 0;
+   size_t i;
+
+   assert(psIn != NULL);
+   assert(pulValue != NULL);
+
+   if((size_t) (psIn->pucEnd - psIn->pucNext) < ulBytes)
+      return FALSE;
+   for(i = 0; i < ulBytes; i++) {
+      if(ulValue > ((size_t) -1) >> 8)
+         return FALSE;
+      ulValue = (ulValue << 8) | psIn->pucNext[i];
+   }
+   psIn->pucNext += ulBytes;
+   *pulValue = ulValue;
+   return TRUE;
+}
+
+/*
+  Builds the subtree whose records come next in psIn as a new child of
+  oNParent, or as a new root if oNParent is NULL. Returns SUCCESS and
+  sets *poNResult to the subtree's root, or returns BAD_FORMAT if the
+  records are malformed and MEMORY_ERROR if memory could not be
+  allocated. On error, *poNResult is the subtree's root if one was
+  built, so the caller frees it with the rest, and NULL otherwise.
+*/
+static int DT_loadSubtree(struct DT_In *psIn, Node_T oNParent,
+                          Node_T *poNResult) {
+   Path_T oPPath = NULL;
+   Node_T oNNew = NULL;
+   size_t ulLength;
+   size_t ulChildren;
+   size_t ulIndex;
+   int iStatus;
+
+   assert(psIn != NULL);
+   assert(poNResult != NULL);
+
+   *poNResult = NULL;
+   if(!DT_inNumber(psIn, NAME_BYTES, &ulLength) ||
+      (size_t) (psIn->pucEnd - psIn->pucNext) < ulLength)
+      return BAD_FORMAT;
+
+   /* the new path extends the parent's, so nothing is parsed again */
+   iStatus = Path_newChild(oNParent == NULL ? NULL :
+                              Node_getPath(oNParent),
+                           (const char *) psIn->pucNext, ulLength,
+                           &oPPath);
+   if(iStatus != SUCCESS)
+      return iStatus == BAD_PATH ? BAD_FORMAT : iStatus;
+   psIn->pucNext += ulLength;
+
+   iStatus = Node_new(oPPath, oNParent, &oNNew);
+   Path_free(oPPath);
+   if(iStatus != SUCCESS)
+      return iStatus == MEMORY_ERROR ? MEMORY_ERROR : BAD_FORMAT;
+   *poNResult = oNNew;
+
+   /* each child needs a record, which bounds any sane count */
+   if(!DT_inNumber(psIn, CHILDREN_BYTES, &ulChildren) ||
+      ulChildren > (size_t) (psIn->pucEnd - psIn->pucNext) /
+                   MIN_RECORD_BYTES)
+      return BAD_FORMAT;
+
+   for(ulIndex = 0; ulIndex < ulChildren; ulIndex++) {
+      Node_T oNChild = NULL;
+      iStatus = DT_loadSubtree(psIn, oNNew, &oNChild);
+      if(oNChild != NULL)
+         Node_growSubtree(oNNew, Node_getSubtreeSize(oNChild));
+      if(iStatus != SUCCESS)
+         return iStatus;
+   }
+   return SUCCESS;
+}
+
+/*
+  Makes the whole contents of the file open on iFd readable at
+  *ppvImage, of *pulSize bytes. Regular files are mapped; anything
+  else, such as a pipe, is read to its end into memory. Sets
+  *pulBuffer to the size of the buffer read into, or to 0 if the file
+  was mapped, for DT_unmapImage. Returns SUCCESS, IO_ERROR if the file
+  cannot be read or MEMORY_ERROR if memory could not be allocated.
+*/
+static int DT_mapImage(int iFd, void **ppvImage, size_t *pulSize,
+                       size_t *pulBuffer) {
+   struct stat sStat;
+   unsigned char *pucBuffer = NULL;
+   size_t ulSize = 0;
+   size_t ulCapacity = 0;
+
+   assert(ppvImage != NULL);
+   assert(pulSize != NULL);
+   assert(pulBuffer != NULL);
+
+   if(fstat(iFd, &sStat) == 0 && S_ISREG(sStat.st_mode) &&
+      sStat.st_size > 0) {
+      void *pvMap = mmap(NULL, (size_t) sStat.st_size, PROT_READ,
+                         MAP_PRIVATE, iFd, 0);
+      if(pvMap != MAP_FAILED) {
+         *ppvImage = pvMap;
+         *pulSize = (size_t) sStat.st_size;
+         *pulBuffer = 0;
+         return SUCCESS;
+      }
+   }
+
+   for(;;) {
+      ssize_t lRead;
+
+      if(ulSize == ulCapacity) {
+         unsigned char *pucGrown;
+         size_t ulGrown =
+            ulCapacity == 0 ? OUT_BUFFER_BYTES : 2 * ulCapacity;
+         pucGrown = Alloc_realloc(ALLOC_TREE_IMAGE, pucBuffer,
+                                  ulCapacity, ulGrown);
+         if(pucGrown == NULL) {
+            Alloc_free(ALLOC_TREE_IMAGE, pucBuffer, ulCapacity);
+            return MEMORY_ERROR;
+         }
+         pucBuffer = pucGrown;
+         ulCapacity = ulGrown;
+      }
+      lRead = read(iFd, pucBuffer + ulSize, ulCapacity - ulSize);
+      if(lRead == 0)
+         break;
+      if(lRead < 0) {
+         if(errno == EINTR)
+            continue;
+         Alloc_free(ALLOC_TREE_IMAGE, pucBuffer, ulCapacity);
+         return IO_ERROR;
+      }
+      ulSize += (size_t) lRead;
+   }
+
+   *ppvImage = pucBuffer;
+   *pulSize = ulSize;
+   *pulBuffer = ulCapacity;
+   return SUCCESS;
+}
+
+/* Releases an image of ulSize bytes at pvImage, in a buffer of
+   ulBuffer bytes, from DT_mapImage. */
+static void DT_unmapImage(void *pvImage, size_t ulSize,
+                          size_t ulBuffer) {
+   if(ulBuffer == 0)
+      (void) munmap(pvImage, ulSize);
+   else
+      Alloc_free(ALLOC_TREE_IMAGE, pvImage, ulBuffer);
+}
+/*--------------------------------------------------------------------*/
+
+/* Does the work of DT_save, which DT_METRICS builds time */
+static int DT_saveUntimed(int iFd) {
+   struct DT_Out *psOut;
+   int iStatus;
+
+   /* the image must be of one moment, so nobody may write meanwhile */
+   DT_writeLock();
+   if(!bIsInitialized) {
+      DT_treeUnlock();
+      return INITIALIZATION_ERROR;
+   }
+   if(Node_settlePaths(oNRoot) != SUCCESS) {
+      DT_treeUnlock();
+      return MEMORY_ERROR;
+   }
+
+   psOut = Alloc_malloc(ALLOC_TREE_OUT, sizeof(struct DT_Out));
+   if(psOut == NULL) {
+      DT_treeUnlock();
+      return MEMORY_ERROR;
+   }
+   psOut->iFd = iFd;
+   psOut->iStatus = SUCCESS;
+   psOut->ulUsed = 0;
+
+   DT_outBytes(psOut, acImageMagic, sizeof(acImageMagic));
+   DT_outNumber(psOut, ulCount, COUNT_BYTES);
+   if(oNRoot != NULL)
+      DT_saveSubtree(psOut, oNRoot);
+   DT_outFlush(psOut);
+   DT_treeUnlock();
+
+   iStatus = psOut->iStatus;
+   Alloc_free(ALLOC_TREE_OUT, psOut, sizeof(struct DT_Out));
+   return iStatus;
+}
+
+int DT_save(int iFd) {
+   int iStatus;
+
+   DT_timeCall(DT_OP_SAVE, iStatus = DT_saveUntimed(iFd), iStatus);
+   return iStatus;
+}
+
+/* Does the work of DT_load, which DT_METRICS builds time */
+static int DT_loadUntimed(int iFd) {
+   struct DT_In sIn;
+   void *pvImage = NULL;
+   size_t ulSize = 0;
+   size_t ulBuffer = 0;
+   size_t ulNewCount = 0;
+   Node_T oNNewRoot = NULL;
+   int iStatus;
+
+   assert(DT_isValid());
+
+   DT_writeLock();
+   if(!bIsInitialized) {
+      DT_treeUnlock();
+      return INITIALIZATION_ERROR;
+   }
+
+   iStatus = DT_mapImage(iFd, &pvImage, &ulSize, &ulBuffer);
+   if(iStatus != SUCCESS) {
+      DT_treeUnlock();
+      return iStatus;
+   }
+
+   /* build the new hierarchy beside the old one, in a single pass */
+   sIn.pucNext = pvImage;
+   sIn.pucEnd = sIn.pucNext + ulSize;
+   if(ulSize < sizeof(acImageMagic) ||
+      memcmp(sIn.pucNext, acImageMagic, sizeof(acImageMagic)))
+      iStatus = BAD_FORMAT;
+   else {
+      sIn.pucNext += sizeof(acImageMagic);
+      if(!DT_inNumber(&sIn, COUNT_BYTES, &ulNewCount))
+         iStatus = BAD_FORMAT;
+      else if(ulNewCount != 0)
+         iStatus = DT_loadSubtree(&sIn, NULL, &oNNewRoot);
+   }
+   if(iStatus == SUCCESS &&
+      (sIn.pucNext != sIn.pucEnd ||
+       ulNewCount != (oNNewRoot == NULL ? 0 :
+                      Node_getSubtreeSize(oNNewRoot))))
+      iStatus = BAD_FORMAT;
+   DT_unmapImage(pvImage, ulSize, ulBuffer);
+
+   if(iStatus != SUCCESS) {
+      if(oNNewRoot != NULL) {
+         DT_lock(oNNewRoot);
+         (void) Node_free(oNNewRoot);
+      }
+      DT_treeUnlock();
+      return iStatus;
+   }
+
+   /* only then replace the old one */
+   if(oNRoot != NULL) {
+      DT_lock(oNRoot);
+      (void) Node_free(oNRoot);
+   }
+   oNRoot = oNNewRoot;
+   ulCount = ulNewCount;
+   DT_setCursor(NULL);
+   DT_treeUnlock();
+
+   assert(DT_isValid());
+   return SUCCESS;
+}
+
+int DT_load(int iFd) {
+   int iStatus;
+
+   DT_timeCall(DT_OP_LOAD, iStatus = DT_loadUntimed(iFd), iStatus);
+   return iStatus;
+}
+
+
+/*
+  Applies the journal record of operation iOp on pcPath, with the
+  ulLength bytes at pvData, to the DT, for Journal_replay. Returns the
+  status of the operation, or BAD_FORMAT if the record is not a DT
+  record.
+*/
+static int DT_replayRecord(int iOp, const char *pcPath,
+                           const void *pvData, size_t ulLength,
+                           void *pvExtra) {
+   char *pcNewPath;
+   int iStatus;
+
+   assert(pcPath != NULL);
+   /* every record is applied the same way */
+   (void) pvExtra;
+
+   switch(iOp) {
+      case DT_LOG_INSERT:
+         return ulLength != 0 ? BAD_FORMAT : DT_insert(pcPath);
+      case DT_LOG_RM:
+         return ulLength != 0 ? BAD_FORMAT : DT_rm(pcPath);
+      case DT_LOG_MV:
+         /* the new path is the data, which is not '\0'-terminated */
+         pcNewPath = Alloc_malloc(ALLOC_TREE_KEY, ulLength + 1);
+         if(pcNewPath == NULL)
+            return MEMORY_ERROR;
+         memcpy(pcNewPath, pvData, ulLength);
+         pcNewPath[ulLength] = '\0';
+         iStatus = DT_mv(pcPath, pcNewPath);
+         Alloc_free(ALLOC_TREE_KEY, pcNewPath, ulLength + 1);
+         return iStatus;
+      default:
+         return BAD_FORMAT;
+   }
+}
+
+int DT_journalStart(int iFd, size_t ulSyncEvery) {
+   int iStatus = SUCCESS;
+
+   DT_journalLock();
+   if(oJJournal != NULL)
+      iStatus = INITIALIZATION_ERROR;
+   else {
+      oJJournal = Journal_new(iFd, ulSyncEvery);
+      if(oJJournal == NULL)
+         iStatus = MEMORY_ERROR;
+   }
+   DT_journalUnlock();
+
+   return iStatus;
+}
+
+int DT_journalSync(void) {
+   int iStatus = INITIALIZATION_ERROR;
+
+   DT_journalLock();
+   if(oJJournal != NULL)
+      iStatus = Journal_sync(oJJournal);
+   DT_journalUnlock();
+
+   return iStatus;
+}
+
+int DT_journalStop(void) {
+   int iStatus = INITIALIZATION_ERROR;
+
+   DT_journalLock();
+   if(oJJournal != NULL) {
+      iStatus = Journal_free(oJJournal);
+      oJJournal = NULL;
+   }
+   DT_journalUnlock();
+
+   return iStatus;
+}
+
+void DT_getJournalStats(size_t *pulRecords, size_t *pulBatches,
+                        size_t *pulSyncs) {
+   assert(pulRecords != NULL);
+   assert(pulBatches != NULL);
+   assert(pulSyncs != NULL);
+
+   DT_journalLock();
+   if(oJJournal != NULL)
+      Journal_getStats(oJJournal, pulRecords, pulBatches, pulSyncs);
+   else {
+      *pulRecords = 0;
+      *pulBatches = 0;
+      *pulSyncs = 0;
+   }
+   DT_journalUnlock();
+}
+
+int DT_recover(int iImageFd, int iJournalFd) {
+   Journal_T oJSuspended;
+   int iStatus;
+
+   iStatus = DT_load(iImageFd);
+   if(iStatus != SUCCESS)
+      return iStatus;
+
+   /* the replayed changes are already journaled */
+   DT_journalLock();
+   oJSuspended = oJJournal;
+   oJJournal = NULL;
+   DT_journalUnlock();
+
+   iStatus = Journal_replay(iJournalFd, DT_replayRecord, NULL);
+
+   DT_journalLock();
+   oJJournal = oJSuspended;
+   DT_journalUnlock();
+
+   return iStatus;
+}
@@ -3,18 +3,80 @@
 /* Author: Christopher Moretti                                        */
 /*--------------------------------------------------------------------*/
 
+/* fileno, pipe and close are POSIX.1 interfaces */
+#define _POSIX_C_SOURCE 200112L
+
 #include <assert.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 #include "dt.h"
+#include "alloc.h"
+
+/* Counts one visited directory into the size_t pointed to by pvCount,
+   for DT_map. */
+static void countDir(const char *pcPath, void *pvCount) {
+  assert(pcPath != NULL);
+  (*(size_t *) pvCount)++;
+}
+
+/* Appends pcPath and a newline to the string pointed to by pvWalk,
+   for DT_find. */
+static void appendDir(const char *pcPath, void *pvWalk) {
+  strcat((char *) pvWalk, pcPath);
+  strcat((char *) pvWalk, "\n");
+}
+
+/* The number of blocks that countingMalloc, countingCalloc and
+   countingRealloc have allocated */
+static size_t ulClientAllocs = 0;
+
+/* Counts one block in ulClientAllocs, then allocates as malloc does. */
+static void *countingMalloc(size_t ulSize) {
+  ulClientAllocs++;
+  return malloc(ulSize);
+}
+
+/* Counts one block in ulClientAllocs, then allocates as calloc does. */
+static void *countingCalloc(size_t ulCount, size_t ulSize) {
+  ulClientAllocs++;
+  return calloc(ulCount, ulSize);
+}
+
+/* Counts one block in ulClientAllocs, then reallocates as realloc
+   does. */
+static void *countingRealloc(void *pvBlock, size_t ulSize) {
+  ulClientAllocs++;
+  return realloc(pvBlock, ulSize);
+}
+
+/* An allocator that counts what it allocates, for Alloc_setFunctions */
+static const struct Alloc_Functions sCounting =
+  {countingMalloc, countingCalloc, countingRealloc, free};
 
 /* Tests the DT implementation with an assortment of checks.
    Prints the status of the data structure along the way to stderr.
    Returns 0. */
 int main(void) {
   char* temp;
+  char* snapTemp;
+  DT_Snapshot_T oSnap;
+  DT_Iter_T oIter;
+  const char *pcNext;
+  char acWalk[256];
+  size_t ulVisited;
+  size_t ulRank;
+  size_t ulHits, ulMisses, ulHits0, ulMisses0;
+  FILE *psImage;
+  FILE *psJournal;
+  int aiPipe[2];
+  struct DT_Stats sStats;
+  struct Alloc_Stats sAlloc, sPaths, sNodes;
+#ifdef DT_METRICS
+  size_t ulLines;
+#endif
 
   /* Before the data structure is initialized:
      * insert, rm, and destroy should each return INITIALIZATION_ERROR
@@ -179,12 +241,469 @@ int main(void) {
   assert(DT_insert("a/x/Grandx/Great_GrandX") == SUCCESS);
   assert((temp = DT_toString()) != NULL);
   fprintf(stderr, "Checkpoint 4:\n%s\n", temp);
+
+  /* A snapshot keeps seeing the DT as it was when taken, however the
+     DT changes afterwards, and even once the DT is destroyed */
+  assert(DT_snapshot(&oSnap) == SUCCESS);
+  assert(DT_Snapshot_contains(oSnap, "a/y/Grand1/Great_Grand") == TRUE);
+  assert(DT_rm("a/y") == SUCCESS);
+  assert(DT_insert("a/x/Grandx/new") == SUCCESS);
+  assert(DT_insert("a/z") == SUCCESS);
+  assert(DT_contains("a/y/Grand1/Great_Grand") == FALSE);
+  assert(DT_Snapshot_contains(oSnap, "a/y/Grand1/Great_Grand") == TRUE);
+  assert(DT_Snapshot_contains(oSnap, "a/x/Grandx/new") == FALSE);
+  assert(DT_Snapshot_contains(oSnap, "a/z") == FALSE);
+  assert(DT_Snapshot_contains(oSnap, "b") == FALSE);
+  assert((snapTemp = DT_Snapshot_toString(oSnap)) != NULL);
+  assert(!strcmp(temp, snapTemp));
+  free(snapTemp);
+  free(temp);
+  assert((temp = DT_toString()) != NULL);
+  assert(!strcmp(temp, "a\na/x\na/x/Grandx\na/x/Grandx/Great_GrandX\n"
+                       "a/x/Grandx/new\na/y2\na/y2/GRAND1\na/z\n"));
+
+  /* Iterators walk in toString order, over the whole DT or a subtree,
+     live or in a snapshot */
+  acWalk[0] = '\0';
+  assert(DT_iterBegin(NULL, &oIter) == SUCCESS);
+  while((pcNext = DT_iterNext(oIter)) != NULL) {
+    strcat(acWalk, pcNext);
+    strcat(acWalk, "\n");
+  }
+  assert(DT_iterNext(oIter) == NULL);
+  DT_iterEnd(oIter);
+  assert(!strcmp(temp, acWalk));
+  free(temp);
+  assert(DT_iterBegin("a/x/Grandx", &oIter) == SUCCESS);
+  assert(!strcmp(DT_iterNext(oIter), "a/x/Grandx"));
+  assert(!strcmp(DT_iterNext(oIter), "a/x/Grandx/Great_GrandX"));
+  assert(!strcmp(DT_iterNext(oIter), "a/x/Grandx/new"));
+  assert(DT_iterNext(oIter) == NULL);
+  DT_iterEnd(oIter);
+  assert(DT_iterBegin("a/y", &oIter) == NO_SUCH_PATH);
+  assert(oIter == NULL);
+  assert(DT_iterBegin("b/x", &oIter) == CONFLICTING_PATH);
+  assert(DT_iterBegin("a//x", &oIter) == BAD_PATH);
+  assert(DT_Snapshot_iterBegin(oSnap, "a/y", &oIter) == SUCCESS);
+  assert(!strcmp(DT_iterNext(oIter), "a/y"));
+  assert(!strcmp(DT_iterNext(oIter), "a/y/Grand0"));
+  assert(!strcmp(DT_iterNext(oIter), "a/y/Grand1"));
+  assert(!strcmp(DT_iterNext(oIter), "a/y/Grand1/Great_Grand"));
+  assert(!strcmp(DT_iterNext(oIter), "a/y/Grand2"));
+  assert(DT_iterNext(oIter) == NULL);
+  DT_iterEnd(oIter);
+  ulVisited = 0;
+  assert(DT_map(NULL, countDir, &ulVisited) == SUCCESS);
+  assert(ulVisited == 8);
+  ulVisited = 0;
+  assert(DT_map("a/y2", countDir, &ulVisited) == SUCCESS);
+  assert(ulVisited == 2);
+
+  /* find only reports matching directories, each once */
+  acWalk[0] = '\0';
+  assert(DT_find("a/*", appendDir, acWalk) == SUCCESS);
+  assert(!strcmp(acWalk, "a/x\na/y2\na/z\n"));
+  acWalk[0] = '\0';
+  assert(DT_find("a/[xz]", appendDir, acWalk) == SUCCESS);
+  assert(!strcmp(acWalk, "a/x\na/z\n"));
+  acWalk[0] = '\0';
+  assert(DT_find("a/y?/GRAND1", appendDir, acWalk) == SUCCESS);
+  assert(!strcmp(acWalk, "a/y2/GRAND1\n"));
+  acWalk[0] = '\0';
+  assert(DT_find("**/G*", appendDir, acWalk) == SUCCESS);
+  assert(!strcmp(acWalk, "a/x/Grandx\na/x/Grandx/Great_GrandX\n"
+                         "a/y2/GRAND1\n"));
+  acWalk[0] = '\0';
+  assert(DT_find("a/**/**/new", appendDir, acWalk) == SUCCESS);
+  assert(!strcmp(acWalk, "a/x/Grandx/new\n"));
+  acWalk[0] = '\0';
+  assert(DT_find("a/**", appendDir, acWalk) == SUCCESS);
+  assert((temp = DT_toString()) != NULL);
+  assert(!strcmp(temp, acWalk));
   free(temp);
+  acWalk[0] = '\0';
+  assert(DT_find("b/*", appendDir, acWalk) == SUCCESS);
+  assert(DT_find("a/x/Grandx/Great_GrandX/*", appendDir, acWalk)
+         == SUCCESS);
+  assert(acWalk[0] == '\0');
+  assert(DT_find("a//x", appendDir, acWalk) == BAD_PATH);
+
+  /* with two "**", a directory reached several ways is still visited
+     once, and matches come in toString order */
+  assert(DT_insert("a/b/b/c") == SUCCESS);
+  assert(DT_insert("a/b/c") == SUCCESS);
+  acWalk[0] = '\0';
+  assert(DT_find("a/**/b/**/c", appendDir, acWalk) == SUCCESS);
+  assert(!strcmp(acWalk, "a/b/b/c\na/b/c\n"));
+  acWalk[0] = '\0';
+  assert(DT_find("a/**/b/**", appendDir, acWalk) == SUCCESS);
+  assert(!strcmp(acWalk, "a/b\na/b/b\na/b/b/c\na/b/c\n"));
+  acWalk[0] = '\0';
+  assert(DT_find("a/b/**/*", appendDir, acWalk) == SUCCESS);
+  assert(!strcmp(acWalk, "a/b/b\na/b/b/c\na/b/c\n"));
+  assert(DT_rm("a/b") == SUCCESS);
+
+  /* subtree sizes, and ranks in toString order, both ways round */
+  assert(DT_subtreeSize("a", &ulVisited) == SUCCESS);
+  assert(ulVisited == 8);
+  assert(DT_subtreeSize("a/x", &ulVisited) == SUCCESS);
+  assert(ulVisited == 4);
+  assert(DT_subtreeSize("a/z", &ulVisited) == SUCCESS);
+  assert(ulVisited == 1);
+  assert(DT_subtreeSize("a/y", &ulVisited) == NO_SUCH_PATH);
+  acWalk[0] = '\0';
+  for(ulVisited = 0; (temp = DT_select(ulVisited)) != NULL;
+      ulVisited++) {
+    assert(DT_rankOf(temp, &ulRank) == SUCCESS);
+    assert(ulRank == ulVisited);
+    appendDir(temp, acWalk);
+    free(temp);
+  }
+  assert(ulVisited == 8);
+  assert((temp = DT_toString()) != NULL);
+  assert(!strcmp(temp, acWalk));
+  free(temp);
+  assert(DT_rankOf("a/y2/GRAND1", &ulRank) == SUCCESS);
+  assert(ulRank == 6);
+  assert(DT_rankOf("b", &ulRank) == CONFLICTING_PATH);
 
   assert(DT_destroy() == SUCCESS);
   assert(DT_destroy() == INITIALIZATION_ERROR);
   assert(DT_contains("a") == FALSE);
   assert((temp = DT_toString()) == NULL);
+  assert(DT_Snapshot_contains(oSnap, "a/x/Grandx/Great_GrandX") == TRUE);
+  DT_Snapshot_free(oSnap);
+  assert(DT_snapshot(&oSnap) == INITIALIZATION_ERROR);
+  assert(DT_iterBegin(NULL, &oIter) == INITIALIZATION_ERROR);
+  assert(DT_find("**", appendDir, acWalk) == INITIALIZATION_ERROR);
+  assert(DT_select(0) == NULL);
+  assert(DT_rankOf("a", &ulRank) == INITIALIZATION_ERROR);
+
+  /* Working through siblings resumes each traversal from the cursor
+     left by the one before, unless the build has no cursor at all;
+     only the first insert and the one into m/d2 start from the root */
+  assert(DT_init() == SUCCESS);
+  assert(DT_insert("m/d/e") == SUCCESS);
+  DT_getCursorStats(&ulHits0, &ulMisses0);
+  for(ulVisited = 0; ulVisited < 10; ulVisited++) {
+    sprintf(acWalk, "m/d/e/f%lu", (unsigned long) ulVisited);
+    assert(DT_insert(acWalk) == SUCCESS);
+    assert(DT_contains(acWalk) == TRUE);
+  }
+  assert(DT_rm("m/d/e/f3") == SUCCESS);
+  assert(DT_contains("m/d/e/f3") == FALSE);
+  assert(DT_contains("m/d/e/f4") == TRUE);
+  assert(DT_contains("m/d") == TRUE);
+  assert(DT_insert("m/d2/e") == SUCCESS);
+  DT_getCursorStats(&ulHits, &ulMisses);
+  assert((ulHits == 0 && ulMisses == 0) ||
+         (ulHits - ulHits0 == 23 && ulMisses - ulMisses0 == 2));
+  /* ranks are counted from the root, without consulting the cursor */
+  assert(DT_rankOf("m/d/e/f4", &ulRank) == SUCCESS);
+  assert((temp = DT_select(ulRank)) != NULL);
+  assert(!strcmp(temp, "m/d/e/f4"));
+  free(temp);
+  DT_getCursorStats(&ulHits0, &ulMisses0);
+  assert(ulHits0 == ulHits && ulMisses0 == ulMisses);
+  assert(DT_subtreeSize("m", &ulVisited) == SUCCESS);
+  assert(ulVisited == 14);
+
+  /* A saved image loads back as the same hierarchy, from a file or
+     from a pipe, while a bad image leaves the DT as it was */
+  assert((psImage = tmpfile()) != NULL);
+  assert(DT_save(fileno(psImage)) == SUCCESS);
+  assert((temp = DT_toString()) != NULL);
+  assert(DT_rm("m/d") == SUCCESS);
+  assert(DT_insert("m/other") == SUCCESS);
+  assert(DT_load(fileno(psImage)) == SUCCESS);
+  assert(fclose(psImage) == 0);
+  assert((snapTemp = DT_toString()) != NULL);
+  assert(!strcmp(temp, snapTemp));
+  free(snapTemp);
+  assert(DT_subtreeSize("m", &ulVisited) == SUCCESS);
+  assert(ulVisited == 14);
+  assert(DT_rankOf("m/d2/e", &ulRank) == SUCCESS);
+  assert(ulRank == 13);
+  assert(DT_contains("m/other") == FALSE);
+
+  /* ranks still agree with toString order where a directory has
+     enough children for their counts to span several levels */
+  acWalk[0] = '\0';
+  for(ulVisited = 0; (snapTemp = DT_select(ulVisited)) != NULL;
+      ulVisited++) {
+    assert(DT_rankOf(snapTemp, &ulRank) == SUCCESS);
+    assert(ulRank == ulVisited);
+    appendDir(snapTemp, acWalk);
+    free(snapTemp);
+  }
+  assert(ulVisited == 14);
+  assert(!strcmp(temp, acWalk));
+  assert(DT_rankOf("m/d/e/f4", &ulRank) == SUCCESS);
+  assert(ulRank == 6);
+
+  assert(pipe(aiPipe) == 0);
+  assert(DT_save(aiPipe[1]) == SUCCESS);
+  assert(close(aiPipe[1]) == 0);
+  assert(DT_rm("m") == SUCCESS);
+  assert(DT_load(aiPipe[0]) == SUCCESS);
+  assert(close(aiPipe[0]) == 0);
+  assert((snapTemp = DT_toString()) != NULL);
+  assert(!strcmp(temp, snapTemp));
+  free(snapTemp);
+
+  assert((psImage = tmpfile()) != NULL);
+  /* the record of "m" is cut off before its number of children */
+  assert(fwrite("DTI1\0\0\0\0\0\0\0\1\0\0\0\1m", 1, 17, psImage)
+         == 17);
+  assert(fflush(psImage) == 0);
+  assert(DT_load(fileno(psImage)) == BAD_FORMAT);
+  assert(fclose(psImage) == 0);
+  assert(DT_load(-1) == IO_ERROR);
+  assert((snapTemp = DT_toString()) != NULL);
+  assert(!strcmp(temp, snapTemp));
+  free(snapTemp);
+  free(temp);
+  assert(DT_destroy() == SUCCESS);
+  assert(DT_save(1) == INITIALIZATION_ERROR);
+
+  /* The changes journaled after an image replay on top of it, with
+     one write and one sync shared by each batch of four, and a record
+     cut off by a crash is left out */
+  assert(DT_init() == SUCCESS);
+  assert(DT_insert("j/a") == SUCCESS);
+  assert((psImage = tmpfile()) != NULL);
+  assert((psJournal = tmpfile()) != NULL);
+  assert(DT_save(fileno(psImage)) == SUCCESS);
+  assert(DT_journalSync() == INITIALIZATION_ERROR);
+  assert(DT_journalStart(fileno(psJournal), 4) == SUCCESS);
+  assert(DT_journalStart(fileno(psJournal), 4) == INITIALIZATION_ERROR);
+  for(ulVisited = 0; ulVisited < 10; ulVisited++) {
+    sprintf(acWalk, "j/a/b%lu/c", (unsigned long) ulVisited);
+    assert(DT_insert(acWalk) == SUCCESS);
+    assert(DT_insert(acWalk) == ALREADY_IN_TREE);
+  }
+  assert(DT_rm("j/a/b3") == SUCCESS);
+  assert(DT_rm("j/a/b3") == NO_SUCH_PATH);
+  assert(DT_mv("j/a/b4", "j/a/b3") == SUCCESS);
+  DT_getJournalStats(&ulVisited, &ulHits, &ulMisses);
+  assert(ulVisited == 12 && ulHits == 3 && ulMisses == 3);
+  assert(DT_journalStop() == SUCCESS);
+  assert(DT_journalStop() == INITIALIZATION_ERROR);
+  assert(write(fileno(psJournal), "\1\0\0\0\7j/a/b", 10) == 10);
+  assert((temp = DT_toString()) != NULL);
+  assert(DT_destroy() == SUCCESS);
+
+  assert(DT_init() == SUCCESS);
+  assert(DT_insert("other") == SUCCESS);
+  assert(lseek(fileno(psJournal), 0, SEEK_SET) == 0);
+  assert(DT_recover(fileno(psImage), fileno(psJournal)) == SUCCESS);
+  assert((snapTemp = DT_toString()) != NULL);
+  assert(!strcmp(temp, snapTemp));
+  free(snapTemp);
+  free(temp);
+  assert(DT_contains("j/a/b3/c") == TRUE);
+  assert(DT_contains("j/a/b4") == FALSE);
+  assert(DT_contains("j/a/b9/c") == TRUE);
+  assert(fclose(psImage) == 0);
+
+  /* the journal does not fit an image of another hierarchy */
+  assert(DT_destroy() == SUCCESS);
+  assert(DT_init() == SUCCESS);
+  assert(DT_insert("other") == SUCCESS);
+  assert((psImage = tmpfile()) != NULL);
+  assert(DT_save(fileno(psImage)) == SUCCESS);
+  assert(lseek(fileno(psJournal), 0, SEEK_SET) == 0);
+  assert(DT_recover(fileno(psImage), fileno(psJournal)) == BAD_FORMAT);
+  assert(DT_contains("other") == TRUE);
+  assert(DT_contains("j") == FALSE);
+  assert(fclose(psJournal) == 0);
+  assert(fclose(psImage) == 0);
+  assert(DT_destroy() == SUCCESS);
+
+  /* A move relinks a whole subtree, whose paths follow it, and keeps
+     subtree sizes and ranks; a live snapshot keeps the old paths */
+  assert(DT_mv("r/a", "r/b") == INITIALIZATION_ERROR);
+  assert(DT_init() == SUCCESS);
+  assert(DT_mv("r/a", "r/b") == NO_SUCH_PATH);
+  assert(DT_insert("r/a/b/c") == SUCCESS);
+  assert(DT_insert("r/a/b/d") == SUCCESS);
+  assert(DT_insert("r/z") == SUCCESS);
+  assert(DT_mv("r/a", "r/a") == ALREADY_IN_TREE);
+  assert(DT_mv("r/a", "r/z") == ALREADY_IN_TREE);
+  assert(DT_mv("r/a", "r/a/b/e") == CONFLICTING_PATH);
+  assert(DT_mv("r", "r/z/r") == CONFLICTING_PATH);
+  assert(DT_mv("r", "s") == CONFLICTING_PATH);
+  assert(DT_mv("r/a", "s/a") == CONFLICTING_PATH);
+  assert(DT_mv("r/a", "r/y/a") == NO_SUCH_PATH);
+  assert(DT_mv("r/q", "r/q2") == NO_SUCH_PATH);
+  assert(DT_mv("r/a", "r//a") == BAD_PATH);
+  assert(DT_mv("r/a/b", "r/z/b2") == SUCCESS);
+  assert(DT_contains("r/a/b") == FALSE);
+  assert(DT_contains("r/z/b2/c") == TRUE);
+  assert(DT_mv("r/z", "r/a/z") == SUCCESS);
+  assert(DT_contains("r/a/z/b2/d") == TRUE);
+  assert((temp = DT_toString()) != NULL);
+  assert(!strcmp(temp, "r\nr/a\nr/a/z\nr/a/z/b2\nr/a/z/b2/c\n"
+                       "r/a/z/b2/d\n"));
+  free(temp);
+  assert(DT_subtreeSize("r", &ulVisited) == SUCCESS);
+  assert(ulVisited == 6);
+  assert(DT_subtreeSize("r/a", &ulVisited) == SUCCESS);
+  assert(ulVisited == 5);
+  assert(DT_rankOf("r/a/z/b2/d", &ulRank) == SUCCESS);
+  assert(ulRank == 5);
+
+  assert(DT_snapshot(&oSnap) == SUCCESS);
+  assert(DT_mv("r/a/z/b2", "r/b2") == SUCCESS);
+  assert(DT_contains("r/b2/c") == TRUE);
+  assert(DT_Snapshot_contains(oSnap, "r/a/z/b2/c") == TRUE);
+  assert(DT_Snapshot_contains(oSnap, "r/b2") == FALSE);
+  assert((temp = DT_Snapshot_toString(oSnap)) != NULL);
+  assert(!strcmp(temp, "r\nr/a\nr/a/z\nr/a/z/b2\nr/a/z/b2/c\n"
+                       "r/a/z/b2/d\n"));
+  free(temp);
+  DT_Snapshot_free(oSnap);
+  assert(DT_mv("r/b2", "r/a/b3") == SUCCESS);
+  assert(DT_contains("r/a/b3/d") == TRUE);
+  assert(DT_subtreeSize("r/a", &ulVisited) == SUCCESS);
+  assert(ulVisited == 5);
+  assert(DT_rankOf("r/a/z", &ulRank) == SUCCESS);
+  assert(ulRank == 5);
+  assert(DT_destroy() == SUCCESS);
+
+  /* Stats describe the shape of the hierarchy as it is now, leaving
+     out directories that only a snapshot holds */
+  assert(DT_getStats(&sStats) == INITIALIZATION_ERROR);
+  assert(DT_init() == SUCCESS);
+  assert(DT_getStats(&sStats) == SUCCESS);
+  assert(sStats.ulNodes == 0);
+  assert(sStats.ulPathBytes == 0 && sStats.ulNodeBytes == 0);
+  assert(DT_insert("r/a/b/c") == SUCCESS);
+  assert(DT_insert("r/a/d") == SUCCESS);
+  assert(DT_insert("r/e") == SUCCESS);
+  assert(DT_getStats(&sStats) == SUCCESS);
+  assert(sStats.ulNodes == 6);
+  assert(sStats.ulMaxDepth == 4);
+  assert(sStats.ulDepthSum == 15);
+  assert(sStats.aulFanout[0] == 3);
+  assert(sStats.aulFanout[1] == 1);
+  assert(sStats.aulFanout[2] == 2);
+  assert(sStats.aulFanout[3] == 0);
+  assert(sStats.ulPathBytes > 0 && sStats.ulNodeBytes > 0);
+  assert(sStats.ulChildBytes > 0);
+  assert(DT_mv("r/a/b", "r/e/b") == SUCCESS);
+  assert(DT_getStats(&sStats) == SUCCESS);
+  assert(sStats.ulNodes == 6);
+  assert(sStats.ulDepthSum == 15);
+  assert(sStats.aulFanout[0] == 2);
+  assert(sStats.aulFanout[1] == 3);
+  assert(sStats.aulFanout[2] == 1);
+  assert(DT_snapshot(&oSnap) == SUCCESS);
+  assert(DT_rm("r/a") == SUCCESS);
+  assert(DT_getStats(&sStats) == SUCCESS);
+  assert(sStats.ulNodes == 4);
+  assert(sStats.ulMaxDepth == 4);
+  assert(sStats.ulDepthSum == 10);
+  DT_Snapshot_free(oSnap);
+  assert(DT_destroy() == SUCCESS);
+
+  /* Metrics builds have timed every operation so far, apart for each
+     status; other builds write nothing */
+  assert((psImage = tmpfile()) != NULL);
+  DT_dumpMetrics(psImage);
+#ifdef DT_METRICS
+  assert(ftell(psImage) > 0);
+  rewind(psImage);
+  ulLines = 0;
+  while(fgets(acWalk, sizeof(acWalk), psImage) != NULL)
+    if(!strncmp(acWalk, "DT_insert SUCCESS: ", 19) ||
+       !strncmp(acWalk, "DT_insert ALREADY_IN_TREE: ", 27) ||
+       !strncmp(acWalk, "DT_contains NO_SUCH_PATH: ", 26))
+      ulLines++;
+  assert(ulLines == 3);
+#else
+  assert(ftell(psImage) == 0);
+#endif
+  assert(fclose(psImage) == 0);
+
+  /* Allocations go through the installed allocator and are counted
+     against their sites; strings handed to the client are counted
+     but not live, and destroying the DT frees everything it held */
+  Alloc_getModuleStats(ALLOC_PATH, &sPaths);
+  Alloc_getModuleStats(ALLOC_NODE, &sNodes);
+  Alloc_setFunctions(&sCounting);
+  assert(DT_init() == SUCCESS);
+  assert(DT_insert("a/b/c") == SUCCESS);
+  assert(ulClientAllocs > 0);
+  Alloc_getModuleStats(ALLOC_PATH, &sAlloc);
+  assert(sAlloc.ulAllocs > sPaths.ulAllocs);
+  assert(sAlloc.ulLiveBytes > sPaths.ulLiveBytes);
+  assert(sAlloc.ulPeakBytes >= sAlloc.ulLiveBytes);
+  Alloc_getSiteStats(ALLOC_PATH_COMPONENT, &sAlloc);
+  assert(sAlloc.ulLiveBytes > 0);
+  assert(Alloc_getModule(ALLOC_PATH_COMPONENT) == ALLOC_PATH);
+  Alloc_getSiteStats(ALLOC_TREE_STRING, &sAlloc);
+  ulVisited = sAlloc.ulAllocs;
+  assert((temp = DT_toString()) != NULL);
+  free(temp);
+  Alloc_getSiteStats(ALLOC_TREE_STRING, &sAlloc);
+  assert(sAlloc.ulAllocs == ulVisited + 1);
+  assert(sAlloc.ulLiveBytes == 0);
+  assert(DT_destroy() == SUCCESS);
+  Alloc_setFunctions(NULL);
+  Alloc_getModuleStats(ALLOC_PATH, &sAlloc);
+  assert(sAlloc.ulLiveBytes == sPaths.ulLiveBytes);
+  Alloc_getModuleStats(ALLOC_NODE, &sAlloc);
+  assert(sAlloc.ulLiveBytes == sNodes.ulLiveBytes);
+  assert((psImage = tmpfile()) != NULL);
+  Alloc_write(psImage);
+  assert(ftell(psImage) > 0);
+  assert(fclose(psImage) == 0);
+
+#ifdef DT_MAPPED
+  /* A mapped DT stays in its file when closed, and opening the file
+     again finds it as it was at the close */
+  (void) remove("dt_client.region");
+  assert(DT_open("dt_client.region") == SUCCESS);
+  assert(DT_open("dt_client.region") == INITIALIZATION_ERROR);
+  assert(DT_insert("m/d/e") == SUCCESS);
+  assert(DT_insert("m/d2") == SUCCESS);
+  assert(DT_checkpoint() == SUCCESS);
+  assert(DT_insert("m/d3") == SUCCESS);
+  assert((temp = DT_toString()) != NULL);
+  assert(DT_close() == SUCCESS);
+  assert(DT_close() == INITIALIZATION_ERROR);
+  assert(DT_checkpoint() == INITIALIZATION_ERROR);
+  assert(DT_contains("m") == FALSE);
+
+  assert(DT_open("dt_client.region") == SUCCESS);
+  assert((snapTemp = DT_toString()) != NULL);
+  assert(!strcmp(temp, snapTemp));
+  free(snapTemp);
+  free(temp);
+  assert(DT_subtreeSize("m", &ulVisited) == SUCCESS);
+  assert(ulVisited == 5);
+  assert(DT_rm("m/d") == SUCCESS);
+  assert(DT_insert("m/d4/f") == SUCCESS);
+  assert(DT_close() == SUCCESS);
+
+  assert(DT_open("dt_client.region") == SUCCESS);
+  assert(DT_contains("m/d/e") == FALSE);
+  assert(DT_contains("m/d4/f") == TRUE);
+  assert(DT_rankOf("m/d4/f", &ulRank) == SUCCESS);
+  assert(ulRank == 4);
+  assert(DT_destroy() == SUCCESS);
+  assert(DT_open("dt_client.region") == SUCCESS);
+  assert(DT_contains("m") == FALSE);
+  assert(DT_close() == SUCCESS);
+
+  assert((psImage = fopen("dt_client.region", "w")) != NULL);
+  assert(fputs("not a DT", psImage) != EOF);
+  assert(fclose(psImage) == 0);
+  assert(DT_open("dt_client.region") == BAD_FORMAT);
+  assert(DT_contains("m") == FALSE);
+  assert(remove("dt_client.region") == 0);
+#endif
 
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,168 @@
+/*--------------------------------------------------------------------*/
+/* dt_mtclient.c                                                      */
+/* Author: Christopher Moretti                                        */
+/*--------------------------------------------------------------------*/
+
+/* fileno and lseek are POSIX.1 interfaces */
+#define _POSIX_C_SOURCE 200112L
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "dt.h"
+
+/* The number of writer threads, each owning one top-level directory */
+enum {NUM_THREADS = 8};
+/* The number of directories each thread inserts per round */
+enum {NUM_DIRS = 200};
+/* The number of insert-then-remove rounds each thread performs */
+enum {NUM_ROUNDS = 5};
+
+/* Inserts, removes and moves directories underneath root/tN, where N
+   is the thread number pointed to by pvArg, checking every status.
+   Other threads work in sibling subtrees at the same time. Returns
+   NULL. */
+static void *writeSubtree(void *pvArg) {
+  enum {BUFLEN = 64};
+  char acPath[BUFLEN];
+  char acMoved[BUFLEN];
+  int iThread = *(int *) pvArg;
+  int iRound, iDir;
+
+  for(iRound = 0; iRound < NUM_ROUNDS; iRound++) {
+    for(iDir = 0; iDir < NUM_DIRS; iDir++) {
+      sprintf(acPath, "root/t%d/d%d/leaf", iThread, iDir);
+      assert(DT_insert(acPath) == SUCCESS);
+      assert(DT_insert(acPath) == ALREADY_IN_TREE);
+      assert(DT_contains(acPath) == TRUE);
+    }
+    for(iDir = 0; iDir < NUM_DIRS; iDir += 2) {
+      sprintf(acPath, "root/t%d/d%d", iThread, iDir);
+      assert(DT_rm(acPath) == SUCCESS);
+      assert(DT_contains(acPath) == FALSE);
+    }
+    /* a move there and back leaves the other threads' paths stale
+       for them to check under their own locks */
+    sprintf(acPath, "root/t%d/d1", iThread);
+    sprintf(acMoved, "root/t%d/moved", iThread);
+    assert(DT_mv(acPath, acMoved) == SUCCESS);
+    assert(DT_mv(acPath, acMoved) == NO_SUCH_PATH);
+    assert(DT_mv(acMoved, acPath) == SUCCESS);
+    if(iRound + 1 < NUM_ROUNDS) {
+      sprintf(acPath, "root/t%d", iThread);
+      assert(DT_rm(acPath) == SUCCESS);
+    }
+  }
+  return NULL;
+}
+
+/* Runs NUM_THREADS writers against disjoint subtrees of one DT while
+   taking snapshots of it and journaling the changes, then checks that
+   exactly the expected directories survived and that replaying the
+   journal rebuilds them. Returns 0. */
+int main(void) {
+  pthread_t aThreads[NUM_THREADS];
+  int aiIds[NUM_THREADS];
+  char *temp;
+  char *pcLine;
+  size_t ulLines = 0;
+  DT_Snapshot_T oSnap;
+  DT_Iter_T oIter;
+  size_t ulWalked;
+  FILE *psImage;
+  FILE *psJournal;
+  size_t ulRecords, ulBatches, ulSyncs;
+  int iStatus;
+  int i;
+
+  assert(DT_init() == SUCCESS);
+  assert(DT_insert("root") == SUCCESS);
+  assert((psImage = tmpfile()) != NULL);
+  assert((psJournal = tmpfile()) != NULL);
+  assert(DT_save(fileno(psImage)) == SUCCESS);
+  assert(DT_journalStart(fileno(psJournal), 64) == SUCCESS);
+
+  for(i = 0; i < NUM_THREADS; i++) {
+    aiIds[i] = i;
+    assert(pthread_create(&aThreads[i], NULL, writeSubtree,
+                          &aiIds[i]) == 0);
+  }
+  /* snapshots taken mid-flight must stay readable while the writers
+     copy the paths they change */
+  for(i = 0; i < NUM_ROUNDS * 4; i++) {
+    assert(DT_snapshot(&oSnap) == SUCCESS);
+    assert(DT_Snapshot_contains(oSnap, "root") == TRUE);
+    assert((temp = DT_Snapshot_toString(oSnap)) != NULL);
+    /* iterating a snapshot does not block the writers */
+    assert(DT_Snapshot_iterBegin(oSnap, NULL, &oIter) == SUCCESS);
+    for(ulWalked = 0; DT_iterNext(oIter) != NULL; ulWalked++)
+      ;
+    DT_iterEnd(oIter);
+    for(pcLine = temp; *pcLine != '\0'; pcLine++)
+      if(*pcLine == '\n')
+        ulWalked--;
+    assert(ulWalked == 0);
+    free(temp);
+    DT_Snapshot_free(oSnap);
+    /* ranking and selecting read the counts the writers update */
+    assert(DT_rankOf("root", &ulWalked) == SUCCESS);
+    assert(ulWalked == 0);
+    assert((temp = DT_select(0)) != NULL);
+    assert(!strcmp(temp, "root"));
+    free(temp);
+    if((temp = DT_select(1 + (size_t) i * NUM_DIRS / 4)) != NULL) {
+      assert(!strncmp(temp, "root/t", 6));
+      iStatus = DT_rankOf(temp, &ulWalked);
+      assert(iStatus == SUCCESS || iStatus == NO_SUCH_PATH);
+      free(temp);
+    }
+  }
+
+  for(i = 0; i < NUM_THREADS; i++)
+    assert(pthread_join(aThreads[i], NULL) == 0);
+
+  /* root, plus per thread: tN and half of the dN/leaf pairs */
+  assert((temp = DT_toString()) != NULL);
+  for(pcLine = temp; *pcLine != '\0'; pcLine++)
+    if(*pcLine == '\n')
+      ulLines++;
+  assert(ulLines == 1 + NUM_THREADS * (1 + NUM_DIRS));
+  free(temp);
+  assert(DT_subtreeSize("root", &ulWalked) == SUCCESS);
+  assert(ulWalked == ulLines);
+  assert(DT_subtreeSize("root/t3", &ulWalked) == SUCCESS);
+  assert(ulWalked == 1 + NUM_DIRS);
+
+  assert(DT_contains("root/t0/d1/leaf") == TRUE);
+  assert(DT_contains("root/t0/d0") == FALSE);
+
+  /* every change was journaled, in an order that replays to the same
+     hierarchy */
+  DT_getJournalStats(&ulRecords, &ulBatches, &ulSyncs);
+  assert(ulRecords == NUM_THREADS *
+         (NUM_ROUNDS * (NUM_DIRS + NUM_DIRS / 2 + 2) + NUM_ROUNDS - 1));
+  assert(ulSyncs == ulRecords / 64);
+  /* group commit wrote them in far fewer batches than records */
+  assert(ulBatches > 0 && ulBatches <= ulRecords / 64 + 1);
+  assert(DT_journalStop() == SUCCESS);
+  assert((temp = DT_toString()) != NULL);
+  assert(DT_destroy() == SUCCESS);
+  assert(DT_init() == SUCCESS);
+  assert(lseek(fileno(psImage), 0, SEEK_SET) == 0);
+  assert(lseek(fileno(psJournal), 0, SEEK_SET) == 0);
+  assert(DT_recover(fileno(psImage), fileno(psJournal)) == SUCCESS);
+  assert((pcLine = DT_toString()) != NULL);
+  assert(strcmp(temp, pcLine) == 0);
+  free(pcLine);
+  free(temp);
+  assert(fclose(psJournal) == 0);
+  assert(fclose(psImage) == 0);
+  assert(DT_destroy() == SUCCESS);
+
+  fprintf(stderr, "%d threads finished consistently\n", NUM_THREADS);
+  return 0;
+}
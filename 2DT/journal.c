@@ -0,0 +1 @@
+../0shared/journal.c
\ No newline at end of file
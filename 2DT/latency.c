@@ -0,0 +1 @@
+../0shared/latency.c
\ No newline at end of file
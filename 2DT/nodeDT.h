@@ -29,13 +29,78 @@ typedef struct node *Node_T;
 int Node_new(Path_T oPPath, Node_T oNParent, Node_T *poNResult);
 
 /*
-  Destroys and frees all memory allocated for the subtree rooted at
-  oNNode, i.e., deletes this node and all its descendents. Returns the
-  number of nodes deleted.
+  Removes the subtree rooted at oNNode from the hierarchy, i.e.,
+  deletes this node and all its descendents, freeing every node that
+  no snapshot still shares. Returns the number of nodes deleted.
+
+  In DT_CONCURRENT builds the caller must hold the locks of oNNode and
+  of its parent (if any). Each descendent is locked before it is
+  freed, so this waits for other threads to leave the subtree.
 */
 size_t Node_free(Node_T oNNode);
 
-/* Returns the path object representing oNNode's absolute path. */
+/*
+  Adds a reference to the subtree rooted at oNNode on behalf of a
+  snapshot. The snapshot's nodes are shared with the hierarchy until
+  a writer makes its own copy with Node_unshare. Returns oNNode.
+*/
+Node_T Node_share(Node_T oNNode);
+
+/*
+  Drops a reference taken by Node_share, freeing every node of the
+  subtree that neither the hierarchy nor another snapshot refers to.
+*/
+void Node_release(Node_T oNNode);
+
+/*
+  Makes oNNode, a child of oNParent (or the root if oNParent is NULL),
+  safe to modify in place. If a snapshot shares oNNode, a copy that in
+  turn shares oNNode's children replaces it in oNParent's children.
+  oNParent must itself be safe to modify. Returns an int SUCCESS
+  status and sets *poNResult to the node to modify. Otherwise, sets
+  *poNResult to NULL and returns status:
+  * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+int Node_unshare(Node_T oNParent, Node_T oNNode, Node_T *poNResult);
+
+/*
+  Moves oNNode, which must not be the root, from its parent to
+  oNNewParent, which must be neither oNNode nor a descendent of it,
+  and gives it path oPNewPath, which must be that of a child that
+  oNNewParent does not have yet. The paths of oNNode's descendents
+  are rewritten only when Node_getPath next asks for each of them, so
+  the move takes time proportional to the depth of the paths rather
+  than to the size of the subtree. If bShared, a snapshot may share
+  nodes of the subtree; those are then copied and every path in the
+  subtree rewritten at once, so that the snapshot keeps the old ones.
+  In DT_MAPPED builds the depths stored in the subtree are rewritten
+  at once either way. Subtree sizes are left to the caller.
+  Returns SUCCESS, or MEMORY_ERROR if memory could not be allocated,
+  in which case the hierarchy is unchanged but for the copies.
+
+  In DT_CONCURRENT builds the caller must hold the DT exclusively.
+*/
+int Node_move(Node_T oNNode, Node_T oNNewParent, Path_T oPNewPath,
+              boolean bShared);
+
+/*
+  Rewrites every path under oNRoot, which may be NULL, that has been
+  left to be rewritten lazily by Node_move, so that the hierarchy can
+  be shared with a snapshot. Takes time proportional to the size of
+  the hierarchy if a node has been moved since the last call, and
+  constant time otherwise. Returns SUCCESS, or MEMORY_ERROR if memory
+  could not be allocated.
+*/
+int Node_settlePaths(Node_T oNRoot);
+
+/*
+  Returns the path object representing oNNode's absolute path.
+  The path of a node with an ancestor moved by Node_move is rebuilt
+  the first time it is asked for afterwards, as is every path in
+  DT_MAPPED builds, and NULL is returned if memory could not be
+  allocated for it. In DT_CONCURRENT builds that first time must be
+  while holding the lock of oNNode's parent, as traversals do.
+*/
 Path_T Node_getPath(Node_T oNNode);
 
 /*
@@ -62,6 +127,59 @@ size_t Node_getNumChildren(Node_T oNParent);
 int Node_getChild(Node_T oNParent, size_t ulChildID,
                   Node_T *poNResult);
 
+/*
+  Returns the number of nodes in the subtree rooted at oNNode,
+  counting oNNode itself.
+*/
+size_t Node_getSubtreeSize(Node_T oNNode);
+
+/*
+  Adds ulDelta to the subtree size of oNNode, and to the cumulative
+  sizes that oNNode's parent keeps of its children's subtrees. Nodes
+  only count themselves when created, so the caller updates every
+  ancestor of the nodes it adds or frees, using Node_shrinkSubtree for
+  the latter. In DT_CONCURRENT builds the update is atomic, and may be
+  made without holding the lock of oNNode or of its parent.
+*/
+void Node_growSubtree(Node_T oNNode, size_t ulDelta);
+
+/* Subtracts ulDelta from the subtree size of oNNode. */
+void Node_shrinkSubtree(Node_T oNNode, size_t ulDelta);
+
+/*
+  Returns the number of nodes in the subtrees of the children of
+  oNParent before the child with identifier ulChildID, in time
+  logarithmic in the number of children. In DT_CONCURRENT builds the
+  caller must hold oNParent's lock.
+*/
+size_t Node_countBefore(Node_T oNParent, size_t ulChildID);
+
+/*
+  Returns the identifier of the child of oNParent whose subtree holds
+  the node at position ulRank among the nodes of all the children's
+  subtrees, taken in order, and stores in *pulBefore the number of
+  nodes in the subtrees of the children before it. Returns the number
+  of children if their subtrees hold no more than ulRank nodes. Takes
+  time logarithmic in the number of children. In DT_CONCURRENT builds
+  the caller must hold oNParent's lock.
+*/
+size_t Node_findRank(Node_T oNParent, size_t ulRank,
+                     size_t *pulBefore);
+
+/*
+  Stores in *pulNodeBytes the bytes of memory that oNNode itself
+  occupies, in *pulPathBytes those that its path occupies, and in
+  *pulChildBytes those that its array of children and their
+  cumulative subtree sizes occupy, with
+  *pulSlack set to the number of slots in that array holding no
+  child. Paths left stale by Node_move are measured as they are. In
+  DT_MAPPED builds the bytes are those of the blocks in the region,
+  and a path counts as its name plus its cached path object, if any.
+*/
+void Node_getFootprint(Node_T oNNode, size_t *pulNodeBytes,
+                       size_t *pulPathBytes, size_t *pulChildBytes,
+                       size_t *pulSlack);
+
 /*
   Returns a the parent node of oNNode.
   Returns NULL if oNNode is the root and thus has no parent.
@@ -84,4 +202,48 @@ int Node_compare(Node_T oNFirst, Node_T oNSecond);
 */
 char *Node_toString(Node_T oNNode);
 
+#ifdef DT_MAPPED
+/*
+  Maps the region of nodes stored in file pcFile, creating the file
+  with an empty region if it is empty or does not exist, or maps a
+  new region in an anonymous temporary file if pcFile is NULL. Every
+  node is then created in, and freed back to, that region until
+  Node_closeRegion. Opening takes constant time however many nodes
+  the region holds. Returns SUCCESS and sets *poNRoot and *pulCount
+  to the root node and number of nodes recorded by the last
+  Node_syncRegion (NULL and 0 for a new region). Otherwise returns:
+  * IO_ERROR if the file cannot be opened, created or mapped
+  * BAD_FORMAT if the file does not hold a region
+  * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+int Node_openRegion(const char *pcFile, Node_T *poNRoot,
+                    size_t *pulCount);
+
+/*
+  Records oNRoot and ulCount as the root node and number of nodes of
+  the open region, then writes the whole region back to its file.
+  Returns SUCCESS, or IO_ERROR if it cannot be written.
+*/
+int Node_syncRegion(Node_T oNRoot, size_t ulCount);
+
+/*
+  Unmaps the open region without freeing its nodes, which stay in its
+  file (unless it was anonymous), and closes the file. Every Node_T
+  of the region is invalid afterwards.
+*/
+void Node_closeRegion(void);
+#endif
+
+#ifdef DT_CONCURRENT
+/*
+  Acquires the lock of oNNode, blocking until it is available.
+  Locks are taken hand-over-hand from the root downwards, so a thread
+  holding a node's lock may then lock any of that node's children.
+*/
+void Node_lock(Node_T oNNode);
+
+/* Releases the lock of oNNode, which the caller must hold. */
+void Node_unlock(Node_T oNNode);
+#endif
+
 #endif
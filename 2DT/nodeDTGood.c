@@ -6,8 +6,12 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
+#ifdef DT_CONCURRENT
+#include <pthread.h>
+#endif
 #include "dynarray.h"
 #include "nodeDT.h"
+#include "alloc.h"
 #include "checkerDT.h"
 
 /* A node in a DT */
@@ -18,8 +22,134 @@ struct node {
    Node_T oNParent;
    /* the object containing links to this node's children */
    DynArray_T oDChildren;
+   /* the number of references to this node: one from the hierarchy
+      or from a parent, plus one per snapshot sharing it directly */
+   size_t ulRefs;
+   /* the number of nodes in the subtree rooted at this node */
+   size_t ulSubtree;
+   /* the subtree sizes of the children, cumulated as a Fenwick tree:
+      entry i sums those of the children from index i + 1 - b to
+      index i, b being the lowest bit set in i + 1 */
+   size_t *pulCounts;
+   /* the number of entries pulCounts has room for */
+   size_t ulCountsCapacity;
+   /* this node's index among its parent's children */
+   size_t ulIndex;
+   /* the number of times oPPath has been rewritten for a move */
+   size_t ulPathVersion;
+   /* the parent's ulPathVersion when oPPath was last written */
+   size_t ulParentVersion;
+   /* the value of ulMoves when oPPath was last found to be current */
+   size_t ulCheckedAt;
+#ifdef DT_CONCURRENT
+   /* the lock protecting oDChildren, taken hand-over-hand */
+   pthread_mutex_t sLock;
+   /* the lock protecting pulCounts and the children's ulIndex and
+      ulSubtree against writers further down, who hold no lock here;
+      no other lock is ever taken while holding it */
+   pthread_mutex_t sCountLock;
+#endif
 };
 
+/* The number of moves so far whose subtrees' paths are rewritten
+   lazily. A node checked since the last of them has a current path;
+   any other has one if its parent does and its parent's path has not
+   been rewritten since the node's was written. */
+static size_t ulMoves;
+/* The value of ulMoves at the last Node_settlePaths */
+static size_t ulSettled;
+
+
+/* Reference counts and subtree sizes are shared between threads in
+   DT_CONCURRENT builds, so they are only ever changed atomically
+   there. Subtree sizes are only read while the DT is locked
+   exclusively, so they need no ordering. */
+#ifdef DT_CONCURRENT
+#define Node_incRefs(oNNode) \
+   __atomic_add_fetch(&(oNNode)->ulRefs, 1, __ATOMIC_RELAXED)
+#define Node_decRefs(oNNode) \
+   __atomic_sub_fetch(&(oNNode)->ulRefs, 1, __ATOMIC_ACQ_REL)
+#define Node_getRefs(oNNode) \
+   __atomic_load_n(&(oNNode)->ulRefs, __ATOMIC_ACQUIRE)
+#define Node_loadSubtree(oNNode) \
+   __atomic_load_n(&(oNNode)->ulSubtree, __ATOMIC_RELAXED)
+#define Node_lockCounts(oNNode) \
+   ((void) pthread_mutex_lock(&(oNNode)->sCountLock))
+#define Node_unlockCounts(oNNode) \
+   ((void) pthread_mutex_unlock(&(oNNode)->sCountLock))
+#else
+#define Node_incRefs(oNNode) (++(oNNode)->ulRefs)
+#define Node_decRefs(oNNode) (--(oNNode)->ulRefs)
+#define Node_getRefs(oNNode) ((oNNode)->ulRefs)
+#define Node_loadSubtree(oNNode) ((oNNode)->ulSubtree)
+#define Node_lockCounts(oNNode) ((void) 0)
+#define Node_unlockCounts(oNNode) ((void) 0)
+#endif
+
+/* The lowest bit set in ulIndex, which is how many children the
+   Fenwick entry at one-based index ulIndex sums */
+#define Node_lowBit(ulIndex) ((ulIndex) & (~(ulIndex) + 1))
+
+/*
+  Makes room in oNParent's cumulative counts for at least ulCapacity
+  children. Returns SUCCESS or MEMORY_ERROR.
+*/
+static int Node_reserveCounts(Node_T oNParent, size_t ulCapacity) {
+   size_t *pulGrown;
+
+   assert(oNParent != NULL);
+
+   if(ulCapacity <= oNParent->ulCountsCapacity)
+      return SUCCESS;
+   if(ulCapacity < 2 * oNParent->ulCountsCapacity)
+      ulCapacity = 2 * oNParent->ulCountsCapacity;
+
+   pulGrown = Alloc_realloc(ALLOC_NODE_COUNTS, oNParent->pulCounts,
+                            oNParent->ulCountsCapacity * sizeof(size_t),
+                            ulCapacity * sizeof(size_t));
+   if(pulGrown == NULL)
+      return MEMORY_ERROR;
+   oNParent->pulCounts = pulGrown;
+   oNParent->ulCountsCapacity = ulCapacity;
+   return SUCCESS;
+}
+
+/*
+  Rebuilds the cumulative counts of oNParent's children from index
+  ulFrom on, and the indices those children keep, after children from
+  there on have been added or removed. Only the entries before ulFrom
+  that sum children from ulFrom on need their counts added again, and
+  those are the ones a prefix sum up to ulFrom reads, so this takes
+  time linear in the number of children from ulFrom on.
+*/
+static void Node_recount(Node_T oNParent, size_t ulFrom) {
+   size_t ulLength;
+   size_t ulIndex, ulNext;
+
+   assert(oNParent != NULL);
+
+   ulLength = DynArray_getLength(oNParent->oDChildren);
+   assert(ulLength <= oNParent->ulCountsCapacity);
+   for(ulIndex = ulFrom; ulIndex < ulLength; ulIndex++) {
+      Node_T oNChild = DynArray_get(oNParent->oDChildren, ulIndex);
+      oNChild->ulIndex = ulIndex;
+      oNParent->pulCounts[ulIndex] = Node_loadSubtree(oNChild);
+   }
+
+   /* each entry, one-based, adds its sum to the next one covering it */
+   for(ulIndex = ulFrom; ulIndex > 0; ulIndex -= Node_lowBit(ulIndex)) {
+      ulNext = ulIndex + Node_lowBit(ulIndex);
+      if(ulNext <= ulLength)
+         oNParent->pulCounts[ulNext - 1] +=
+            oNParent->pulCounts[ulIndex - 1];
+   }
+   for(ulIndex = ulFrom + 1; ulIndex <= ulLength; ulIndex++) {
+      ulNext = ulIndex + Node_lowBit(ulIndex);
+      if(ulNext <= ulLength)
+         oNParent->pulCounts[ulNext - 1] +=
+            oNParent->pulCounts[ulIndex - 1];
+   }
+}
 
 /*
   Links new child oNChild into oNParent's children array at index
@@ -28,27 +158,60 @@ struct node {
 */
 static int Node_addChild(Node_T oNParent, Node_T oNChild,
                          size_t ulIndex) {
+   boolean bAdded = FALSE;
+
    assert(oNParent != NULL);
    assert(oNChild != NULL);
 
-   if(DynArray_addAt(oNParent->oDChildren, ulIndex, oNChild))
+   /* inserters below other children update the counts concurrently,
+      so even growing them takes the count lock */
+   Node_lockCounts(oNParent);
+   if(Node_reserveCounts(oNParent,
+         DynArray_getLength(oNParent->oDChildren) + 1) == SUCCESS)
+      bAdded = (boolean) DynArray_addAt(oNParent->oDChildren, ulIndex,
+                                        oNChild);
+   if(bAdded)
+      Node_recount(oNParent, ulIndex);
+   Node_unlockCounts(oNParent);
+
+   if(bAdded)
       return SUCCESS;
    else
       return MEMORY_ERROR;
 }
 
+/* Unlinks the child at index ulIndex of oNParent's children array. */
+static void Node_removeChild(Node_T oNParent, size_t ulIndex) {
+   assert(oNParent != NULL);
+
+   Node_lockCounts(oNParent);
+   (void) DynArray_removeAt(oNParent->oDChildren, ulIndex);
+   Node_recount(oNParent, ulIndex);
+   Node_unlockCounts(oNParent);
+}
+
 /*
-  Compares the string representation of oNfirst with a string
-  pcSecond representing a node's path.
-  Returns <0, 0, or >0 if oNFirst is "less than", "equal to", or
-  "greater than" pcSecond, respectively.
+  Returns the last component of oNNode's path, which is current even
+  when the rest of the path is yet to be rewritten for a move.
 */
-static int Node_compareString(const Node_T oNFirst,
-                                 const char *pcSecond) {
+static const char *Node_name(Node_T oNNode) {
+   assert(oNNode != NULL);
+
+   return Path_getComponent(oNNode->oPPath,
+                            Path_getDepth(oNNode->oPPath) - 1);
+}
+
+/*
+  Compares the last path component of oNFirst with string pcName.
+  Returns <0, 0, or >0 if oNFirst's name is "less than", "equal to",
+  or "greater than" pcName, respectively. Among siblings this orders
+  the nodes as their full paths would.
+*/
+static int Node_compareName(const Node_T oNFirst, const char *pcName) {
    assert(oNFirst != NULL);
-   assert(pcSecond != NULL);
+   assert(pcName != NULL);
 
-   return Path_compareString(oNFirst->oPPath, pcSecond);
+   return strcmp(Node_name(oNFirst), pcName);
 }
 
 
@@ -75,7 +238,7 @@ int Node_new(Path_T oPPath, Node_T oNParent, Node_T *poNResult) {
    assert(oNParent == NULL || CheckerDT_Node_isValid(oNParent));
 
    /* allocate space for a new node */
-   psNew = malloc(sizeof(struct node));
+   psNew = Alloc_malloc(ALLOC_NODE_STRUCT, sizeof(struct node));
    if(psNew == NULL) {
       *poNResult = NULL;
       return MEMORY_ERROR;
@@ -84,7 +247,7 @@ int Node_new(Path_T oPPath, Node_T oNParent, Node_T *poNResult) {
    /* set the new node's path */
    iStatus = Path_dup(oPPath, &oPNewPath);
    if(iStatus != SUCCESS) {
-      free(psNew);
+      Alloc_free(ALLOC_NODE_STRUCT, psNew, sizeof(struct node));
       *poNResult = NULL;
       return iStatus;
    }
@@ -94,14 +257,20 @@ int Node_new(Path_T oPPath, Node_T oNParent, Node_T *poNResult) {
    if(oNParent != NULL) {
       size_t ulSharedDepth;
 
-      oPParentPath = oNParent->oPPath;
+      oPParentPath = Node_getPath(oNParent);
+      if(oPParentPath == NULL) {
+         Path_free(psNew->oPPath);
+         Alloc_free(ALLOC_NODE_STRUCT, psNew, sizeof(struct node));
+         *poNResult = NULL;
+         return MEMORY_ERROR;
+      }
       ulParentDepth = Path_getDepth(oPParentPath);
       ulSharedDepth = Path_getSharedPrefixDepth(psNew->oPPath,
                                                 oPParentPath);
       /* parent must be an ancestor of child */
       if(ulSharedDepth < ulParentDepth) {
          Path_free(psNew->oPPath);
-         free(psNew);
+         Alloc_free(ALLOC_NODE_STRUCT, psNew, sizeof(struct node));
          *poNResult = NULL;
          return CONFLICTING_PATH;
       }
@@ -109,7 +278,7 @@ int Node_new(Path_T oPPath, Node_T oNParent, Node_T *poNResult) {
       /* parent must be exactly one level up from child */
       if(Path_getDepth(psNew->oPPath) != ulParentDepth + 1) {
          Path_free(psNew->oPPath);
-         free(psNew);
+         Alloc_free(ALLOC_NODE_STRUCT, psNew, sizeof(struct node));
          *poNResult = NULL;
          return NO_SUCH_PATH;
       }
@@ -117,7 +286,7 @@ int Node_new(Path_T oPPath, Node_T oNParent, Node_T *poNResult) {
       /* parent must not already have child with this path */
       if(Node_hasChild(oNParent, oPPath, &ulIndex)) {
          Path_free(psNew->oPPath);
-         free(psNew);
+         Alloc_free(ALLOC_NODE_STRUCT, psNew, sizeof(struct node));
          *poNResult = NULL;
          return ALREADY_IN_TREE;
       }
@@ -127,28 +296,60 @@ int Node_new(Path_T oPPath, Node_T oNParent, Node_T *poNResult) {
       /* can only create one "level" at a time */
       if(Path_getDepth(psNew->oPPath) != 1) {
          Path_free(psNew->oPPath);
-         free(psNew);
+         Alloc_free(ALLOC_NODE_STRUCT, psNew, sizeof(struct node));
          *poNResult = NULL;
          return NO_SUCH_PATH;
       }
    }
    psNew->oNParent = oNParent;
+   psNew->ulRefs = 1;
+   psNew->ulSubtree = 1;
+   psNew->pulCounts = NULL;
+   psNew->ulCountsCapacity = 0;
+   psNew->ulIndex = 0;
+   psNew->ulPathVersion = 0;
+   psNew->ulParentVersion =
+      oNParent == NULL ? 0 : oNParent->ulPathVersion;
+   psNew->ulCheckedAt = ulMoves;
 
    /* initialize the new node */
    psNew->oDChildren = DynArray_new(0);
    if(psNew->oDChildren == NULL) {
       Path_free(psNew->oPPath);
-      free(psNew);
+      Alloc_free(ALLOC_NODE_STRUCT, psNew, sizeof(struct node));
+      *poNResult = NULL;
+      return MEMORY_ERROR;
+   }
+
+#ifdef DT_CONCURRENT
+   if(pthread_mutex_init(&psNew->sLock, NULL) != 0) {
+      DynArray_free(psNew->oDChildren);
+      Path_free(psNew->oPPath);
+      Alloc_free(ALLOC_NODE_STRUCT, psNew, sizeof(struct node));
+      *poNResult = NULL;
+      return MEMORY_ERROR;
+   }
+   if(pthread_mutex_init(&psNew->sCountLock, NULL) != 0) {
+      (void) pthread_mutex_destroy(&psNew->sLock);
+      DynArray_free(psNew->oDChildren);
+      Path_free(psNew->oPPath);
+      Alloc_free(ALLOC_NODE_STRUCT, psNew, sizeof(struct node));
       *poNResult = NULL;
       return MEMORY_ERROR;
    }
+#endif
 
    /* Link into parent's children list */
    if(oNParent != NULL) {
       iStatus = Node_addChild(oNParent, psNew, ulIndex);
       if(iStatus != SUCCESS) {
+#ifdef DT_CONCURRENT
+         (void) pthread_mutex_destroy(&psNew->sLock);
+         (void) pthread_mutex_destroy(&psNew->sCountLock);
+#endif
+         DynArray_free(psNew->oDChildren);
          Path_free(psNew->oPPath);
-         free(psNew);
+         Alloc_free(ALLOC_NODE_STRUCT, psNew, sizeof(struct node));
          *poNResult = NULL;
          return iStatus;
       }
@@ -162,42 +363,417 @@ int Node_new(Path_T oPPath, Node_T oNParent, Node_T *poNResult) {
    return SUCCESS;
 }
 
+/*
+  Frees oNNode's own storage: its children array and their counts,
+  path and struct. oNNode's children must already have been released.
+*/
+static void Node_destroy(Node_T oNNode) {
+   assert(oNNode != NULL);
+
+   DynArray_free(oNNode->oDChildren);
+   Alloc_free(ALLOC_NODE_COUNTS, oNNode->pulCounts,
+              oNNode->ulCountsCapacity * sizeof(size_t));
+#ifdef DT_CONCURRENT
+   (void) pthread_mutex_destroy(&oNNode->sLock);
+   (void) pthread_mutex_destroy(&oNNode->sCountLock);
+#endif
+   Path_free(oNNode->oPPath);
+   Alloc_free(ALLOC_NODE_STRUCT, oNNode, sizeof(struct node));
+}
+
 size_t Node_free(Node_T oNNode) {
-   size_t ulIndex;
+   Node_T oNParent;
    size_t ulCount = 0;
 
    assert(oNNode != NULL);
    assert(CheckerDT_Node_isValid(oNNode));
 
    /* remove from parent's list */
-   if(oNNode->oNParent != NULL) {
-      if(DynArray_bsearch(
-            oNNode->oNParent->oDChildren,
-            oNNode, &ulIndex,
-            (int (*)(const void *, const void *)) Node_compare)
-        )
-         (void) DynArray_removeAt(oNNode->oNParent->oDChildren,
-                                  ulIndex);
+   oNParent = oNNode->oNParent;
+   if(oNParent != NULL &&
+      oNNode->ulIndex < DynArray_getLength(oNParent->oDChildren) &&
+      DynArray_get(oNParent->oDChildren, oNNode->ulIndex) == oNNode)
+      Node_removeChild(oNParent, oNNode->ulIndex);
+
+   /* a snapshot still holds this subtree, so it stays intact */
+   if(Node_decRefs(oNNode) != 0) {
+      ulCount = Node_loadSubtree(oNNode);
+#ifdef DT_CONCURRENT
+      Node_unlock(oNNode);
+#endif
+      return ulCount;
    }
 
    /* recursively remove children */
    while(DynArray_getLength(oNNode->oDChildren) != 0) {
-      ulCount += Node_free(DynArray_get(oNNode->oDChildren, 0));
+      Node_T oNChild = DynArray_get(oNNode->oDChildren, 0);
+#ifdef DT_CONCURRENT
+      Node_lock(oNChild);
+#endif
+      ulCount += Node_free(oNChild);
    }
-   DynArray_free(oNNode->oDChildren);
 
-   /* remove path */
-   Path_free(oNNode->oPPath);
+#ifdef DT_CONCURRENT
+   Node_unlock(oNNode);
+#endif
 
-   /* finally, free the struct node */
-   free(oNNode);
+   /* finally, free the node itself */
+   Node_destroy(oNNode);
    ulCount++;
    return ulCount;
 }
 
+Node_T Node_share(Node_T oNNode) {
+   assert(oNNode != NULL);
+
+   (void) Node_incRefs(oNNode);
+   return oNNode;
+}
+
+void Node_release(Node_T oNNode) {
+   size_t ulIndex;
+
+   assert(oNNode != NULL);
+
+   if(Node_decRefs(oNNode) != 0)
+      return;
+
+   /* no longer reachable from anywhere: release the children too,
+      without touching their parent links, which belong to whichever
+      copy of this node is in the hierarchy */
+   for(ulIndex = 0; ulIndex < DynArray_getLength(oNNode->oDChildren);
+       ulIndex++)
+      Node_release(DynArray_get(oNNode->oDChildren, ulIndex));
+   Node_destroy(oNNode);
+}
+
+int Node_unshare(Node_T oNParent, Node_T oNNode, Node_T *poNResult) {
+   struct node *psNew;
+   Path_T oPNewPath = NULL;
+   size_t ulLength;
+   size_t ulIndex;
+   int iStatus;
+
+   assert(oNNode != NULL);
+   assert(poNResult != NULL);
+   assert(oNParent == NULL || Node_getRefs(oNParent) == 1);
+
+   if(Node_getRefs(oNNode) == 1) {
+      *poNResult = oNNode;
+      return SUCCESS;
+   }
+
+   psNew = Alloc_malloc(ALLOC_NODE_STRUCT, sizeof(struct node));
+   if(psNew == NULL) {
+      *poNResult = NULL;
+      return MEMORY_ERROR;
+   }
+
+   iStatus = Path_dup(oNNode->oPPath, &oPNewPath);
+   if(iStatus != SUCCESS) {
+      Alloc_free(ALLOC_NODE_STRUCT, psNew, sizeof(struct node));
+      *poNResult = NULL;
+      return iStatus;
+   }
+   psNew->oPPath = oPNewPath;
+
+   ulLength = DynArray_getLength(oNNode->oDChildren);
+   psNew->oDChildren = DynArray_new(ulLength);
+   if(psNew->oDChildren == NULL) {
+      Path_free(psNew->oPPath);
+      Alloc_free(ALLOC_NODE_STRUCT, psNew, sizeof(struct node));
+      *poNResult = NULL;
+      return MEMORY_ERROR;
+   }
+   psNew->pulCounts = NULL;
+   psNew->ulCountsCapacity = 0;
+   if(Node_reserveCounts(psNew, ulLength) != SUCCESS) {
+      DynArray_free(psNew->oDChildren);
+      Path_free(psNew->oPPath);
+      Alloc_free(ALLOC_NODE_STRUCT, psNew, sizeof(struct node));
+      *poNResult = NULL;
+      return MEMORY_ERROR;
+   }
+
+#ifdef DT_CONCURRENT
+   if(pthread_mutex_init(&psNew->sLock, NULL) != 0) {
+      Alloc_free(ALLOC_NODE_COUNTS, psNew->pulCounts,
+                 psNew->ulCountsCapacity * sizeof(size_t));
+      DynArray_free(psNew->oDChildren);
+      Path_free(psNew->oPPath);
+      Alloc_free(ALLOC_NODE_STRUCT, psNew, sizeof(struct node));
+      *poNResult = NULL;
+      return MEMORY_ERROR;
+   }
+   if(pthread_mutex_init(&psNew->sCountLock, NULL) != 0) {
+      (void) pthread_mutex_destroy(&psNew->sLock);
+      Alloc_free(ALLOC_NODE_COUNTS, psNew->pulCounts,
+                 psNew->ulCountsCapacity * sizeof(size_t));
+      DynArray_free(psNew->oDChildren);
+      Path_free(psNew->oPPath);
+      Alloc_free(ALLOC_NODE_STRUCT, psNew, sizeof(struct node));
+      *poNResult = NULL;
+      return MEMORY_ERROR;
+   }
+#endif
+
+   /* the copy shares every child with the original, and becomes the
+      parent the hierarchy sees for each of them */
+   Node_lockCounts(oNNode);
+   for(ulIndex = 0; ulIndex < ulLength; ulIndex++) {
+      Node_T oNChild = DynArray_get(oNNode->oDChildren, ulIndex);
+      (void) Node_incRefs(oNChild);
+      oNChild->oNParent = psNew;
+      (void) DynArray_set(psNew->oDChildren, ulIndex, oNChild);
+   }
+   if(ulLength != 0)
+      memcpy(psNew->pulCounts, oNNode->pulCounts,
+             ulLength * sizeof(size_t));
+   Node_unlockCounts(oNNode);
+   psNew->oNParent = oNParent;
+   psNew->ulRefs = 1;
+   psNew->ulSubtree = Node_loadSubtree(oNNode);
+   psNew->ulIndex = oNNode->ulIndex;
+   psNew->ulPathVersion = oNNode->ulPathVersion;
+   psNew->ulParentVersion = oNNode->ulParentVersion;
+   psNew->ulCheckedAt = oNNode->ulCheckedAt;
+
+   /* swap the copy in for the original */
+   if(oNParent != NULL) {
+      if(DynArray_bsearch(oNParent->oDChildren, oNNode, &ulIndex,
+            (int (*)(const void *, const void *)) Node_compare))
+         (void) DynArray_set(oNParent->oDChildren, ulIndex, psNew);
+   }
+   Node_release(oNNode);
+
+   *poNResult = psNew;
+   return SUCCESS;
+}
+
+/*
+  Copies every node of the subtree rooted at oNNode, which must itself
+  be safe to modify, that a snapshot shares, as Node_unshare does.
+  Returns SUCCESS, or MEMORY_ERROR if memory could not be allocated,
+  leaving the rest of the subtree shared.
+*/
+static int Node_unshareSubtree(Node_T oNNode) {
+   size_t ulIndex;
+   int iStatus;
+
+   assert(oNNode != NULL);
+
+   for(ulIndex = 0; ulIndex < DynArray_getLength(oNNode->oDChildren);
+       ulIndex++) {
+      Node_T oNChild = DynArray_get(oNNode->oDChildren, ulIndex);
+      iStatus = Node_unshare(oNNode, oNChild, &oNChild);
+      if(iStatus == SUCCESS)
+         iStatus = Node_unshareSubtree(oNChild);
+      if(iStatus != SUCCESS)
+         return iStatus;
+   }
+   return SUCCESS;
+}
+
+/*
+  Adds to oDPaths, in pre-order, the path that each descendent of
+  oNNode would have if oNNode's path were oPPath. Returns SUCCESS, or
+  MEMORY_ERROR if memory could not be allocated, in which case the
+  caller still frees the paths already added.
+*/
+static int Node_newPaths(Node_T oNNode, Path_T oPPath,
+                         DynArray_T oDPaths) {
+   size_t ulIndex;
+   int iStatus;
+
+   assert(oNNode != NULL);
+   assert(oPPath != NULL);
+   assert(oDPaths != NULL);
+
+   for(ulIndex = 0; ulIndex < DynArray_getLength(oNNode->oDChildren);
+       ulIndex++) {
+      Node_T oNChild = DynArray_get(oNNode->oDChildren, ulIndex);
+      const char *pcName = Node_name(oNChild);
+      Path_T oPChild = NULL;
+
+      iStatus = Path_newChild(oPPath, pcName, strlen(pcName), &oPChild);
+      if(iStatus != SUCCESS)
+         return iStatus;
+      if(!DynArray_add(oDPaths, oPChild)) {
+         Path_free(oPChild);
+         return MEMORY_ERROR;
+      }
+      iStatus = Node_newPaths(oNChild, oPChild, oDPaths);
+      if(iStatus != SUCCESS)
+         return iStatus;
+   }
+   return SUCCESS;
+}
+
+/*
+  Gives the descendents of oNNode, in pre-order, the paths in oDPaths
+  from index *pulNext on, as built by Node_newPaths, and advances
+  *pulNext past them.
+*/
+static void Node_setPaths(Node_T oNNode, DynArray_T oDPaths,
+                          size_t *pulNext) {
+   size_t ulIndex;
+
+   assert(oNNode != NULL);
+   assert(oDPaths != NULL);
+   assert(pulNext != NULL);
+
+   for(ulIndex = 0; ulIndex < DynArray_getLength(oNNode->oDChildren);
+       ulIndex++) {
+      Node_T oNChild = DynArray_get(oNNode->oDChildren, ulIndex);
+      Path_free(oNChild->oPPath);
+      oNChild->oPPath = DynArray_get(oDPaths, (*pulNext)++);
+      Node_setPaths(oNChild, oDPaths, pulNext);
+   }
+}
+
+/* Frees the paths in oDPaths, then oDPaths itself. */
+static void Node_freePaths(DynArray_T oDPaths) {
+   size_t ulIndex;
+
+   assert(oDPaths != NULL);
+
+   for(ulIndex = 0; ulIndex < DynArray_getLength(oDPaths); ulIndex++)
+      Path_free(DynArray_get(oDPaths, ulIndex));
+   DynArray_free(oDPaths);
+}
+
+int Node_move(Node_T oNNode, Node_T oNNewParent, Path_T oPNewPath,
+              boolean bShared) {
+   Node_T oNOldParent;
+   Path_T oPDupPath = NULL;
+   DynArray_T oDPaths = NULL;
+   size_t ulOldIndex, ulNewIndex;
+   int iStatus;
+
+   assert(oNNode != NULL);
+   assert(oNNode->oNParent != NULL);
+   assert(oNNewParent != NULL);
+   assert(oPNewPath != NULL);
+   assert(Node_getRefs(oNNode) == 1);
+
+   /* copy anything a snapshot shares, so its paths can be rewritten
+      now without the snapshot seeing it */
+   if(bShared) {
+      iStatus = Node_unshareSubtree(oNNode);
+      if(iStatus != SUCCESS)
+         return iStatus;
+   }
+
+   iStatus = Path_dup(oPNewPath, &oPDupPath);
+   if(iStatus != SUCCESS)
+      return iStatus;
+   if(bShared) {
+      oDPaths = DynArray_new(0);
+      if(oDPaths == NULL) {
+         Path_free(oPDupPath);
+         return MEMORY_ERROR;
+      }
+      iStatus = Node_newPaths(oNNode, oPDupPath, oDPaths);
+      if(iStatus != SUCCESS) {
+         Node_freePaths(oDPaths);
+         Path_free(oPDupPath);
+         return iStatus;
+      }
+   }
+
+   /* unlink oNNode, then link it in again where it belongs; removing
+      never shrinks an array, so putting it back cannot fail */
+   oNOldParent = oNNode->oNParent;
+   ulOldIndex = oNNode->ulIndex;
+   assert(DynArray_get(oNOldParent->oDChildren, ulOldIndex) == oNNode);
+   Node_removeChild(oNOldParent, ulOldIndex);
+   if(Node_hasChild(oNNewParent, oPNewPath, &ulNewIndex))
+      assert(FALSE);
+   if(Node_addChild(oNNewParent, oNNode, ulNewIndex) != SUCCESS) {
+      (void) Node_addChild(oNOldParent, oNNode, ulOldIndex);
+      if(oDPaths != NULL)
+         Node_freePaths(oDPaths);
+      Path_free(oPDupPath);
+      return MEMORY_ERROR;
+   }
+   oNNode->oNParent = oNNewParent;
+   Path_free(oNNode->oPPath);
+   oNNode->oPPath = oPDupPath;
+
+   if(bShared) {
+      /* every path is already right, so nothing needs checking */
+      ulOldIndex = 0;
+      Node_setPaths(oNNode, oDPaths, &ulOldIndex);
+      DynArray_free(oDPaths);
+   }
+   else {
+      /* every other node is checked again when next asked for its
+         path, which only oNNode's descendents then need to rewrite */
+      oNNode->ulPathVersion++;
+      oNNode->ulParentVersion = oNNewParent->ulPathVersion;
+      ulMoves++;
+      oNNode->ulCheckedAt = ulMoves;
+   }
+   return SUCCESS;
+}
+
+/*
+  Checks the path of every node of the subtree rooted at oNNode,
+  rewriting those left stale by a move. Returns SUCCESS, or
+  MEMORY_ERROR if memory could not be allocated.
+*/
+static int Node_settleSubtree(Node_T oNNode) {
+   size_t ulIndex;
+
+   assert(oNNode != NULL);
+
+   if(Node_getPath(oNNode) == NULL)
+      return MEMORY_ERROR;
+   for(ulIndex = 0; ulIndex < DynArray_getLength(oNNode->oDChildren);
+       ulIndex++)
+      if(Node_settleSubtree(DynArray_get(oNNode->oDChildren, ulIndex))
+         != SUCCESS)
+         return MEMORY_ERROR;
+   return SUCCESS;
+}
+
+int Node_settlePaths(Node_T oNRoot) {
+   if(ulSettled == ulMoves)
+      return SUCCESS;
+   if(oNRoot != NULL && Node_settleSubtree(oNRoot) != SUCCESS)
+      return MEMORY_ERROR;
+   ulSettled = ulMoves;
+   return SUCCESS;
+}
+
 Path_T Node_getPath(Node_T oNNode) {
+   Path_T oPParentPath;
+   Path_T oPNewPath = NULL;
+   const char *pcName;
+
    assert(oNNode != NULL);
 
+   /* a node a snapshot shares is always current, and its parent link
+      may be changing under Node_unshare, so test that first */
+   if(oNNode->ulCheckedAt == ulMoves || oNNode->oNParent == NULL)
+      return oNNode->oPPath;
+
+   /* a move since the last check may have left the path stale, in
+      which case it is the parent's extended by this node's name */
+   oPParentPath = Node_getPath(oNNode->oNParent);
+   if(oPParentPath == NULL)
+      return NULL;
+   if(oNNode->ulParentVersion != oNNode->oNParent->ulPathVersion) {
+      pcName = Node_name(oNNode);
+      if(Path_newChild(oPParentPath, pcName, strlen(pcName),
+                       &oPNewPath) != SUCCESS)
+         return NULL;
+      Path_free(oNNode->oPPath);
+      oNNode->oPPath = oPNewPath;
+      oNNode->ulPathVersion++;
+      oNNode->ulParentVersion = oNNode->oNParent->ulPathVersion;
+   }
+   oNNode->ulCheckedAt = ulMoves;
    return oNNode->oPPath;
 }
 
@@ -209,8 +785,10 @@ boolean Node_hasChild(Node_T oNParent, Path_T oPPath,
 
    /* *pulChildID is the index into oNParent->oDChildren */
    return DynArray_bsearch(oNParent->oDChildren,
-            (char*) Path_getPathname(oPPath), pulChildID,
-            (int (*)(const void*,const void*)) Node_compareString);
+            (char*) Path_getComponent(oPPath,
+                                      Path_getDepth(oPPath) - 1),
+            pulChildID,
+            (int (*)(const void*,const void*)) Node_compareName);
 }
 
 size_t Node_getNumChildren(Node_T oNParent) {
@@ -236,6 +814,123 @@ int  Node_getChild(Node_T oNParent, size_t ulChildID,
    }
 }
 
+size_t Node_getSubtreeSize(Node_T oNNode) {
+   assert(oNNode != NULL);
+
+   return Node_loadSubtree(oNNode);
+}
+
+void Node_growSubtree(Node_T oNNode, size_t ulDelta) {
+   Node_T oNParent;
+   size_t ulIndex;
+
+   assert(oNNode != NULL);
+
+   /* the parent's entries covering oNNode change with its size */
+   oNParent = oNNode->oNParent;
+   if(oNParent != NULL)
+      Node_lockCounts(oNParent);
+#ifdef DT_CONCURRENT
+   (void) __atomic_add_fetch(&oNNode->ulSubtree, ulDelta,
+                             __ATOMIC_RELAXED);
+#else
+   oNNode->ulSubtree += ulDelta;
+#endif
+   if(oNParent != NULL) {
+      for(ulIndex = oNNode->ulIndex + 1;
+          ulIndex <= DynArray_getLength(oNParent->oDChildren);
+          ulIndex += Node_lowBit(ulIndex))
+         oNParent->pulCounts[ulIndex - 1] += ulDelta;
+      Node_unlockCounts(oNParent);
+   }
+}
+
+void Node_shrinkSubtree(Node_T oNNode, size_t ulDelta) {
+   Node_T oNParent;
+   size_t ulIndex;
+
+   assert(oNNode != NULL);
+   assert(Node_loadSubtree(oNNode) > ulDelta);
+
+   oNParent = oNNode->oNParent;
+   if(oNParent != NULL)
+      Node_lockCounts(oNParent);
+#ifdef DT_CONCURRENT
+   (void) __atomic_sub_fetch(&oNNode->ulSubtree, ulDelta,
+                             __ATOMIC_RELAXED);
+#else
+   oNNode->ulSubtree -= ulDelta;
+#endif
+   if(oNParent != NULL) {
+      for(ulIndex = oNNode->ulIndex + 1;
+          ulIndex <= DynArray_getLength(oNParent->oDChildren);
+          ulIndex += Node_lowBit(ulIndex))
+         oNParent->pulCounts[ulIndex - 1] -= ulDelta;
+      Node_unlockCounts(oNParent);
+   }
+}
+
+size_t Node_countBefore(Node_T oNParent, size_t ulChildID) {
+   size_t ulCount = 0;
+
+   assert(oNParent != NULL);
+   assert(ulChildID <= DynArray_getLength(oNParent->oDChildren));
+
+   Node_lockCounts(oNParent);
+   for(; ulChildID > 0; ulChildID -= Node_lowBit(ulChildID))
+      ulCount += oNParent->pulCounts[ulChildID - 1];
+   Node_unlockCounts(oNParent);
+   return ulCount;
+}
+
+size_t Node_findRank(Node_T oNParent, size_t ulRank,
+                     size_t *pulBefore) {
+   size_t ulLength;
+   size_t ulStep = 1;
+   size_t ulIndex = 0;
+   size_t ulBefore = 0;
+
+   assert(oNParent != NULL);
+   assert(pulBefore != NULL);
+
+   /* descend from the entry summing the most children, skipping each
+      entry whose children all come before the rank */
+   Node_lockCounts(oNParent);
+   ulLength = DynArray_getLength(oNParent->oDChildren);
+   while(ulStep <= ulLength / 2)
+      ulStep *= 2;
+   for(; ulLength != 0 && ulStep != 0; ulStep /= 2)
+      if(ulIndex + ulStep <= ulLength &&
+         ulBefore + oNParent->pulCounts[ulIndex + ulStep - 1] <=
+         ulRank) {
+         ulIndex += ulStep;
+         ulBefore += oNParent->pulCounts[ulIndex - 1];
+      }
+   Node_unlockCounts(oNParent);
+
+   *pulBefore = ulBefore;
+   return ulIndex;
+}
+
+void Node_getFootprint(Node_T oNNode, size_t *pulNodeBytes,
+                       size_t *pulPathBytes, size_t *pulChildBytes,
+                       size_t *pulSlack) {
+   size_t ulSlots;
+
+   assert(oNNode != NULL);
+   assert(pulNodeBytes != NULL);
+   assert(pulPathBytes != NULL);
+   assert(pulChildBytes != NULL);
+   assert(pulSlack != NULL);
+
+   ulSlots = DynArray_getPhysLength(oNNode->oDChildren);
+   *pulNodeBytes = sizeof(struct node);
+   *pulPathBytes = Path_getBytes(oNNode->oPPath);
+   *pulChildBytes = ulSlots * sizeof(void *) +
+                    oNNode->ulCountsCapacity * sizeof(size_t);
+   *pulSlack = ulSlots - DynArray_getLength(oNNode->oDChildren);
+}
+
 Node_T Node_getParent(Node_T oNNode) {
    assert(oNNode != NULL);
 
@@ -246,17 +941,42 @@ int Node_compare(Node_T oNFirst, Node_T oNSecond) {
    assert(oNFirst != NULL);
    assert(oNSecond != NULL);
 
-   return Path_comparePath(oNFirst->oPPath, oNSecond->oPPath);
+   /* siblings are ordered by name alone, which needs no rewriting */
+   if(oNFirst->oNParent == oNSecond->oNParent)
+      return Node_compareName(oNFirst, Node_name(oNSecond));
+   return Path_comparePath(Node_getPath(oNFirst),
+                           Node_getPath(oNSecond));
 }
 
 char *Node_toString(Node_T oNNode) {
+   Path_T oPPath;
    char *copyPath;
 
    assert(oNNode != NULL);
 
-   copyPath = malloc(Path_getStrLength(Node_getPath(oNNode))+1);
+   oPPath = Node_getPath(oNNode);
+   if(oPPath == NULL)
+      return NULL;
+   copyPath = malloc(Path_getStrLength(oPPath)+1);
    if(copyPath == NULL)
       return NULL;
-   else
-      return strcpy(copyPath, Path_getPathname(Node_getPath(oNNode)));
-}
\ No newline at end of file
+   Alloc_noteAlloc(ALLOC_NODE_STRING, Path_getStrLength(oPPath)+1);
+   strcpy(copyPath, Path_getPathname(oPPath));
+   /* the string is the caller's to free from here */
+   Alloc_noteFree(ALLOC_NODE_STRING, Path_getStrLength(oPPath)+1);
+   return copyPath;
+}
+
+#ifdef DT_CONCURRENT
+void Node_lock(Node_T oNNode) {
+   assert(oNNode != NULL);
+
+   (void) pthread_mutex_lock(&oNNode->sLock);
+}
+
+void Node_unlock(Node_T oNNode) {
+   assert(oNNode != NULL);
+
+   (void) pthread_mutex_unlock(&oNNode->sLock);
+}
+#endif
@@ -0,0 +1,1112 @@
+/*--------------------------------------------------------------------*/
+/* nodeDTMapped.c                                                     */
+/* Author: Christopher Moretti                                        */
+/*--------------------------------------------------------------------*/
+
+/* mmap, msync and ftruncate are POSIX.1-2001 interfaces */
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "dynarray.h"
+#include "nodeDT.h"
+#include "alloc.h"
+#include "checkerDT.h"
+
+#ifdef DT_CONCURRENT
+#error "nodeDTMapped.c does not support DT_CONCURRENT builds"
+#endif
+
+/*
+  Every node lives in one region: a file mapped into memory. Nothing
+  in the region is a pointer; nodes, their names and their children
+  arrays refer to each other by their offsets from the start of the
+  region, where its header lives, so offset 0 never names a node and
+  stands for "none". The file can thus be mapped again at any address
+  and used as it is.
+*/
+
+/* The number of size classes of the region's blocks, which hold
+   16 bytes, 32 bytes, and so on, doubling */
+enum {NUM_CLASSES = 40};
+/* The size in bytes of the smallest block */
+enum {MIN_BLOCK_BYTES = 16};
+/* The size in bytes of a new region's file */
+enum {INITIAL_BYTES = 65536};
+
+/* The header at the start of a region */
+struct region {
+   /* "DTRGN2" and two '\0's */
+   char acMagic[8];
+   /* the length in bytes of the region's file */
+   size_t ulLength;
+   /* the offset of the first byte never allocated */
+   size_t ulTop;
+   /* the offset of the root node as of the last Node_syncRegion */
+   size_t ulRoot;
+   /* the number of nodes in the hierarchy, likewise */
+   size_t ulCount;
+   /* the number of path slots ever handed out to nodes */
+   size_t ulSlots;
+   /* the offset of the first free node record */
+   size_t ulFreeNodes;
+   /* the offsets of the first free block of each size class */
+   size_t aulFree[NUM_CLASSES];
+};
+
+/* A node in a DT */
+struct node {
+   /* the offset of this node's parent */
+   size_t ulParent;
+   /* the offset of this node's last path component, '\0'-terminated,
+      or of the next free node record if this record is free */
+   size_t ulName;
+   /* the number of components in this node's path */
+   size_t ulDepth;
+   /* the offset of the array of the offsets of this node's children,
+      in lexicographic order, followed by as many cumulative subtree
+      sizes of the children, as a Fenwick tree: entry i sums those of
+      the children from index i + 1 - b to index i, b being the lowest
+      bit set in i + 1 */
+   size_t ulChildren;
+   /* the number of children in that array */
+   size_t ulNumChildren;
+   /* the number of children that array, and the sizes after it, have
+      room for */
+   size_t ulCapacity;
+   /* the number of references to this node: one from the hierarchy
+      or from a parent, plus one per snapshot sharing it directly */
+   size_t ulRefs;
+   /* the number of nodes in the subtree rooted at this node */
+   size_t ulSubtree;
+   /* the index of this node's path in oDPaths; the index stays with
+      the record when it is freed and reused */
+   size_t ulSlot;
+};
+
+/* The bytes that start every region */
+static const char acRegionMagic[8] = {'D', 'T', 'R', 'G', 'N', '2'};
+
+/* The start of the mapped region, or NULL if none is open */
+static struct region *psRegion;
+/* The number of bytes of address space reserved for the region, so
+   that growing the file never moves it */
+static size_t ulReserved;
+/* The file descriptor of the region's file */
+static int iRegionFd = -1;
+/* The anonymous temporary file holding the region, if any */
+static FILE *psRegionTemp;
+/* The path objects of the nodes, indexed by slot. They are built the
+   first time each node's path is asked for, and are never stored in
+   the region itself */
+static DynArray_T oDPaths;
+
+/* Converts between offsets in the region and the addresses that the
+   region is currently mapped at */
+#define Node_at(ulOffset) \
+   ((struct node *) ((char *) psRegion + (ulOffset)))
+#define Node_offsetOf(oNNode) \
+   ((size_t) ((char *) (oNNode) - (char *) psRegion))
+#define Node_children(oNNode) \
+   ((size_t *) ((char *) psRegion + (oNNode)->ulChildren))
+#define Node_counts(oNNode) \
+   (Node_children(oNNode) + (oNNode)->ulCapacity)
+#define Node_name(oNNode) ((char *) psRegion + (oNNode)->ulName)
+
+
+/* --------------------------------------------------------------------
+
+  The following auxiliary functions allocate and free blocks inside
+  the region, from a free list per power-of-two size class. Node
+  records all have the same size and have a free list of their own.
+*/
+
+/* Returns the size class of a block holding ulBytes bytes. */
+static size_t Node_classOf(size_t ulBytes) {
+   size_t ulClass = 0;
+   size_t ulBlock = MIN_BLOCK_BYTES;
+
+   while(ulBlock < ulBytes) {
+      ulBlock <<= 1;
+      ulClass++;
+   }
+   return ulClass;
+}
+
+/* Returns the size in bytes of a node record, rounded up to keep
+   every block aligned. */
+static size_t Node_recordBytes(void) {
+   return (sizeof(struct node) + MIN_BLOCK_BYTES - 1) /
+          MIN_BLOCK_BYTES * MIN_BLOCK_BYTES;
+}
+
+/* Returns the size in bytes of the block that holds ulBytes bytes. */
+static size_t Node_blockBytes(size_t ulBytes) {
+   return (size_t) MIN_BLOCK_BYTES << Node_classOf(ulBytes);
+}
+
+/*
+  Takes ulBytes (a multiple of MIN_BLOCK_BYTES) from the top of the
+  region, growing its file if need be, and stores their offset in
+  *pulOffset. Returns SUCCESS, or MEMORY_ERROR if the file cannot grow
+  or the reserved address space is used up.
+*/
+static int Node_allocTop(size_t ulBytes, size_t *pulOffset) {
+   size_t ulNeeded;
+
+   assert(psRegion != NULL);
+   assert(pulOffset != NULL);
+
+   ulNeeded = psRegion->ulTop + ulBytes;
+   if(ulNeeded < psRegion->ulTop || ulNeeded > ulReserved)
+      return MEMORY_ERROR;
+
+   if(ulNeeded > psRegion->ulLength) {
+      size_t ulLength = psRegion->ulLength;
+      while(ulLength < ulNeeded)
+         ulLength = ulLength > ulReserved / 2 ? ulReserved : 2 * ulLength;
+      if(ftruncate(iRegionFd, (off_t) ulLength) != 0)
+         return MEMORY_ERROR;
+      psRegion->ulLength = ulLength;
+   }
+
+   *pulOffset = psRegion->ulTop;
+   psRegion->ulTop = ulNeeded;
+   return SUCCESS;
+}
+
+/*
+  Allocates a block of at least ulBytes bytes in the region and stores
+  its offset in *pulOffset. Returns SUCCESS or MEMORY_ERROR.
+*/
+static int Node_alloc(size_t ulBytes, size_t *pulOffset) {
+   size_t ulClass;
+
+   assert(pulOffset != NULL);
+
+   ulClass = Node_classOf(ulBytes);
+   if(ulClass >= NUM_CLASSES)
+      return MEMORY_ERROR;
+
+   if(psRegion->aulFree[ulClass] != 0) {
+      *pulOffset = psRegion->aulFree[ulClass];
+      psRegion->aulFree[ulClass] =
+         *(size_t *) ((char *) psRegion + *pulOffset);
+      return SUCCESS;
+   }
+   return Node_allocTop((size_t) MIN_BLOCK_BYTES << ulClass, pulOffset);
+}
+
+/* Returns the block at ulOffset, allocated for ulBytes bytes, to its
+   size class's free list. */
+static void Node_dealloc(size_t ulOffset, size_t ulBytes) {
+   size_t ulClass;
+
+   assert(ulOffset != 0);
+
+   ulClass = Node_classOf(ulBytes);
+   *(size_t *) ((char *) psRegion + ulOffset) = psRegion->aulFree[ulClass];
+   psRegion->aulFree[ulClass] = ulOffset;
+}
+
+/*
+  Allocates a node record, reusing a free one (and its slot) if there
+  is one, and stores its address in *poNResult. Returns SUCCESS or
+  MEMORY_ERROR.
+*/
+static int Node_allocRecord(Node_T *poNResult) {
+   size_t ulOffset;
+   int iStatus;
+
+   assert(poNResult != NULL);
+
+   if(psRegion->ulFreeNodes != 0) {
+      *poNResult = Node_at(psRegion->ulFreeNodes);
+      psRegion->ulFreeNodes = (*poNResult)->ulName;
+      return SUCCESS;
+   }
+
+   iStatus = Node_allocTop(Node_recordBytes(), &ulOffset);
+   if(iStatus != SUCCESS)
+      return iStatus;
+   *poNResult = Node_at(ulOffset);
+   (*poNResult)->ulSlot = psRegion->ulSlots++;
+   return SUCCESS;
+}
+
+/* Returns node record oNNode to the free list of node records. */
+static void Node_deallocRecord(Node_T oNNode) {
+   assert(oNNode != NULL);
+
+   oNNode->ulName = psRegion->ulFreeNodes;
+   psRegion->ulFreeNodes = Node_offsetOf(oNNode);
+}
+/*--------------------------------------------------------------------*/
+
+
+/* --------------------------------------------------------------------
+
+  The following auxiliary functions keep the cache of path objects
+  indexed by node slot.
+*/
+
+/* Returns the cached path of the node with slot ulSlot, or NULL. */
+static Path_T Node_cachedPath(size_t ulSlot) {
+   if(ulSlot >= DynArray_getLength(oDPaths))
+      return NULL;
+   return DynArray_get(oDPaths, ulSlot);
+}
+
+/*
+  Caches oPPath as the path of the node with slot ulSlot, which has
+  none cached. Returns SUCCESS, or MEMORY_ERROR if the cache cannot
+  grow to hold it.
+*/
+static int Node_cachePath(size_t ulSlot, Path_T oPPath) {
+   assert(Node_cachedPath(ulSlot) == NULL);
+
+   while(DynArray_getLength(oDPaths) <= ulSlot)
+      if(!DynArray_add(oDPaths, NULL))
+         return MEMORY_ERROR;
+   (void) DynArray_set(oDPaths, ulSlot, oPPath);
+   return SUCCESS;
+}
+
+/* Frees the cached path, if any, of the node with slot ulSlot. */
+static void Node_uncachePath(size_t ulSlot) {
+   Path_T oPPath = Node_cachedPath(ulSlot);
+
+   if(oPPath != NULL) {
+      Path_free(oPPath);
+      (void) DynArray_set(oDPaths, ulSlot, NULL);
+   }
+}
+/*--------------------------------------------------------------------*/
+
+
+/*
+  Compares the last path component of oNFirst with string pcName.
+  Returns <0, 0, or >0 if oNFirst's name is "less than", "equal to",
+  or "greater than" pcName, respectively. Among siblings this orders
+  the nodes as their full paths would.
+*/
+static int Node_compareName(Node_T oNFirst, const char *pcName) {
+   assert(oNFirst != NULL);
+   assert(pcName != NULL);
+
+   return strcmp(Node_name(oNFirst), pcName);
+}
+
+/*
+  Searches oNParent's children for one named pcName. Returns TRUE and
+  stores its index in *pulIndex if there is one, and otherwise returns
+  FALSE and stores the index it would be inserted at.
+*/
+static boolean Node_findName(Node_T oNParent, const char *pcName,
+                             size_t *pulIndex) {
+   size_t *pulChildren;
+   size_t ulLo = 0;
+   size_t ulHi;
+
+   assert(oNParent != NULL);
+   assert(pcName != NULL);
+   assert(pulIndex != NULL);
+
+   pulChildren = Node_children(oNParent);
+   ulHi = oNParent->ulNumChildren;
+   while(ulLo < ulHi) {
+      size_t ulMid = ulLo + (ulHi - ulLo) / 2;
+      int iCompare = Node_compareName(Node_at(pulChildren[ulMid]),
+                                      pcName);
+      if(iCompare == 0) {
+         *pulIndex = ulMid;
+         return TRUE;
+      }
+      if(iCompare < 0)
+         ulLo = ulMid + 1;
+      else
+         ulHi = ulMid;
+   }
+   *pulIndex = ulLo;
+   return FALSE;
+}
+
+/*
+  Makes room in oNParent's children array, and in the cumulative
+  counts after it, for at least ulCapacity children. Returns SUCCESS
+  or MEMORY_ERROR.
+*/
+static int Node_reserveChildren(Node_T oNParent, size_t ulCapacity) {
+   size_t *pulGrown;
+   size_t ulOffset;
+   int iStatus;
+
+   assert(oNParent != NULL);
+
+   if(ulCapacity <= oNParent->ulCapacity)
+      return SUCCESS;
+   if(ulCapacity < 2 * oNParent->ulCapacity)
+      ulCapacity = 2 * oNParent->ulCapacity;
+
+   iStatus = Node_alloc(2 * ulCapacity * sizeof(size_t), &ulOffset);
+   if(iStatus != SUCCESS)
+      return iStatus;
+   pulGrown = (size_t *) ((char *) psRegion + ulOffset);
+   if(oNParent->ulNumChildren != 0) {
+      memcpy(pulGrown, Node_children(oNParent),
+             oNParent->ulNumChildren * sizeof(size_t));
+      memcpy(pulGrown + ulCapacity, Node_counts(oNParent),
+             oNParent->ulNumChildren * sizeof(size_t));
+   }
+   if(oNParent->ulChildren != 0)
+      Node_dealloc(oNParent->ulChildren,
+                   2 * oNParent->ulCapacity * sizeof(size_t));
+   oNParent->ulChildren = ulOffset;
+   oNParent->ulCapacity = ulCapacity;
+   return SUCCESS;
+}
+
+/* The lowest bit set in ulIndex, which is how many children the
+   Fenwick entry at one-based index ulIndex sums */
+#define Node_lowBit(ulIndex) ((ulIndex) & (~(ulIndex) + 1))
+
+/*
+  Rebuilds the cumulative counts of oNParent's children from index
+  ulFrom on, after children from there on have been added or removed.
+  Only the entries before ulFrom that sum children from ulFrom on need
+  their counts added again, and those are the ones a prefix sum up to
+  ulFrom reads, so this takes time linear in the number of children
+  from ulFrom on.
+*/
+static void Node_recount(Node_T oNParent, size_t ulFrom) {
+   size_t *pulCounts;
+   size_t ulLength;
+   size_t ulIndex, ulNext;
+
+   assert(oNParent != NULL);
+
+   ulLength = oNParent->ulNumChildren;
+   pulCounts = Node_counts(oNParent);
+   for(ulIndex = ulFrom; ulIndex < ulLength; ulIndex++)
+      pulCounts[ulIndex] =
+         Node_at(Node_children(oNParent)[ulIndex])->ulSubtree;
+
+   /* each entry, one-based, adds its sum to the next one covering it */
+   for(ulIndex = ulFrom; ulIndex > 0; ulIndex -= Node_lowBit(ulIndex)) {
+      ulNext = ulIndex + Node_lowBit(ulIndex);
+      if(ulNext <= ulLength)
+         pulCounts[ulNext - 1] += pulCounts[ulIndex - 1];
+   }
+   for(ulIndex = ulFrom + 1; ulIndex <= ulLength; ulIndex++) {
+      ulNext = ulIndex + Node_lowBit(ulIndex);
+      if(ulNext <= ulLength)
+         pulCounts[ulNext - 1] += pulCounts[ulIndex - 1];
+   }
+}
+
+/*
+  Links new child oNChild into oNParent's children array at index
+  ulIndex. Returns SUCCESS if the new child was added successfully,
+  or  MEMORY_ERROR if allocation fails adding oNChild to the array.
+*/
+static int Node_addChild(Node_T oNParent, Node_T oNChild,
+                         size_t ulIndex) {
+   size_t *pulChildren;
+   int iStatus;
+
+   assert(oNParent != NULL);
+   assert(oNChild != NULL);
+   assert(ulIndex <= oNParent->ulNumChildren);
+
+   iStatus = Node_reserveChildren(oNParent, oNParent->ulNumChildren + 1);
+   if(iStatus != SUCCESS)
+      return iStatus;
+
+   pulChildren = Node_children(oNParent);
+   memmove(pulChildren + ulIndex + 1, pulChildren + ulIndex,
+           (oNParent->ulNumChildren - ulIndex) * sizeof(size_t));
+   pulChildren[ulIndex] = Node_offsetOf(oNChild);
+   oNParent->ulNumChildren++;
+   Node_recount(oNParent, ulIndex);
+   return SUCCESS;
+}
+
+/* Unlinks the child at index ulIndex of oNParent's children array. */
+static void Node_removeChild(Node_T oNParent, size_t ulIndex) {
+   size_t *pulChildren;
+
+   assert(oNParent != NULL);
+   assert(ulIndex < oNParent->ulNumChildren);
+
+   pulChildren = Node_children(oNParent);
+   memmove(pulChildren + ulIndex, pulChildren + ulIndex + 1,
+           (oNParent->ulNumChildren - ulIndex - 1) * sizeof(size_t));
+   oNParent->ulNumChildren--;
+   Node_recount(oNParent, ulIndex);
+}
+
+/*
+  Stores a copy of the ulLength-byte name pcName in the region and
+  sets *pulOffset to it. Returns SUCCESS or MEMORY_ERROR.
+*/
+static int Node_storeName(const char *pcName, size_t ulLength,
+                          size_t *pulOffset) {
+   int iStatus;
+
+   assert(pcName != NULL);
+   assert(pulOffset != NULL);
+
+   iStatus = Node_alloc(ulLength + 1, pulOffset);
+   if(iStatus != SUCCESS)
+      return iStatus;
+   memcpy((char *) psRegion + *pulOffset, pcName, ulLength);
+   ((char *) psRegion)[*pulOffset + ulLength] = '\0';
+   return SUCCESS;
+}
+
+
+int Node_new(Path_T oPPath, Node_T oNParent, Node_T *poNResult) {
+   struct node *psNew;
+   Path_T oPNewPath = NULL;
+   const char *pcName;
+   size_t ulDepth;
+   size_t ulIndex = 0;
+   int iStatus;
+
+   assert(oPPath != NULL);
+   assert(psRegion != NULL);
+   assert(oNParent == NULL || CheckerDT_Node_isValid(oNParent));
+
+   *poNResult = NULL;
+   ulDepth = Path_getDepth(oPPath);
+
+   /* validate the new node's parent */
+   if(oNParent != NULL) {
+      Path_T oPParentPath = Node_getPath(oNParent);
+
+      if(oPParentPath == NULL)
+         return MEMORY_ERROR;
+      /* parent must be an ancestor of child */
+      if(Path_getSharedPrefixDepth(oPPath, oPParentPath) <
+         oNParent->ulDepth)
+         return CONFLICTING_PATH;
+      /* parent must be exactly one level up from child */
+      if(ulDepth != oNParent->ulDepth + 1)
+         return NO_SUCH_PATH;
+      /* parent must not already have child with this path */
+      if(Node_hasChild(oNParent, oPPath, &ulIndex))
+         return ALREADY_IN_TREE;
+   }
+   /* new node must be root */
+   /* can only create one "level" at a time */
+   else if(ulDepth != 1)
+      return NO_SUCH_PATH;
+
+   iStatus = Path_dup(oPPath, &oPNewPath);
+   if(iStatus != SUCCESS)
+      return iStatus;
+
+   /* allocate space for a new node and its name */
+   iStatus = Node_allocRecord(&psNew);
+   if(iStatus != SUCCESS) {
+      Path_free(oPNewPath);
+      return iStatus;
+   }
+   pcName = Path_getComponent(oPPath, ulDepth - 1);
+   iStatus = Node_storeName(pcName, strlen(pcName), &psNew->ulName);
+   if(iStatus != SUCCESS) {
+      Node_deallocRecord(psNew);
+      Path_free(oPNewPath);
+      return iStatus;
+   }
+
+   /* initialize the new node */
+   psNew->ulParent = oNParent == NULL ? 0 : Node_offsetOf(oNParent);
+   psNew->ulDepth = ulDepth;
+   psNew->ulChildren = 0;
+   psNew->ulNumChildren = 0;
+   psNew->ulCapacity = 0;
+   psNew->ulRefs = 1;
+   psNew->ulSubtree = 1;
+
+   /* the path is already at hand, so cache it straight away */
+   iStatus = Node_cachePath(psNew->ulSlot, oPNewPath);
+   if(iStatus == SUCCESS && oNParent != NULL)
+      iStatus = Node_addChild(oNParent, psNew, ulIndex);
+   if(iStatus != SUCCESS) {
+      if(Node_cachedPath(psNew->ulSlot) == oPNewPath)
+         (void) DynArray_set(oDPaths, psNew->ulSlot, NULL);
+      Path_free(oPNewPath);
+      Node_dealloc(psNew->ulName, strlen(pcName) + 1);
+      Node_deallocRecord(psNew);
+      return iStatus;
+   }
+
+   *poNResult = psNew;
+
+   assert(oNParent == NULL || CheckerDT_Node_isValid(oNParent));
+   assert(CheckerDT_Node_isValid(*poNResult));
+
+   return SUCCESS;
+}
+
+/*
+  Frees oNNode's own storage: its children array and their counts,
+  name, cached path and record. oNNode's children must already have
+  been released.
+*/
+static void Node_destroy(Node_T oNNode) {
+   assert(oNNode != NULL);
+
+   if(oNNode->ulChildren != 0)
+      Node_dealloc(oNNode->ulChildren,
+                   2 * oNNode->ulCapacity * sizeof(size_t));
+   Node_dealloc(oNNode->ulName, strlen(Node_name(oNNode)) + 1);
+   Node_uncachePath(oNNode->ulSlot);
+   Node_deallocRecord(oNNode);
+}
+
+size_t Node_free(Node_T oNNode) {
+   size_t ulIndex;
+   size_t ulCount = 0;
+
+   assert(oNNode != NULL);
+   assert(CheckerDT_Node_isValid(oNNode));
+
+   /* remove from parent's list */
+   if(oNNode->ulParent != 0) {
+      Node_T oNParent = Node_at(oNNode->ulParent);
+      if(Node_findName(oNParent, Node_name(oNNode), &ulIndex) &&
+         Node_children(oNParent)[ulIndex] == Node_offsetOf(oNNode))
+         Node_removeChild(oNParent, ulIndex);
+   }
+
+   /* a snapshot still holds this subtree, so it stays intact */
+   if(--oNNode->ulRefs != 0)
+      return oNNode->ulSubtree;
+
+   /* recursively remove children */
+   while(oNNode->ulNumChildren != 0)
+      ulCount += Node_free(Node_at(Node_children(oNNode)[0]));
+
+   /* finally, free the node itself */
+   Node_destroy(oNNode);
+   ulCount++;
+   return ulCount;
+}
+
+Node_T Node_share(Node_T oNNode) {
+   assert(oNNode != NULL);
+
+   oNNode->ulRefs++;
+   return oNNode;
+}
+
+void Node_release(Node_T oNNode) {
+   size_t ulIndex;
+
+   assert(oNNode != NULL);
+
+   if(--oNNode->ulRefs != 0)
+      return;
+
+   /* no longer reachable from anywhere: release the children too,
+      without touching their parent links, which belong to whichever
+      copy of this node is in the hierarchy */
+   for(ulIndex = 0; ulIndex < oNNode->ulNumChildren; ulIndex++)
+      Node_release(Node_at(Node_children(oNNode)[ulIndex]));
+   Node_destroy(oNNode);
+}
+
+int Node_unshare(Node_T oNParent, Node_T oNNode, Node_T *poNResult) {
+   struct node *psNew;
+   size_t ulIndex;
+   int iStatus;
+
+   assert(oNNode != NULL);
+   assert(poNResult != NULL);
+   assert(oNParent == NULL || oNParent->ulRefs == 1);
+
+   if(oNNode->ulRefs == 1) {
+      *poNResult = oNNode;
+      return SUCCESS;
+   }
+
+   /* pin the original's path, which a later move of the copy must not
+      change for the snapshots still holding it */
+   if(Node_getPath(oNNode) == NULL) {
+      *poNResult = NULL;
+      return MEMORY_ERROR;
+   }
+
+   iStatus = Node_allocRecord(&psNew);
+   if(iStatus != SUCCESS) {
+      *poNResult = NULL;
+      return iStatus;
+   }
+   iStatus = Node_storeName(Node_name(oNNode), strlen(Node_name(oNNode)),
+                            &psNew->ulName);
+   if(iStatus != SUCCESS) {
+      Node_deallocRecord(psNew);
+      *poNResult = NULL;
+      return iStatus;
+   }
+   psNew->ulChildren = 0;
+   psNew->ulNumChildren = 0;
+   psNew->ulCapacity = 0;
+   iStatus = Node_reserveChildren(psNew, oNNode->ulNumChildren);
+   if(iStatus != SUCCESS) {
+      Node_dealloc(psNew->ulName, strlen(Node_name(psNew)) + 1);
+      Node_deallocRecord(psNew);
+      *poNResult = NULL;
+      return iStatus;
+   }
+
+   /* the copy shares every child with the original, and becomes the
+      parent the hierarchy sees for each of them */
+   for(ulIndex = 0; ulIndex < oNNode->ulNumChildren; ulIndex++) {
+      Node_T oNChild = Node_at(Node_children(oNNode)[ulIndex]);
+      oNChild->ulRefs++;
+      oNChild->ulParent = Node_offsetOf(psNew);
+      Node_children(psNew)[ulIndex] = Node_offsetOf(oNChild);
+      Node_counts(psNew)[ulIndex] = Node_counts(oNNode)[ulIndex];
+   }
+   psNew->ulNumChildren = oNNode->ulNumChildren;
+   psNew->ulParent = oNParent == NULL ? 0 : Node_offsetOf(oNParent);
+   psNew->ulDepth = oNNode->ulDepth;
+   psNew->ulRefs = 1;
+   psNew->ulSubtree = oNNode->ulSubtree;
+
+   /* swap the copy in for the original */
+   if(oNParent != NULL &&
+      Node_findName(oNParent, Node_name(oNNode), &ulIndex))
+      Node_children(oNParent)[ulIndex] = Node_offsetOf(psNew);
+   Node_release(oNNode);
+
+   *poNResult = psNew;
+   return SUCCESS;
+}
+
+/*
+  Copies every node of the subtree rooted at oNNode, which must itself
+  be safe to modify, that a snapshot shares, as Node_unshare does.
+  Returns SUCCESS, or MEMORY_ERROR if memory could not be allocated,
+  leaving the rest of the subtree shared.
+*/
+static int Node_unshareSubtree(Node_T oNNode) {
+   size_t ulIndex;
+   int iStatus;
+
+   assert(oNNode != NULL);
+
+   for(ulIndex = 0; ulIndex < oNNode->ulNumChildren; ulIndex++) {
+      Node_T oNChild = Node_at(Node_children(oNNode)[ulIndex]);
+      iStatus = Node_unshare(oNNode, oNChild, &oNChild);
+      if(iStatus == SUCCESS)
+         iStatus = Node_unshareSubtree(oNChild);
+      if(iStatus != SUCCESS)
+         return iStatus;
+   }
+   return SUCCESS;
+}
+
+/*
+  Sets the depth of every node of the subtree rooted at oNNode from
+  its parent's, and drops their cached paths to be built again.
+*/
+static void Node_redepth(Node_T oNNode) {
+   size_t ulIndex;
+
+   assert(oNNode != NULL);
+   assert(oNNode->ulParent != 0);
+
+   oNNode->ulDepth = Node_at(oNNode->ulParent)->ulDepth + 1;
+   Node_uncachePath(oNNode->ulSlot);
+   for(ulIndex = 0; ulIndex < oNNode->ulNumChildren; ulIndex++)
+      Node_redepth(Node_at(Node_children(oNNode)[ulIndex]));
+}
+
+int Node_move(Node_T oNNode, Node_T oNNewParent, Path_T oPNewPath,
+              boolean bShared) {
+   Node_T oNOldParent;
+   const char *pcName;
+   size_t ulName;
+   size_t ulOldIndex, ulNewIndex;
+   int iStatus;
+
+   assert(oNNode != NULL);
+   assert(oNNode->ulParent != 0);
+   assert(oNNewParent != NULL);
+   assert(oPNewPath != NULL);
+   assert(oNNode->ulRefs == 1);
+
+   /* copy anything a snapshot shares before the depths change */
+   if(bShared) {
+      iStatus = Node_unshareSubtree(oNNode);
+      if(iStatus != SUCCESS)
+         return iStatus;
+   }
+
+   pcName = Path_getComponent(oPNewPath, Path_getDepth(oPNewPath) - 1);
+   iStatus = Node_storeName(pcName, strlen(pcName), &ulName);
+   if(iStatus != SUCCESS)
+      return iStatus;
+
+   /* unlink oNNode, then link it in again where it belongs; removing
+      never shrinks an array, so putting it back cannot fail */
+   oNOldParent = Node_at(oNNode->ulParent);
+   if(!Node_findName(oNOldParent, Node_name(oNNode), &ulOldIndex))
+      assert(FALSE);
+   Node_removeChild(oNOldParent, ulOldIndex);
+   if(Node_findName(oNNewParent, pcName, &ulNewIndex))
+      assert(FALSE);
+   iStatus = Node_addChild(oNNewParent, oNNode, ulNewIndex);
+   if(iStatus != SUCCESS) {
+      (void) Node_addChild(oNOldParent, oNNode, ulOldIndex);
+      Node_dealloc(ulName, strlen(pcName) + 1);
+      return iStatus;
+   }
+   Node_dealloc(oNNode->ulName, strlen(Node_name(oNNode)) + 1);
+   oNNode->ulName = ulName;
+   oNNode->ulParent = Node_offsetOf(oNNewParent);
+
+   /* the depths are stored, so unlike the paths they cannot wait */
+   Node_redepth(oNNode);
+   return SUCCESS;
+}
+
+int Node_settlePaths(Node_T oNRoot) {
+   /* paths are cached only once built, and a move drops them */
+   (void) oNRoot;
+   return SUCCESS;
+}
+
+Path_T Node_getPath(Node_T oNNode) {
+   Path_T oPPath;
+   Path_T oPParentPath = NULL;
+
+   assert(oNNode != NULL);
+
+   oPPath = Node_cachedPath(oNNode->ulSlot);
+   if(oPPath != NULL)
+      return oPPath;
+
+   /* first use since the region was opened: extend the parent's */
+   if(oNNode->ulParent != 0) {
+      oPParentPath = Node_getPath(Node_at(oNNode->ulParent));
+      if(oPParentPath == NULL)
+         return NULL;
+   }
+   if(Path_newChild(oPParentPath, Node_name(oNNode),
+                    strlen(Node_name(oNNode)), &oPPath) != SUCCESS)
+      return NULL;
+   if(Node_cachePath(oNNode->ulSlot, oPPath) != SUCCESS) {
+      Path_free(oPPath);
+      return NULL;
+   }
+   return oPPath;
+}
+
+boolean Node_hasChild(Node_T oNParent, Path_T oPPath,
+                         size_t *pulChildID) {
+   assert(oNParent != NULL);
+   assert(oPPath != NULL);
+   assert(pulChildID != NULL);
+   assert(Path_getDepth(oPPath) > oNParent->ulDepth);
+
+   /* *pulChildID is the index into oNParent's children array */
+   return Node_findName(oNParent,
+                        Path_getComponent(oPPath, oNParent->ulDepth),
+                        pulChildID);
+}
+
+size_t Node_getNumChildren(Node_T oNParent) {
+   assert(oNParent != NULL);
+
+   return oNParent->ulNumChildren;
+}
+
+int  Node_getChild(Node_T oNParent, size_t ulChildID,
+                   Node_T *poNResult) {
+
+   assert(oNParent != NULL);
+   assert(poNResult != NULL);
+
+   /* ulChildID is the index into oNParent's children array */
+   if(ulChildID >= Node_getNumChildren(oNParent)) {
+      *poNResult = NULL;
+      return NO_SUCH_PATH;
+   }
+   else {
+      *poNResult = Node_at(Node_children(oNParent)[ulChildID]);
+      return SUCCESS;
+   }
+}
+
+size_t Node_getSubtreeSize(Node_T oNNode) {
+   assert(oNNode != NULL);
+
+   return oNNode->ulSubtree;
+}
+
+void Node_growSubtree(Node_T oNNode, size_t ulDelta) {
+   Node_T oNParent;
+   size_t ulIndex;
+
+   assert(oNNode != NULL);
+
+   oNNode->ulSubtree += ulDelta;
+
+   /* the parent's entries covering oNNode change with its size */
+   if(oNNode->ulParent == 0)
+      return;
+   oNParent = Node_at(oNNode->ulParent);
+   if(!Node_findName(oNParent, Node_name(oNNode), &ulIndex))
+      assert(FALSE);
+   for(ulIndex++; ulIndex <= oNParent->ulNumChildren;
+       ulIndex += Node_lowBit(ulIndex))
+      Node_counts(oNParent)[ulIndex - 1] += ulDelta;
+}
+
+void Node_shrinkSubtree(Node_T oNNode, size_t ulDelta) {
+   Node_T oNParent;
+   size_t ulIndex;
+
+   assert(oNNode != NULL);
+   assert(oNNode->ulSubtree > ulDelta);
+
+   oNNode->ulSubtree -= ulDelta;
+
+   if(oNNode->ulParent == 0)
+      return;
+   oNParent = Node_at(oNNode->ulParent);
+   if(!Node_findName(oNParent, Node_name(oNNode), &ulIndex))
+      assert(FALSE);
+   for(ulIndex++; ulIndex <= oNParent->ulNumChildren;
+       ulIndex += Node_lowBit(ulIndex))
+      Node_counts(oNParent)[ulIndex - 1] -= ulDelta;
+}
+
+size_t Node_countBefore(Node_T oNParent, size_t ulChildID) {
+   size_t ulCount = 0;
+
+   assert(oNParent != NULL);
+   assert(ulChildID <= oNParent->ulNumChildren);
+
+   for(; ulChildID > 0; ulChildID -= Node_lowBit(ulChildID))
+      ulCount += Node_counts(oNParent)[ulChildID - 1];
+   return ulCount;
+}
+
+size_t Node_findRank(Node_T oNParent, size_t ulRank,
+                     size_t *pulBefore) {
+   size_t ulLength;
+   size_t ulStep = 1;
+   size_t ulIndex = 0;
+   size_t ulBefore = 0;
+
+   assert(oNParent != NULL);
+   assert(pulBefore != NULL);
+
+   /* descend from the entry summing the most children, skipping each
+      entry whose children all come before the rank */
+   ulLength = oNParent->ulNumChildren;
+   while(ulStep <= ulLength / 2)
+      ulStep *= 2;
+   for(; ulLength != 0 && ulStep != 0; ulStep /= 2)
+      if(ulIndex + ulStep <= ulLength &&
+         ulBefore + Node_counts(oNParent)[ulIndex + ulStep - 1] <=
+         ulRank) {
+         ulIndex += ulStep;
+         ulBefore += Node_counts(oNParent)[ulIndex - 1];
+      }
+
+   *pulBefore = ulBefore;
+   return ulIndex;
+}
+
+void Node_getFootprint(Node_T oNNode, size_t *pulNodeBytes,
+                       size_t *pulPathBytes, size_t *pulChildBytes,
+                       size_t *pulSlack) {
+   Path_T oPPath;
+
+   assert(oNNode != NULL);
+   assert(pulNodeBytes != NULL);
+   assert(pulPathBytes != NULL);
+   assert(pulChildBytes != NULL);
+   assert(pulSlack != NULL);
+
+   *pulNodeBytes = Node_recordBytes();
+   *pulPathBytes = Node_blockBytes(strlen(Node_name(oNNode)) + 1);
+   oPPath = Node_cachedPath(oNNode->ulSlot);
+   if(oPPath != NULL)
+      *pulPathBytes += Path_getBytes(oPPath);
+   *pulChildBytes = 0;
+   if(oNNode->ulChildren != 0)
+      *pulChildBytes =
+         Node_blockBytes(2 * oNNode->ulCapacity * sizeof(size_t));
+   *pulSlack = oNNode->ulCapacity - oNNode->ulNumChildren;
+}
+
+Node_T Node_getParent(Node_T oNNode) {
+   assert(oNNode != NULL);
+
+   if(oNNode->ulParent == 0)
+      return NULL;
+   return Node_at(oNNode->ulParent);
+}
+
+int Node_compare(Node_T oNFirst, Node_T oNSecond) {
+   assert(oNFirst != NULL);
+   assert(oNSecond != NULL);
+
+   /* siblings are ordered by name alone, without building paths */
+   if(oNFirst->ulParent == oNSecond->ulParent)
+      return Node_compareName(oNFirst, Node_name(oNSecond));
+   return Path_comparePath(Node_getPath(oNFirst), Node_getPath(oNSecond));
+}
+
+char *Node_toString(Node_T oNNode) {
+   Path_T oPPath;
+   char *copyPath;
+
+   assert(oNNode != NULL);
+
+   oPPath = Node_getPath(oNNode);
+   if(oPPath == NULL)
+      return NULL;
+   copyPath = malloc(Path_getStrLength(oPPath)+1);
+   if(copyPath == NULL)
+      return NULL;
+   Alloc_noteAlloc(ALLOC_NODE_STRING, Path_getStrLength(oPPath)+1);
+   strcpy(copyPath, Path_getPathname(oPPath));
+   /* the string is the caller's to free from here */
+   Alloc_noteFree(ALLOC_NODE_STRING, Path_getStrLength(oPPath)+1);
+   return copyPath;
+}
+
+
+/* Returns the number of bytes of address space to reserve for a
+   region whose file is ulLength bytes long. */
+static size_t Node_reservation(size_t ulLength) {
+   /* 64 GiB where size_t allows, and 1 GiB otherwise */
+   size_t ulDefault = (size_t) 1 << (sizeof(size_t) > 4 ? 36 : 30);
+
+   return ulLength > ulDefault ? ulLength : ulDefault;
+}
+
+int Node_openRegion(const char *pcFile, Node_T *poNRoot,
+                    size_t *pulCount) {
+   struct stat sStat;
+   void *pvMap;
+   boolean bIsNew;
+
+   assert(psRegion == NULL);
+   assert(poNRoot != NULL);
+   assert(pulCount != NULL);
+
+   if(pcFile == NULL) {
+      psRegionTemp = tmpfile();
+      iRegionFd = psRegionTemp == NULL ? -1 : fileno(psRegionTemp);
+   }
+   else
+      iRegionFd = open(pcFile, O_RDWR | O_CREAT, 0666);
+   if(iRegionFd < 0 || fstat(iRegionFd, &sStat) != 0) {
+      Node_closeRegion();
+      return IO_ERROR;
+   }
+
+   bIsNew = sStat.st_size == 0;
+   if(bIsNew) {
+      if(ftruncate(iRegionFd, INITIAL_BYTES) != 0) {
+         Node_closeRegion();
+         return IO_ERROR;
+      }
+      sStat.st_size = INITIAL_BYTES;
+   }
+   else if(!S_ISREG(sStat.st_mode) ||
+           (size_t) sStat.st_size < sizeof(struct region)) {
+      Node_closeRegion();
+      return BAD_FORMAT;
+   }
+
+   ulReserved = Node_reservation((size_t) sStat.st_size);
+   pvMap = mmap(NULL, ulReserved, PROT_READ | PROT_WRITE, MAP_SHARED,
+                iRegionFd, 0);
+   if(pvMap == MAP_FAILED) {
+      Node_closeRegion();
+      return IO_ERROR;
+   }
+   psRegion = pvMap;
+
+   if(bIsNew) {
+      memcpy(psRegion->acMagic, acRegionMagic, sizeof(acRegionMagic));
+      psRegion->ulLength = INITIAL_BYTES;
+      psRegion->ulTop = (sizeof(struct region) + MIN_BLOCK_BYTES - 1) /
+                        MIN_BLOCK_BYTES * MIN_BLOCK_BYTES;
+      psRegion->ulRoot = 0;
+      psRegion->ulCount = 0;
+      psRegion->ulSlots = 0;
+      psRegion->ulFreeNodes = 0;
+      memset(psRegion->aulFree, 0, sizeof(psRegion->aulFree));
+   }
+   else if(memcmp(psRegion->acMagic, acRegionMagic,
+                  sizeof(acRegionMagic)) != 0 ||
+           psRegion->ulLength != (size_t) sStat.st_size ||
+           psRegion->ulTop > psRegion->ulLength ||
+           psRegion->ulRoot >= psRegion->ulTop) {
+      Node_closeRegion();
+      return BAD_FORMAT;
+   }
+
+   oDPaths = DynArray_new(0);
+   if(oDPaths == NULL) {
+      Node_closeRegion();
+      return MEMORY_ERROR;
+   }
+
+   *poNRoot = psRegion->ulRoot == 0 ? NULL : Node_at(psRegion->ulRoot);
+   *pulCount = psRegion->ulCount;
+   return SUCCESS;
+}
+
+int Node_syncRegion(Node_T oNRoot, size_t ulCount) {
+   assert(psRegion != NULL);
+
+   psRegion->ulRoot = oNRoot == NULL ? 0 : Node_offsetOf(oNRoot);
+   psRegion->ulCount = ulCount;
+   /* an anonymous region disappears with its file anyway */
+   if(psRegionTemp == NULL &&
+      msync(psRegion, psRegion->ulLength, MS_SYNC) != 0)
+      return IO_ERROR;
+   return SUCCESS;
+}
+
+void Node_closeRegion(void) {
+   size_t ulSlot;
+
+   if(oDPaths != NULL) {
+      for(ulSlot = 0; ulSlot < DynArray_getLength(oDPaths); ulSlot++)
+         Node_uncachePath(ulSlot);
+      DynArray_free(oDPaths);
+      oDPaths = NULL;
+   }
+   if(psRegion != NULL) {
+      (void) munmap(psRegion, ulReserved);
+      psRegion = NULL;
+   }
+   if(psRegionTemp != NULL) {
+      (void) fclose(psRegionTemp);
+      psRegionTemp = NULL;
+   }
+   else if(iRegionFd >= 0)
+      (void) close(iRegionFd);
+   iRegionFd = -1;
+}
@@ -0,0 +1,472 @@
+/*--------------------------------------------------------------------*/
+/* blob.c                                                             */
+/* Author: Christopher Moretti                                        */
+/*--------------------------------------------------------------------*/
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef FT_CONCURRENT
+#include <pthread.h>
+#endif
+
+#include "blob.h"
+#include "spill.h"
+#include "alloc.h"
+
+/* The number of buckets the table starts with; it doubles whenever
+   there come to be more blobs than buckets */
+enum {MIN_BUCKETS = 16};
+
+/* The hash is computed 16 bytes at a time */
+enum {HASH_BLOCK_BYTES = 16};
+
+/* A run of bytes in the store */
+struct blob {
+   /* the 128-bit hash of the bytes */
+   unsigned long aulHash[2];
+   /* the bytes, from malloc, or NULL while they are spilled, and how
+      many there are */
+   void *pvBytes;
+   size_t ulLength;
+   /* the bytes as counted against the spill budget, once for all
+      the references */
+   struct Spill_Unit sUnit;
+   /* the number of references to this blob */
+   size_t ulRefs;
+   /* the next blob in the same bucket */
+   struct blob *psNext;
+};
+
+/*
+  The store is an abstract object with 3 state variables:
+*/
+
+/* 1. the table of buckets, each a list of blobs, or NULL if empty */
+static struct blob **ppsBuckets;
+/* 2. the number of buckets, a power of two, or 0 if ppsBuckets is
+      NULL */
+static size_t ulBuckets;
+/* 3. the number of blobs, the bytes they hold in memory, and the
+      references to them */
+static size_t ulBlobs;
+static size_t ulBytes;
+static size_t ulRefs;
+
+#ifdef FT_CONCURRENT
+/* In FT_CONCURRENT builds there is also: */
+/* 4. a lock guarding all of the above and every blob's ulRefs */
+static pthread_mutex_t sStoreLock = PTHREAD_MUTEX_INITIALIZER;
+#define Blob_lock() ((void) pthread_mutex_lock(&sStoreLock))
+#define Blob_unlock() ((void) pthread_mutex_unlock(&sStoreLock))
+#else
+#define Blob_lock() ((void) 0)
+#define Blob_unlock() ((void) 0)
+#endif
+
+
+/* Returns ulX rotated left by iBits bits, where unsigned long is 64
+   bits wide, as it is everywhere this is built. */
+static unsigned long Blob_rotl(unsigned long ulX, int iBits) {
+   return (ulX << iBits) | (ulX >> (64 - iBits));
+}
+
+/* Returns ulK with its bits mixed so each affects every other. */
+static unsigned long Blob_finalMix(unsigned long ulK) {
+   ulK ^= ulK >> 33;
+   ulK *= 0xff51afd7ed558ccdUL;
+   ulK ^= ulK >> 33;
+   ulK *= 0xc4ceb9fe1a85ec53UL;
+   ulK ^= ulK >> 33;
+   return ulK;
+}
+
+/*
+  Stores in aulHash the 128-bit hash of the ulLength bytes at
+  pucBytes, with seed 0, as MurmurHash3_x64_128 computes it: a block
+  of 16 bytes is mixed in per round, and the bytes of the final
+  partial block, taken as little-endian words, are mixed in without
+  the rounds' rotation of the hash.
+*/
+static void Blob_hash(const unsigned char *pucBytes, size_t ulLength,
+                      unsigned long aulHash[2]) {
+   const unsigned long ulC1 = 0x87c37b91114253d5UL;
+   const unsigned long ulC2 = 0x4cf5ad432745937fUL;
+   unsigned long ulH1 = 0, ulH2 = 0;
+   unsigned long ulK1, ulK2;
+   unsigned long aulBlock[2];
+   size_t ulDone;
+   size_t ulTail;
+   size_t i;
+
+   assert(pucBytes != NULL);
+
+   for(ulDone = 0; ulLength - ulDone >= HASH_BLOCK_BYTES;
+       ulDone += HASH_BLOCK_BYTES) {
+      /* memcpy reads the block whatever its alignment */
+      memcpy(aulBlock, pucBytes + ulDone, HASH_BLOCK_BYTES);
+
+      ulK1 = aulBlock[0] * ulC1;
+      ulK1 = Blob_rotl(ulK1, 31) * ulC2;
+      ulH1 ^= ulK1;
+      ulH1 = (Blob_rotl(ulH1, 27) + ulH2) * 5 + 0x52dce729;
+
+      ulK2 = aulBlock[1] * ulC2;
+      ulK2 = Blob_rotl(ulK2, 33) * ulC1;
+      ulH2 ^= ulK2;
+      ulH2 = (Blob_rotl(ulH2, 31) + ulH1) * 5 + 0x38495ab5;
+   }
+
+   ulTail = ulLength - ulDone;
+   ulK1 = 0;
+   ulK2 = 0;
+   for(i = 0; i < ulTail; i++)
+      if(i < HASH_BLOCK_BYTES / 2)
+         ulK1 |= (unsigned long) pucBytes[ulDone + i] << (8 * i);
+      else
+         ulK2 |= (unsigned long) pucBytes[ulDone + i] <<
+                 (8 * (i - HASH_BLOCK_BYTES / 2));
+   if(ulTail > HASH_BLOCK_BYTES / 2) {
+      ulK2 *= ulC2;
+      ulK2 = Blob_rotl(ulK2, 33) * ulC1;
+      ulH2 ^= ulK2;
+   }
+   if(ulTail > 0) {
+      ulK1 *= ulC1;
+      ulK1 = Blob_rotl(ulK1, 31) * ulC2;
+      ulH1 ^= ulK1;
+   }
+
+   ulH1 ^= (unsigned long) ulLength;
+   ulH2 ^= (unsigned long) ulLength;
+   ulH1 += ulH2;
+   ulH2 += ulH1;
+   ulH1 = Blob_finalMix(ulH1);
+   ulH2 = Blob_finalMix(ulH2);
+   ulH1 += ulH2;
+   ulH2 += ulH1;
+   aulHash[0] = ulH1;
+   aulHash[1] = ulH2;
+}
+
+/* Returns the bucket of the table that holds blobs with hash
+   aulHash. The table must not be NULL. */
+static struct blob **Blob_bucket(const unsigned long aulHash[2]) {
+   assert(ppsBuckets != NULL);
+
+   return &ppsBuckets[aulHash[0] & (ulBuckets - 1)];
+}
+
+/*
+  Doubles the number of buckets, or makes the first MIN_BUCKETS if the
+  table is NULL. Returns SUCCESS, or MEMORY_ERROR if memory could not
+  be allocated, in which case the table is unchanged.
+*/
+static int Blob_grow(void) {
+   struct blob **ppsOld = ppsBuckets;
+   size_t ulOld = ulBuckets;
+   size_t ulIndex;
+
+   ulBuckets = ulOld == 0 ? MIN_BUCKETS : 2 * ulOld;
+   ppsBuckets = Alloc_calloc(ALLOC_CONTENTS_TABLE, ulBuckets,
+                             sizeof(struct blob *));
+   if(ppsBuckets == NULL) {
+      ppsBuckets = ppsOld;
+      ulBuckets = ulOld;
+      return MEMORY_ERROR;
+   }
+
+   for(ulIndex = 0; ulIndex < ulOld; ulIndex++)
+      while(ppsOld[ulIndex] != NULL) {
+         struct blob *psBlob = ppsOld[ulIndex];
+         struct blob **ppsBucket = Blob_bucket(psBlob->aulHash);
+         ppsOld[ulIndex] = psBlob->psNext;
+         psBlob->psNext = *ppsBucket;
+         *ppsBucket = psBlob;
+      }
+   Alloc_free(ALLOC_CONTENTS_TABLE, ppsOld,
+              ulOld * sizeof(struct blob *));
+   return SUCCESS;
+}
+
+/* Writes blob pvHolder's bytes to the spill file from offset ulSlot,
+   for Spill_evict. Returns SUCCESS, or IO_ERROR if they could not all
+   be written. */
+static int Blob_writeUnit(void *pvHolder, size_t ulSlot) {
+   struct blob *psBlob = pvHolder;
+
+   assert(psBlob != NULL);
+
+   return Spill_write(psBlob->pvBytes, ulSlot, psBlob->ulLength);
+}
+
+/* Frees blob pvHolder's bytes, which are then only in the spill
+   file, for Spill_evict. */
+static void Blob_dropUnit(void *pvHolder) {
+   struct blob *psBlob = pvHolder;
+
+   assert(psBlob != NULL);
+
+   free(psBlob->pvBytes);
+   psBlob->pvBytes = NULL;
+   ulBytes -= psBlob->ulLength;
+   Alloc_noteFree(ALLOC_CONTENTS_SHARED, psBlob->ulLength);
+}
+
+/* What a blob does for the spill file */
+static const struct Spill_Ops sBlobOps =
+   {Blob_writeUnit, Blob_dropUnit};
+
+/*
+  Reads psBlob's bytes back from the spill file, if they were spilled,
+  which may spill others, and marks them as the most recently used.
+  Returns SUCCESS, or MEMORY_ERROR if memory could not be allocated or
+  IO_ERROR if they could not be read, in which case they stay
+  spilled.
+*/
+static int Blob_loadBytes(struct blob *psBlob) {
+   void *pvBytes;
+
+   assert(psBlob != NULL);
+
+   if(!Spill_isSpilled(&psBlob->sUnit)) {
+      Spill_use(&psBlob->sUnit);
+      return SUCCESS;
+   }
+   pvBytes = malloc(psBlob->ulLength);
+   if(pvBytes == NULL)
+      return MEMORY_ERROR;
+   if(Spill_load(&psBlob->sUnit, pvBytes) != SUCCESS) {
+      free(pvBytes);
+      return IO_ERROR;
+   }
+   Alloc_noteAlloc(ALLOC_CONTENTS_SHARED, psBlob->ulLength);
+   psBlob->pvBytes = pvBytes;
+   ulBytes += psBlob->ulLength;
+   return SUCCESS;
+}
+
+/*
+  Unlinks psBlob, which has no references left, from the table, and
+  frees it, along with its bytes if bFreeBytes. The table itself is
+  freed with its last blob.
+*/
+static void Blob_remove(struct blob *psBlob, boolean bFreeBytes) {
+   struct blob **ppsLink;
+
+   assert(psBlob != NULL);
+   assert(psBlob->ulRefs == 0);
+
+   for(ppsLink = Blob_bucket(psBlob->aulHash); *ppsLink != psBlob;
+       ppsLink = &(*ppsLink)->psNext)
+      assert(*ppsLink != NULL);
+   *ppsLink = psBlob->psNext;
+   ulBlobs--;
+
+   Spill_forget(&psBlob->sUnit);
+   if(psBlob->pvBytes != NULL) {
+      if(bFreeBytes)
+         free(psBlob->pvBytes);
+      /* bytes that are not freed are handed to the caller to free */
+      ulBytes -= psBlob->ulLength;
+      Alloc_noteFree(ALLOC_CONTENTS_SHARED, psBlob->ulLength);
+   }
+   Alloc_free(ALLOC_CONTENTS_BLOB, psBlob, sizeof(struct blob));
+
+   if(ulBlobs == 0) {
+      Alloc_free(ALLOC_CONTENTS_TABLE, ppsBuckets,
+                 ulBuckets * sizeof(struct blob *));
+      ppsBuckets = NULL;
+      ulBuckets = 0;
+   }
+}
+
+
+int Blob_intern(const void *pvBytes, size_t ulLength,
+                Blob_T *poBResult) {
+   unsigned long aulHash[2];
+   struct blob *psBlob;
+   struct blob **ppsBucket;
+
+   assert(pvBytes != NULL);
+   assert(ulLength > 0);
+   assert(poBResult != NULL);
+
+   Blob_hash(pvBytes, ulLength, aulHash);
+
+   Blob_lock();
+   if(ppsBuckets != NULL) {
+      /* the bytes are compared too, so a collision costs only time,
+         and spilled ones are read back to be */
+      for(psBlob = *Blob_bucket(aulHash); psBlob != NULL;
+          psBlob = psBlob->psNext)
+         if(psBlob->aulHash[0] == aulHash[0] &&
+            psBlob->aulHash[1] == aulHash[1] &&
+            psBlob->ulLength == ulLength &&
+            Blob_loadBytes(psBlob) == SUCCESS &&
+            memcmp(psBlob->pvBytes, pvBytes, ulLength) == 0) {
+            psBlob->ulRefs++;
+            ulRefs++;
+            Blob_unlock();
+            *poBResult = psBlob;
+            return SUCCESS;
+         }
+   }
+
+   /* a full table grows, but one that cannot still holds more */
+   if((ppsBuckets == NULL || ulBlobs >= ulBuckets) &&
+      Blob_grow() != SUCCESS && ppsBuckets == NULL) {
+      Blob_unlock();
+      *poBResult = NULL;
+      return MEMORY_ERROR;
+   }
+
+   psBlob = Alloc_malloc(ALLOC_CONTENTS_BLOB, sizeof(struct blob));
+   if(psBlob == NULL) {
+      Blob_unlock();
+      *poBResult = NULL;
+      return MEMORY_ERROR;
+   }
+   /* the bytes may be handed to the client, so come from malloc */
+   psBlob->pvBytes = malloc(ulLength);
+   if(psBlob->pvBytes == NULL) {
+      Alloc_free(ALLOC_CONTENTS_BLOB, psBlob, sizeof(struct blob));
+      Blob_unlock();
+      *poBResult = NULL;
+      return MEMORY_ERROR;
+   }
+   Alloc_noteAlloc(ALLOC_CONTENTS_SHARED, ulLength);
+   memcpy(psBlob->pvBytes, pvBytes, ulLength);
+   psBlob->ulLength = ulLength;
+   psBlob->aulHash[0] = aulHash[0];
+   psBlob->aulHash[1] = aulHash[1];
+   psBlob->ulRefs = 1;
+   Spill_initUnit(&psBlob->sUnit, &sBlobOps, psBlob);
+
+   ppsBucket = Blob_bucket(aulHash);
+   psBlob->psNext = *ppsBucket;
+   *ppsBucket = psBlob;
+   ulBlobs++;
+   ulBytes += ulLength;
+   ulRefs++;
+   Spill_count(&psBlob->sUnit, ulLength, ulLength);
+   Blob_unlock();
+
+   *poBResult = psBlob;
+   return SUCCESS;
+}
+
+void *Blob_getBytes(Blob_T oBBlob) {
+   assert(oBBlob != NULL);
+
+   return oBBlob->pvBytes;
+}
+
+int Blob_load(Blob_T oBBlob) {
+   int iStatus;
+
+   assert(oBBlob != NULL);
+
+   Blob_lock();
+   iStatus = Blob_loadBytes(oBBlob);
+   Blob_unlock();
+   return iStatus;
+}
+
+boolean Blob_isSpilled(Blob_T oBBlob) {
+   assert(oBBlob != NULL);
+
+   return Spill_isSpilled(&oBBlob->sUnit);
+}
+
+int Blob_read(Blob_T oBBlob, size_t ulOffset, size_t ulLength,
+              void *pvBuffer) {
+   int iStatus = SUCCESS;
+
+   assert(oBBlob != NULL);
+   assert(ulOffset <= oBBlob->ulLength &&
+          ulLength <= oBBlob->ulLength - ulOffset);
+   assert(pvBuffer != NULL || ulLength == 0);
+
+   Blob_lock();
+   if(Spill_isSpilled(&oBBlob->sUnit))
+      iStatus = Spill_read(&oBBlob->sUnit, ulOffset, ulLength,
+                           pvBuffer);
+   else {
+      Spill_use(&oBBlob->sUnit);
+      memcpy(pvBuffer, (char *) oBBlob->pvBytes + ulOffset, ulLength);
+   }
+   Blob_unlock();
+   return iStatus;
+}
+
+size_t Blob_getLength(Blob_T oBBlob) {
+   assert(oBBlob != NULL);
+
+   return oBBlob->ulLength;
+}
+
+void Blob_release(Blob_T oBBlob) {
+   assert(oBBlob != NULL);
+
+   Blob_lock();
+   assert(oBBlob->ulRefs > 0);
+   oBBlob->ulRefs--;
+   ulRefs--;
+   if(oBBlob->ulRefs == 0)
+      Blob_remove(oBBlob, TRUE);
+   Blob_unlock();
+}
+
+int Blob_take(Blob_T oBBlob, void **ppvBytes) {
+   void *pvCopy;
+   int iStatus;
+
+   assert(oBBlob != NULL);
+   assert(ppvBytes != NULL);
+
+   Blob_lock();
+   assert(oBBlob->ulRefs > 0);
+   iStatus = Blob_loadBytes(oBBlob);
+   if(iStatus != SUCCESS) {
+      Blob_unlock();
+      *ppvBytes = NULL;
+      return iStatus;
+   }
+   if(oBBlob->ulRefs == 1) {
+      *ppvBytes = oBBlob->pvBytes;
+      oBBlob->ulRefs--;
+      ulRefs--;
+      Blob_remove(oBBlob, FALSE);
+      Blob_unlock();
+      return SUCCESS;
+   }
+
+   /* others still share the bytes, so the caller gets a copy */
+   pvCopy = malloc(oBBlob->ulLength);
+   if(pvCopy == NULL) {
+      Blob_unlock();
+      *ppvBytes = NULL;
+      return MEMORY_ERROR;
+   }
+   memcpy(pvCopy, oBBlob->pvBytes, oBBlob->ulLength);
+   oBBlob->ulRefs--;
+   ulRefs--;
+   Blob_unlock();
+
+   *ppvBytes = pvCopy;
+   return SUCCESS;
+}
+
+void Blob_getStats(size_t *pulBlobs, size_t *pulBytes,
+                   size_t *pulRefs) {
+   assert(pulBlobs != NULL);
+   assert(pulBytes != NULL);
+   assert(pulRefs != NULL);
+
+   Blob_lock();
+   *pulBlobs = ulBlobs;
+   *pulBytes = ulBytes;
+   *pulRefs = ulRefs;
+   Blob_unlock();
+}
@@ -0,0 +1,88 @@
+/*--------------------------------------------------------------------*/
+/* blob.h                                                             */
+/* Author: Christopher Moretti                                        */
+/*--------------------------------------------------------------------*/
+
+#ifndef BLOB_INCLUDED
+#define BLOB_INCLUDED
+
+#include <stddef.h>
+#include "a4def.h"
+
+/*
+  The blob store holds the contents of files in an FT that shares
+  them: each distinct run of bytes is kept once, as a blob, however
+  many files have it. Blobs are found by a 128-bit hash of their
+  bytes, and each counts the references to it, being freed when the
+  last is released. Each blob's bytes are counted against the spill
+  budget once (see spill.h), and spilled for all its references at
+  once. The store is an abstract object; in FT_CONCURRENT
+  builds it has a lock of its own, so files beneath different node
+  locks may share a blob.
+*/
+
+/* A Blob_T is a counted reference to one run of bytes in the store */
+typedef struct blob *Blob_T;
+
+/*
+  Finds the blob holding the ulLength bytes at pvBytes, which must not
+  be NULL, adding them to the store if it has no such blob yet.
+  Returns SUCCESS and sets *poBResult to the blob, with one more
+  reference for the caller. Otherwise sets *poBResult to NULL and
+  returns MEMORY_ERROR if memory could not be allocated.
+*/
+int Blob_intern(const void *pvBytes, size_t ulLength,
+                Blob_T *poBResult);
+
+/* Returns the bytes that oBBlob holds, which must not be modified,
+   or NULL if they are spilled (see Blob_load). */
+void *Blob_getBytes(Blob_T oBBlob);
+
+/*
+  Reads oBBlob's bytes back from the spill file, if they were spilled,
+  which may spill others, and marks them as the most recently used.
+  Returns SUCCESS, or MEMORY_ERROR if memory could not be allocated or
+  IO_ERROR if they could not be read, in which case they stay
+  spilled.
+*/
+int Blob_load(Blob_T oBBlob);
+
+/* Returns TRUE if oBBlob's bytes are only in the spill file, and FALSE
+   otherwise. */
+boolean Blob_isSpilled(Blob_T oBBlob);
+
+/*
+  Copies the ulLength bytes of oBBlob from offset ulOffset, which must
+  all be within it, into pvBuffer, reading spilled ones where they are
+  in the spill file. Returns SUCCESS, or IO_ERROR if they could not
+  all be read.
+*/
+int Blob_read(Blob_T oBBlob, size_t ulOffset, size_t ulLength,
+              void *pvBuffer);
+
+/* Returns the number of bytes that oBBlob holds. */
+size_t Blob_getLength(Blob_T oBBlob);
+
+/* Releases a reference to oBBlob, freeing it if it was the last. */
+void Blob_release(Blob_T oBBlob);
+
+/*
+  Releases a reference to oBBlob as Blob_release does, and sets
+  *ppvBytes to a block from malloc holding oBBlob's bytes, which the
+  caller then owns. If the reference was the last, the block is the
+  blob's own, so nothing is copied. Spilled bytes are read back first,
+  as Blob_load does. Returns SUCCESS, or MEMORY_ERROR if memory could
+  not be allocated or IO_ERROR if spilled bytes could not be read, in
+  which case *ppvBytes is NULL and the reference is kept.
+*/
+int Blob_take(Blob_T oBBlob, void **ppvBytes);
+
+/*
+  Stores in *pulBlobs the number of blobs in the store, in *pulBytes
+  the number of bytes they hold in memory, spilled ones not counted,
+  and in *pulRefs the number of references to them.
+*/
+void Blob_getStats(size_t *pulBlobs, size_t *pulBytes,
+                   size_t *pulRefs);
+
+#endif
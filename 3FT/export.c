@@ -0,0 +1,516 @@
+/*--------------------------------------------------------------------*/
+/* export.c                                                           */
+/* Author: Christopher Moretti                                        */
+/*--------------------------------------------------------------------*/
+
+/* writev and the *at functions are POSIX.1-2008 interfaces */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stddef.h>
+#include <assert.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "path.h"
+#include "alloc.h"
+#include "tar.h"
+#include "export.h"
+
+/* The most pieces, and the most tar headers, waiting to be written */
+enum {MAX_PIECES = 64, MAX_HEADERS = 16};
+
+/* The zeros that pad contents, and end an archive */
+static const unsigned char aucZeros[TAR_BLOCK];
+
+/* Pieces waiting to be written to a file descriptor */
+struct Export_Gather {
+   /* the file descriptor being written */
+   int iFd;
+   /* SUCCESS, or IO_ERROR once a write has failed, or the status of
+      reading spilled contents back once that has */
+   int iStatus;
+   /* the number of pieces waiting, and the pieces */
+   size_t ulPieces;
+   struct iovec asPieces[MAX_PIECES];
+   /* the number of headers in aaucHeaders that pieces point to */
+   size_t ulHeaders;
+   unsigned char aaucHeaders[MAX_HEADERS][TAR_BLOCK];
+};
+
+/* Writes all the pieces waiting in psGather, then forgets them. */
+static void Export_flush(struct Export_Gather *psGather) {
+   struct iovec *psNext;
+   size_t ulLeft;
+
+   assert(psGather != NULL);
+
+   psNext = psGather->asPieces;
+   ulLeft = psGather->ulPieces;
+   while(ulLeft > 0 && psGather->iStatus == SUCCESS) {
+      ssize_t lWritten = writev(psGather->iFd, psNext, (int) ulLeft);
+      if(lWritten < 0 && errno == EINTR)
+         continue;
+      if(lWritten <= 0) {
+         psGather->iStatus = IO_ERROR;
+         break;
+      }
+      /* skip the pieces written whole, and trim one written in part */
+      while(ulLeft > 0 && (size_t) lWritten >= psNext->iov_len) {
+         lWritten -= (ssize_t) psNext->iov_len;
+         psNext++;
+         ulLeft--;
+      }
+      if(ulLeft > 0) {
+         psNext->iov_base = (char *) psNext->iov_base + lWritten;
+         psNext->iov_len -= (size_t) lWritten;
+      }
+   }
+   psGather->ulPieces = 0;
+   psGather->ulHeaders = 0;
+}
+
+/* Adds the ulLength bytes at pvBytes, which must stay as they are
+   until written, to the pieces waiting in psGather. */
+static void Export_piece(struct Export_Gather *psGather,
+                         const void *pvBytes, size_t ulLength) {
+   assert(psGather != NULL);
+   assert(pvBytes != NULL || ulLength == 0);
+
+   if(ulLength == 0)
+      return;
+   if(psGather->ulPieces == MAX_PIECES)
+      Export_flush(psGather);
+   /* writev only reads the bytes */
+   psGather->asPieces[psGather->ulPieces].iov_base = (void *) pvBytes;
+   psGather->asPieces[psGather->ulPieces].iov_len = ulLength;
+   psGather->ulPieces++;
+}
+
+/* Adds the contents of file oNNode, piece by piece, to the pieces
+   waiting in psGather. */
+static void Export_contents(struct Export_Gather *psGather,
+                            Node_T oNNode) {
+   const void *pvBytes;
+   size_t ulLength;
+   size_t ulIndex;
+
+   assert(psGather != NULL);
+   assert(oNNode != NULL);
+
+   /* reading spilled contents back may spill others' still waiting */
+   if(Node_isSpilled(oNNode)) {
+      Export_flush(psGather);
+      if(psGather->iStatus != SUCCESS)
+         return;
+      psGather->iStatus = Node_loadContents(oNNode);
+      if(psGather->iStatus != SUCCESS)
+         return;
+   }
+   for(ulIndex = 0;
+       Node_getPiece(oNNode, ulIndex, &pvBytes, &ulLength);
+       ulIndex++)
+      Export_piece(psGather, pvBytes, ulLength);
+}
+
+/* Adds a new header of zeros to the pieces waiting in psGather, and
+   returns it to be filled in before the next flush. */
+static unsigned char *Export_header(struct Export_Gather *psGather) {
+   unsigned char *pucHeader;
+
+   assert(psGather != NULL);
+
+   if(psGather->ulHeaders == MAX_HEADERS ||
+      psGather->ulPieces == MAX_PIECES)
+      Export_flush(psGather);
+   pucHeader = psGather->aaucHeaders[psGather->ulHeaders++];
+   memset(pucHeader, 0, TAR_BLOCK);
+   Export_piece(psGather, pucHeader, TAR_BLOCK);
+   return pucHeader;
+}
+
+/* Writes ulValue into the ulWidth bytes at pucField as a tar header
+   does, in octal with leading zeros and a final '\0', keeping only
+   the digits that fit. */
+static void Export_octal(unsigned char *pucField, size_t ulWidth,
+                         size_t ulValue) {
+   size_t i;
+
+   assert(pucField != NULL);
+   assert(ulWidth > 0);
+
+   pucField[ulWidth - 1] = '\0';
+   for(i = ulWidth - 1; i > 0; i--) {
+      pucField[i - 1] = (unsigned char) ('0' + (ulValue & 7));
+      ulValue >>= 3;
+   }
+}
+
+/* Fills in header pucHeader's mode, owners, time, type cType, size
+   ulSize, magic and checksum, leaving its name and prefix alone. */
+static void Export_finish(unsigned char *pucHeader, char cType,
+                          size_t ulSize) {
+   size_t ulSum = 0;
+   size_t i;
+
+   assert(pucHeader != NULL);
+
+   Export_octal(pucHeader + TAR_MODE, 8, cType == '5' ? 0755 : 0644);
+   Export_octal(pucHeader + TAR_UID, 8, 0);
+   Export_octal(pucHeader + TAR_GID, 8, 0);
+   Export_octal(pucHeader + TAR_SIZE, TAR_SIZE_BYTES, ulSize);
+   Export_octal(pucHeader + TAR_MTIME, 12, 0);
+   pucHeader[TAR_TYPE] = (unsigned char) cType;
+   memcpy(pucHeader + TAR_MAGIC, "ustar", 6);
+   memcpy(pucHeader + TAR_VERSION, "00", 2);
+
+   /* the checksum is summed as if its own field were spaces */
+   memset(pucHeader + TAR_CHKSUM, ' ', 8);
+   for(i = 0; i < TAR_BLOCK; i++)
+      ulSum += pucHeader[i];
+   Export_octal(pucHeader + TAR_CHKSUM, 7, ulSum);
+}
+
+/* Returns the number of decimal digits in ulValue. */
+static size_t Export_digits(size_t ulValue) {
+   size_t ulDigits = 1;
+
+   while(ulValue >= 10) {
+      ulValue /= 10;
+      ulDigits++;
+   }
+   return ulDigits;
+}
+
+/*
+  Writes at pcOut, if it is not NULL, a pax extended header record
+  setting pcKey to the ulLength bytes at pcValue, followed by a slash
+  if bSlash, and returns the length of the record: its own length in
+  decimal, a space, the key, '=', the value and a newline.
+*/
+static size_t Export_paxRecord(char *pcOut, const char *pcKey,
+                               const char *pcValue, size_t ulLength,
+                               boolean bSlash) {
+   size_t ulBody;
+   size_t ulTotal;
+   size_t ulKey;
+
+   assert(pcKey != NULL);
+   assert(pcValue != NULL);
+
+   ulKey = strlen(pcKey);
+   ulBody = 1 + ulKey + 1 + ulLength + (bSlash ? 1 : 0) + 1;
+   /* the length counts its own digits */
+   ulTotal = ulBody + 1;
+   while(ulBody + Export_digits(ulTotal) != ulTotal)
+      ulTotal = ulBody + Export_digits(ulTotal);
+   if(pcOut == NULL)
+      return ulTotal;
+
+   pcOut += sprintf(pcOut, "%lu %s=", (unsigned long) ulTotal, pcKey);
+   memcpy(pcOut, pcValue, ulLength);
+   pcOut += ulLength;
+   if(bSlash)
+      *pcOut++ = '/';
+   *pcOut = '\n';
+   return ulTotal;
+}
+
+/*
+  Adds to psGather the tar header of the node with pathname pcPath,
+  of ulLength characters, that is a directory if cType is '5' and a
+  file with ulSize bytes of contents if it is '0'. A pathname (with
+  a directory's trailing slash) that does not fit the header's name
+  field, or its prefix and name fields split at a slash, or a size
+  that does not fit its size field, is given in full in a pax
+  extended header first, which is written out at once. Returns
+  SUCCESS, or MEMORY_ERROR if memory could not be allocated.
+*/
+static int Export_tarHeader(struct Export_Gather *psGather,
+                            const char *pcPath, size_t ulLength,
+                            char cType, size_t ulSize) {
+   enum {SIZE_DIGITS = 3 * sizeof(size_t) + 1};
+   unsigned char *pucHeader;
+   boolean bSlash = (boolean) (cType == '5');
+   size_t ulFull = ulLength + (bSlash ? 1 : 0);
+   size_t ulSplit = 0;
+   boolean bFits = FALSE;
+   boolean bLong;
+   char acSize[SIZE_DIGITS];
+   char *pcPax;
+   size_t ulPax = 0;
+
+   assert(psGather != NULL);
+   assert(pcPath != NULL);
+
+   /* split at the first slash that leaves a short enough name */
+   if(ulFull <= TAR_NAME_BYTES)
+      bFits = TRUE;
+   else
+      for(ulSplit = 1; ulSplit <= TAR_PREFIX_BYTES &&
+                       ulSplit < ulLength; ulSplit++)
+         if(pcPath[ulSplit] == '/' &&
+            ulFull - ulSplit - 1 <= TAR_NAME_BYTES) {
+            bFits = TRUE;
+            break;
+         }
+   bLong = (boolean) (ulSize >> (3 * (TAR_SIZE_BYTES - 1)) != 0);
+
+   if(!bFits || bLong) {
+      sprintf(acSize, "%lu", (unsigned long) ulSize);
+      if(!bFits)
+         ulPax += Export_paxRecord(NULL, "path", pcPath, ulLength,
+                                   bSlash);
+      if(bLong)
+         ulPax += Export_paxRecord(NULL, "size", acSize, strlen(acSize),
+                                   FALSE);
+      /* room for the '\0' that sprintf adds to the last number */
+      pcPax = Alloc_malloc(ALLOC_TREE_OUT, ulPax + 1);
+      if(pcPax == NULL)
+         return MEMORY_ERROR;
+      ulPax = 0;
+      if(!bFits)
+         ulPax += Export_paxRecord(pcPax, "path", pcPath, ulLength,
+                                   bSlash);
+      if(bLong)
+         ulPax += Export_paxRecord(pcPax + ulPax, "size", acSize,
+                                   strlen(acSize), FALSE);
+      pucHeader = Export_header(psGather);
+      memcpy(pucHeader, "././@PaxHeader", 14);
+      Export_finish(pucHeader, 'x', ulPax);
+      Export_piece(psGather, pcPax, ulPax);
+      Export_piece(psGather, aucZeros,
+                   (TAR_BLOCK - ulPax % TAR_BLOCK) % TAR_BLOCK);
+      Export_flush(psGather);
+      Alloc_free(ALLOC_TREE_OUT, pcPax, ulPax + 1);
+   }
+
+   /* readers that know pax headers ignore what had to be cut */
+   pucHeader = Export_header(psGather);
+   if(bFits && ulSplit > 0) {
+      memcpy(pucHeader + TAR_PREFIX, pcPath, ulSplit);
+      pcPath += ulSplit + 1;
+      ulLength -= ulSplit + 1;
+   }
+   else if(!bFits && ulFull > TAR_NAME_BYTES) {
+      pcPath += ulFull - TAR_NAME_BYTES;
+      ulLength -= ulFull - TAR_NAME_BYTES;
+   }
+   memcpy(pucHeader, pcPath, ulLength);
+   if(bSlash)
+      pucHeader[ulLength] = '/';
+   Export_finish(pucHeader, cType, bLong ? 0 : ulSize);
+   return SUCCESS;
+}
+
+/*
+  Adds to psGather the tar entries of the subtree rooted at oNNode,
+  in pre-order, each directory's files before its subdirectories.
+  Returns SUCCESS, or MEMORY_ERROR if memory could not be allocated.
+  The paths in the subtree must have been settled.
+*/
+static int Export_tarSubtree(struct Export_Gather *psGather,
+                             Node_T oNNode) {
+   Path_T oPPath;
+   size_t ulLength;
+   size_t ulIndex;
+   int iStatus;
+
+   assert(psGather != NULL);
+   assert(oNNode != NULL);
+
+   oPPath = Node_getPath(oNNode);
+   if(!Node_isFile(oNNode))
+      ulLength = 0;
+   else
+      ulLength = Node_getLength(oNNode);
+   iStatus = Export_tarHeader(psGather, Path_getPathname(oPPath),
+                              Path_getStrLength(oPPath),
+                              Node_isFile(oNNode) ? '0' : '5',
+                              ulLength);
+   if(iStatus != SUCCESS)
+      return iStatus;
+   if(Node_isFile(oNNode)) {
+      Export_contents(psGather, oNNode);
+      Export_piece(psGather, aucZeros,
+                   (TAR_BLOCK - ulLength % TAR_BLOCK) % TAR_BLOCK);
+      return SUCCESS;
+   }
+
+   for(ulIndex = 0; ulIndex < Node_getNumChildren(oNNode) &&
+                    psGather->iStatus == SUCCESS; ulIndex++) {
+      Node_T oNChild = NULL;
+      (void) Node_getChild(oNNode, ulIndex, &oNChild);
+      iStatus = Export_tarSubtree(psGather, oNChild);
+      if(iStatus != SUCCESS)
+         return iStatus;
+   }
+   return SUCCESS;
+}
+
+/*
+  Returns TRUE if every node in the subtree rooted at oNNode is named
+  by its last component as an entry of its parent directory on disk,
+  and FALSE if any component is empty, ".", "..", or holds a '/',
+  which would name somewhere else. The paths in the subtree must
+  have been settled.
+*/
+static boolean Export_isNamed(Node_T oNNode) {
+   Path_T oPPath;
+   const char *pcName;
+   size_t ulIndex;
+
+   assert(oNNode != NULL);
+
+   oPPath = Node_getPath(oNNode);
+   pcName = Path_getComponent(oPPath, Path_getDepth(oPPath) - 1);
+   if(*pcName == '\0' || !strcmp(pcName, ".") ||
+      !strcmp(pcName, "..") || strchr(pcName, '/') != NULL)
+      return FALSE;
+   for(ulIndex = 0; ulIndex < Node_getNumChildren(oNNode); ulIndex++) {
+      Node_T oNChild = NULL;
+      (void) Node_getChild(oNNode, ulIndex, &oNChild);
+      if(!Export_isNamed(oNChild))
+         return FALSE;
+   }
+   return TRUE;
+}
+
+/*
+  Mirrors the subtree rooted at oNNode in the directory open on
+  iDirFd, in pre-order: a directory as a subdirectory, made unless
+  there is one already, and a file as a regular file, made or
+  emptied, into which its contents are written from psGather. Sets
+  psGather's status to IO_ERROR if anything cannot be made or
+  written. The paths in the subtree must have been settled.
+*/
+static void Export_dirSubtree(struct Export_Gather *psGather,
+                              int iDirFd, Node_T oNNode) {
+   Path_T oPPath;
+   const char *pcName;
+   int iFd;
+   size_t ulIndex;
+
+   assert(psGather != NULL);
+   assert(oNNode != NULL);
+
+   oPPath = Node_getPath(oNNode);
+   pcName = Path_getComponent(oPPath, Path_getDepth(oPPath) - 1);
+   if(Node_isFile(oNNode)) {
+      iFd = openat(iDirFd, pcName, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+      if(iFd < 0) {
+         psGather->iStatus = IO_ERROR;
+         return;
+      }
+      psGather->iFd = iFd;
+      Export_contents(psGather, oNNode);
+      Export_flush(psGather);
+      if(close(iFd) != 0)
+         psGather->iStatus = IO_ERROR;
+      return;
+   }
+
+   /* each directory is reached through its parent's descriptor, so
+      no pathname on disk is ever built */
+   if(mkdirat(iDirFd, pcName, 0777) != 0 && errno != EEXIST) {
+      psGather->iStatus = IO_ERROR;
+      return;
+   }
+   iFd = openat(iDirFd, pcName, O_RDONLY | O_DIRECTORY);
+   if(iFd < 0) {
+      psGather->iStatus = IO_ERROR;
+      return;
+   }
+   for(ulIndex = 0; ulIndex < Node_getNumChildren(oNNode) &&
+                    psGather->iStatus == SUCCESS; ulIndex++) {
+      Node_T oNChild = NULL;
+      (void) Node_getChild(oNNode, ulIndex, &oNChild);
+      Export_dirSubtree(psGather, iFd, oNChild);
+   }
+   (void) close(iFd);
+}
+
+/*
+  Sets *ppsGather to new pieces to be written to iFd. Returns
+  SUCCESS, or MEMORY_ERROR if memory could not be allocated.
+*/
+static int Export_start(int iFd, struct Export_Gather **ppsGather) {
+   struct Export_Gather *psGather;
+
+   assert(ppsGather != NULL);
+
+   psGather = Alloc_malloc(ALLOC_TREE_OUT,
+                           sizeof(struct Export_Gather));
+   if(psGather == NULL)
+      return MEMORY_ERROR;
+   psGather->iFd = iFd;
+   psGather->iStatus = SUCCESS;
+   psGather->ulPieces = 0;
+   psGather->ulHeaders = 0;
+   *ppsGather = psGather;
+   return SUCCESS;
+}
+
+/* Ends an export begun by Export_start with psGather, returning its
+   status. */
+static int Export_end(struct Export_Gather *psGather) {
+   int iStatus;
+
+   assert(psGather != NULL);
+
+   iStatus = psGather->iStatus;
+   Alloc_free(ALLOC_TREE_OUT, psGather, sizeof(struct Export_Gather));
+   return iStatus;
+}
+
+int Export_dir(Node_T oNRoot, const char *pcDiskPath) {
+   struct Export_Gather *psGather = NULL;
+   int iDirFd;
+   int iStatus;
+
+   assert(pcDiskPath != NULL);
+
+   iStatus = Export_start(-1, &psGather);
+   if(iStatus != SUCCESS)
+      return iStatus;
+   /* every name is checked before anything is made, so none can lead
+      outside pcDiskPath */
+   if(oNRoot != NULL && !Export_isNamed(oNRoot)) {
+      psGather->iStatus = IO_ERROR;
+      return Export_end(psGather);
+   }
+   iDirFd = open(pcDiskPath, O_RDONLY | O_DIRECTORY);
+   if(iDirFd < 0)
+      psGather->iStatus = IO_ERROR;
+   else {
+      if(oNRoot != NULL)
+         Export_dirSubtree(psGather, iDirFd, oNRoot);
+      (void) close(iDirFd);
+   }
+   return Export_end(psGather);
+}
+
+int Export_tar(Node_T oNRoot, int iFd) {
+   struct Export_Gather *psGather = NULL;
+   int iStatus;
+
+   iStatus = Export_start(iFd, &psGather);
+   if(iStatus != SUCCESS)
+      return iStatus;
+   if(oNRoot != NULL)
+      iStatus = Export_tarSubtree(psGather, oNRoot);
+   if(iStatus == SUCCESS) {
+      /* an archive ends with two blocks of zeros */
+      Export_piece(psGather, aucZeros, TAR_BLOCK);
+      Export_piece(psGather, aucZeros, TAR_BLOCK);
+      Export_flush(psGather);
+   }
+   else
+      psGather->iStatus = iStatus;
+   return Export_end(psGather);
+}
@@ -0,0 +1,43 @@
+/*--------------------------------------------------------------------*/
+/* export.h                                                           */
+/* Author: Christopher Moretti                                        */
+/*--------------------------------------------------------------------*/
+
+#ifndef EXPORT_INCLUDED
+#define EXPORT_INCLUDED
+
+#include "a4def.h"
+#include "nodeFT.h"
+
+/*
+  The exporter writes an FT out for FT_exportDir and FT_exportTar.
+  What is to be written is gathered as pieces (file contents where
+  the FT keeps them, tar headers and padding) that go to writev
+  together, so contents are never copied on the way out. Only a few
+  dozen pieces and headers wait at once, so the memory used does not
+  grow with the FT. The caller must hold the FT so that nothing in it
+  changes until the export returns, and must have settled the paths
+  of the subtree being exported.
+*/
+
+/*
+  Mirrors the subtree rooted at oNRoot, if it is not NULL, in
+  directory pcDiskPath on disk, in pre-order: a directory as a
+  subdirectory, made unless there is one already, and a file as a
+  regular file, made or emptied, into which its contents are written.
+  Returns SUCCESS, IO_ERROR if anything cannot be made or written, or,
+  making nothing, if a node's name is ".", ".." or holds a '/',
+  MEMORY_ERROR if memory could not be allocated, or as
+  Node_loadContents does for spilled contents.
+*/
+int Export_dir(Node_T oNRoot, const char *pcDiskPath);
+
+/*
+  Writes the subtree rooted at oNRoot, if it is not NULL, to iFd as a
+  ustar archive, in pre-order, each directory's files before its
+  subdirectories, with pax extended headers for the pathnames and
+  sizes that do not fit a ustar header. Returns as Export_dir does.
+*/
+int Export_tar(Node_T oNRoot, int iFd);
+
+#endif
@@ -0,0 +1,2882 @@
+/*--------------------------------------------------------------------*/
+/* ft.c                                                               */
+/* Author: Christopher Moretti                                        */
+/*--------------------------------------------------------------------*/
+
+/* reader-writer locks, mmap and clock_gettime are POSIX.1-2008
+   interfaces */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stddef.h>
+#include <assert.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#ifdef FT_CONCURRENT
+#include <pthread.h>
+#endif
+
+#include "dynarray.h"
+#include "path.h"
+#include "nodeFT.h"
+#include "blob.h"
+#include "mapping.h"
+#include "spill.h"
+#include "import.h"
+#include "export.h"
+#include "tar.h"
+#include "journal.h"
+#include "alloc.h"
+#ifdef FT_METRICS
+#include "latency.h"
+#endif
+#include "ft.h"
+
+
+/*
+  A File Tree is a representation of a hierarchy of directories and
+  files, represented as an AO with 3 state variables:
+*/
+
+/* 1. a flag for being in an initialized state (TRUE) or not (FALSE) */
+static boolean bIsInitialized;
+/* 2. a pointer to the root node in the hierarchy */
+static Node_T oNRoot;
+/* 3. a counter of the number of nodes in the hierarchy */
+static size_t ulCount;
+
+#ifdef FT_CONCURRENT
+/* In FT_CONCURRENT builds there are also two locks: */
+/* 4. a tree-wide lock, held shared by the operations on one path,
+      and exclusively by the operations on the whole FT */
+static pthread_rwlock_t sTreeLock = PTHREAD_RWLOCK_INITIALIZER;
+/* 5. a lock guarding oNRoot, standing in for the root's parent when
+      coupling node locks down the hierarchy */
+static pthread_mutex_t sRootLock = PTHREAD_MUTEX_INITIALIZER;
+#else
+/* Single-threaded builds instead keep a traversal cursor: */
+/* 4. the node the last traversal reached, or NULL, from whose
+      ancestors the next traversal resumes */
+static Node_T oNCursor;
+/* 5. the number of traversals that resumed from the cursor */
+static size_t ulCursorHits;
+/* 6. the number of traversals that started from the root */
+static size_t ulCursorMisses;
+#endif
+
+/* Changes to the hierarchy may also be journaled, given: */
+/* 7. the journal that the changing operations append to, or NULL */
+static Journal_T oJJournal;
+#ifdef FT_CONCURRENT
+/* 8. a lock guarding oJJournal, so records go in one at a time */
+static pthread_mutex_t sJournalLock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/* The contents of files are kept as given by: */
+/* 9. the storage that FT_setStorage last chose, and the threshold
+      that FT_setInlineThreshold last set, neither of which can change
+      while the FT is initialized */
+static enum FT_Storage eStorage = FT_STORE_CLIENT;
+static size_t ulInlineThreshold;
+/* 10. the budget that FT_setMemoryBudget last set for the contents
+       the FT owns, 0 for none, and the spill file open on iSpillFd
+       that those beyond it go to */
+static size_t ulMemoryBudget;
+static int iSpillFd = -1;
+
+/* The operation codes of the records in a FT journal */
+enum {FT_LOG_INSERT_DIR = 1, FT_LOG_INSERT_FILE, FT_LOG_REPLACE,
+      FT_LOG_RM_DIR, FT_LOG_RM_FILE, FT_LOG_MV, FT_LOG_WRITE,
+      FT_LOG_TRUNCATE};
+
+#ifdef FT_METRICS
+/* The operations whose calls FT_METRICS builds time */
+enum FT_Op {FT_OP_INSERT_DIR, FT_OP_CONTAINS_DIR, FT_OP_RM_DIR,
+            FT_OP_INSERT_FILE, FT_OP_CONTAINS_FILE, FT_OP_RM_FILE,
+            FT_OP_MV, FT_OP_GET_CONTENTS, FT_OP_REPLACE_CONTENTS,
+            FT_OP_STAT, FT_OP_STAT_TREE, FT_OP_READ_RANGE,
+            FT_OP_WRITE_RANGE, FT_OP_APPEND, FT_OP_TRUNCATE,
+            FT_OP_INIT, FT_OP_DESTROY, FT_OP_TOSTRING, FT_OP_FIND,
+            FT_OP_SAVE, FT_OP_LOAD, FT_OP_IMPORT, FT_OP_EXPORT_DIR,
+            FT_OP_EXPORT_TAR, FT_OP_IMPORT_TAR, FT_OP_INSERT_FROM_FD,
+            FT_NUM_OPS};
+static const char *apcOpNames[FT_NUM_OPS] =
+   {"FT_insertDir", "FT_containsDir", "FT_rmDir", "FT_insertFile",
+    "FT_containsFile", "FT_rmFile", "FT_mv", "FT_getFileContents",
+    "FT_replaceFileContents", "FT_stat", "FT_statTree",
+    "FT_readFileRange", "FT_writeFileRange", "FT_appendFile",
+    "FT_truncateFile", "FT_init", "FT_destroy", "FT_toString",
+    "FT_find", "FT_save", "FT_load", "FT_import", "FT_exportDir",
+    "FT_exportTar", "FT_importTar", "FT_insertFileFromFd"};
+
+/* FT_METRICS builds also keep: */
+/* 11. for each operation and status, a latency histogram of the calls
+      to the operation that returned the status */
+static size_t aulLatencies[FT_NUM_OPS][LATENCY_STATUSES]
+                          [LATENCY_BUCKETS];
+#endif
+
+
+/* --------------------------------------------------------------------
+
+  The following helpers compile away unless FT_CONCURRENT is defined,
+  exactly as their DT counterparts do.
+*/
+#ifdef FT_CONCURRENT
+
+#define FT_readLock() ((void) pthread_rwlock_rdlock(&sTreeLock))
+#define FT_writeLock() ((void) pthread_rwlock_wrlock(&sTreeLock))
+#define FT_treeUnlock() ((void) pthread_rwlock_unlock(&sTreeLock))
+#define FT_addCount(n) \
+   ((void) __atomic_add_fetch(&ulCount, (n), __ATOMIC_RELAXED))
+#define FT_subCount(n) \
+   ((void) __atomic_sub_fetch(&ulCount, (n), __ATOMIC_RELAXED))
+#define FT_setCursor(oNNode) ((void) 0)
+#define FT_journalLock() ((void) pthread_mutex_lock(&sJournalLock))
+#define FT_journalUnlock() ((void) pthread_mutex_unlock(&sJournalLock))
+
+/* Locks oNNode, or the root lock if oNNode is NULL. */
+static void FT_lock(Node_T oNNode) {
+   if(oNNode == NULL)
+      (void) pthread_mutex_lock(&sRootLock);
+   else
+      Node_lock(oNNode);
+}
+
+/* Unlocks oNNode, or the root lock if oNNode is NULL. */
+static void FT_unlock(Node_T oNNode) {
+   if(oNNode == NULL)
+      (void) pthread_mutex_unlock(&sRootLock);
+   else
+      Node_unlock(oNNode);
+}
+
+/*
+  Releases the locks left held by FT_traversePath or FT_findNode on
+  oNNode and, if bHoldParent, on its parent.
+*/
+static void FT_release(Node_T oNNode, boolean bHoldParent) {
+   if(oNNode == NULL) {
+      FT_unlock(NULL);
+      return;
+   }
+   if(bHoldParent)
+      FT_unlock(Node_getParent(oNNode));
+   FT_unlock(oNNode);
+}
+
+#else
+
+#define FT_readLock() ((void) 0)
+#define FT_writeLock() ((void) 0)
+#define FT_treeUnlock() ((void) 0)
+#define FT_addCount(n) ((void) (ulCount += (n)))
+#define FT_subCount(n) ((void) (ulCount -= (n)))
+#define FT_setCursor(oNNode) ((void) (oNCursor = (oNNode)))
+#define FT_lock(oNNode) ((void) 0)
+#define FT_unlock(oNNode) ((void) 0)
+#define FT_release(oNNode, bHoldParent) ((void) 0)
+#define FT_journalLock() ((void) 0)
+#define FT_journalUnlock() ((void) 0)
+
+#endif
+
+/*
+  Appends a record of operation iOp on pcPath, with the ulLength bytes
+  at pvData, to the journal, if there is one. Callers still hold the
+  node locks that ordered the change, so conflicting changes are
+  journaled in the order they were made.
+*/
+static void FT_log(int iOp, const char *pcPath, const void *pvData,
+                   size_t ulLength) {
+   FT_journalLock();
+   if(oJJournal != NULL)
+      (void) Journal_append(oJJournal, iOp, pcPath, pvData, ulLength);
+   FT_journalUnlock();
+}
+
+/*
+  Appends a record of operation iOp on pcPath to the journal, if there
+  is one, as FT_log does, whose data is ulNumber followed by the
+  ulLength bytes at pvData.
+*/
+static void FT_logNumbered(int iOp, const char *pcPath,
+                           size_t ulNumber, const void *pvData,
+                           size_t ulLength) {
+   FT_journalLock();
+   if(oJJournal != NULL)
+      (void) Journal_appendNumbered(oJJournal, iOp, pcPath, ulNumber,
+                                    pvData, ulLength);
+   FT_journalUnlock();
+}
+
+/* --------------------------------------------------------------------
+
+  FT_timeCall makes a call to an operation, and in FT_METRICS builds
+  counts its latency in the histogram for operation eOp and status
+  iStatus, exactly as DT_timeCall does.
+*/
+#ifdef FT_METRICS
+
+#ifdef FT_CONCURRENT
+#define FT_countCall(pulCount) \
+   ((void) __atomic_add_fetch((pulCount), 1, __ATOMIC_RELAXED))
+#define FT_getCalls(pulCount) \
+   __atomic_load_n((pulCount), __ATOMIC_RELAXED)
+#else
+#define FT_countCall(pulCount) ((void) ++*(pulCount))
+#define FT_getCalls(pulCount) (*(pulCount))
+#endif
+
+#define FT_timeCall(eOp, call, iStatus) \
+   do { \
+      unsigned long ulStart = Latency_now(); \
+      (call); \
+      FT_countCall(&aulLatencies[eOp][iStatus] \
+                   [Latency_bucketSince(ulStart)]); \
+   } while(0)
+
+#else
+
+#define FT_timeCall(eOp, call, iStatus) ((void) (call))
+
+#endif
+/*--------------------------------------------------------------------*/
+
+
+/* --------------------------------------------------------------------
+
+  The FT_traversePath and FT_findNode functions modularize the common
+  functionality of going as far as possible down an FT towards a path
+  and returning either the node of however far was reached or the
+  node if the full path was reached, respectively.
+*/
+
+/*
+  Starts a traversal towards absolute path oPPath at the root. Returns
+  an int SUCCESS status and sets *poNRoot to the root, which may be
+  NULL. Otherwise, sets *poNRoot to NULL and returns with status:
+  * CONFLICTING_PATH if the root's path is not a prefix of oPPath
+  * MEMORY_ERROR if memory could not be allocated to complete request
+
+  The locks left held on SUCCESS are as for FT_traversePath.
+*/
+static int FT_enterRoot(Path_T oPPath, boolean bHoldParent,
+                        Node_T *poNRoot) {
+   Path_T oPPrefix = NULL;
+   int iStatus;
+
+   assert(oPPath != NULL);
+   assert(poNRoot != NULL);
+
+   FT_lock(NULL);
+
+   /* root is NULL -> won't find anything */
+   if(oNRoot == NULL) {
+      *poNRoot = NULL;
+      return SUCCESS;
+   }
+
+   iStatus = Path_prefix(oPPath, 1, &oPPrefix);
+   if(iStatus != SUCCESS) {
+      FT_unlock(NULL);
+      *poNRoot = NULL;
+      return iStatus;
+   }
+
+   if(Path_comparePath(Node_getPath(oNRoot), oPPrefix)) {
+      FT_unlock(NULL);
+      Path_free(oPPrefix);
+      *poNRoot = NULL;
+      return CONFLICTING_PATH;
+   }
+   Path_free(oPPrefix);
+
+   *poNRoot = oNRoot;
+   FT_lock(*poNRoot);
+   if(!bHoldParent)
+      FT_unlock(NULL);
+   return SUCCESS;
+}
+
+/*
+  Traverses the FT from the root (or the cursor, see below) as far as
+  possible towards absolute path oPPath. If able to traverse, returns
+  an int SUCCESS status and sets *poNFurthest to the furthest node
+  reached (which may be only a prefix of oPPath, or even NULL if the
+  root is NULL). Otherwise, sets *poNFurthest to NULL and returns with
+  status:
+  * CONFLICTING_PATH if the root's path is not a prefix of oPPath
+  * MEMORY_ERROR if memory could not be allocated to complete request
+
+  Each directory keeps its files apart from its subdirectories, so
+  unless eKind is FT_FIND_ALL the last component of oPPath is only
+  looked for among the children of that kind, and a node of the other
+  kind there is not reached.
+
+  In single-threaded builds, the traversal resumes from the deepest
+  ancestor of the cursor that is also an ancestor of oPPath, when that
+  is below the root, and leaves the cursor at *poNFurthest.
+
+  In FT_CONCURRENT builds, a SUCCESS return leaves *poNFurthest locked
+  (the root lock if it is NULL) and, if bHoldParent, its parent too
+  (the root lock if it is the root); FT_release drops them. No locks
+  are left held on any other status.
+*/
+static int FT_traversePath(Path_T oPPath, boolean bHoldParent,
+                           enum FT_FindKind eKind,
+                           Node_T *poNFurthest) {
+   int iStatus;
+   Path_T oPPrefix = NULL;
+   Node_T oNCurr;
+   Node_T oNChild = NULL;
+   size_t ulDepth;
+   size_t i;
+   size_t ulChildID;
+   boolean bFound;
+
+   assert(oPPath != NULL);
+   assert(poNFurthest != NULL);
+
+   oNCurr = NULL;
+   i = 2;
+#ifndef FT_CONCURRENT
+   /* siblings are often visited in a row, so climb from the cursor
+      only as far as the path it shares with oPPath */
+   if(oNCursor != NULL && Node_getPath(oNCursor) != NULL) {
+      size_t ulShared = Path_getSharedPrefixDepth(
+                           Node_getPath(oNCursor), oPPath);
+      if(ulShared > 1) {
+         oNCurr = oNCursor;
+         for(i = Path_getDepth(Node_getPath(oNCurr)); i > ulShared; i--)
+            oNCurr = Node_getParent(oNCurr);
+         i = ulShared + 1;
+      }
+   }
+   if(oNCurr != NULL)
+      ulCursorHits++;
+   else
+      ulCursorMisses++;
+#endif
+   if(oNCurr == NULL) {
+      iStatus = FT_enterRoot(oPPath, bHoldParent, &oNCurr);
+      if(iStatus != SUCCESS || oNCurr == NULL) {
+         *poNFurthest = NULL;
+         return iStatus;
+      }
+   }
+
+   ulDepth = Path_getDepth(oPPath);
+   for(; i <= ulDepth; i++) {
+      iStatus = Path_prefix(oPPath, i, &oPPrefix);
+      if(iStatus != SUCCESS) {
+         FT_release(oNCurr, bHoldParent);
+         *poNFurthest = NULL;
+         return iStatus;
+      }
+      if(i == ulDepth && eKind != FT_FIND_ALL)
+         bFound = Node_hasChildOfKind(oNCurr, oPPrefix,
+                     (boolean) (eKind == FT_FIND_FILES), &ulChildID);
+      else
+         bFound = Node_hasChild(oNCurr, oPPrefix, &ulChildID);
+      if(bFound) {
+         /* go to that child and continue with next prefix */
+         Path_free(oPPrefix);
+         oPPrefix = NULL;
+         iStatus = Node_getChild(oNCurr, ulChildID, &oNChild);
+         /* a path left stale by FT_mv is rewritten under the parent's
+            lock, so no two threads rewrite the same one */
+         if(iStatus == SUCCESS && Node_getPath(oNChild) == NULL)
+            iStatus = MEMORY_ERROR;
+         if(iStatus != SUCCESS) {
+            FT_release(oNCurr, bHoldParent);
+            *poNFurthest = NULL;
+            return iStatus;
+         }
+         /* hand-over-hand: take the child before letting go above */
+         FT_lock(oNChild);
+         if(bHoldParent)
+            FT_unlock(Node_getParent(oNCurr));
+         else
+            FT_unlock(oNCurr);
+         oNCurr = oNChild;
+      }
+      else {
+         /* oNCurr doesn't have child with path oPPrefix:
+            this is as far as we can go */
+         break;
+      }
+   }
+
+   Path_free(oPPrefix);
+   FT_setCursor(oNCurr);
+   *poNFurthest = oNCurr;
+   return SUCCESS;
+}
+
+/*
+  Traverses the FT to find a node with absolute path pcPath, of kind
+  eKind as FT_traversePath looks for it. Returns a
+  int SUCCESS status and sets *poNResult to be the node, if found.
+  Otherwise, sets *poNResult to NULL and returns with status:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state
+  * BAD_PATH if pcPath does not represent a well-formatted path
+  * CONFLICTING_PATH if the root's path is not a prefix of pcPath
+  * NO_SUCH_PATH if no node with pcPath exists in the hierarchy
+  * MEMORY_ERROR if memory could not be allocated to complete request
+
+  On SUCCESS, locks are left held as by FT_traversePath.
+ */
+static int FT_findNode(const char *pcPath, boolean bHoldParent,
+                       enum FT_FindKind eKind, Node_T *poNResult) {
+   Path_T oPPath = NULL;
+   Node_T oNFound = NULL;
+   int iStatus;
+
+   assert(pcPath != NULL);
+   assert(poNResult != NULL);
+
+   if(!bIsInitialized) {
+      *poNResult = NULL;
+      return INITIALIZATION_ERROR;
+   }
+
+   iStatus = Path_new(pcPath, &oPPath);
+   if(iStatus != SUCCESS) {
+      *poNResult = NULL;
+      return iStatus;
+   }
+
+   iStatus = FT_traversePath(oPPath, bHoldParent, eKind, &oNFound);
+   if(iStatus != SUCCESS)
+   {
+      Path_free(oPPath);
+      *poNResult = NULL;
+      return iStatus;
+   }
+
+   if(oNFound == NULL) {
+      FT_release(oNFound, bHoldParent);
+      Path_free(oPPath);
+      *poNResult = NULL;
+      return NO_SUCH_PATH;
+   }
+
+   if(Path_comparePath(Node_getPath(oNFound), oPPath) != 0) {
+      FT_release(oNFound, bHoldParent);
+      Path_free(oPPath);
+      *poNResult = NULL;
+      return NO_SUCH_PATH;
+   }
+
+   Path_free(oPPath);
+   *poNResult = oNFound;
+   return SUCCESS;
+}
+
+/* Returns the bytes of room for contents that a new file's node is
+   made with: the inline threshold if the FT shares contents, and
+   none otherwise. */
+static size_t FT_nodeRoom(void) {
+   return eStorage == FT_STORE_SHARED ? ulInlineThreshold : 0;
+}
+
+/*
+  Inserts a new directory (if !bIsFile) or file with contents
+  pvContents of ulLength bytes (if bIsFile) into the FT with absolute
+  path pcPath, creating any missing ancestor directories. If oBBlob is
+  not NULL, pvContents must be its bytes, and the new file is handed
+  the caller's reference to it on SUCCESS. If oMMapping is not NULL,
+  pvContents must be NULL and ulLength 0, and the new file's contents
+  are instead all the bytes of oMMapping, handing it the caller's
+  reference on SUCCESS. Otherwise an FT that shares contents copies
+  them into the new file's node. Returns statuses as documented for
+  FT_insertDir and FT_insertFile.
+*/
+static int FT_insert(const char *pcPath, boolean bIsFile,
+                     void *pvContents, size_t ulLength,
+                     Blob_T oBBlob, Mapping_T oMMapping) {
+   int iStatus;
+   Path_T oPPath = NULL;
+   Node_T oNFurthest = NULL;
+   Node_T oNFirstNew = NULL;
+   Node_T oNCurr = NULL;
+   size_t ulDepth, ulIndex;
+   size_t ulNewNodes = 0;
+
+   assert(pcPath != NULL);
+
+   FT_readLock();
+
+   /* validate pcPath and generate a Path_T for it */
+   if(!bIsInitialized) {
+      FT_treeUnlock();
+      return INITIALIZATION_ERROR;
+   }
+
+   iStatus = Path_new(pcPath, &oPPath);
+   if(iStatus != SUCCESS) {
+      FT_treeUnlock();
+      return iStatus;
+   }
+
+   /* a file can never be the root */
+   ulDepth = Path_getDepth(oPPath);
+   if(bIsFile && ulDepth == 1) {
+      Path_free(oPPath);
+      FT_treeUnlock();
+      return CONFLICTING_PATH;
+   }
+
+   /* find the closest ancestor of oPPath already in the tree */
+   iStatus = FT_traversePath(oPPath, FALSE, FT_FIND_ALL, &oNFurthest);
+   if(iStatus != SUCCESS)
+   {
+      Path_free(oPPath);
+      FT_treeUnlock();
+      return iStatus;
+   }
+   oNCurr = oNFurthest;
+
+   /* no ancestor node found, so if root is not NULL,
+      pcPath isn't underneath root. */
+   if(oNCurr == NULL && oNRoot != NULL) {
+      FT_release(oNFurthest, FALSE);
+      Path_free(oPPath);
+      FT_treeUnlock();
+      return CONFLICTING_PATH;
+   }
+
+   if(oNCurr == NULL) /* new root! */
+      ulIndex = 1;
+   else {
+      ulIndex = Path_getDepth(Node_getPath(oNCurr))+1;
+
+      /* oNCurr is the node we're trying to insert */
+      if(ulIndex == ulDepth+1 && !Path_comparePath(oPPath,
+                                       Node_getPath(oNCurr))) {
+         FT_release(oNFurthest, FALSE);
+         Path_free(oPPath);
+         FT_treeUnlock();
+         return ALREADY_IN_TREE;
+      }
+
+      /* oNCurr is a proper prefix of oPPath, so must be a directory */
+      if(Node_isFile(oNCurr)) {
+         FT_release(oNFurthest, FALSE);
+         Path_free(oPPath);
+         FT_treeUnlock();
+         return NOT_A_DIRECTORY;
+      }
+   }
+
+   /* starting at oNCurr, build rest of the path one level at a time;
+      the new nodes are only reachable through oNFurthest, whose lock
+      is held until they are all in place */
+   while(ulIndex <= ulDepth) {
+      Path_T oPPrefix = NULL;
+      Node_T oNNewNode = NULL;
+      boolean bNewIsFile = (boolean) (bIsFile && ulIndex == ulDepth);
+
+      /* generate a Path_T for this level */
+      iStatus = Path_prefix(oPPath, ulIndex, &oPPrefix);
+      if(iStatus != SUCCESS) {
+         Path_free(oPPath);
+         if(oNFirstNew != NULL) {
+            FT_lock(oNFirstNew);
+            (void) Node_free(oNFirstNew);
+         }
+         FT_release(oNFurthest, FALSE);
+         FT_treeUnlock();
+         return iStatus;
+      }
+
+      /* insert the new node for this level */
+      iStatus = Node_new(oPPrefix, oNCurr, bNewIsFile,
+                         pvContents, ulLength, FT_nodeRoom(),
+                         &oNNewNode);
+      if(iStatus != SUCCESS) {
+         Path_free(oPPath);
+         Path_free(oPPrefix);
+         if(oNFirstNew != NULL) {
+            FT_lock(oNFirstNew);
+            (void) Node_free(oNFirstNew);
+         }
+         FT_release(oNFurthest, FALSE);
+         FT_treeUnlock();
+         return iStatus;
+      }
+
+      /* set up for next level */
+      Path_free(oPPrefix);
+      oNCurr = oNNewNode;
+      ulNewNodes++;
+      if(oNFirstNew == NULL)
+         oNFirstNew = oNCurr;
+      ulIndex++;
+   }
+
+   Path_free(oPPath);
+   if(oBBlob != NULL)
+      (void) Node_shareContents(oNCurr, oBBlob);
+   else if(oMMapping != NULL) {
+      /* the mapped bytes are the ones journaled */
+      Node_mapContents(oNCurr, oMMapping, 0,
+                       Mapping_getLength(oMMapping));
+      pvContents = Node_getContents(oNCurr);
+      ulLength = Node_getLength(oNCurr);
+   }
+   else if(bIsFile && eStorage == FT_STORE_SHARED)
+      (void) Node_inlineContents(oNCurr, pvContents, ulLength);
+   /* update FT state variables to reflect insertion; a new root
+      was only built if the root lock is the one held */
+   if(oNFurthest == NULL)
+      oNRoot = oNFirstNew;
+   FT_addCount(ulNewNodes);
+   if(bIsFile)
+      FT_log(FT_LOG_INSERT_FILE, pcPath, pvContents, ulLength);
+   else
+      FT_log(FT_LOG_INSERT_DIR, pcPath, NULL, 0);
+
+   FT_release(oNFurthest, FALSE);
+   FT_treeUnlock();
+   return SUCCESS;
+}
+
+/*
+  Returns TRUE if the FT contains a node with absolute path pcPath
+  that is a file (if bIsFile) or a directory (if !bIsFile), and FALSE
+  if not or if there is an error while checking.
+*/
+static boolean FT_contains(const char *pcPath, boolean bIsFile) {
+   int iStatus;
+   Node_T oNFound = NULL;
+   boolean bResult = FALSE;
+
+   assert(pcPath != NULL);
+
+   /* only the children of the kind asked for are searched */
+   FT_readLock();
+   iStatus = FT_findNode(pcPath, FALSE,
+                         bIsFile ? FT_FIND_FILES : FT_FIND_DIRS,
+                         &oNFound);
+   if(iStatus == SUCCESS) {
+      bResult = (boolean) (Node_isFile(oNFound) == bIsFile);
+      FT_release(oNFound, FALSE);
+   }
+   FT_treeUnlock();
+
+   return bResult;
+}
+
+/*
+  Removes the FT hierarchy (subtree) at the node with absolute path
+  pcPath, which must be a file (if bIsFile) or a directory (if
+  !bIsFile). Returns statuses as documented for FT_rmDir and FT_rmFile.
+*/
+static int FT_rm(const char *pcPath, boolean bIsFile) {
+   int iStatus;
+   Node_T oNFound = NULL;
+   Node_T oNParent;
+
+   assert(pcPath != NULL);
+
+   FT_readLock();
+   iStatus = FT_findNode(pcPath, TRUE, FT_FIND_ALL, &oNFound);
+
+   if(iStatus != SUCCESS) {
+      FT_treeUnlock();
+      return iStatus;
+   }
+
+   if(Node_isFile(oNFound) != bIsFile) {
+      FT_release(oNFound, TRUE);
+      FT_treeUnlock();
+      if(bIsFile)
+         return NOT_A_FILE;
+      else
+         return NOT_A_DIRECTORY;
+   }
+
+   /* Node_free releases oNFound's lock, but not its parent's */
+   oNParent = Node_getParent(oNFound);
+   FT_subCount(Node_free(oNFound));
+   /* the cursor was left at oNFound, so move it out of harm's way */
+   FT_setCursor(oNParent);
+   if(oNParent == NULL)
+      oNRoot = NULL;
+   FT_log(bIsFile ? FT_LOG_RM_FILE : FT_LOG_RM_DIR, pcPath, NULL, 0);
+   FT_unlock(oNParent);
+   FT_treeUnlock();
+
+   return SUCCESS;
+}
+/*--------------------------------------------------------------------*/
+
+
+int FT_insertDir(const char *pcPath) {
+   int iStatus;
+
+   assert(pcPath != NULL);
+
+   FT_timeCall(FT_OP_INSERT_DIR,
+               iStatus = FT_insert(pcPath, FALSE, NULL, 0, NULL, NULL),
+               iStatus);
+   return iStatus;
+}
+
+boolean FT_containsDir(const char *pcPath) {
+   boolean bFound;
+
+   assert(pcPath != NULL);
+
+   FT_timeCall(FT_OP_CONTAINS_DIR, bFound = FT_contains(pcPath, FALSE),
+               bFound ? SUCCESS : NO_SUCH_PATH);
+   return bFound;
+}
+
+int FT_rmDir(const char *pcPath) {
+   int iStatus;
+
+   assert(pcPath != NULL);
+
+   FT_timeCall(FT_OP_RM_DIR, iStatus = FT_rm(pcPath, FALSE), iStatus);
+   return iStatus;
+}
+
+/*
+  Finds the blob in the store for the contents pvContents of ulLength
+  bytes given to an FT that shares contents, setting *poBBlob to it
+  and *ppvContents and *pulLength to pvContents and ulLength, which
+  stay in memory while a budget may spill the blob's own copy, or
+  *poBBlob to NULL and the others to NULL and 0 if the contents are
+  NULL or empty. Contents no longer than the inline threshold are
+  left for the file's node to copy: *poBBlob is set to NULL and the
+  others to pvContents and ulLength. Returns SUCCESS, or MEMORY_ERROR
+  if memory could not be allocated.
+*/
+static int FT_internContents(void *pvContents, size_t ulLength,
+                             Blob_T *poBBlob, void **ppvContents,
+                             size_t *pulLength) {
+   assert(poBBlob != NULL);
+   assert(ppvContents != NULL);
+   assert(pulLength != NULL);
+
+   *poBBlob = NULL;
+   *ppvContents = NULL;
+   *pulLength = 0;
+   if(pvContents == NULL || ulLength == 0)
+      return SUCCESS;
+   if(ulLength <= ulInlineThreshold) {
+      *ppvContents = pvContents;
+      *pulLength = ulLength;
+      return SUCCESS;
+   }
+   if(Blob_intern(pvContents, ulLength, poBBlob) != SUCCESS)
+      return MEMORY_ERROR;
+   *ppvContents = pvContents;
+   *pulLength = ulLength;
+   return SUCCESS;
+}
+
+/* Does the work of FT_insertFile, which FT_METRICS builds time */
+static int FT_insertFileUntimed(const char *pcPath, void *pvContents,
+                                size_t ulLength) {
+   Blob_T oBBlob = NULL;
+   int iStatus;
+
+   assert(pcPath != NULL);
+
+   /* the contents are copied before any lock is taken */
+   if(eStorage == FT_STORE_SHARED &&
+      FT_internContents(pvContents, ulLength, &oBBlob, &pvContents,
+                        &ulLength) != SUCCESS)
+      return MEMORY_ERROR;
+
+   iStatus = FT_insert(pcPath, TRUE, pvContents, ulLength, oBBlob,
+                       NULL);
+   if(iStatus != SUCCESS && oBBlob != NULL)
+      Blob_release(oBBlob);
+   return iStatus;
+}
+
+int FT_insertFile(const char *pcPath, void *pvContents,
+                  size_t ulLength) {
+   int iStatus;
+
+   assert(pcPath != NULL);
+
+   FT_timeCall(FT_OP_INSERT_FILE,
+               iStatus = FT_insertFileUntimed(pcPath, pvContents,
+                                              ulLength),
+               iStatus);
+   return iStatus;
+}
+
+/* Does the work of FT_insertFileFromFd, which FT_METRICS builds
+   time */
+static int FT_insertFileFromFdUntimed(const char *pcPath, int iFd,
+                                      size_t ulOffset,
+                                      size_t ulLength) {
+   Mapping_T oMMapping = NULL;
+   int iStatus;
+
+   assert(pcPath != NULL);
+
+   if(ulLength == 0)
+      return FT_insert(pcPath, TRUE, NULL, 0, NULL, NULL);
+   iStatus = Mapping_newRange(iFd, ulOffset, ulLength, &oMMapping);
+   if(iStatus != SUCCESS)
+      return iStatus;
+
+   /* a sharing FT keeps copies, as for FT_insertFile, so the mapping
+      is only needed while they are made */
+   if(eStorage == FT_STORE_SHARED)
+      iStatus = FT_insertFileUntimed(pcPath,
+                                     Mapping_getBytes(oMMapping),
+                                     ulLength);
+   else {
+      iStatus = FT_insert(pcPath, TRUE, NULL, 0, NULL, oMMapping);
+      if(iStatus == SUCCESS)
+         oMMapping = NULL;
+   }
+   if(oMMapping != NULL)
+      Mapping_release(oMMapping);
+   return iStatus;
+}
+
+int FT_insertFileFromFd(const char *pcPath, int iFd, size_t ulOffset,
+                        size_t ulLength) {
+   int iStatus;
+
+   assert(pcPath != NULL);
+
+   FT_timeCall(FT_OP_INSERT_FROM_FD,
+               iStatus = FT_insertFileFromFdUntimed(pcPath, iFd,
+                                                    ulOffset, ulLength),
+               iStatus);
+   return iStatus;
+}
+
+boolean FT_containsFile(const char *pcPath) {
+   boolean bFound;
+
+   assert(pcPath != NULL);
+
+   FT_timeCall(FT_OP_CONTAINS_FILE, bFound = FT_contains(pcPath, TRUE),
+               bFound ? SUCCESS : NO_SUCH_PATH);
+   return bFound;
+}
+
+int FT_rmFile(const char *pcPath) {
+   int iStatus;
+
+   assert(pcPath != NULL);
+
+   FT_timeCall(FT_OP_RM_FILE, iStatus = FT_rm(pcPath, TRUE), iStatus);
+   return iStatus;
+}
+
+/* Does the work of FT_mv, which FT_METRICS builds time */
+static int FT_mvUntimed(const char *pcOldPath, const char *pcNewPath) {
+   int iStatus;
+   Path_T oPNewPath = NULL;
+   Path_T oPOldPath;
+   Node_T oNFound = NULL;
+   Node_T oNParent = NULL;
+   size_t ulDepth;
+
+   assert(pcOldPath != NULL);
+   assert(pcNewPath != NULL);
+
+   /* the locks of both parents are needed at once, which coupling
+      down the hierarchy cannot give, so take the whole FT */
+   FT_writeLock();
+   iStatus = FT_findNode(pcOldPath, FALSE, FT_FIND_ALL, &oNFound);
+   if(iStatus != SUCCESS) {
+      FT_treeUnlock();
+      return iStatus;
+   }
+   FT_release(oNFound, FALSE);
+
+   iStatus = Path_new(pcNewPath, &oPNewPath);
+   if(iStatus != SUCCESS) {
+      FT_treeUnlock();
+      return iStatus;
+   }
+
+   /* the new path must not be oNFound's own or one beneath it, which
+      also keeps the root in place; the new parent must exist as a
+      directory, and must not have the new path yet */
+   oPOldPath = Node_getPath(oNFound);
+   ulDepth = Path_getDepth(oPOldPath);
+   if(Path_getSharedPrefixDepth(oPOldPath, oPNewPath) == ulDepth)
+      iStatus = Path_getDepth(oPNewPath) == ulDepth ?
+                ALREADY_IN_TREE : CONFLICTING_PATH;
+   else
+      iStatus = FT_traversePath(oPNewPath, FALSE, FT_FIND_ALL,
+                                &oNParent);
+   if(iStatus == SUCCESS) {
+      FT_release(oNParent, FALSE);
+      ulDepth = Path_getDepth(Node_getPath(oNParent));
+      if(ulDepth == Path_getDepth(oPNewPath))
+         iStatus = ALREADY_IN_TREE;
+      else if(Node_isFile(oNParent))
+         iStatus = NOT_A_DIRECTORY;
+      else if(ulDepth + 1 != Path_getDepth(oPNewPath))
+         iStatus = NO_SUCH_PATH;
+   }
+   if(iStatus == SUCCESS)
+      iStatus = Node_move(oNFound, oNParent, oPNewPath);
+   Path_free(oPNewPath);
+   if(iStatus != SUCCESS) {
+      FT_treeUnlock();
+      return iStatus;
+   }
+
+   FT_setCursor(oNParent);
+   FT_log(FT_LOG_MV, pcOldPath, pcNewPath, strlen(pcNewPath));
+   FT_treeUnlock();
+
+   return SUCCESS;
+}
+
+int FT_mv(const char *pcOldPath, const char *pcNewPath) {
+   int iStatus;
+
+   FT_timeCall(FT_OP_MV,
+               iStatus = FT_mvUntimed(pcOldPath, pcNewPath),
+               iStatus);
+   return iStatus;
+}
+
+/*
+  Does the work of FT_getFileContents, which FT_METRICS builds time,
+  also setting *piStatus to SUCCESS, NOT_A_FILE or the status of
+  finding pcPath.
+*/
+static void *FT_getFileContentsUntimed(const char *pcPath,
+                                       int *piStatus) {
+   Node_T oNFound = NULL;
+   void *pvResult = NULL;
+   int iStatus;
+
+   assert(pcPath != NULL);
+   assert(piStatus != NULL);
+
+   FT_readLock();
+   *piStatus = FT_findNode(pcPath, FALSE, FT_FIND_ALL, &oNFound);
+   if(*piStatus == SUCCESS) {
+      if(!Node_isFile(oNFound))
+         *piStatus = NOT_A_FILE;
+      /* contents changed by range are only made contiguous now, and
+         spilled ones only read back now */
+      else if((iStatus = Node_flattenContents(oNFound)) != SUCCESS)
+         *piStatus = iStatus;
+      else
+         pvResult = Node_getContents(oNFound);
+      FT_release(oNFound, FALSE);
+   }
+   FT_treeUnlock();
+
+   return pvResult;
+}
+
+void *FT_getFileContents(const char *pcPath) {
+   int iStatus;
+   void *pvResult;
+
+   FT_timeCall(FT_OP_GET_CONTENTS,
+               pvResult = FT_getFileContentsUntimed(pcPath, &iStatus),
+               iStatus);
+   return pvResult;
+}
+
+/*
+  Does the work of FT_replaceFileContents, which FT_METRICS builds
+  time, also setting *piStatus to SUCCESS, NOT_A_FILE or the status of
+  finding pcPath.
+*/
+static void *FT_replaceFileContentsUntimed(const char *pcPath,
+                                           void *pvNewContents,
+                                           size_t ulNewLength,
+                                           int *piStatus) {
+   Node_T oNFound = NULL;
+   Blob_T oBNew = NULL;
+   Blob_T oBOld;
+   void *pvResult = NULL;
+   int iStatus;
+
+   assert(pcPath != NULL);
+   assert(piStatus != NULL);
+
+   if(eStorage == FT_STORE_SHARED &&
+      FT_internContents(pvNewContents, ulNewLength, &oBNew,
+                        &pvNewContents, &ulNewLength) != SUCCESS) {
+      *piStatus = MEMORY_ERROR;
+      return NULL;
+   }
+
+   FT_readLock();
+   *piStatus = FT_findNode(pcPath, FALSE, FT_FIND_ALL, &oNFound);
+   if(*piStatus == SUCCESS) {
+      if(!Node_isFile(oNFound))
+         *piStatus = NOT_A_FILE;
+      /* contents changed by range are handed back in one block, and
+         those in a mapped file or spilled in a block of their own */
+      else if((iStatus = Node_flattenContents(oNFound)) != SUCCESS)
+         *piStatus = iStatus;
+      else if(Node_unmapContents(oNFound) != SUCCESS)
+         *piStatus = MEMORY_ERROR;
+      else if(eStorage != FT_STORE_SHARED)
+         pvResult = Node_replaceContents(oNFound, pvNewContents,
+                                         ulNewLength);
+      else {
+         /* the old blob's bytes are handed over, or a copy of them
+            if other files still share them or they are in the node,
+            or the block they were just made contiguous in */
+         oBOld = Node_getBlob(oNFound);
+         if(oBOld != NULL)
+            *piStatus = Blob_take(oBOld, &pvResult);
+         else if(Node_isInline(oNFound)) {
+            pvResult = malloc(Node_getLength(oNFound));
+            if(pvResult == NULL)
+               *piStatus = MEMORY_ERROR;
+            else
+               memcpy(pvResult, Node_getContents(oNFound),
+                      Node_getLength(oNFound));
+         }
+         else
+            pvResult = Node_replaceContents(oNFound, NULL, 0);
+         if(*piStatus == SUCCESS && oBNew != NULL)
+            (void) Node_shareContents(oNFound, oBNew);
+         else if(*piStatus == SUCCESS)
+            (void) Node_inlineContents(oNFound, pvNewContents,
+                                       ulNewLength);
+      }
+      if(*piStatus == SUCCESS)
+         FT_log(FT_LOG_REPLACE, pcPath, pvNewContents, ulNewLength);
+      FT_release(oNFound, FALSE);
+   }
+   FT_treeUnlock();
+
+   if(*piStatus != SUCCESS && oBNew != NULL)
+      Blob_release(oBNew);
+   return pvResult;
+}
+
+void *FT_replaceFileContents(const char *pcPath, void *pvNewContents,
+                             size_t ulNewLength) {
+   int iStatus;
+   void *pvResult;
+
+   FT_timeCall(FT_OP_REPLACE_CONTENTS,
+               pvResult = FT_replaceFileContentsUntimed(pcPath,
+                             pvNewContents, ulNewLength, &iStatus),
+               iStatus);
+   return pvResult;
+}
+
+/* Does the work of FT_stat, which FT_METRICS builds time */
+static int FT_statUntimed(const char *pcPath, boolean *pbIsFile,
+                          size_t *pulSize) {
+   int iStatus;
+   Node_T oNFound = NULL;
+
+   assert(pcPath != NULL);
+   assert(pbIsFile != NULL);
+   assert(pulSize != NULL);
+
+   FT_readLock();
+   iStatus = FT_findNode(pcPath, FALSE, FT_FIND_ALL, &oNFound);
+   if(iStatus == SUCCESS) {
+      *pbIsFile = Node_isFile(oNFound);
+      if(*pbIsFile)
+         *pulSize = Node_getLength(oNFound);
+      FT_release(oNFound, FALSE);
+   }
+   FT_treeUnlock();
+
+   return iStatus;
+}
+
+int FT_stat(const char *pcPath, boolean *pbIsFile, size_t *pulSize) {
+   int iStatus;
+
+   FT_timeCall(FT_OP_STAT,
+               iStatus = FT_statUntimed(pcPath, pbIsFile, pulSize),
+               iStatus);
+   return iStatus;
+}
+
+/* Does the work of FT_statTree, which FT_METRICS builds time */
+static int FT_statTreeUntimed(const char *pcPath, size_t *pulFiles,
+                              size_t *pulDirs, size_t *pulBytes) {
+   int iStatus;
+   Node_T oNFound = NULL;
+
+   assert(pcPath != NULL);
+   assert(pulFiles != NULL);
+   assert(pulDirs != NULL);
+   assert(pulBytes != NULL);
+
+   FT_readLock();
+   iStatus = FT_findNode(pcPath, FALSE, FT_FIND_ALL, &oNFound);
+   if(iStatus == SUCCESS) {
+      Node_getTotals(oNFound, pulFiles, pulDirs, pulBytes);
+      FT_release(oNFound, FALSE);
+   }
+   FT_treeUnlock();
+
+   return iStatus;
+}
+
+int FT_statTree(const char *pcPath, size_t *pulFiles, size_t *pulDirs,
+                size_t *pulBytes) {
+   int iStatus;
+
+   FT_timeCall(FT_OP_STAT_TREE,
+               iStatus = FT_statTreeUntimed(pcPath, pulFiles, pulDirs,
+                                            pulBytes),
+               iStatus);
+   return iStatus;
+}
+
+/* Does the work of FT_readFileRange, which FT_METRICS builds time */
+static int FT_readFileRangeUntimed(const char *pcPath, size_t ulOffset,
+                                   size_t ulLength, void *pvBuffer,
+                                   size_t *pulRead) {
+   int iStatus;
+   Node_T oNFound = NULL;
+
+   assert(pcPath != NULL);
+   assert(pvBuffer != NULL || ulLength == 0);
+   assert(pulRead != NULL);
+
+   *pulRead = 0;
+   FT_readLock();
+   iStatus = FT_findNode(pcPath, FALSE, FT_FIND_ALL, &oNFound);
+   if(iStatus == SUCCESS) {
+      if(Node_isFile(oNFound))
+         iStatus = Node_readContents(oNFound, ulOffset, ulLength,
+                                     pvBuffer, pulRead);
+      else
+         iStatus = NOT_A_FILE;
+      FT_release(oNFound, FALSE);
+   }
+   FT_treeUnlock();
+
+   return iStatus;
+}
+
+int FT_readFileRange(const char *pcPath, size_t ulOffset,
+                     size_t ulLength, void *pvBuffer, size_t *pulRead) {
+   int iStatus;
+
+   FT_timeCall(FT_OP_READ_RANGE,
+               iStatus = FT_readFileRangeUntimed(pcPath, ulOffset,
+                            ulLength, pvBuffer, pulRead),
+               iStatus);
+   return iStatus;
+}
+
+/*
+  Does the work of FT_writeFileRange, and of FT_appendFile if bAppend,
+  when ulOffset is ignored and the bytes go at the end of the file.
+  Either is journaled as a write at the offset the bytes went to.
+*/
+static int FT_writeUntimed(const char *pcPath, size_t ulOffset,
+                           boolean bAppend, const void *pvBytes,
+                           size_t ulLength) {
+   int iStatus;
+   Node_T oNFound = NULL;
+
+   assert(pcPath != NULL);
+   assert(pvBytes != NULL || ulLength == 0);
+
+   FT_readLock();
+   iStatus = FT_findNode(pcPath, FALSE, FT_FIND_ALL, &oNFound);
+   if(iStatus == SUCCESS) {
+      if(!Node_isFile(oNFound))
+         iStatus = NOT_A_FILE;
+      else if((iStatus = Node_loadContents(oNFound)) == SUCCESS) {
+         if(bAppend)
+            ulOffset = Node_getLength(oNFound);
+         iStatus = Node_writeContents(oNFound, ulOffset, pvBytes,
+                                      ulLength);
+         if(iStatus == SUCCESS && ulLength > 0)
+            FT_logNumbered(FT_LOG_WRITE, pcPath, ulOffset, pvBytes,
+                           ulLength);
+      }
+      FT_release(oNFound, FALSE);
+   }
+   FT_treeUnlock();
+
+   return iStatus;
+}
+
+int FT_writeFileRange(const char *pcPath, size_t ulOffset,
+                      const void *pvBytes, size_t ulLength) {
+   int iStatus;
+
+   FT_timeCall(FT_OP_WRITE_RANGE,
+               iStatus = FT_writeUntimed(pcPath, ulOffset, FALSE,
+                                         pvBytes, ulLength),
+               iStatus);
+   return iStatus;
+}
+
+int FT_appendFile(const char *pcPath, const void *pvBytes,
+                  size_t ulLength) {
+   int iStatus;
+
+   FT_timeCall(FT_OP_APPEND,
+               iStatus = FT_writeUntimed(pcPath, 0, TRUE, pvBytes,
+                                         ulLength),
+               iStatus);
+   return iStatus;
+}
+
+/* Does the work of FT_truncateFile, which FT_METRICS builds time */
+static int FT_truncateFileUntimed(const char *pcPath, size_t ulLength) {
+   int iStatus;
+   Node_T oNFound = NULL;
+
+   assert(pcPath != NULL);
+
+   FT_readLock();
+   iStatus = FT_findNode(pcPath, FALSE, FT_FIND_ALL, &oNFound);
+   if(iStatus == SUCCESS) {
+      if(!Node_isFile(oNFound))
+         iStatus = NOT_A_FILE;
+      else if(Node_getLength(oNFound) != ulLength &&
+              (iStatus = Node_loadContents(oNFound)) == SUCCESS) {
+         iStatus = Node_truncateContents(oNFound, ulLength);
+         if(iStatus == SUCCESS)
+            FT_logNumbered(FT_LOG_TRUNCATE, pcPath, ulLength, NULL, 0);
+      }
+      FT_release(oNFound, FALSE);
+   }
+   FT_treeUnlock();
+
+   return iStatus;
+}
+
+int FT_truncateFile(const char *pcPath, size_t ulLength) {
+   int iStatus;
+
+   FT_timeCall(FT_OP_TRUNCATE,
+               iStatus = FT_truncateFileUntimed(pcPath, ulLength),
+               iStatus);
+   return iStatus;
+}
+
+void FT_getCursorStats(size_t *pulHits, size_t *pulMisses) {
+   assert(pulHits != NULL);
+   assert(pulMisses != NULL);
+
+#ifdef FT_CONCURRENT
+   *pulHits = 0;
+   *pulMisses = 0;
+#else
+   *pulHits = ulCursorHits;
+   *pulMisses = ulCursorMisses;
+#endif
+}
+
+/*
+  Returns the bucket of the fan-out histogram of an FT_Stats that
+  counts a directory with ulChildren children.
+*/
+static size_t FT_fanoutBucket(size_t ulChildren) {
+   size_t ulBucket = 0;
+
+   while(ulChildren != 0 && ulBucket < FT_FANOUT_BUCKETS - 1) {
+      ulChildren >>= 1;
+      ulBucket++;
+   }
+   return ulBucket;
+}
+
+/* Adds the subtree rooted at oNNode, of depth ulDepth, to *psStats. */
+static void FT_addStats(Node_T oNNode, size_t ulDepth,
+                        struct FT_Stats *psStats) {
+   size_t ulNodeBytes, ulPathBytes, ulChildBytes, ulSlack;
+   size_t ulIndex;
+
+   assert(oNNode != NULL);
+   assert(psStats != NULL);
+
+   Node_getFootprint(oNNode, &ulNodeBytes, &ulPathBytes, &ulChildBytes,
+                     &ulSlack);
+   psStats->ulNodes++;
+   if(ulDepth > psStats->ulMaxDepth)
+      psStats->ulMaxDepth = ulDepth;
+   psStats->ulDepthSum += ulDepth;
+   psStats->ulPathBytes += ulPathBytes;
+   psStats->ulNodeBytes += ulNodeBytes;
+   psStats->ulChildBytes += ulChildBytes;
+   psStats->ulSlack += ulSlack;
+
+   if(Node_isFile(oNNode)) {
+      psStats->ulFiles++;
+      psStats->ulFileBytes += Node_getLength(oNNode);
+      /* shared contents are counted once, from the store, those in
+         the node with it, and spilled ones not at all */
+      if(Node_getBlob(oNNode) == NULL && !Node_isInline(oNNode) &&
+         !Node_isSpilled(oNNode))
+         psStats->ulContentBytes += Node_getLength(oNNode);
+      return;
+   }
+   psStats->ulDirs++;
+   psStats->aulFanout[FT_fanoutBucket(Node_getNumChildren(oNNode))]++;
+   for(ulIndex = 0; ulIndex < Node_getNumChildren(oNNode); ulIndex++) {
+      Node_T oNChild = NULL;
+      (void) Node_getChild(oNNode, ulIndex, &oNChild);
+      FT_addStats(oNChild, ulDepth + 1, psStats);
+   }
+}
+
+void FT_dumpMetrics(FILE *psFile) {
+#ifdef FT_METRICS
+   size_t aulCounts[LATENCY_BUCKETS];
+   int iOp, iStatus;
+   size_t ulBucket;
+#endif
+
+   assert(psFile != NULL);
+
+#ifdef FT_METRICS
+   /* the write lock keeps dumps from interleaving */
+   FT_writeLock();
+   for(iOp = 0; iOp < FT_NUM_OPS; iOp++)
+      for(iStatus = 0; iStatus < LATENCY_STATUSES; iStatus++) {
+         for(ulBucket = 0; ulBucket < LATENCY_BUCKETS; ulBucket++)
+            aulCounts[ulBucket] =
+               FT_getCalls(&aulLatencies[iOp][iStatus][ulBucket]);
+         Latency_write(psFile, apcOpNames[iOp], iStatus, aulCounts);
+      }
+   FT_treeUnlock();
+#else
+   (void) psFile;
+#endif
+}
+
+int FT_getStats(struct FT_Stats *psStats) {
+   size_t ulBlobs, ulBlobBytes, ulRefs;
+
+   assert(psStats != NULL);
+
+   /* the walk reads every node without locking it */
+   FT_writeLock();
+   if(!bIsInitialized) {
+      FT_treeUnlock();
+      return INITIALIZATION_ERROR;
+   }
+
+   memset(psStats, 0, sizeof(struct FT_Stats));
+   if(oNRoot != NULL)
+      FT_addStats(oNRoot, 1, psStats);
+   /* every blob in the store is one of this FT's files' contents */
+   Blob_getStats(&ulBlobs, &ulBlobBytes, &ulRefs);
+   psStats->ulContentBytes += ulBlobBytes;
+   FT_treeUnlock();
+
+   assert(psStats->ulNodes == ulCount);
+   return SUCCESS;
+}
+
+int FT_getSpillStats(struct FT_SpillStats *psStats) {
+   assert(psStats != NULL);
+
+   FT_writeLock();
+   if(!bIsInitialized) {
+      FT_treeUnlock();
+      return INITIALIZATION_ERROR;
+   }
+
+   Spill_getStats(&psStats->ulHits, &psStats->ulFaults,
+                  &psStats->ulSpills, &psStats->ulBytesWritten,
+                  &psStats->ulBytesRead, &psStats->ulResidentBytes,
+                  &psStats->ulSpilledBytes);
+   FT_treeUnlock();
+
+   return SUCCESS;
+}
+
+int FT_setStorage(enum FT_Storage eNewStorage) {
+   assert(eNewStorage == FT_STORE_CLIENT ||
+          eNewStorage == FT_STORE_SHARED);
+
+   FT_writeLock();
+   if(bIsInitialized) {
+      FT_treeUnlock();
+      return INITIALIZATION_ERROR;
+   }
+
+   eStorage = eNewStorage;
+   FT_treeUnlock();
+
+   return SUCCESS;
+}
+
+int FT_setInlineThreshold(size_t ulThreshold) {
+   FT_writeLock();
+   if(bIsInitialized) {
+      FT_treeUnlock();
+      return INITIALIZATION_ERROR;
+   }
+
+   ulInlineThreshold = ulThreshold;
+   FT_treeUnlock();
+
+   return SUCCESS;
+}
+
+int FT_setMemoryBudget(size_t ulBudget, int iFd) {
+   assert(iFd >= 0 || ulBudget == 0);
+
+   /* a thread could be reading the contents that another's read would
+      spill, so FT_CONCURRENT builds refuse a budget */
+#ifdef FT_CONCURRENT
+   if(ulBudget != 0)
+      return INITIALIZATION_ERROR;
+#endif
+
+   FT_writeLock();
+   if(bIsInitialized) {
+      FT_treeUnlock();
+      return INITIALIZATION_ERROR;
+   }
+
+   ulMemoryBudget = ulBudget;
+   iSpillFd = ulBudget == 0 ? -1 : iFd;
+   FT_treeUnlock();
+
+   return SUCCESS;
+}
+
+/* Does the work of FT_init, which FT_METRICS builds time */
+static int FT_initUntimed(void) {
+   FT_writeLock();
+   if(bIsInitialized) {
+      FT_treeUnlock();
+      return INITIALIZATION_ERROR;
+   }
+
+   bIsInitialized = TRUE;
+   oNRoot = NULL;
+   ulCount = 0;
+   Spill_setBudget(iSpillFd, ulMemoryBudget);
+   FT_treeUnlock();
+
+   return SUCCESS;
+}
+
+int FT_init(void) {
+   int iStatus;
+
+   FT_timeCall(FT_OP_INIT, iStatus = FT_initUntimed(), iStatus);
+   return iStatus;
+}
+
+/* Does the work of FT_destroy, which FT_METRICS builds time */
+static int FT_destroyUntimed(void) {
+   FT_writeLock();
+   if(!bIsInitialized) {
+      FT_treeUnlock();
+      return INITIALIZATION_ERROR;
+   }
+
+   if(oNRoot) {
+      FT_lock(oNRoot);
+      ulCount -= Node_free(oNRoot);
+      oNRoot = NULL;
+   }
+   FT_setCursor(NULL);
+
+   bIsInitialized = FALSE;
+   FT_treeUnlock();
+
+   return SUCCESS;
+}
+
+int FT_destroy(void) {
+   int iStatus;
+
+   FT_timeCall(FT_OP_DESTROY, iStatus = FT_destroyUntimed(), iStatus);
+   return iStatus;
+}
+
+
+/* --------------------------------------------------------------------
+
+  The following auxiliary functions are used for generating the
+  string representation of the FT.
+*/
+
+/*
+  Performs a pre-order traversal of the tree rooted at n, visiting
+  the file children of each directory before its directory children,
+  inserting each payload to DynArray_T d beginning at index i.
+  Returns the next unused index in d after the insertion(s).
+*/
+static size_t FT_preOrderTraversal(Node_T n, DynArray_T d, size_t i) {
+   size_t c;
+
+   assert(d != NULL);
+
+   if(n != NULL) {
+      (void) DynArray_set(d, i, n);
+      i++;
+      /* the children come files first, so need no partitioning */
+      for(c = 0; c < Node_getNumChildren(n); c++) {
+         Node_T oNChild = NULL;
+         if(Node_getChild(n, c, &oNChild) != SUCCESS)
+            assert(FALSE);
+         i = FT_preOrderTraversal(oNChild, d, i);
+      }
+   }
+   return i;
+}
+
+/*
+  Alternate version of strlen that uses pulAcc as an in-out parameter
+  to accumulate a string length, rather than returning the length of
+  oNNode's path, and also always adds one addition byte to the sum.
+*/
+static void FT_strlenAccumulate(Node_T oNNode, size_t *pulAcc) {
+   assert(pulAcc != NULL);
+
+   if(oNNode != NULL)
+      *pulAcc += (Path_getStrLength(Node_getPath(oNNode)) + 1);
+}
+
+/*
+  Alternate version of strcat that inverts the typical argument
+  order, appending oNNode's path onto pcAcc, and also always adds one
+  newline at the end of the concatenated string.
+*/
+static void FT_strcatAccumulate(Node_T oNNode, char *pcAcc) {
+   assert(pcAcc != NULL);
+
+   if(oNNode != NULL) {
+      strcat(pcAcc, Path_getPathname(Node_getPath(oNNode)));
+      strcat(pcAcc, "\n");
+   }
+}
+/*--------------------------------------------------------------------*/
+
+/* Does the work of FT_toString, which FT_METRICS builds time */
+static char *FT_toStringUntimed(void) {
+   DynArray_T nodes;
+   size_t totalStrlen = 1;
+   char *result = NULL;
+
+   FT_writeLock();
+   if(!bIsInitialized || Node_settlePaths(oNRoot) != SUCCESS) {
+      FT_treeUnlock();
+      return NULL;
+   }
+
+   nodes = DynArray_new(ulCount);
+   if(nodes == NULL) {
+      FT_treeUnlock();
+      return NULL;
+   }
+   (void) FT_preOrderTraversal(oNRoot, nodes, 0);
+
+   DynArray_map(nodes, (void (*)(void *, void*)) FT_strlenAccumulate,
+                (void*) &totalStrlen);
+
+   result = malloc(totalStrlen);
+   if(result == NULL) {
+      DynArray_free(nodes);
+      FT_treeUnlock();
+      return NULL;
+   }
+   Alloc_noteAlloc(ALLOC_TREE_STRING, totalStrlen);
+   *result = '\0';
+
+   DynArray_map(nodes, (void (*)(void *, void*)) FT_strcatAccumulate,
+                (void *) result);
+
+   DynArray_free(nodes);
+   FT_treeUnlock();
+
+   /* the string is the client's to free from here */
+   Alloc_noteFree(ALLOC_TREE_STRING, totalStrlen);
+   return result;
+}
+
+char *FT_toString(void) {
+   char *pcResult;
+
+   FT_timeCall(FT_OP_TOSTRING,
+               pcResult = FT_toStringUntimed(),
+               pcResult != NULL ? SUCCESS : MEMORY_ERROR);
+   return pcResult;
+}
+
+
+/* --------------------------------------------------------------------
+
+  The following auxiliary functions are used for finding the nodes
+  whose paths match a pattern.
+*/
+
+/*
+  Stores in aulStart[0] the identifier of the first file child of
+  directory oNParent whose last path component starts with the
+  ulLength characters at pcPrefix, or the identifier such a child
+  would have, and in aulStart[1] that of the first such directory
+  child. Children of each kind are sorted by path, so those sharing a
+  prefix are consecutive from there. Returns SUCCESS, or MEMORY_ERROR
+  if memory could not be allocated to search.
+*/
+static int FT_findPrefixStart(Node_T oNParent, const char *pcPrefix,
+                              size_t ulLength, size_t aulStart[2]) {
+   Path_T oPParent;
+   Path_T oPKey = NULL;
+   char *pcKey;
+   size_t ulParentLength;
+   int iStatus;
+
+   assert(oNParent != NULL);
+   assert(pcPrefix != NULL);
+   assert(aulStart != NULL);
+
+   aulStart[0] = 0;
+   aulStart[1] = Node_getNumFiles(oNParent);
+   if(ulLength == 0 || Node_isFile(oNParent))
+      return SUCCESS;
+
+   oPParent = Node_getPath(oNParent);
+   ulParentLength = Path_getStrLength(oPParent);
+   pcKey = Alloc_malloc(ALLOC_TREE_KEY,
+                        ulParentLength + 1 + ulLength + 1);
+   if(pcKey == NULL)
+      return MEMORY_ERROR;
+   memcpy(pcKey, Path_getPathname(oPParent), ulParentLength);
+   pcKey[ulParentLength] = '/';
+   memcpy(pcKey + ulParentLength + 1, pcPrefix, ulLength);
+   pcKey[ulParentLength + 1 + ulLength] = '\0';
+
+   iStatus = Path_new(pcKey, &oPKey);
+   Alloc_free(ALLOC_TREE_KEY, pcKey, ulParentLength + 1 + ulLength + 1);
+   if(iStatus != SUCCESS)
+      return iStatus;
+   (void) Node_hasChildOfKind(oNParent, oPKey, TRUE, &aulStart[0]);
+   (void) Node_hasChildOfKind(oNParent, oPKey, FALSE, &aulStart[1]);
+   Path_free(oPKey);
+   return SUCCESS;
+}
+
+/*
+  Adds to abLive the positions in oPPattern after each live "**", as
+  "**" may match no components at all. A run of "**" is followed
+  through, since each position is settled before the next.
+*/
+static void FT_findClose(Path_T oPPattern, boolean *abLive) {
+   size_t ulDepth = Path_getDepth(oPPattern);
+   size_t ulPos;
+
+   assert(oPPattern != NULL);
+   assert(abLive != NULL);
+
+   for(ulPos = 0; ulPos < ulDepth; ulPos++)
+      if(abLive[ulPos] &&
+         !strcmp(Path_getComponent(oPPattern, ulPos), "**"))
+         abLive[ulPos + 1] = TRUE;
+}
+
+/*
+  Sets abNext to the positions in oPPattern reached from the live
+  positions abLive by matching one more path component, pcName: a
+  "**" at a live position stays live, and any other component that
+  matches pcName makes the next position live. Returns TRUE if any
+  position is live in abNext, once closed as by FT_findClose.
+*/
+static boolean FT_findStep(Path_T oPPattern, const boolean *abLive,
+                           const char *pcName, boolean *abNext) {
+   size_t ulDepth = Path_getDepth(oPPattern);
+   size_t ulPos;
+   boolean bAnyLive = FALSE;
+
+   assert(oPPattern != NULL);
+   assert(abLive != NULL);
+   assert(pcName != NULL);
+   assert(abNext != NULL);
+
+   for(ulPos = 0; ulPos <= ulDepth; ulPos++)
+      abNext[ulPos] = FALSE;
+   for(ulPos = 0; ulPos < ulDepth; ulPos++) {
+      const char *pcComponent;
+
+      if(!abLive[ulPos])
+         continue;
+      pcComponent = Path_getComponent(oPPattern, ulPos);
+      if(!strcmp(pcComponent, "**"))
+         abNext[ulPos] = TRUE;
+      else if(Path_matchComponent(pcComponent, pcName))
+         abNext[ulPos + 1] = TRUE;
+   }
+   FT_findClose(oPPattern, abNext);
+
+   for(ulPos = 0; ulPos <= ulDepth; ulPos++)
+      bAnyLive = bAnyLive || abNext[ulPos];
+   return bAnyLive;
+}
+
+/*
+  Calls (*pfVisit) on each node of kind eKind below oNParent whose
+  path matches oPPattern, in pre-order, given the live positions
+  abLive that oNParent's path leaves in oPPattern. With oNParent
+  NULL, the root is the only child. Each node is visited once, and a
+  directory is descended into only while some position is live after
+  its name. When the only live position is a component other than
+  "**", its literal prefix is binary searched among the sorted files
+  and, apart, the sorted directories. Returns SUCCESS, or
+  MEMORY_ERROR if memory could not be allocated to search.
+*/
+static int FT_findFrom(Node_T oNParent, Path_T oPPattern,
+                       const boolean *abLive, enum FT_FindKind eKind,
+                       void (*pfVisit)(const char *pcPath,
+                                       void *pvExtra),
+                       void *pvExtra) {
+   const char *pcComponent = "";
+   size_t ulDepth = Path_getDepth(oPPattern);
+   size_t ulNumChildren;
+   size_t ulNumLive = 0;
+   size_t ulPrefix = 0;
+   size_t ulIndex;
+   size_t ulPos;
+   size_t aulStart[2];
+   size_t aulEnd[2];
+   boolean *abNext;
+   int iKind;
+   Node_T oNChild = NULL;
+   int iStatus = SUCCESS;
+
+   assert(oPPattern != NULL);
+   assert(abLive != NULL);
+   assert(pfVisit != NULL);
+
+   /* with only a finished match live, no child can match */
+   for(ulPos = 0; ulPos < ulDepth; ulPos++)
+      if(abLive[ulPos]) {
+         pcComponent = Path_getComponent(oPPattern, ulPos);
+         ulNumLive++;
+      }
+   if(ulNumLive == 0)
+      return SUCCESS;
+
+   if(oNParent == NULL)
+      ulNumChildren = (oNRoot != NULL);
+   else
+      ulNumChildren = Node_getNumChildren(oNParent);
+
+   /* the files, then the directories, are each a run sorted by
+      path, which for the root alone is just the root */
+   aulStart[0] = aulStart[1] = aulEnd[0] = 0;
+   aulEnd[1] = ulNumChildren;
+   if(oNParent != NULL)
+      aulStart[1] = aulEnd[0] = Node_getNumFiles(oNParent);
+
+   /* with one component left to match, skip to its literal prefix */
+   if(ulNumLive == 1 && strcmp(pcComponent, "**")) {
+      ulPrefix = strcspn(pcComponent, "*?[");
+      if(oNParent != NULL) {
+         iStatus = FT_findPrefixStart(oNParent, pcComponent, ulPrefix,
+                                      aulStart);
+         if(iStatus != SUCCESS)
+            return iStatus;
+      }
+   }
+   else
+      /* otherwise scan every child, as for a component "*" */
+      pcComponent = "*";
+   /* a file cannot be, or be above, a directory that is looked for */
+   if(eKind == FT_FIND_DIRS)
+      aulEnd[0] = aulStart[0];
+
+   abNext = Alloc_malloc(ALLOC_TREE_FIND,
+                         (ulDepth + 1) * sizeof(boolean));
+   if(abNext == NULL)
+      return MEMORY_ERROR;
+
+   for(iKind = 0; iKind < 2 && iStatus == SUCCESS; iKind++)
+      for(ulIndex = aulStart[iKind]; ulIndex < aulEnd[iKind];
+          ulIndex++) {
+         Path_T oPChild;
+         const char *pcName;
+
+         if(oNParent == NULL)
+            oNChild = oNRoot;
+         else if(Node_getChild(oNParent, ulIndex, &oNChild) != SUCCESS)
+            assert(FALSE);
+         oPChild = Node_getPath(oNChild);
+         pcName = Path_getComponent(oPChild,
+                                    Path_getDepth(oPChild) - 1);
+
+         /* past the children sharing the literal prefix */
+         if(strncmp(pcName, pcComponent, ulPrefix))
+            break;
+         if(FT_findStep(oPPattern, abLive, pcName, abNext)) {
+            if(abNext[ulDepth] &&
+               (eKind == FT_FIND_ALL ||
+                Node_isFile(oNChild) ==
+                (boolean) (eKind == FT_FIND_FILES)))
+               (*pfVisit)(Path_getPathname(oPChild), pvExtra);
+            /* files end every branch */
+            if(!Node_isFile(oNChild))
+               iStatus = FT_findFrom(oNChild, oPPattern, abNext,
+                                     eKind, pfVisit, pvExtra);
+            if(iStatus != SUCCESS)
+               break;
+         }
+         /* a literal component matches at most one child of a kind */
+         if(pcComponent[ulPrefix] == '\0')
+            break;
+      }
+
+   Alloc_free(ALLOC_TREE_FIND, abNext, (ulDepth + 1) * sizeof(boolean));
+   return iStatus;
+}
+/*--------------------------------------------------------------------*/
+
+/* Does the work of FT_find, which FT_METRICS builds time */
+static int FT_findUntimed(const char *pcPattern, enum FT_FindKind eKind,
+                          void (*pfVisit)(const char *pcPath,
+                                          void *pvExtra),
+                          void *pvExtra) {
+   Path_T oPPattern = NULL;
+   boolean *abLive;
+   size_t ulSize;
+   size_t ulPos;
+   int iStatus;
+
+   assert(pcPattern != NULL);
+   assert(pfVisit != NULL);
+
+   iStatus = Path_new(pcPattern, &oPPattern);
+   if(iStatus != SUCCESS)
+      return iStatus;
+
+   /* before the root, only the first position is live */
+   ulSize = (Path_getDepth(oPPattern) + 1) * sizeof(boolean);
+   abLive = Alloc_malloc(ALLOC_TREE_FIND, ulSize);
+   if(abLive == NULL) {
+      Path_free(oPPattern);
+      return MEMORY_ERROR;
+   }
+   for(ulPos = 0; ulPos <= Path_getDepth(oPPattern); ulPos++)
+      abLive[ulPos] = (ulPos == 0);
+   FT_findClose(oPPattern, abLive);
+
+   /* the walk reads the hierarchy without locking each node, so
+      nobody else may change it meanwhile */
+   FT_writeLock();
+   if(!bIsInitialized)
+      iStatus = INITIALIZATION_ERROR;
+   else if(Node_settlePaths(oNRoot) != SUCCESS)
+      iStatus = MEMORY_ERROR;
+   else
+      iStatus = FT_findFrom(NULL, oPPattern, abLive, eKind,
+                            pfVisit, pvExtra);
+   FT_treeUnlock();
+
+   Alloc_free(ALLOC_TREE_FIND, abLive, ulSize);
+   Path_free(oPPattern);
+   return iStatus;
+}
+
+int FT_find(const char *pcPattern, enum FT_FindKind eKind,
+            void (*pfVisit)(const char *pcPath, void *pvExtra),
+            void *pvExtra) {
+   int iStatus;
+
+   FT_timeCall(FT_OP_FIND,
+               iStatus = FT_findUntimed(pcPattern, eKind, pfVisit,
+                                        pvExtra),
+               iStatus);
+   return iStatus;
+}
+
+
+/* --------------------------------------------------------------------
+
+  The following auxiliary functions write and read the binary image
+  of a hierarchy described for FT_save. Numbers are stored with their
+  most significant byte first, so images move between machines.
+*/
+
+/* The bytes that start every FT image */
+static const char acImageMagic[4] = {'F', 'T', 'I', '1'};
+
+/* The sizes in bytes of the numbers in an image */
+enum {COUNT_BYTES = 8, NAME_BYTES = 4, CHILDREN_BYTES = 4,
+      LENGTH_BYTES = 8};
+
+/* The type bytes that start the records of directories and files */
+enum {DIR_RECORD = 0, FILE_RECORD = 1};
+
+/* The smallest possible record of a node in an image */
+enum {MIN_RECORD_BYTES = 1 + NAME_BYTES + 1 + CHILDREN_BYTES};
+
+/* The size of the buffer gathering an image on its way out */
+enum {OUT_BUFFER_BYTES = 8192};
+
+/* An image being written to a file descriptor */
+struct FT_Out {
+   /* the file descriptor being written */
+   int iFd;
+   /* SUCCESS, or IO_ERROR once a write, or a read of spilled
+      contents, has failed */
+   int iStatus;
+   /* the number of bytes of aucBuffer waiting to be written */
+   size_t ulUsed;
+   /* the bytes waiting to be written */
+   unsigned char aucBuffer[OUT_BUFFER_BYTES];
+};
+
+/* An image being read, from its next unread byte up to pucEnd */
+struct FT_In {
+   const unsigned char *pucNext;
+   const unsigned char *pucEnd;
+};
+
+/* Writes out the bytes waiting in psOut's buffer, if it has not
+   already failed. */
+static void FT_outFlush(struct FT_Out *psOut) {
+   size_t ulDone = 0;
+
+   assert(psOut != NULL);
+
+   while(psOut->iStatus == SUCCESS && ulDone < psOut->ulUsed) {
+      ssize_t lWritten = write(psOut->iFd, psOut->aucBuffer + ulDone,
+                               psOut->ulUsed - ulDone);
+      if(lWritten > 0)
+         ulDone += (size_t) lWritten;
+      else if(lWritten < 0 && errno == EINTR)
+         continue;
+      else
+         psOut->iStatus = IO_ERROR;
+   }
+   psOut->ulUsed = 0;
+}
+
+/* Appends the ulLength bytes at pvBytes to psOut. */
+static void FT_outBytes(struct FT_Out *psOut, const void *pvBytes,
+                        size_t ulLength) {
+   const unsigned char *pucBytes = pvBytes;
+
+   assert(psOut != NULL);
+   assert(pvBytes != NULL || ulLength == 0);
+
+   while(ulLength > 0) {
+      size_t ulChunk = OUT_BUFFER_BYTES - psOut->ulUsed;
+      if(ulChunk > ulLength)
+         ulChunk = ulLength;
+      memcpy(psOut->aucBuffer + psOut->ulUsed, pucBytes, ulChunk);
+      psOut->ulUsed += ulChunk;
+      pucBytes += ulChunk;
+      ulLength -= ulChunk;
+      if(psOut->ulUsed == OUT_BUFFER_BYTES)
+         FT_outFlush(psOut);
+   }
+}
+
+/* Appends ulValue to psOut as a number of ulBytes bytes. */
+static void FT_outNumber(struct FT_Out *psOut, size_t ulValue,
+                         size_t ulBytes) {
+   unsigned char aucNumber[COUNT_BYTES];
+   size_t i;
+
+   assert(psOut != NULL);
+   assert(ulBytes <= COUNT_BYTES);
+
+   for(i = ulBytes; i > 0; i--) {
+      aucNumber[i - 1] = (unsigned char) (ulValue & 0xFF);
+      ulValue >>= 8;
+   }
+   /* every length and count in the hierarchy fits its field */
+   assert(ulValue == 0);
+   FT_outBytes(psOut, aucNumber, ulBytes);
+}
+
+/* Appends the contents of file oNNode to psOut, read straight into
+   its buffer, so that contents in a rope need not be made
+   contiguous. */
+static void FT_outContents(struct FT_Out *psOut, Node_T oNNode) {
+   size_t ulDone, ulRead;
+
+   assert(psOut != NULL);
+   assert(oNNode != NULL);
+
+   for(ulDone = 0; ulDone < Node_getLength(oNNode); ulDone += ulRead) {
+      if(Node_readContents(oNNode, ulDone,
+                           OUT_BUFFER_BYTES - psOut->ulUsed,
+                           psOut->aucBuffer + psOut->ulUsed, &ulRead) !=
+         SUCCESS) {
+         psOut->iStatus = IO_ERROR;
+         return;
+      }
+      psOut->ulUsed += ulRead;
+      if(psOut->ulUsed == OUT_BUFFER_BYTES)
+         FT_outFlush(psOut);
+   }
+}
+
+/* Appends the records of the subtree rooted at oNNode to psOut in
+   pre-order. */
+static void FT_saveSubtree(struct FT_Out *psOut, Node_T oNNode) {
+   Path_T oPPath;
+   const char *pcName;
+   unsigned char ucType;
+   size_t ulLength;
+   size_t ulIndex;
+
+   assert(psOut != NULL);
+   assert(oNNode != NULL);
+
+   oPPath = Node_getPath(oNNode);
+   pcName = Path_getComponent(oPPath, Path_getDepth(oPPath) - 1);
+   ulLength = strlen(pcName);
+   ucType = Node_isFile(oNNode) ? FILE_RECORD : DIR_RECORD;
+   FT_outBytes(psOut, &ucType, 1);
+   FT_outNumber(psOut, ulLength, NAME_BYTES);
+   FT_outBytes(psOut, pcName, ulLength);
+
+   if(Node_isFile(oNNode)) {
+      FT_outNumber(psOut, Node_getLength(oNNode), LENGTH_BYTES);
+      FT_outContents(psOut, oNNode);
+      return;
+   }
+
+   FT_outNumber(psOut, Node_getNumChildren(oNNode), CHILDREN_BYTES);
+   for(ulIndex = 0; ulIndex < Node_getNumChildren(oNNode); ulIndex++) {
+      Node_T oNChild = NULL;
+      (void) Node_getChild(oNNode, ulIndex, &oNChild);
+      FT_saveSubtree(psOut, oNChild);
+   }
+}
+
+/*
+  Reads a number of ulBytes bytes from psIn into *pulValue. Returns
+  FALSE if the image ends first or the number does not fit a size_t.
+*/
+static boolean FT_inNumber(struct FT_In *psIn, size_t ulBytes,
+                           size_t *pulValue) {
+   size_t ulValue = 0;
+   size_t i;
+
+   assert(psIn != NULL);
+   assert(pulValue != NULL);
+
+   if((size_t) (psIn->pucEnd - psIn->pucNext) < ulBytes)
+      return FALSE;
+   for(i = 0; i < ulBytes; i++) {
+      if(ulValue > ((size_t) -1) >> 8)
+         return FALSE;
+      ulValue = (ulValue << 8) | psIn->pucNext[i];
+   }
+   psIn->pucNext += ulBytes;
+   *pulValue = ulValue;
+   return TRUE;
+}
+
+/*
+  Builds the node whose record comes next in psIn as a new child of
+  oNParent, or as a new root if oNParent is NULL. File contents are
+  copied into memory that the new node owns, or, if the FT shares
+  contents, into the blob store or the node itself. Returns SUCCESS,
+  sets *poNResult to the node and sets *pulChildren to the number of
+  children whose records follow, 0 for a file, or returns BAD_FORMAT
+  if the record is malformed and MEMORY_ERROR if memory could not be
+  allocated. On error, *poNResult is the node if it was built, and
+  NULL otherwise.
+*/
+static int FT_loadRecord(struct FT_In *psIn, Node_T oNParent,
+                         Node_T *poNResult, size_t *pulChildren) {
+   Path_T oPPath = NULL;
+   Node_T oNNew = NULL;
+   boolean bIsFile;
+   void *pvContents = NULL;
+   Blob_T oBBlob = NULL;
+   const unsigned char *pucInline = NULL;
+   size_t ulLength;
+   size_t ulInline = 0;
+   int iStatus;
+
+   assert(psIn != NULL);
+   assert(poNResult != NULL);
+   assert(pulChildren != NULL);
+
+   *poNResult = NULL;
+   *pulChildren = 0;
+   if(psIn->pucNext == psIn->pucEnd ||
+      (*psIn->pucNext != DIR_RECORD && *psIn->pucNext != FILE_RECORD))
+      return BAD_FORMAT;
+   bIsFile = *psIn->pucNext == FILE_RECORD;
+   psIn->pucNext++;
+   /* as for FT_insertFile, the root must be a directory */
+   if(bIsFile && oNParent == NULL)
+      return BAD_FORMAT;
+
+   if(!FT_inNumber(psIn, NAME_BYTES, &ulLength) ||
+      (size_t) (psIn->pucEnd - psIn->pucNext) < ulLength)
+      return BAD_FORMAT;
+
+   /* the new path extends the parent's, so nothing is parsed again */
+   iStatus = Path_newChild(oNParent == NULL ? NULL :
+                              Node_getPath(oNParent),
+                           (const char *) psIn->pucNext, ulLength,
+                           &oPPath);
+   if(iStatus != SUCCESS)
+      return iStatus == BAD_PATH ? BAD_FORMAT : iStatus;
+   psIn->pucNext += ulLength;
+
+   if(bIsFile) {
+      if(!FT_inNumber(psIn, LENGTH_BYTES, &ulLength) ||
+         (size_t) (psIn->pucEnd - psIn->pucNext) < ulLength) {
+         Path_free(oPPath);
+         return BAD_FORMAT;
+      }
+      if(ulLength > 0 && eStorage == FT_STORE_SHARED) {
+         /* small contents are copied once the node is built */
+         if(ulLength <= ulInlineThreshold) {
+            pucInline = psIn->pucNext;
+            ulInline = ulLength;
+         }
+         else if(Blob_intern(psIn->pucNext, ulLength, &oBBlob) !=
+                 SUCCESS) {
+            Path_free(oPPath);
+            return MEMORY_ERROR;
+         }
+         psIn->pucNext += ulLength;
+         ulLength = 0;
+      }
+      else if(ulLength > 0) {
+         pvContents = malloc(ulLength);
+         if(pvContents == NULL) {
+            Path_free(oPPath);
+            return MEMORY_ERROR;
+         }
+         memcpy(pvContents, psIn->pucNext, ulLength);
+         psIn->pucNext += ulLength;
+      }
+   }
+   else
+      ulLength = 0;
+
+   iStatus = Node_new(oPPath, oNParent, bIsFile, pvContents, ulLength,
+                      FT_nodeRoom(), &oNNew);
+   Path_free(oPPath);
+   if(iStatus != SUCCESS) {
+      free(pvContents);
+      if(oBBlob != NULL)
+         Blob_release(oBBlob);
+      return iStatus == MEMORY_ERROR ? MEMORY_ERROR : BAD_FORMAT;
+   }
+   if(pvContents != NULL)
+      Node_ownContents(oNNew);
+   if(oBBlob != NULL)
+      (void) Node_shareContents(oNNew, oBBlob);
+   if(pucInline != NULL)
+      (void) Node_inlineContents(oNNew, pucInline, ulInline);
+   *poNResult = oNNew;
+   if(bIsFile)
+      return SUCCESS;
+
+   /* each child needs a record, which bounds any sane count */
+   if(!FT_inNumber(psIn, CHILDREN_BYTES, pulChildren) ||
+      *pulChildren > (size_t) (psIn->pucEnd - psIn->pucNext) /
+                     MIN_RECORD_BYTES) {
+      *pulChildren = 0;
+      return BAD_FORMAT;
+   }
+   return SUCCESS;
+}
+
+/* A directory whose children's records FT_loadSubtree is reading,
+   and how many of them are still to come */
+struct FT_LoadDir {
+   Node_T oNDir;
+   size_t ulLeft;
+};
+
+/*
+  Builds the hierarchy whose records come next in psIn as a new root,
+  adding the number of nodes built to *pulCount. The directories
+  whose children are still to come are kept on a stack of their own,
+  so however deep the image nests its records, the call stack does
+  not grow with it.
+  Returns SUCCESS and sets *poNResult to the root, or returns
+  BAD_FORMAT if the records are malformed and MEMORY_ERROR if memory
+  could not be allocated. On error, *poNResult is the root if one was
+  built, so the caller frees it with the rest, and NULL otherwise.
+*/
+static int FT_loadSubtree(struct FT_In *psIn, size_t *pulCount,
+                          Node_T *poNResult) {
+   struct FT_LoadDir *psStack = NULL;
+   struct FT_LoadDir *psGrown;
+   size_t ulDepth = 0;
+   size_t ulRoom = 0;
+   size_t ulNewRoom;
+   Node_T oNNew;
+   size_t ulChildren = 0;
+   int iStatus;
+
+   assert(psIn != NULL);
+   assert(pulCount != NULL);
+   assert(poNResult != NULL);
+
+   iStatus = FT_loadRecord(psIn, NULL, poNResult, &ulChildren);
+   oNNew = *poNResult;
+   while(iStatus == SUCCESS) {
+      (*pulCount)++;
+      if(ulChildren > 0 && ulDepth == ulRoom) {
+         ulNewRoom = ulRoom == 0 ? 16 : 2 * ulRoom;
+         psGrown = Alloc_realloc(ALLOC_TREE_IMAGE, psStack,
+                                 ulRoom * sizeof(struct FT_LoadDir),
+                                 ulNewRoom * sizeof(struct FT_LoadDir));
+         if(psGrown == NULL) {
+            iStatus = MEMORY_ERROR;
+            break;
+         }
+         psStack = psGrown;
+         ulRoom = ulNewRoom;
+      }
+      if(ulChildren > 0) {
+         psStack[ulDepth].oNDir = oNNew;
+         psStack[ulDepth].ulLeft = ulChildren;
+         ulDepth++;
+      }
+
+      /* the next record is a child of the deepest directory that
+         still has children to come */
+      while(ulDepth > 0 && psStack[ulDepth - 1].ulLeft == 0)
+         ulDepth--;
+      if(ulDepth == 0)
+         break;
+      psStack[ulDepth - 1].ulLeft--;
+      iStatus = FT_loadRecord(psIn, psStack[ulDepth - 1].oNDir, &oNNew,
+                              &ulChildren);
+   }
+
+   Alloc_free(ALLOC_TREE_IMAGE, psStack,
+              ulRoom * sizeof(struct FT_LoadDir));
+   return iStatus;
+}
+
+/*
+  Makes the whole contents of the file open on iFd readable at
+  *ppvImage, of *pulSize bytes. Regular files are mapped; anything
+  else, such as a pipe, is read to its end into memory. Sets
+  *pulBuffer to the size of the buffer read into, or to 0 if the file
+  was mapped, for FT_unmapImage. Returns SUCCESS, IO_ERROR if the file
+  cannot be read or MEMORY_ERROR if memory could not be allocated.
+*/
+static int FT_mapImage(int iFd, void **ppvImage, size_t *pulSize,
+                       size_t *pulBuffer) {
+   struct stat sStat;
+   unsigned char *pucBuffer = NULL;
+   size_t ulSize = 0;
+   size_t ulCapacity = 0;
+
+   assert(ppvImage != NULL);
+   assert(pulSize != NULL);
+   assert(pulBuffer != NULL);
+
+   if(fstat(iFd, &sStat) == 0 && S_ISREG(sStat.st_mode) &&
+      sStat.st_size > 0) {
+      void *pvMap = mmap(NULL, (size_t) sStat.st_size, PROT_READ,
+                         MAP_PRIVATE, iFd, 0);
+      if(pvMap != MAP_FAILED) {
+         *ppvImage = pvMap;
+         *pulSize = (size_t) sStat.st_size;
+         *pulBuffer = 0;
+         return SUCCESS;
+      }
+   }
+
+   for(;;) {
+      ssize_t lRead;
+
+      if(ulSize == ulCapacity) {
+         unsigned char *pucGrown;
+         size_t ulGrown =
+            ulCapacity == 0 ? OUT_BUFFER_BYTES : 2 * ulCapacity;
+         pucGrown = Alloc_realloc(ALLOC_TREE_IMAGE, pucBuffer,
+                                  ulCapacity, ulGrown);
+         if(pucGrown == NULL) {
+            Alloc_free(ALLOC_TREE_IMAGE, pucBuffer, ulCapacity);
+            return MEMORY_ERROR;
+         }
+         pucBuffer = pucGrown;
+         ulCapacity = ulGrown;
+      }
+      lRead = read(iFd, pucBuffer + ulSize, ulCapacity - ulSize);
+      if(lRead == 0)
+         break;
+      if(lRead < 0) {
+         if(errno == EINTR)
+            continue;
+         Alloc_free(ALLOC_TREE_IMAGE, pucBuffer, ulCapacity);
+         return IO_ERROR;
+      }
+      ulSize += (size_t) lRead;
+   }
+
+   *ppvImage = pucBuffer;
+   *pulSize = ulSize;
+   *pulBuffer = ulCapacity;
+   return SUCCESS;
+}
+
+/* Releases an image of ulSize bytes at pvImage, in a buffer of
+   ulBuffer bytes, from FT_mapImage. */
+static void FT_unmapImage(void *pvImage, size_t ulSize,
+                          size_t ulBuffer) {
+   if(ulBuffer == 0)
+      (void) munmap(pvImage, ulSize);
+   else
+      Alloc_free(ALLOC_TREE_IMAGE, pvImage, ulBuffer);
+}
+/*--------------------------------------------------------------------*/
+
+/* Does the work of FT_save, which FT_METRICS builds time */
+static int FT_saveUntimed(int iFd) {
+   struct FT_Out *psOut;
+   int iStatus;
+
+   /* the image must be of one moment, so nobody may write meanwhile */
+   FT_writeLock();
+   if(!bIsInitialized) {
+      FT_treeUnlock();
+      return INITIALIZATION_ERROR;
+   }
+   if(Node_settlePaths(oNRoot) != SUCCESS) {
+      FT_treeUnlock();
+      return MEMORY_ERROR;
+   }
+
+   psOut = Alloc_malloc(ALLOC_TREE_OUT, sizeof(struct FT_Out));
+   if(psOut == NULL) {
+      FT_treeUnlock();
+      return MEMORY_ERROR;
+   }
+   psOut->iFd = iFd;
+   psOut->iStatus = SUCCESS;
+   psOut->ulUsed = 0;
+
+   FT_outBytes(psOut, acImageMagic, sizeof(acImageMagic));
+   FT_outNumber(psOut, ulCount, COUNT_BYTES);
+   if(oNRoot != NULL)
+      FT_saveSubtree(psOut, oNRoot);
+   FT_outFlush(psOut);
+   FT_treeUnlock();
+
+   iStatus = psOut->iStatus;
+   Alloc_free(ALLOC_TREE_OUT, psOut, sizeof(struct FT_Out));
+   return iStatus;
+}
+
+int FT_save(int iFd) {
+   int iStatus;
+
+   FT_timeCall(FT_OP_SAVE, iStatus = FT_saveUntimed(iFd), iStatus);
+   return iStatus;
+}
+
+/* Does the work of FT_load, which FT_METRICS builds time */
+static int FT_loadUntimed(int iFd) {
+   struct FT_In sIn;
+   void *pvImage = NULL;
+   size_t ulSize = 0;
+   size_t ulBuffer = 0;
+   size_t ulNewCount = 0;
+   size_t ulBuilt = 0;
+   Node_T oNNewRoot = NULL;
+   int iStatus;
+
+   FT_writeLock();
+   if(!bIsInitialized) {
+      FT_treeUnlock();
+      return INITIALIZATION_ERROR;
+   }
+
+   iStatus = FT_mapImage(iFd, &pvImage, &ulSize, &ulBuffer);
+   if(iStatus != SUCCESS) {
+      FT_treeUnlock();
+      return iStatus;
+   }
+
+   /* build the new hierarchy beside the old one, in a single pass */
+   sIn.pucNext = pvImage;
+   sIn.pucEnd = sIn.pucNext + ulSize;
+   if(ulSize < sizeof(acImageMagic) ||
+      memcmp(sIn.pucNext, acImageMagic, sizeof(acImageMagic)))
+      iStatus = BAD_FORMAT;
+   else {
+      sIn.pucNext += sizeof(acImageMagic);
+      if(!FT_inNumber(&sIn, COUNT_BYTES, &ulNewCount))
+         iStatus = BAD_FORMAT;
+      else if(ulNewCount != 0)
+         iStatus = FT_loadSubtree(&sIn, &ulBuilt, &oNNewRoot);
+   }
+   if(iStatus == SUCCESS &&
+      (sIn.pucNext != sIn.pucEnd || ulNewCount != ulBuilt))
+      iStatus = BAD_FORMAT;
+   FT_unmapImage(pvImage, ulSize, ulBuffer);
+
+   if(iStatus != SUCCESS) {
+      if(oNNewRoot != NULL) {
+         FT_lock(oNNewRoot);
+         (void) Node_free(oNNewRoot);
+      }
+      FT_treeUnlock();
+      return iStatus;
+   }
+
+   /* only then replace the old one */
+   if(oNRoot != NULL) {
+      FT_lock(oNRoot);
+      (void) Node_free(oNRoot);
+   }
+   oNRoot = oNNewRoot;
+   ulCount = ulNewCount;
+   FT_setCursor(NULL);
+   FT_treeUnlock();
+
+   return SUCCESS;
+}
+
+int FT_load(int iFd) {
+   int iStatus;
+
+   FT_timeCall(FT_OP_LOAD, iStatus = FT_loadUntimed(iFd), iStatus);
+   return iStatus;
+}
+
+/* Returns the current time of CLOCK_MONOTONIC in microseconds. */
+static size_t FT_nowMicros(void) {
+   struct timespec sTime;
+
+   (void) clock_gettime(CLOCK_MONOTONIC, &sTime);
+   return (size_t) sTime.tv_sec * 1000000 +
+          (size_t) sTime.tv_nsec / 1000;
+}
+
+/* Does the work of FT_import, which FT_METRICS builds time */
+static int FT_importUntimed(const char *pcPath, const char *pcDiskPath,
+                            size_t ulThreads,
+                            struct FT_ImportStats *psStats) {
+   Path_T oPPath = NULL;
+   Path_T oPParent = NULL;
+   Node_T oNParent = NULL;
+   Node_T oNNew = NULL;
+   struct Import_Storage sStorage;
+   size_t ulStart;
+   size_t ulNodes = 0;
+   int iStatus;
+
+   assert(pcPath != NULL);
+   assert(pcDiskPath != NULL);
+   assert(psStats != NULL);
+
+   ulStart = FT_nowMicros();
+   psStats->ulDirs = 0;
+   psStats->ulFiles = 0;
+   psStats->ulBytes = 0;
+   psStats->ulSkipped = 0;
+   psStats->ulMicros = 0;
+
+   /* the workers add nodes throughout, so nobody else may meanwhile */
+   FT_writeLock();
+   if(!bIsInitialized) {
+      FT_treeUnlock();
+      return INITIALIZATION_ERROR;
+   }
+   iStatus = Path_new(pcPath, &oPPath);
+   if(iStatus != SUCCESS) {
+      FT_treeUnlock();
+      return iStatus;
+   }
+
+   /* the new directory's parent must already be there, unless it is
+      to be the root of an empty FT */
+   if(Path_getDepth(oPPath) > 1) {
+      iStatus = Path_prefix(oPPath, Path_getDepth(oPPath) - 1,
+                            &oPParent);
+      if(iStatus == SUCCESS) {
+         iStatus = FT_findNode(Path_getPathname(oPParent), FALSE,
+                               FT_FIND_ALL, &oNParent);
+         Path_free(oPParent);
+      }
+      if(iStatus == SUCCESS) {
+         FT_release(oNParent, FALSE);
+         if(Node_isFile(oNParent))
+            iStatus = NOT_A_DIRECTORY;
+      }
+   }
+   else if(oNRoot != NULL)
+      iStatus = Path_comparePath(Node_getPath(oNRoot), oPPath) ?
+                CONFLICTING_PATH : ALREADY_IN_TREE;
+   if(iStatus == SUCCESS)
+      iStatus = Node_new(oPPath, oNParent, FALSE, NULL, 0, 0, &oNNew);
+   Path_free(oPPath);
+   if(iStatus != SUCCESS) {
+      FT_treeUnlock();
+      return iStatus;
+   }
+   psStats->ulDirs = 1;
+   ulNodes = 1;
+
+   sStorage.bShare = (boolean) (eStorage == FT_STORE_SHARED);
+   sStorage.ulRoom = FT_nodeRoom();
+   iStatus = Import_tree(oNNew, pcDiskPath, ulThreads, &sStorage,
+                         psStats, &ulNodes);
+   if(iStatus != SUCCESS) {
+      FT_lock(oNNew);
+      (void) Node_free(oNNew);
+      psStats->ulDirs = 0;
+      psStats->ulFiles = 0;
+      psStats->ulBytes = 0;
+      psStats->ulSkipped = 0;
+   }
+   else {
+      if(oNParent == NULL)
+         oNRoot = oNNew;
+      ulCount += ulNodes;
+   }
+   FT_treeUnlock();
+
+   psStats->ulMicros = FT_nowMicros() - ulStart;
+   return iStatus;
+}
+
+int FT_import(const char *pcPath, const char *pcDiskPath,
+              size_t ulThreads, struct FT_ImportStats *psStats) {
+   int iStatus;
+
+   FT_timeCall(FT_OP_IMPORT,
+               iStatus = FT_importUntimed(pcPath, pcDiskPath,
+                                          ulThreads, psStats),
+               iStatus);
+   return iStatus;
+}
+
+/*
+  Starts an export as FT_exportDir and FT_exportTar do, holding the
+  FT exclusively and settling its paths. Returns SUCCESS, leaving the
+  FT held, or INITIALIZATION_ERROR or MEMORY_ERROR, leaving it not.
+*/
+static int FT_exportStart(void) {
+   /* the export must be of one moment, and the pieces written stay
+      as they are until then */
+   FT_writeLock();
+   if(!bIsInitialized) {
+      FT_treeUnlock();
+      return INITIALIZATION_ERROR;
+   }
+   if(Node_settlePaths(oNRoot) != SUCCESS) {
+      FT_treeUnlock();
+      return MEMORY_ERROR;
+   }
+   return SUCCESS;
+}
+
+/* Does the work of FT_exportDir, which FT_METRICS builds time */
+static int FT_exportDirUntimed(const char *pcDiskPath) {
+   int iStatus;
+
+   assert(pcDiskPath != NULL);
+
+   iStatus = FT_exportStart();
+   if(iStatus != SUCCESS)
+      return iStatus;
+   iStatus = Export_dir(oNRoot, pcDiskPath);
+   FT_treeUnlock();
+   return iStatus;
+}
+
+int FT_exportDir(const char *pcDiskPath) {
+   int iStatus;
+
+   FT_timeCall(FT_OP_EXPORT_DIR,
+               iStatus = FT_exportDirUntimed(pcDiskPath), iStatus);
+   return iStatus;
+}
+
+/* Does the work of FT_exportTar, which FT_METRICS builds time */
+static int FT_exportTarUntimed(int iFd) {
+   int iStatus;
+
+   iStatus = FT_exportStart();
+   if(iStatus != SUCCESS)
+      return iStatus;
+   iStatus = Export_tar(oNRoot, iFd);
+   FT_treeUnlock();
+   return iStatus;
+}
+
+int FT_exportTar(int iFd) {
+   int iStatus;
+
+   FT_timeCall(FT_OP_EXPORT_TAR, iStatus = FT_exportTarUntimed(iFd),
+               iStatus);
+   return iStatus;
+}
+
+/* Does the work of FT_importTar, which FT_METRICS builds time */
+static int FT_importTarUntimed(int iFd,
+                               struct FT_ImportStats *psStats) {
+   struct Import_Storage sStorage;
+   size_t ulStart;
+   size_t ulMade = 0;
+   int iStatus;
+
+   assert(psStats != NULL);
+
+   ulStart = FT_nowMicros();
+   psStats->ulDirs = 0;
+   psStats->ulFiles = 0;
+   psStats->ulBytes = 0;
+   psStats->ulSkipped = 0;
+   psStats->ulMicros = 0;
+
+   /* entries are added without locking the nodes, so nobody else may
+      meanwhile */
+   FT_writeLock();
+   if(!bIsInitialized) {
+      FT_treeUnlock();
+      return INITIALIZATION_ERROR;
+   }
+   sStorage.bShare = (boolean) (eStorage == FT_STORE_SHARED);
+   sStorage.ulRoom = FT_nodeRoom();
+   iStatus = Tar_import(iFd, &oNRoot, &sStorage, psStats, &ulMade);
+   /* a failed import freed what it made, which the cursor may be */
+   if(iStatus != SUCCESS)
+      FT_setCursor(NULL);
+   ulCount += ulMade;
+   FT_treeUnlock();
+
+   psStats->ulMicros = FT_nowMicros() - ulStart;
+   return iStatus;
+}
+
+int FT_importTar(int iFd, struct FT_ImportStats *psStats) {
+   int iStatus;
+
+   FT_timeCall(FT_OP_IMPORT_TAR,
+               iStatus = FT_importTarUntimed(iFd, psStats), iStatus);
+   return iStatus;
+}
+
+/*
+  Hands the contents of file pcPath, just given to it by a replayed
+  record, to the FT, as FT_load does with those it loads.
+*/
+static void FT_ownContents(const char *pcPath) {
+   Node_T oNFound = NULL;
+
+   assert(pcPath != NULL);
+
+   FT_readLock();
+   if(FT_findNode(pcPath, FALSE, FT_FIND_FILES, &oNFound) == SUCCESS) {
+      if(Node_isFile(oNFound) && Node_getContents(oNFound) != NULL)
+         Node_ownContents(oNFound);
+      FT_release(oNFound, FALSE);
+   }
+   FT_treeUnlock();
+}
+
+/*
+  Applies the journal record of operation iOp on pcPath with the
+  ulLength bytes at pvData to the FT, for Journal_replay. File
+  contents are copied into memory owned by the FT, unless it shares
+  contents and so copies them itself; empty contents become NULL.
+  Writes and truncations are applied to the ranges they changed.
+  Returns the status of the operation, or BAD_FORMAT if
+  the record is not a FT record.
+*/
+static int FT_replayRecord(int iOp, const char *pcPath,
+                           const void *pvData, size_t ulLength,
+                           void *pvExtra) {
+   void *pvContents = NULL;
+   void *pvCopy = NULL;
+   char *pcNewPath;
+   int iStatus;
+
+   assert(pcPath != NULL);
+   /* every record is applied the same way */
+   (void) pvExtra;
+
+   if(iOp == FT_LOG_MV) {
+      /* the new path is the data, which is not '\0'-terminated */
+      pcNewPath = Alloc_malloc(ALLOC_TREE_KEY, ulLength + 1);
+      if(pcNewPath == NULL)
+         return MEMORY_ERROR;
+      memcpy(pcNewPath, pvData, ulLength);
+      pcNewPath[ulLength] = '\0';
+      iStatus = FT_mv(pcPath, pcNewPath);
+      Alloc_free(ALLOC_TREE_KEY, pcNewPath, ulLength + 1);
+      return iStatus;
+   }
+
+   if(iOp == FT_LOG_WRITE || iOp == FT_LOG_TRUNCATE) {
+      /* the data starts with the offset written at, or the length */
+      struct FT_In sIn;
+      size_t ulNumber;
+
+      if(ulLength < LENGTH_BYTES)
+         return BAD_FORMAT;
+      sIn.pucNext = pvData;
+      sIn.pucEnd = sIn.pucNext + ulLength;
+      if(!FT_inNumber(&sIn, LENGTH_BYTES, &ulNumber))
+         return BAD_FORMAT;
+      if(iOp == FT_LOG_WRITE)
+         return FT_writeFileRange(pcPath, ulNumber, sIn.pucNext,
+                                  (size_t) (sIn.pucEnd - sIn.pucNext));
+      if(sIn.pucNext != sIn.pucEnd)
+         return BAD_FORMAT;
+      return FT_truncateFile(pcPath, ulNumber);
+   }
+
+   if(iOp != FT_LOG_INSERT_FILE && iOp != FT_LOG_REPLACE) {
+      if(ulLength != 0)
+         return BAD_FORMAT;
+      switch(iOp) {
+         case FT_LOG_INSERT_DIR:
+            return FT_insertDir(pcPath);
+         case FT_LOG_RM_DIR:
+            return FT_rmDir(pcPath);
+         case FT_LOG_RM_FILE:
+            return FT_rmFile(pcPath);
+         default:
+            return BAD_FORMAT;
+      }
+   }
+
+   if(ulLength > 0 && eStorage == FT_STORE_SHARED)
+      pvContents = (void *) pvData;
+   else if(ulLength > 0) {
+      pvCopy = malloc(ulLength);
+      if(pvCopy == NULL)
+         return MEMORY_ERROR;
+      memcpy(pvCopy, pvData, ulLength);
+      pvContents = pvCopy;
+   }
+
+   if(iOp == FT_LOG_INSERT_FILE) {
+      iStatus = FT_insertFile(pcPath, pvContents, ulLength);
+      if(iStatus != SUCCESS) {
+         free(pvCopy);
+         return iStatus;
+      }
+   }
+   else {
+      boolean bIsFile = FALSE;
+      size_t ulOldLength;
+
+      /* every file's contents are the FT's after FT_load, so the old
+         ones handed back are freed here */
+      if(FT_stat(pcPath, &bIsFile, &ulOldLength) != SUCCESS ||
+         !bIsFile) {
+         free(pvCopy);
+         return NOT_A_FILE;
+      }
+      free(FT_replaceFileContents(pcPath, pvContents, ulLength));
+   }
+   if(pvCopy != NULL)
+      FT_ownContents(pcPath);
+   return SUCCESS;
+}
+
+int FT_journalStart(int iFd, size_t ulSyncEvery) {
+   int iStatus = SUCCESS;
+
+   FT_journalLock();
+   if(oJJournal != NULL)
+      iStatus = INITIALIZATION_ERROR;
+   else {
+      oJJournal = Journal_new(iFd, ulSyncEvery);
+      if(oJJournal == NULL)
+         iStatus = MEMORY_ERROR;
+   }
+   FT_journalUnlock();
+
+   return iStatus;
+}
+
+int FT_journalSync(void) {
+   int iStatus = INITIALIZATION_ERROR;
+
+   FT_journalLock();
+   if(oJJournal != NULL)
+      iStatus = Journal_sync(oJJournal);
+   FT_journalUnlock();
+
+   return iStatus;
+}
+
+int FT_journalStop(void) {
+   int iStatus = INITIALIZATION_ERROR;
+
+   FT_journalLock();
+   if(oJJournal != NULL) {
+      iStatus = Journal_free(oJJournal);
+      oJJournal = NULL;
+   }
+   FT_journalUnlock();
+
+   return iStatus;
+}
+
+void FT_getJournalStats(size_t *pulRecords, size_t *pulBatches,
+                        size_t *pulSyncs) {
+   assert(pulRecords != NULL);
+   assert(pulBatches != NULL);
+   assert(pulSyncs != NULL);
+
+   FT_journalLock();
+   if(oJJournal != NULL)
+      Journal_getStats(oJJournal, pulRecords, pulBatches, pulSyncs);
+   else {
+      *pulRecords = 0;
+      *pulBatches = 0;
+      *pulSyncs = 0;
+   }
+   FT_journalUnlock();
+}
+
+int FT_recover(int iImageFd, int iJournalFd) {
+   Journal_T oJSuspended;
+   int iStatus;
+
+   iStatus = FT_load(iImageFd);
+   if(iStatus != SUCCESS)
+      return iStatus;
+
+   /* the replayed changes are already journaled */
+   FT_journalLock();
+   oJSuspended = oJJournal;
+   oJJournal = NULL;
+   FT_journalUnlock();
+
+   iStatus = Journal_replay(iJournalFd, FT_replayRecord, NULL);
+
+   FT_journalLock();
+   oJJournal = oJSuspended;
+   FT_journalUnlock();
+
+   return iStatus;
+}
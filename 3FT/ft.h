@@ -13,6 +13,7 @@
 */
 
 #include <stddef.h>
+#include <stdio.h>
 #include "a4def.h"
 
 /*
@@ -50,7 +51,8 @@ int FT_rmDir(const char *pcPath);
 
 /*
    Inserts a new file into the FT with absolute path pcPath, with
-   file contents pvContents of size ulLength bytes.
+   file contents pvContents of size ulLength bytes, which the FT keeps
+   as such or copies, as FT_setStorage chooses.
    Returns SUCCESS if the new file is inserted successfully.
    Otherwise, returns:
    * INITIALIZATION_ERROR if the FT is not in an initialized state
@@ -64,6 +66,28 @@ int FT_rmDir(const char *pcPath);
 int FT_insertFile(const char *pcPath, void *pvContents,
                   size_t ulLength);
 
+/*
+  Inserts a new file into the FT with absolute path pcPath, whose
+  contents are the ulLength bytes from offset ulOffset of the regular
+  file open on iFd, as FT_insertFile does. Those bytes are mapped into
+  memory rather than read, and pages of them are only read from the
+  file when first touched, so an FT may hold more contents than fit
+  in memory. FT_getFileContents returns a pointer into the mapping,
+  through which changes the client makes are private to the FT, and
+  FT_stat gives ulLength. FT_replaceFileContents returns a copy of
+  them, from malloc, and changing a range copies the bytes changed,
+  so the mapping is never written. The mapping stays until the file
+  is removed or its contents replaced, and iFd may be closed
+  meanwhile, but the file must not be truncated. An FT that shares
+  contents copies them into its store, as for FT_insertFile. A
+  ulLength of 0 gives NULL contents without reading iFd.
+  Returns SUCCESS, the statuses of FT_insertFile, or IO_ERROR if iFd
+  is not open on a regular file, the bytes are not all within it, or
+  they cannot be mapped.
+*/
+int FT_insertFileFromFd(const char *pcPath, int iFd, size_t ulOffset,
+                        size_t ulLength);
+
 /*
   Returns TRUE if the FT contains a file with absolute path
   pcPath and FALSE if not or if there is an error while checking.
@@ -83,6 +107,26 @@ boolean FT_containsFile(const char *pcPath);
 */
 int FT_rmFile(const char *pcPath);
 
+/*
+  Moves the file or directory with absolute path pcOldPath, with
+  everything beneath it, to absolute path pcNewPath, whose parent must
+  exist as a directory. The subtree is relinked in one step, and the
+  paths beneath it are only rewritten as they are next used, so the
+  move takes time proportional to the depth of the paths rather than
+  to the size of the subtree. Returns SUCCESS if moved.
+  Otherwise, returns:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state
+  * BAD_PATH if pcOldPath or pcNewPath is not a well-formatted path
+  * CONFLICTING_PATH if the root exists but is not a prefix of
+                     pcOldPath or pcNewPath, or if pcNewPath is beneath
+                     pcOldPath (so the root cannot be moved)
+  * NO_SUCH_PATH if pcOldPath, or pcNewPath's parent, is not in the FT
+  * NOT_A_DIRECTORY if pcNewPath's parent is in the FT as a file
+  * ALREADY_IN_TREE if pcNewPath is already in the FT (as dir or file)
+  * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+int FT_mv(const char *pcOldPath, const char *pcNewPath);
+
 /*
   Returns the contents of the file with absolute path pcPath.
   Returns NULL if unable to complete the request for any reason.
@@ -97,6 +141,10 @@ void *FT_getFileContents(const char *pcPath);
   the parameter pvNewContents of size ulNewLength bytes.
   Returns the old contents if successful. (Note: contents may be NULL.)
   Returns NULL if unable to complete the request for any reason.
+
+  Contents that FT_load allocated, any changed by range (see
+  FT_writeFileRange), and any with FT_STORE_SHARED, are returned to,
+  and must then be freed by, the client.
 */
 void *FT_replaceFileContents(const char *pcPath, void *pvNewContents,
                              size_t ulNewLength);
@@ -119,6 +167,244 @@ void *FT_replaceFileContents(const char *pcPath, void *pvNewContents,
 */
 int FT_stat(const char *pcPath, boolean *pbIsFile, size_t *pulSize);
 
+/*
+  Returns SUCCESS if pcPath exists in the hierarchy,
+  Otherwise, returns the same statuses as FT_stat.
+
+  When returning SUCCESS, sets *pulFiles and *pulDirs to the numbers
+  of files and directories in the subtree rooted at pcPath, counting
+  pcPath itself, and *pulBytes to the total length of those files'
+  contents, all in constant time: each directory keeps its totals up
+  to date as the FT changes beneath it. When returning another
+  status, *pulFiles, *pulDirs and *pulBytes are unchanged.
+*/
+int FT_statTree(const char *pcPath, size_t *pulFiles, size_t *pulDirs,
+                size_t *pulBytes);
+
+/*
+  The next four functions read and change a range of a file's
+  contents in place, so changing a few bytes of a large file copies
+  only those. The first change moves the contents into chunks of the
+  FT's own, copying them unless the FT already owned them; contents
+  given by the client are no longer the file's from then on, but
+  stay the client's. FT_getFileContents joins the chunks into one
+  block only when it is called, and FT_replaceFileContents hands that
+  block back for the client to free. FT_stat's size is always exact.
+  Besides SUCCESS, each returns:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state
+  * BAD_PATH if pcPath does not represent a well-formatted path
+  * CONFLICTING_PATH if the root exists but is not a prefix of pcPath
+  * NO_SUCH_PATH if absolute path pcPath does not exist in the FT
+  * NOT_A_FILE if pcPath is in the FT as a directory not a file
+  * IO_ERROR if the contents were spilled (see FT_setMemoryBudget) and
+             could not be read back, in which case they are unchanged
+  * MEMORY_ERROR if memory could not be allocated to complete request,
+                 in which case the contents are unchanged
+*/
+
+/*
+  Copies into pvBuffer the bytes of the contents of the file with
+  absolute path pcPath from offset ulOffset, up to ulLength of them,
+  and sets *pulRead to the number copied: fewer than ulLength if the
+  contents end first, and 0 if they end at or before ulOffset, or if
+  the status returned is not SUCCESS.
+*/
+int FT_readFileRange(const char *pcPath, size_t ulOffset,
+                     size_t ulLength, void *pvBuffer, size_t *pulRead);
+
+/*
+  Writes the ulLength bytes at pvBytes over the contents of the file
+  with absolute path pcPath from offset ulOffset, extending them as
+  needed, and filling any gap between their end and ulOffset with
+  zeros.
+*/
+int FT_writeFileRange(const char *pcPath, size_t ulOffset,
+                      const void *pvBytes, size_t ulLength);
+
+/*
+  Appends the ulLength bytes at pvBytes to the contents of the file
+  with absolute path pcPath.
+*/
+int FT_appendFile(const char *pcPath, const void *pvBytes,
+                  size_t ulLength);
+
+/*
+  Makes the contents of the file with absolute path pcPath ulLength
+  bytes long, dropping the bytes past ulLength, or adding zeros to
+  their end.
+*/
+int FT_truncateFile(const char *pcPath, size_t ulLength);
+
+/*
+  Stores in *pulHits the number of traversals (by the operations on a
+  single path) that resumed partway down, from an ancestor of the node
+  the previous one reached, and in *pulMisses the number that started
+  from the root. Working through the files of one directory, or a
+  sorted list of paths, makes nearly every traversal a hit.
+  FT_CONCURRENT builds have no cursor, and report zero for both.
+*/
+void FT_getCursorStats(size_t *pulHits, size_t *pulMisses);
+
+/*
+  Writes to psFile the latencies of the calls made so far to each
+  operation from FT_insertDir to FT_truncateFile, and to FT_init,
+  FT_destroy, FT_toString, FT_find, FT_save, FT_load, FT_import,
+  FT_exportDir, FT_exportTar, FT_importTar and FT_insertFileFromFd, as
+  DT_dumpMetrics does for a DT, in builds with FT_METRICS defined. The
+  contains operations count as returning SUCCESS or NO_SUCH_PATH,
+  FT_toString SUCCESS or MEMORY_ERROR, and the contents operations
+  whatever status finding the file had, or NOT_A_FILE or MEMORY_ERROR.
+  Other builds write nothing.
+*/
+void FT_dumpMetrics(FILE *psFile);
+
+/* The number of buckets in the fan-out histogram of an FT_Stats */
+enum {FT_FANOUT_BUCKETS = 16};
+
+/* The shape of an FT and the memory it occupies, from FT_getStats */
+struct FT_Stats {
+   /* the number of nodes, and how many are directories and files */
+   size_t ulNodes;
+   size_t ulDirs;
+   size_t ulFiles;
+   /* the greatest depth of a node, the root's being 1, and the sum of
+      their depths, so the average is ulDepthSum / ulNodes */
+   size_t ulMaxDepth;
+   size_t ulDepthSum;
+   /* aulFanout[0] counts the directories with no children, and
+      aulFanout[i] those with from 2^(i-1) to 2^i - 1, the last
+      bucket also counting any with more */
+   size_t aulFanout[FT_FANOUT_BUCKETS];
+   /* the bytes of memory that the paths, the nodes themselves, the
+      directories' arrays of children and the files' contents occupy,
+      contents shared by several files (see FT_setStorage) being
+      counted once, and those kept in nodes (see
+      FT_setInlineThreshold) with the nodes */
+   size_t ulPathBytes;
+   size_t ulNodeBytes;
+   size_t ulChildBytes;
+   size_t ulContentBytes;
+   /* the total length of the files' contents, each file's counted
+      whether shared or not */
+   size_t ulFileBytes;
+   /* the number of slots in the arrays holding no child */
+   size_t ulSlack;
+};
+
+/*
+  Fills in *psStats for the FT, in one walk of the hierarchy that
+  allocates no memory. Returns SUCCESS, or INITIALIZATION_ERROR if the
+  FT is not in an initialized state.
+*/
+int FT_getStats(struct FT_Stats *psStats);
+
+/* How the FT has kept the contents counted against the budget from
+   FT_setMemoryBudget since FT_init, from FT_getSpillStats */
+struct FT_SpillStats {
+   /* the reads of those contents that found them in memory, and that
+      read them from the spill file */
+   size_t ulHits;
+   size_t ulFaults;
+   /* the number of times contents were spilled, and the bytes written
+      to and read from the spill file */
+   size_t ulSpills;
+   size_t ulBytesWritten;
+   size_t ulBytesRead;
+   /* the bytes of those contents now in memory, and now only in the
+      spill file */
+   size_t ulResidentBytes;
+   size_t ulSpilledBytes;
+};
+
+/*
+  Fills in *psStats for the FT, all 0 if it has no budget. Returns
+  SUCCESS, or INITIALIZATION_ERROR if the FT is not in an initialized
+  state.
+*/
+int FT_getSpillStats(struct FT_SpillStats *psStats);
+
+/* How an FT keeps the contents of its files, from FT_setStorage */
+enum FT_Storage {
+   /* the FT keeps the client's pointers, as described above */
+   FT_STORE_CLIENT,
+   /* the FT keeps copies, shared by files with the same contents */
+   FT_STORE_SHARED
+};
+
+/*
+  Makes eStorage the way the FT keeps the contents of its files from
+  the next FT_init on; FT_STORE_CLIENT is used until this is called.
+
+  With FT_STORE_SHARED, FT_insertFile and FT_replaceFileContents copy
+  the contents they are given, which remain the client's, into a
+  store that keeps one copy of each distinct run of bytes, found by a
+  128-bit hash of them, however many files have it. FT_getFileContents
+  then returns the shared copy, which the client must not modify or
+  free, and which is valid until the file's contents are replaced or
+  the file is removed. FT_replaceFileContents returns the old contents
+  in memory from malloc, which the client must free. FT_load and
+  FT_recover put the contents they read in the store too. NULL or
+  empty contents are kept as NULL contents of length 0.
+
+  Returns SUCCESS, or INITIALIZATION_ERROR if the FT is in an
+  initialized state.
+*/
+int FT_setStorage(enum FT_Storage eStorage);
+
+/*
+  Makes ulThreshold the most bytes of contents that an FT with
+  FT_STORE_SHARED keeps in a file's own node, rather than in the
+  store, from the next FT_init on; 0, which keeps none there, is used
+  until this is called. Every file node then has room for that many
+  bytes, so contents no longer than it cost no allocation of their
+  own and are not shared with other files. FT_getFileContents returns
+  a pointer into the node, valid as for shared contents, and
+  FT_replaceFileContents moves contents between the node and the
+  store as their length requires. The threshold has no effect with
+  FT_STORE_CLIENT.
+
+  Returns SUCCESS, or INITIALIZATION_ERROR if the FT is in an
+  initialized state.
+*/
+int FT_setInlineThreshold(size_t ulThreshold);
+
+/*
+  Makes ulBudget the most bytes of contents of its own that the FT
+  keeps in memory, from the next FT_init on, with iFd open for reading
+  and writing on the spill file that those beyond it go to; 0, which
+  keeps them all in memory and ignores iFd, is used until this is
+  called. The FT's own contents are those that FT_load, FT_recover,
+  FT_import and FT_importTar from a stream read into memory, those
+  that changes by range keep in chunks, counted by the memory the
+  chunks take up, and those that FT_getFileContents makes contiguous.
+  Contents that an FT_STORE_SHARED FT shares are counted once however
+  many files share them, and spilled for all of them at once. The
+  client's, those kept in nodes, and those mapped from a file are not
+  counted.
+
+  Whenever those in memory come to more than the budget, those read
+  least recently are written to the spill file and freed until they
+  fit, leaving out the ones just read. FT_getFileContents and the
+  operations that change or replace contents read spilled contents
+  back first, which may spill others, so with a budget the pointer
+  that FT_getFileContents returns is only valid until the next call
+  to the FT. FT_exportDir and FT_exportTar read them back too, one at
+  a time, while FT_readFileRange and FT_save read them where they are,
+  and FT_stat, FT_statTree and FT_getStats never read them. The spill
+  file is written from offset 0, contents
+  going to the same place each time they are spilled, and only
+  rewritten if FT_getFileContents may have let the client change
+  them; the place is not reused once the file is removed or its
+  contents are changed, until the next FT_init. If the spill file
+  cannot be written, contents stay in memory beyond the budget.
+  Spilled chunks are read back contiguous.
+
+  Returns SUCCESS, or INITIALIZATION_ERROR if the FT is in an
+  initialized state or, in FT_CONCURRENT builds, which keep all
+  contents in memory, if ulBudget is not 0.
+*/
+int FT_setMemoryBudget(size_t ulBudget, int iFd);
+
 /*
   Sets the FT data structure to an initialized state.
   The data structure is initially empty.
@@ -149,4 +435,255 @@ int FT_destroy(void);
 */
 char *FT_toString(void);
 
+/* The kinds of nodes that FT_find reports */
+enum FT_FindKind {FT_FIND_ALL, FT_FIND_FILES, FT_FIND_DIRS};
+
+/*
+  Calls (*pfVisit)(pcPath, pvExtra) once for each node of kind eKind
+  whose absolute path matches pcPattern, in the order of FT_toString,
+  even where a node matches in several ways. The pattern is a path
+  whose components each match one component of a node's path.
+  In a component, '*' matches any run of characters, '?' any one
+  character, and "[...]" one character from a set such as "[a-z]"
+  or "[!0-9]". A whole component "**" matches any number of
+  components, including none. Only the branches that can match are
+  visited.
+
+  pcPath is borrowed from the FT and must not be modified or freed,
+  and pfVisit must not change the FT.
+  Returns SUCCESS even if nothing matches. Otherwise returns:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state
+  * BAD_PATH if pcPattern is not a well-formatted path
+  * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+int FT_find(const char *pcPattern, enum FT_FindKind eKind,
+            void (*pfVisit)(const char *pcPath, void *pvExtra),
+            void *pvExtra);
+
+/*
+  Writes a binary image of the FT, file contents included, to file
+  descriptor iFd, for FT_load. The image is a 4-byte magic number
+  "FTI1", the number of nodes in 8 bytes, then one record per node in
+  pre-order, with each directory's files and then its subdirectories
+  in path order, as FT_toString lists them (FT_load takes them in any
+  order). A record
+  is a type byte (0 for a directory, 1 for a file), the length of the
+  node's last path component in 4 bytes and the component itself,
+  followed for a file by the length of its contents in 8 bytes and
+  the contents, or for a directory by its number of children in 4
+  bytes. Numbers are big-endian.
+  Returns SUCCESS, or:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state
+  * IO_ERROR if writing to iFd, or reading spilled contents, fails
+  * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+int FT_save(int iFd);
+
+/*
+  Replaces the contents of the FT with the image from FT_save that
+  makes up the whole of the file open on iFd. Regular files are mapped
+  into memory rather than read, and either way the nodes are built in
+  a single pass over the image, without parsing a pathname or
+  traversing the FT. The contents of the loaded files are copies
+  owned by the FT, freed when their files are removed; empty contents
+  load as NULL. The FT is left unchanged unless SUCCESS is returned.
+  Otherwise returns:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state
+  * IO_ERROR if reading from iFd fails
+  * BAD_FORMAT if the file is not a valid image
+  * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+int FT_load(int iFd);
+
+/* What FT_import or FT_importTar added, and how long it took */
+struct FT_ImportStats {
+   /* the numbers of directories and files mirrored, the new
+      directory included, and the total length of the files'
+      contents */
+   size_t ulDirs;
+   size_t ulFiles;
+   size_t ulBytes;
+   /* the number of entries skipped for being neither directories nor
+      regular files, such as symbolic links */
+   size_t ulSkipped;
+   /* the wall-clock time that the import took, in microseconds, from
+      which its throughput follows */
+   size_t ulMicros;
+};
+
+/*
+  Mirrors the directory with pathname pcDiskPath on disk, and all
+  that it holds, as a new directory with absolute path pcPath, whose
+  parent must already be in the FT unless pcPath is to be the root
+  of an empty one. Regular files become files whose contents are
+  read into copies owned by the FT, or into its store if it shares
+  contents; empty ones get NULL contents. Entries that are neither
+  directories nor regular files are skipped, and symbolic links are
+  not followed. Each new node is built beneath its parent's, without
+  parsing a pathname or traversing the FT, and each directory's
+  entries are added in sorted order, so each goes on the end of its
+  parent's children.
+
+  In FT_CONCURRENT builds the directories on disk are read by up to
+  ulThreads threads (0 counting as 1, and at most 64), the caller's
+  among them, each stealing waiting directories from the others when
+  it runs out; other builds read them all in the caller's thread.
+  Nothing else may change or read the FT meanwhile, and the import
+  is not journaled, so an image from FT_save should follow it.
+
+  Sets *psStats to what was mirrored and how long it took. Returns
+  SUCCESS, or, leaving the FT unchanged and *psStats all 0 but for
+  ulMicros:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state
+  * BAD_PATH if pcPath does not represent a well-formatted path
+  * CONFLICTING_PATH if the root exists but is not a prefix of pcPath
+  * NO_SUCH_PATH if pcPath's parent does not exist in the FT
+  * NOT_A_DIRECTORY if pcPath's parent is in the FT as a file
+  * ALREADY_IN_TREE if pcPath is already in the FT
+  * IO_ERROR if pcDiskPath is not a directory that can be read, or
+             a directory or file within it cannot be read
+  * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+int FT_import(const char *pcPath, const char *pcDiskPath,
+              size_t ulThreads, struct FT_ImportStats *psStats);
+
+/*
+  Writes the FT out into the directory with pathname pcDiskPath on
+  disk, which must exist: each directory in the FT as a directory,
+  made unless there is one already, and each file as a regular file,
+  made or emptied, holding its contents. The root goes in pcDiskPath
+  under its own name. Nodes are written in pre-order, each
+  directory's files before its subdirectories, and each file's
+  contents go out with writev straight from where the FT keeps them,
+  without being copied, so the memory the export uses does not grow
+  with the FT. Nothing else may change the FT meanwhile.
+  Returns SUCCESS, or:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state
+  * IO_ERROR if pcDiskPath is not a directory, a directory or file
+             cannot be made or written, or spilled contents cannot be
+             read back, in which case whatever was written before
+             stays, or, before anything is written, if a component of
+             a pathname in the FT is "." or "..", which would lead
+             outside pcDiskPath
+  * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+int FT_exportDir(const char *pcDiskPath);
+
+/*
+  Writes the FT to file descriptor iFd as a POSIX ustar archive, in
+  the order and with the contents FT_exportDir writes, each entry's
+  header made as it is reached. Files have mode 0644 and directories
+  0755, owned by user and group 0, with modification time 0. An
+  entry whose pathname does not fit a ustar header, or whose size
+  does not fit in 11 octal digits, is preceded by a pax extended
+  header giving them in full. Nothing else may change the FT
+  meanwhile. Returns SUCCESS, or:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state
+  * IO_ERROR if writing to iFd, or reading spilled contents back,
+             fails, in which case whatever was written before stays
+  * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+int FT_exportTar(int iFd);
+
+/*
+  Reads the tar archive on file descriptor iFd, in POSIX ustar or pax
+  format or as GNU tar writes it, into the FT in a single pass, adding
+  each directory and regular file as its entry is reached, along with
+  any of its ancestors that are missing. A directory that is already
+  in the FT is kept as it is. Leading slashes and "./", and trailing
+  slashes, are dropped from the pathnames; other entries, such as
+  links, are skipped. An entry that goes in the same directory as the
+  one before it is added without traversing the FT. The archive ends
+  with a block of zeros, or at the end of its file.
+
+  An archive in a regular file is mapped into memory whole, and each
+  file's contents are left where they are in the mapping, which stays
+  until the last of them is gone, so the archive must not be
+  truncated meanwhile; changes the client makes through
+  FT_getFileContents are private to the FT. Any other archive, such
+  as a pipe's, is read as it comes, each file's contents into memory
+  owned by the FT, which grows as they arrive rather than as big as
+  the header says. An FT that shares contents copies them into its
+  store or nodes either way. Nothing else may change or read the FT
+  meanwhile, and the import is not journaled, so an image from
+  FT_save should follow it.
+
+  Sets *psStats to what was added and how long it took. Returns
+  SUCCESS, or, leaving the FT unchanged and *psStats all 0 but for
+  ulMicros:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state
+  * BAD_FORMAT if the archive is malformed or ends partway through an
+               entry, or a pathname in it is not a well-formatted path
+               or has a "." or ".." component other than a leading
+               "./", which GNU tar would drop instead
+  * CONFLICTING_PATH if the root is not a prefix of a pathname in the
+                     archive, or a file in it would be the root
+  * NOT_A_DIRECTORY if a proper prefix of a pathname in the archive is
+                    a file in the FT
+  * ALREADY_IN_TREE if a file in the archive is already in the FT, or
+                    a directory in it is a file in the FT
+  * IO_ERROR if reading from iFd fails
+  * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+int FT_importTar(int iFd, struct FT_ImportStats *psStats);
+
+/*
+  Starts journaling every successful FT_insertDir, FT_insertFile,
+  FT_replaceFileContents, FT_rmDir, FT_rmFile, FT_mv and change by
+  range to file descriptor iFd, for FT_recover. A record of a file's
+  contents carries a copy of them, and one of a write a copy of just
+  the bytes written. Records are written out in batches rather
+  than one by one, and the file is synced after every ulSyncEvery
+  records, or only by FT_journalSync and FT_journalStop if ulSyncEvery
+  is 0, so that many changes share each sync. A change is durable
+  once a sync has followed it. Nothing else that changes the FT is
+  journaled, so an image from FT_save should follow it.
+  Returns SUCCESS, or:
+  * INITIALIZATION_ERROR if the FT is already being journaled
+  * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+int FT_journalStart(int iFd, size_t ulSyncEvery);
+
+/*
+  Writes out and syncs every record journaled so far.
+  Returns SUCCESS, or:
+  * INITIALIZATION_ERROR if the FT is not being journaled
+  * IO_ERROR if this or any earlier write or sync of the journal
+             failed, after which the journal records nothing more
+*/
+int FT_journalSync(void);
+
+/*
+  Syncs the journal as FT_journalSync does, then stops journaling,
+  leaving iFd open. Returns as FT_journalSync does.
+*/
+int FT_journalStop(void);
+
+/*
+  Stores in *pulRecords the number of records journaled since
+  FT_journalStart, in *pulBatches the number of batches they were
+  written to the journal in and in *pulSyncs the number of syncs
+  they took, or 0 in each if the FT is not being journaled.
+*/
+void FT_getJournalStats(size_t *pulRecords, size_t *pulBatches,
+                        size_t *pulSyncs);
+
+/*
+  Replaces the contents of the FT with the image from FT_save on
+  iImageFd, as FT_load does, then replays on top of it the journal
+  read from iJournalFd, which must have been started right after the
+  image was saved. Replayed contents are copies owned by the FT, as
+  loaded ones are. A record cut off by a crash at the end of the
+  journal is ignored. The replayed changes are not journaled again,
+  and nothing else may change the FT meanwhile.
+  Returns SUCCESS, or:
+  * any status that FT_load returns, leaving the FT unchanged
+  * IO_ERROR if reading from iJournalFd fails
+  * BAD_FORMAT if a record is malformed or cannot be replayed, in
+               which case the FT holds the image and every change
+               journaled before that record
+  * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+int FT_recover(int iImageFd, int iJournalFd);
+
 #endif
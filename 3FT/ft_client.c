@@ -3,12 +3,135 @@
 /* Author: Christopher Moretti                                        */
 /*--------------------------------------------------------------------*/
 
+/* fileno, pipe, close, mkdtemp and symlink are POSIX.1 interfaces */
+#define _POSIX_C_SOURCE 200809L
+
 #include <assert.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include "ft.h"
+#include "alloc.h"
+#ifdef FT_METRICS
+#include "latency.h"
+#endif
+
+/* Appends pcPath and a newline to the string pointed to by pvWalk,
+   for FT_find. */
+static void appendPath(const char *pcPath, void *pvWalk) {
+  strcat((char *) pvWalk, pcPath);
+  strcat((char *) pvWalk, "\n");
+}
+
+/* Writes pcContents and its terminating '\0' to a new file with
+   pathname pcDir/pcName on disk. */
+static void writeDiskFile(const char *pcDir, const char *pcName,
+                          const char *pcContents) {
+  enum {BUFLEN = 256};
+  char acPath[BUFLEN];
+  FILE *psFile;
+
+  sprintf(acPath, "%s/%s", pcDir, pcName);
+  assert((psFile = fopen(acPath, "w")) != NULL);
+  assert(fwrite(pcContents, 1, strlen(pcContents) + 1, psFile) ==
+         strlen(pcContents) + 1);
+  assert(fclose(psFile) == 0);
+}
+
+/* Removes the file, link or empty directory with pathname
+   pcDir/pcName on disk. */
+static void removeDiskEntry(const char *pcDir, const char *pcName) {
+  enum {BUFLEN = 256};
+  char acPath[BUFLEN];
+
+  sprintf(acPath, "%s/%s", pcDir, pcName);
+  assert(remove(acPath) == 0);
+}
+
+/* Reads into pcBuffer the file with pathname pcDir/pcName on disk,
+   of at most ulMax bytes, returning its length. */
+static size_t readDiskFile(const char *pcDir, const char *pcName,
+                           char *pcBuffer, size_t ulMax) {
+  enum {BUFLEN = 256};
+  char acPath[BUFLEN];
+  FILE *psFile;
+  size_t ulLength;
+
+  sprintf(acPath, "%s/%s", pcDir, pcName);
+  assert((psFile = fopen(acPath, "r")) != NULL);
+  ulLength = fread(pcBuffer, 1, ulMax, psFile);
+  assert(fclose(psFile) == 0);
+  return ulLength;
+}
+
+/* Appends to pcList a line for each entry of the ulLength-byte tar
+   archive at pcTar: its type, a space and its name, checking each
+   header's magic and checksum, and that the archive ends with
+   blocks of zeros. */
+static void listTar(const char *pcTar, size_t ulLength, char *pcList) {
+  enum {BLOCK = 512};
+  const unsigned char *pucHeader;
+  size_t ulOffset = 0;
+  size_t ulSum;
+  size_t i;
+
+  assert(ulLength % BLOCK == 0 && ulLength >= 2 * BLOCK);
+  while(ulOffset < ulLength && pcTar[ulOffset] != '\0') {
+    pucHeader = (const unsigned char *) pcTar + ulOffset;
+    assert(!memcmp(pucHeader + 257, "ustar", 6));
+    ulSum = 0;
+    for(i = 0; i < BLOCK; i++)
+      ulSum += (i >= 148 && i < 156) ? ' ' : pucHeader[i];
+    assert(strtoul((const char *) pucHeader + 148, NULL, 8) == ulSum);
+    pcList += strlen(pcList);
+    if(pucHeader[345] != '\0')
+      sprintf(pcList, "%c %.155s/%.100s\n", pucHeader[156],
+              pcTar + ulOffset + 345, pcTar + ulOffset);
+    else
+      sprintf(pcList, "%c %.100s\n", pucHeader[156],
+              pcTar + ulOffset);
+    ulOffset += BLOCK + (strtoul((const char *) pucHeader + 124,
+                                 NULL, 8) + BLOCK - 1) / BLOCK * BLOCK;
+  }
+  assert(ulLength - ulOffset >= 2 * BLOCK);
+  for(; ulOffset < ulLength; ulOffset++)
+    assert(pcTar[ulOffset] == '\0');
+}
+
+/* Makes the tar header at pcHeader one of type cType whose body has
+   the size in the 11 octal digits at pcSize, and sets its checksum
+   again. */
+static void retypeTar(char *pcHeader, char cType, const char *pcSize) {
+  enum {BLOCK = 512};
+  size_t ulSum = 0;
+  size_t i;
+
+  pcHeader[156] = cType;
+  memcpy(pcHeader + 124, pcSize, 11);
+  memset(pcHeader + 148, ' ', 8);
+  for(i = 0; i < BLOCK; i++)
+    ulSum += (unsigned char) pcHeader[i];
+  sprintf(pcHeader + 148, "%06lo", (unsigned long) ulSum);
+}
+
+/* Writes the ulLength bytes at pcTar to a pipe and has FT_importTar
+   read them from it, setting *psStats, and returns its status. */
+static int importPipe(const char *pcTar, size_t ulLength,
+                      struct FT_ImportStats *psStats) {
+  int aiPipe[2];
+  int iStatus;
+
+  /* the archives are small enough to wait in the pipe whole */
+  assert(pipe(aiPipe) == 0);
+  assert(write(aiPipe[1], pcTar, ulLength) == (ssize_t) ulLength);
+  assert(close(aiPipe[1]) == 0);
+  iStatus = FT_importTar(aiPipe[0], psStats);
+  assert(close(aiPipe[0]) == 0);
+  return iStatus;
+}
 
 /* Tests the FT implementation with an assortment of checks.
    Prints the status of the data structure along the way to stderr.
@@ -18,7 +141,31 @@ int main(void) {
   char* temp;
   boolean bIsFile;
   size_t l;
+  size_t ulHits, ulMisses, ulHits0, ulMisses0;
+  size_t ulFiles, ulDirs, ulBytes;
+  char *pcLoaded;
+  FILE *psImage;
+  FILE *psJournal;
+  int aiPipe[2];
+  struct FT_Stats sStats;
+  struct Alloc_Stats sAlloc;
+  size_t ulLive;
+#ifdef FT_METRICS
+  size_t ulLines;
+  char acLine[ARRLEN];
+  size_t aulCounts[LATENCY_BUCKETS];
+  char *pcBound;
+#endif
   char arr[ARRLEN];
+  char acRange[ARRLEN];
+  char acDisk[] = "/tmp/ft_clientXXXXXX";
+  struct FT_ImportStats sImport;
+  char *pcTar;
+  char acLong[ARRLEN];
+  FILE *psSpill;
+  struct FT_SpillStats sSpill;
+  boolean bSpills;
+  int iStatus;
   arr[0] = '\0';
 
   /* Before the data structure is initialized:
@@ -235,11 +382,978 @@ int main(void) {
   fprintf(stderr, "Checkpoint 4.5:\n%s\n", temp);
   free(temp);
 
+  /* find reports each matching node of the requested kind once */
+  arr[0] = '\0';
+  assert(FT_find("1root/y/CHILD?FILE", FT_FIND_FILES, appendPath, arr)
+         == SUCCESS);
+  assert(!strcmp(arr, "1root/y/CHILD1FILE\n1root/y/CHILD2FILE\n"));
+  arr[0] = '\0';
+  assert(FT_find("1root/**/CHILD*", FT_FIND_DIRS, appendPath, arr)
+         == SUCCESS);
+  assert(!strcmp(arr, "1root/y/CHILD1DIR\n1root/y/CHILD2DIR\n"
+                      "1root/y/CHILD2DIR/CHILD4DIR\n"
+                      "1root/y/CHILD3DIR\n"));
+  arr[0] = '\0';
+  assert(FT_find("1root/x/[A-C]*", FT_FIND_ALL, appendPath, arr)
+         == SUCCESS);
+  assert(!strcmp(arr, "1root/x/B\n1root/x/C\n"));
+  arr[0] = '\0';
+  assert(FT_find("1root/x/[A-C]*", FT_FIND_DIRS, appendPath, arr)
+         == SUCCESS);
+  assert(FT_find("1root/x/C/*", FT_FIND_ALL, appendPath, arr)
+         == SUCCESS);
+  assert(FT_find("2root/**", FT_FIND_ALL, appendPath, arr) == SUCCESS);
+  assert(arr[0] == '\0');
+  assert(FT_find("1root/", FT_FIND_ALL, appendPath, arr) == BAD_PATH);
+
+  /* with two "**", a node reached several ways is still visited
+     once, and matches come in toString order */
+  assert(FT_insertDir("1root/a/b/b/c") == SUCCESS);
+  assert(FT_insertDir("1root/a/b/c") == SUCCESS);
+  arr[0] = '\0';
+  assert(FT_find("1root/a/**/b/**/c", FT_FIND_ALL, appendPath, arr)
+         == SUCCESS);
+  assert(!strcmp(arr, "1root/a/b/b/c\n1root/a/b/c\n"));
+  arr[0] = '\0';
+  assert(FT_find("1root/a/**/*", FT_FIND_ALL, appendPath, arr)
+         == SUCCESS);
+  assert(!strcmp(arr, "1root/a/b\n1root/a/b/b\n1root/a/b/b/c\n"
+                      "1root/a/b/c\n"));
+  arr[0] = '\0';
+  assert(FT_find("1root/**/b/**", FT_FIND_DIRS, appendPath, arr)
+         == SUCCESS);
+  assert(!strcmp(arr, "1root/a/b\n1root/a/b/b\n1root/a/b/b/c\n"
+                      "1root/a/b/c\n"));
+
   assert(FT_destroy() == SUCCESS);
   assert(FT_destroy() == INITIALIZATION_ERROR);
   assert(FT_containsDir("1root") == FALSE);
   assert(FT_containsFile("1root") == FALSE);
   assert((temp = FT_toString()) == NULL);
+  assert(FT_find("**", FT_FIND_ALL, appendPath, arr)
+         == INITIALIZATION_ERROR);
+
+  /* Working through one directory's files resumes each traversal
+     from the cursor left by the one before, unless the build has no
+     cursor at all; only the first insert starts from the root */
+  assert(FT_init() == SUCCESS);
+  assert(FT_insertDir("m/d") == SUCCESS);
+  FT_getCursorStats(&ulHits0, &ulMisses0);
+  for(l = 0; l < 10; l++) {
+    sprintf(arr, "m/d/e/f%lu", (unsigned long) l);
+    assert(FT_insertFile(arr, NULL, 0) == SUCCESS);
+    assert(FT_containsFile(arr) == TRUE);
+  }
+  assert(FT_rmFile("m/d/e/f3") == SUCCESS);
+  assert(FT_containsFile("m/d/e/f3") == FALSE);
+  assert(FT_containsFile("m/d/e/f4") == TRUE);
+  assert(FT_insertDir("m/d/e/f4/g") == NOT_A_DIRECTORY);
+  FT_getCursorStats(&ulHits, &ulMisses);
+  assert((ulHits == 0 && ulMisses == 0) ||
+         (ulHits - ulHits0 == 23 && ulMisses - ulMisses0 == 1));
+
+  /* A saved image loads back as the same hierarchy with copies of the
+     file contents, from a file or from a pipe, while a bad image
+     leaves the FT as it was */
+  assert(FT_replaceFileContents("m/d/e/f4", "Ritchie", 8) == NULL);
+  assert((psImage = tmpfile()) != NULL);
+  assert(FT_save(fileno(psImage)) == SUCCESS);
+  assert((temp = FT_toString()) != NULL);
+  assert(FT_rmDir("m/d/e") == SUCCESS);
+  assert(FT_insertFile("m/other", NULL, 0) == SUCCESS);
+  assert(FT_load(fileno(psImage)) == SUCCESS);
+  assert(fclose(psImage) == 0);
+  assert((pcLoaded = FT_toString()) != NULL);
+  assert(!strcmp(temp, pcLoaded));
+  free(pcLoaded);
+  assert(FT_containsFile("m/other") == FALSE);
+  assert(FT_stat("m/d/e/f4", &bIsFile, &l) == SUCCESS);
+  assert(bIsFile == TRUE && l == 8);
+  assert((pcLoaded = FT_getFileContents("m/d/e/f4")) != NULL);
+  assert(!strcmp(pcLoaded, "Ritchie"));
+  assert(FT_getFileContents("m/d/e/f5") == NULL);
+
+  assert(pipe(aiPipe) == 0);
+  assert(FT_save(aiPipe[1]) == SUCCESS);
+  assert(close(aiPipe[1]) == 0);
+  assert(FT_rmDir("m") == SUCCESS);
+  assert(FT_load(aiPipe[0]) == SUCCESS);
+  assert(close(aiPipe[0]) == 0);
+  assert((pcLoaded = FT_toString()) != NULL);
+  assert(!strcmp(temp, pcLoaded));
+  free(pcLoaded);
+  /* loaded contents handed back to the client are the client's, and
+     no longer counted as the FT's */
+  Alloc_getSiteStats(ALLOC_CONTENTS_LOADED, &sAlloc);
+  ulLive = sAlloc.ulLiveBytes;
+  assert(ulLive >= 8);
+  pcLoaded = FT_replaceFileContents("m/d/e/f4", "Kernighan", 10);
+  assert(pcLoaded != NULL && !strcmp(pcLoaded, "Ritchie"));
+  free(pcLoaded);
+  Alloc_getSiteStats(ALLOC_CONTENTS_LOADED, &sAlloc);
+  assert(sAlloc.ulLiveBytes == ulLive - 8);
+
+  assert((psImage = tmpfile()) != NULL);
+  /* the root "m" is recorded as a file, which it cannot be */
+  assert(fwrite("FTI1\0\0\0\0\0\0\0\1\1\0\0\0\1m\0\0\0\0\0\0\0\0",
+                1, 26, psImage) == 26);
+  assert(fflush(psImage) == 0);
+  assert(FT_load(fileno(psImage)) == BAD_FORMAT);
+  assert(fclose(psImage) == 0);
+  assert(FT_load(-1) == IO_ERROR);
+  assert((pcLoaded = FT_toString()) != NULL);
+  assert(!strcmp(temp, pcLoaded));
+  free(pcLoaded);
+  free(temp);
+
+  /* The changes journaled after an image replay on top of it with
+     copies of the contents they carried, all written and synced at
+     once when asked, and a record cut off by a crash is left out */
+  assert((psImage = tmpfile()) != NULL);
+  assert((psJournal = tmpfile()) != NULL);
+  assert(FT_save(fileno(psImage)) == SUCCESS);
+  assert(FT_journalStart(fileno(psJournal), 0) == SUCCESS);
+  assert(FT_insertDir("m/j") == SUCCESS);
+  assert(FT_insertFile("m/j/f", "Thompson", 9) == SUCCESS);
+  assert(FT_insertFile("m/j/f", "Thompson", 9) == ALREADY_IN_TREE);
+  assert(!strcmp(FT_replaceFileContents("m/j/f", "Pike", 5),
+                 "Thompson"));
+  assert(FT_replaceFileContents("m/j", "Pike", 5) == NULL);
+  assert(FT_insertFile("m/j/empty", NULL, 0) == SUCCESS);
+  assert(FT_rmFile("m/d/e/f5") == SUCCESS);
+  assert(FT_rmDir("m/d/e/f6") == NOT_A_DIRECTORY);
+  assert(FT_mv("m/j/empty", "m/d/empty") == SUCCESS);
+  FT_getJournalStats(&l, &ulHits, &ulMisses);
+  assert(l == 6 && ulHits == 0 && ulMisses == 0);
+  assert(FT_journalSync() == SUCCESS);
+  FT_getJournalStats(&l, &ulHits, &ulMisses);
+  assert(l == 6 && ulHits == 1 && ulMisses == 1);
+  assert(FT_journalStop() == SUCCESS);
+  assert(FT_journalStop() == INITIALIZATION_ERROR);
+  assert(write(fileno(psJournal), "\2\0\0\0\7m/j/g", 10) == 10);
+  assert((temp = FT_toString()) != NULL);
+  assert(FT_destroy() == SUCCESS);
+
+  assert(FT_init() == SUCCESS);
+  assert(FT_insertDir("other") == SUCCESS);
+  assert(lseek(fileno(psJournal), 0, SEEK_SET) == 0);
+  assert(FT_recover(fileno(psImage), fileno(psJournal)) == SUCCESS);
+  assert(fclose(psJournal) == 0);
+  assert(fclose(psImage) == 0);
+  assert((pcLoaded = FT_toString()) != NULL);
+  assert(!strcmp(temp, pcLoaded));
+  free(pcLoaded);
+  free(temp);
+  assert(FT_containsFile("m/j/empty") == FALSE);
+  assert(FT_containsFile("m/d/empty") == TRUE);
+  assert(FT_stat("m/j/f", &bIsFile, &l) == SUCCESS);
+  assert(bIsFile == TRUE && l == 5);
+  /* the replayed contents are the FT's until handed back */
+  pcLoaded = FT_replaceFileContents("m/j/f", NULL, 0);
+  assert(pcLoaded != NULL && !strcmp(pcLoaded, "Pike"));
+  free(pcLoaded);
+  assert(FT_destroy() == SUCCESS);
+  assert(FT_save(1) == INITIALIZATION_ERROR);
+
+  /* A move relinks a file or a whole directory, whose paths follow
+     it, but only ever into a directory */
+  assert(FT_mv("m/a", "m/b") == INITIALIZATION_ERROR);
+  assert(FT_init() == SUCCESS);
+  assert(FT_insertFile("m/a/b/f", "Lesk", 5) == SUCCESS);
+  assert(FT_insertDir("m/a/b/c") == SUCCESS);
+  assert(FT_insertFile("m/g", NULL, 0) == SUCCESS);
+  assert(FT_mv("m/a", "m/a") == ALREADY_IN_TREE);
+  assert(FT_mv("m/a", "m/g") == ALREADY_IN_TREE);
+  assert(FT_mv("m/a", "m/a/b/x") == CONFLICTING_PATH);
+  assert(FT_mv("m", "n") == CONFLICTING_PATH);
+  assert(FT_mv("m/a", "n/a") == CONFLICTING_PATH);
+  assert(FT_mv("m/a", "m/g/a") == NOT_A_DIRECTORY);
+  assert(FT_mv("m/a", "m/y/a") == NO_SUCH_PATH);
+  assert(FT_mv("m/q", "m/q2") == NO_SUCH_PATH);
+  assert(FT_mv("m/a", "m//a") == BAD_PATH);
+  assert(FT_mv("m/a/b", "m/z") == SUCCESS);
+  assert(FT_containsDir("m/a/b") == FALSE);
+  assert(FT_containsDir("m/z/c") == TRUE);
+  assert(!strcmp(FT_getFileContents("m/z/f"), "Lesk"));
+  assert(FT_mv("m/z/f", "m/a/f") == SUCCESS);
+  assert(FT_mv("m/z", "m/a/z") == SUCCESS);
+  assert(FT_containsFile("m/a/f") == TRUE);
+  assert((temp = FT_toString()) != NULL);
+  assert(!strcmp(temp, "m\nm/g\nm/a\nm/a/f\nm/a/z\nm/a/z/c\n"));
+  free(temp);
+  arr[0] = '\0';
+  assert(FT_find("m/a/*", FT_FIND_ALL, appendPath, arr) == SUCCESS);
+  assert(!strcmp(arr, "m/a/f\nm/a/z\n"));
+  /* files come before directories wherever the FT lists children,
+     and each kind is looked for only among its own */
+  assert(FT_insertDir("m/a/e") == SUCCESS);
+  assert(FT_insertFile("m/a/y", NULL, 0) == SUCCESS);
+  arr[0] = '\0';
+  assert(FT_find("m/a/*", FT_FIND_ALL, appendPath, arr) == SUCCESS);
+  assert(!strcmp(arr, "m/a/f\nm/a/y\nm/a/e\nm/a/z\n"));
+  arr[0] = '\0';
+  assert(FT_find("m/**/[e-y]", FT_FIND_DIRS, appendPath, arr)
+         == SUCCESS);
+  assert(!strcmp(arr, "m/a/e\n"));
+  assert(FT_containsDir("m/a/y") == FALSE);
+  assert(FT_containsFile("m/a/e") == FALSE);
+  assert(FT_insertFile("m/a/e", NULL, 0) == ALREADY_IN_TREE);
+  assert(FT_insertDir("m/a/y") == ALREADY_IN_TREE);
+  assert(FT_mv("m/a/y", "m/a/e") == ALREADY_IN_TREE);
+  assert(FT_rmFile("m/a/y") == SUCCESS);
+  assert(FT_rmDir("m/a/e") == SUCCESS);
+
+  /* Stats describe the shape of the hierarchy, counting fan-out for
+     directories only and the contents of files */
+  assert(FT_getStats(&sStats) == SUCCESS);
+  assert(sStats.ulNodes == 6);
+  assert(sStats.ulDirs == 4 && sStats.ulFiles == 2);
+  assert(sStats.ulMaxDepth == 4);
+  assert(sStats.ulDepthSum == 15);
+  assert(sStats.aulFanout[0] == 1);
+  assert(sStats.aulFanout[1] == 1);
+  assert(sStats.aulFanout[2] == 2);
+  assert(sStats.ulContentBytes == 5);
+  assert(sStats.ulPathBytes > 0 && sStats.ulNodeBytes > 0);
+  assert(sStats.ulChildBytes > 0);
+  assert(FT_rmDir("m/a") == SUCCESS);
+  assert(FT_getStats(&sStats) == SUCCESS);
+  assert(sStats.ulNodes == 2 && sStats.ulFiles == 1);
+  assert(sStats.ulDepthSum == 3);
+  assert(sStats.ulContentBytes == 0);
+  assert(FT_destroy() == SUCCESS);
+  assert(FT_getStats(&sStats) == INITIALIZATION_ERROR);
+
+  /* Each directory's totals count itself and everything beneath it,
+     and follow every change there, including moves and ranged
+     changes */
+  assert(FT_statTree("m", &ulFiles, &ulDirs, &ulBytes) ==
+         INITIALIZATION_ERROR);
+  assert(FT_init() == SUCCESS);
+  assert(FT_statTree("m", &ulFiles, &ulDirs, &ulBytes) ==
+         NO_SUCH_PATH);
+  assert(FT_insertFile("m/a/f", "Lesk", 5) == SUCCESS);
+  assert(FT_insertDir("m/a/z/c") == SUCCESS);
+  assert(FT_insertFile("m/g", NULL, 0) == SUCCESS);
+  assert(FT_statTree("m", &ulFiles, &ulDirs, &ulBytes) == SUCCESS);
+  assert(ulFiles == 2 && ulDirs == 4 && ulBytes == 5);
+  assert(FT_statTree("m/a", &ulFiles, &ulDirs, &ulBytes) == SUCCESS);
+  assert(ulFiles == 1 && ulDirs == 3 && ulBytes == 5);
+  assert(FT_statTree("m/a/f", &ulFiles, &ulDirs, &ulBytes) ==
+         SUCCESS);
+  assert(ulFiles == 1 && ulDirs == 0 && ulBytes == 5);
+  assert(FT_replaceFileContents("m/g", "Kernighan", 10) == NULL);
+  assert(FT_appendFile("m/a/f", "!", 1) == SUCCESS);
+  assert(FT_statTree("m", &ulFiles, &ulDirs, &ulBytes) == SUCCESS);
+  assert(ulFiles == 2 && ulDirs == 4 && ulBytes == 16);
+  assert(FT_mv("m/a/z", "m/z") == SUCCESS);
+  assert(FT_insertFile("m/z/c/h", "Ritchie", 8) == SUCCESS);
+  assert(FT_truncateFile("m/a/f", 2) == SUCCESS);
+  assert(FT_statTree("m/a", &ulFiles, &ulDirs, &ulBytes) == SUCCESS);
+  assert(ulFiles == 1 && ulDirs == 1 && ulBytes == 2);
+  assert(FT_statTree("m/z", &ulFiles, &ulDirs, &ulBytes) == SUCCESS);
+  assert(ulFiles == 1 && ulDirs == 2 && ulBytes == 8);
+  assert(FT_statTree("m", &ulFiles, &ulDirs, &ulBytes) == SUCCESS);
+  assert(ulFiles == 3 && ulDirs == 4 && ulBytes == 20);
+  assert(FT_rmDir("m/z") == SUCCESS);
+  assert(FT_rmFile("m/g") == SUCCESS);
+  assert(FT_statTree("m", &ulFiles, &ulDirs, &ulBytes) == SUCCESS);
+  assert(ulFiles == 1 && ulDirs == 2 && ulBytes == 2);
+  assert(FT_statTree("m/z", &ulFiles, &ulDirs, &ulBytes) ==
+         NO_SUCH_PATH);
+  assert(ulFiles == 1 && ulDirs == 2 && ulBytes == 2);
+  assert(FT_destroy() == SUCCESS);
+
+  /* An import mirrors a directory on disk as a new directory, in
+     sorted order with files first, skipping symbolic links, or leaves
+     the FT as it was */
+  assert(mkdtemp(acDisk) != NULL);
+  writeDiskFile(acDisk, "a", "Aho");
+  assert(fclose(fopen(strcat(strcpy(arr, acDisk), "/e"), "w")) == 0);
+  assert(mkdir(strcat(strcpy(arr, acDisk), "/sub"), 0700) == 0);
+  assert(mkdir(strcat(strcpy(arr, acDisk), "/sub/deep"), 0700) == 0);
+  writeDiskFile(acDisk, "sub/b", "Weinberger");
+  assert(symlink("a", strcat(strcpy(arr, acDisk), "/link")) == 0);
+  assert(FT_import("i", acDisk, 1, &sImport) ==
+         INITIALIZATION_ERROR);
+  assert(FT_init() == SUCCESS);
+  assert(FT_import("m/i", acDisk, 1, &sImport) == NO_SUCH_PATH);
+  assert(FT_import("i", acDisk, 1, &sImport) == SUCCESS);
+  assert(sImport.ulDirs == 3 && sImport.ulFiles == 3);
+  assert(sImport.ulBytes == 15 && sImport.ulSkipped == 1);
+  assert((temp = FT_toString()) != NULL);
+  assert(!strcmp(temp, "i\ni/a\ni/e\ni/sub\ni/sub/b\n"
+                       "i/sub/deep\n"));
+  free(temp);
+  assert(!strcmp(FT_getFileContents("i/a"), "Aho"));
+  assert(FT_getFileContents("i/e") == NULL);
+  assert(FT_statTree("i", &ulFiles, &ulDirs, &ulBytes) == SUCCESS);
+  assert(ulFiles == 3 && ulDirs == 3 && ulBytes == 15);
+  assert(FT_import("i", acDisk, 1, &sImport) == ALREADY_IN_TREE);
+  assert(FT_import("j", acDisk, 1, &sImport) == CONFLICTING_PATH);
+  assert(FT_import("i/a/x", acDisk, 1, &sImport) == NOT_A_DIRECTORY);
+  assert(FT_import("i//x", acDisk, 1, &sImport) == BAD_PATH);
+  assert(FT_import("i/x", strcat(strcpy(arr, acDisk), "/a"), 1,
+                   &sImport) == IO_ERROR);
+  assert(sImport.ulDirs == 0 && sImport.ulFiles == 0);
+  assert(FT_import("i/x", strcat(strcpy(arr, acDisk), "/none"), 1,
+                   &sImport) == IO_ERROR);
+  assert(FT_containsDir("i/x") == FALSE);
+  /* a copy beneath the first is a directory like any other */
+  assert(FT_import("i/sub/deep/copy", acDisk, 4, &sImport) ==
+         SUCCESS);
+  assert(!strcmp(FT_getFileContents("i/sub/deep/copy/sub/b"),
+                 "Weinberger"));
+  assert(FT_statTree("i", &ulFiles, &ulDirs, &ulBytes) == SUCCESS);
+  assert(ulFiles == 6 && ulDirs == 6 && ulBytes == 30);
+  assert(FT_getStats(&sStats) == SUCCESS);
+  assert(sStats.ulNodes == 12);
+  /* the imported contents are the FT's own */
+  pcLoaded = FT_replaceFileContents("i/a", NULL, 0);
+  assert(pcLoaded != NULL && !strcmp(pcLoaded, "Aho"));
+  free(pcLoaded);
+  assert(FT_destroy() == SUCCESS);
+
+  /* an FT that shares contents shares those it imports */
+  assert(FT_setStorage(FT_STORE_SHARED) == SUCCESS);
+  assert(FT_init() == SUCCESS);
+  assert(FT_insertDir("s") == SUCCESS);
+  assert(FT_import("s/1", acDisk, 1, &sImport) == SUCCESS);
+  assert(FT_import("s/2", acDisk, 1, &sImport) == SUCCESS);
+  assert(FT_getStats(&sStats) == SUCCESS);
+  assert(sStats.ulFileBytes == 30 && sStats.ulContentBytes == 15);
+  assert(!strcmp(FT_getFileContents("s/2/sub/b"), "Weinberger"));
+  assert(FT_destroy() == SUCCESS);
+  assert(FT_setStorage(FT_STORE_CLIENT) == SUCCESS);
+  removeDiskEntry(acDisk, "link");
+  removeDiskEntry(acDisk, "sub/b");
+  removeDiskEntry(acDisk, "sub/deep");
+  removeDiskEntry(acDisk, "sub");
+  removeDiskEntry(acDisk, "e");
+  removeDiskEntry(acDisk, "a");
+  assert(rmdir(acDisk) == 0);
+
+  /* An export writes the FT out in pre-order with files first, into
+     a directory on disk or as a tar archive, whatever way each file
+     keeps its contents, and a pathname too long for a tar header
+     gets a pax header first */
+  strcpy(acDisk, "/tmp/ft_clientXXXXXX");
+  assert(mkdtemp(acDisk) != NULL);
+  assert(FT_exportDir(acDisk) == INITIALIZATION_ERROR);
+  assert(FT_exportTar(0) == INITIALIZATION_ERROR);
+  assert(FT_init() == SUCCESS);
+  assert(FT_insertFile("x/a", "Aho", 4) == SUCCESS);
+  assert(FT_insertFile("x/e", NULL, 0) == SUCCESS);
+  memset(acLong, 'z', 120);
+  acLong[120] = '\0';
+  strcat(strcpy(arr, "x/"), acLong);
+  assert(FT_insertFile(arr, "Weinberger", 11) == SUCCESS);
+  assert(FT_insertDir("x/sub") == SUCCESS);
+  assert(FT_insertFile("x/sub/r", NULL, 0) == SUCCESS);
+  assert(FT_writeFileRange("x/sub/r", 0, "Kernighan", 10) == SUCCESS);
+  assert(FT_writeFileRange("x/sub/r", 5000, "Ritchie", 8) == SUCCESS);
+  assert(FT_exportDir(strcat(strcpy(arr, acDisk), "/none")) ==
+         IO_ERROR);
+  assert(FT_exportDir(acDisk) == SUCCESS);
+  /* exporting again reuses the directories and empties the files */
+  assert(FT_exportDir(acDisk) == SUCCESS);
+  assert(readDiskFile(acDisk, "x/a", acRange, ARRLEN) == 4);
+  assert(!strcmp(acRange, "Aho"));
+  assert(readDiskFile(acDisk, "x/e", acRange, ARRLEN) == 0);
+  assert(readDiskFile(acDisk, strcat(strcpy(arr, "x/"), acLong),
+                      acRange, ARRLEN) == 11);
+  assert(!strcmp(acRange, "Weinberger"));
+  assert((pcTar = malloc(8192)) != NULL);
+  assert(readDiskFile(acDisk, "x/sub/r", pcTar, 8192) == 5008);
+  assert(!strcmp(pcTar, "Kernighan") && pcTar[4999] == '\0');
+  assert(!strcmp(pcTar + 5000, "Ritchie"));
+  removeDiskEntry(acDisk, "x/sub/r");
+  removeDiskEntry(acDisk, "x/sub");
+  removeDiskEntry(acDisk, strcat(strcpy(arr, "x/"), acLong));
+  removeDiskEntry(acDisk, "x/e");
+  removeDiskEntry(acDisk, "x/a");
+  removeDiskEntry(acDisk, "x");
+  assert(rmdir(acDisk) == 0);
+
+  assert((psImage = tmpfile()) != NULL);
+  assert(FT_exportTar(fileno(psImage)) == SUCCESS);
+  l = (size_t) lseek(fileno(psImage), 0, SEEK_END);
+  assert(l == 22 * 512);
+  assert(lseek(fileno(psImage), 0, SEEK_SET) == 0);
+  assert((pcTar = realloc(pcTar, l)) != NULL);
+  assert(fread(pcTar, 1, l, psImage) == l);
+  assert(fclose(psImage) == 0);
+  arr[0] = '\0';
+  listTar(pcTar, l, arr);
+  sprintf(acRange, "5 x/\n0 x/a\n0 x/e\nx ././@PaxHeader\n"
+          "0 %.100s\n5 x/sub/\n0 x/sub/r\n", acLong);
+  assert(!strcmp(arr, acRange));
+  sprintf(acRange, "path=x/%.120s\n", acLong);
+  assert(strstr(pcTar + 5 * 512, acRange) != NULL);
+  assert(!memcmp(pcTar + 512 + 124, "00000000004", 12));
+  assert(!strcmp(pcTar + 7 * 512, "Weinberger"));
+  assert(!strcmp(pcTar + 10 * 512 + 5000, "Ritchie"));
+
+  /* An archive is read back into the FT as it was written, mapped
+     from a regular file or read from a pipe; the contents of a
+     mapped one outlive its file, and are handed back as copies */
+  assert((temp = FT_toString()) != NULL);
+  assert(FT_destroy() == SUCCESS);
+  assert((psImage = tmpfile()) != NULL);
+  assert(fwrite(pcTar, 1, l, psImage) == l);
+  assert(fflush(psImage) == 0);
+  assert(FT_importTar(fileno(psImage), &sImport) ==
+         INITIALIZATION_ERROR);
+  assert(FT_init() == SUCCESS);
+  assert(FT_importTar(fileno(psImage), &sImport) == SUCCESS);
+  assert(sImport.ulDirs == 2 && sImport.ulFiles == 4);
+  assert(sImport.ulBytes == 5023 && sImport.ulSkipped == 0);
+  assert((pcLoaded = FT_toString()) != NULL);
+  assert(!strcmp(pcLoaded, temp));
+  free(pcLoaded);
+  assert(!strcmp(FT_getFileContents("x/a"), "Aho"));
+  assert(FT_getFileContents("x/e") == NULL);
+  /* nothing is added if anything fails */
+  assert(FT_importTar(fileno(psImage), &sImport) == ALREADY_IN_TREE);
+  assert(sImport.ulDirs == 0 && sImport.ulFiles == 0);
+  assert(fclose(psImage) == 0);
+  pcLoaded = FT_replaceFileContents("x/a", NULL, 0);
+  assert(pcLoaded != NULL && !strcmp(pcLoaded, "Aho"));
+  free(pcLoaded);
+  assert(FT_writeFileRange("x/sub/r", 0, "K", 1) == SUCCESS);
+  assert(FT_readFileRange("x/sub/r", 5000, 8, acRange, &l) ==
+         SUCCESS);
+  assert(l == 8 && !strcmp(acRange, "Ritchie"));
+  assert(!strcmp(FT_getFileContents(strcat(strcpy(arr, "x/"), acLong)),
+                 "Weinberger"));
+  assert(FT_statTree("x", &ulFiles, &ulDirs, &ulBytes) == SUCCESS);
+  assert(ulFiles == 4 && ulDirs == 2 && ulBytes == 5019);
+  assert(FT_destroy() == SUCCESS);
+
+  /* a piped archive's contents are read in, or shared */
+  assert(FT_setStorage(FT_STORE_SHARED) == SUCCESS);
+  assert(FT_init() == SUCCESS);
+  assert(FT_insertFile("x/sub/r", "Kernighan", 10) == SUCCESS);
+  assert(importPipe(pcTar, 22 * 512, &sImport) == ALREADY_IN_TREE);
+  assert((pcLoaded = FT_toString()) != NULL);
+  assert(!strcmp(pcLoaded, "x\nx/sub\nx/sub/r\n"));
+  free(pcLoaded);
+  assert(FT_rmFile("x/sub/r") == SUCCESS);
+  assert(importPipe(pcTar, 22 * 512, &sImport) == SUCCESS);
+  assert(sImport.ulDirs == 0 && sImport.ulFiles == 4);
+  assert((pcLoaded = FT_toString()) != NULL);
+  assert(!strcmp(pcLoaded, temp));
+  free(pcLoaded);
+  assert(FT_getStats(&sStats) == SUCCESS);
+  assert(sStats.ulFileBytes == 5023 && sStats.ulContentBytes == 5023);
+  assert(!strcmp(FT_getFileContents("x/a"), "Aho"));
+  assert(FT_destroy() == SUCCESS);
+  assert(FT_setStorage(FT_STORE_CLIENT) == SUCCESS);
+  free(temp);
+
+  /* missing directories are made, a malformed archive adds nothing,
+     and every entry must be beneath the root */
+  assert(FT_init() == SUCCESS);
+  assert(importPipe(pcTar + 9 * 512, 2 * 512, &sImport) ==
+         BAD_FORMAT);
+  assert(importPipe(pcTar + 9 * 512, 13 * 512, &sImport) == SUCCESS);
+  assert(sImport.ulDirs == 2 && sImport.ulFiles == 1);
+  assert(FT_containsFile("x/sub/r") == TRUE);
+  assert(FT_destroy() == SUCCESS);
+  assert(FT_init() == SUCCESS);
+  assert(importPipe(pcTar + 10 * 512, 512, &sImport) == BAD_FORMAT);
+  pcTar[9 * 512 + 1] = 'y';
+  assert(importPipe(pcTar + 9 * 512, 13 * 512, &sImport) ==
+         BAD_FORMAT);
+  assert(FT_insertDir("y") == SUCCESS);
+  assert(importPipe(pcTar, 22 * 512, &sImport) == CONFLICTING_PATH);
+  assert((pcLoaded = FT_toString()) != NULL);
+  assert(!strcmp(pcLoaded, "y\n"));
+  free(pcLoaded);
+  assert(FT_destroy() == SUCCESS);
+
+  /* an entry that claims more than the archive holds is malformed,
+     read as it comes or mapped, and nothing that big is allocated */
+  assert(FT_init() == SUCCESS);
+  retypeTar(pcTar + 512, '0', "77777777777");
+  assert(importPipe(pcTar + 512, 21 * 512, &sImport) == BAD_FORMAT);
+  assert((psImage = tmpfile()) != NULL);
+  assert(fwrite(pcTar + 512, 1, 21 * 512, psImage) == 21 * 512);
+  assert(fflush(psImage) == 0);
+  assert(FT_importTar(fileno(psImage), &sImport) == BAD_FORMAT);
+  assert(fclose(psImage) == 0);
+  retypeTar(pcTar + 512, 'x', "77777777777");
+  assert(importPipe(pcTar + 512, 21 * 512, &sImport) == BAD_FORMAT);
+  retypeTar(pcTar + 512, 'L', "77777777777");
+  assert(importPipe(pcTar + 512, 21 * 512, &sImport) == BAD_FORMAT);
+  assert(FT_containsDir("x") == FALSE);
+  assert(FT_destroy() == SUCCESS);
+
+  /* so is an entry with a "." or ".." component, which an export
+     could follow out of its directory */
+  assert(FT_init() == SUCCESS);
+  assert(FT_insertFile("a/../../escaped", "Thompson", 9) == SUCCESS);
+  assert((psImage = tmpfile()) != NULL);
+  assert(FT_exportTar(fileno(psImage)) == SUCCESS);
+  l = (size_t) lseek(fileno(psImage), 0, SEEK_END);
+  assert(l <= 22 * 512);
+  assert(lseek(fileno(psImage), 0, SEEK_SET) == 0);
+  assert(fread(pcTar, 1, l, psImage) == l);
+  assert(FT_destroy() == SUCCESS);
+  assert(FT_init() == SUCCESS);
+  assert(FT_importTar(fileno(psImage), &sImport) == BAD_FORMAT);
+  assert(fclose(psImage) == 0);
+  assert(importPipe(pcTar, l, &sImport) == BAD_FORMAT);
+  assert(FT_containsDir("a") == FALSE);
+  assert(sImport.ulDirs == 0 && sImport.ulFiles == 0);
+  memcpy(pcTar + 2, "./", 2);
+  retypeTar(pcTar, '5', "00000000000");
+  assert(importPipe(pcTar, 512, &sImport) == BAD_FORMAT);
+  memcpy(pcTar + 2, "\0", 2);
+  retypeTar(pcTar, '5', "00000000000");
+  assert(importPipe(pcTar, 512, &sImport) == SUCCESS);
+  assert(FT_containsDir("a") == TRUE);
+  free(pcTar);
+  assert(FT_destroy() == SUCCESS);
+
+  /* a tree with a name that would lead outside the directory is not
+     exported, and nothing of it is made */
+  strcpy(acDisk, "/tmp/ft_clientXXXXXX");
+  assert(mkdtemp(acDisk) != NULL);
+  assert(FT_init() == SUCCESS);
+  assert(FT_insertDir("a") == SUCCESS);
+  assert(FT_insertFile("a/../../escaped", "Thompson", 9) == SUCCESS);
+  assert(mkdir(strcat(strcpy(arr, acDisk), "/out"), 0777) == 0);
+  assert(FT_exportDir(arr) == IO_ERROR);
+  assert(access(strcat(strcpy(arr, acDisk), "/out/a"), F_OK) != 0);
+  assert(access(strcat(strcpy(arr, acDisk), "/escaped"), F_OK) != 0);
+  assert(FT_rmDir("a/..") == SUCCESS);
+  assert(FT_insertDir("a/.b") == SUCCESS);
+  assert(FT_exportDir(strcat(strcpy(arr, acDisk), "/out")) == SUCCESS);
+  removeDiskEntry(acDisk, "out/a/.b");
+  removeDiskEntry(acDisk, "out/a");
+  removeDiskEntry(acDisk, "out");
+  assert(rmdir(acDisk) == 0);
+  assert(FT_destroy() == SUCCESS);
+
+  /* A file's contents may be a run of another file's bytes, mapped
+     rather than read, which outlives the descriptor and is copied
+     when replaced or changed; an FT that shares contents copies them
+     into its store */
+  assert((psImage = tmpfile()) != NULL);
+  assert(fseek(psImage, 5000, SEEK_SET) == 0);
+  assert(fwrite("Thompson", 1, 9, psImage) == 9);
+  assert(fflush(psImage) == 0);
+  assert(FT_insertFileFromFd("m/t", fileno(psImage), 5000, 9) ==
+         INITIALIZATION_ERROR);
+  assert(FT_init() == SUCCESS);
+  assert(FT_insertFileFromFd("m/t", fileno(psImage), 5000, 9) ==
+         SUCCESS);
+  assert(FT_insertFileFromFd("m/u", fileno(psImage), 4000, 1009) ==
+         SUCCESS);
+  assert(FT_insertFileFromFd("m/t", fileno(psImage), 0, 1) ==
+         ALREADY_IN_TREE);
+  assert(FT_insertFileFromFd("m/t/v", fileno(psImage), 0, 1) ==
+         NOT_A_DIRECTORY);
+  assert(FT_insertFileFromFd("m/v", fileno(psImage), 5000, 10) ==
+         IO_ERROR);
+  assert(FT_insertFileFromFd("m/v", fileno(psImage), 6000, 1) ==
+         IO_ERROR);
+  assert(pipe(aiPipe) == 0);
+  assert(FT_insertFileFromFd("m/v", aiPipe[0], 0, 1) == IO_ERROR);
+  assert(close(aiPipe[0]) == 0 && close(aiPipe[1]) == 0);
+  assert(FT_containsFile("m/v") == FALSE);
+  assert(FT_insertFileFromFd("m/v", -1, 0, 0) == SUCCESS);
+  assert(FT_getFileContents("m/v") == NULL);
+  assert(fclose(psImage) == 0);
+  assert(!strcmp(FT_getFileContents("m/t"), "Thompson"));
+  assert(FT_stat("m/u", &bIsFile, &l) == SUCCESS);
+  assert(bIsFile && l == 1009);
+  temp = FT_getFileContents("m/u");
+  assert(temp[0] == '\0' && !strcmp(temp + 1000, "Thompson"));
+  assert(FT_writeFileRange("m/u", 1000, "K", 1) == SUCCESS);
+  assert(FT_readFileRange("m/u", 999, 10, acRange, &l) == SUCCESS);
+  assert(l == 10 && acRange[0] == '\0' &&
+         !strcmp(acRange + 1, "Khompson"));
+  pcLoaded = FT_replaceFileContents("m/t", NULL, 0);
+  assert(pcLoaded != NULL && !strcmp(pcLoaded, "Thompson"));
+  free(pcLoaded);
+  assert(FT_getFileContents("m/t") == NULL);
+  assert(FT_statTree("m", &ulFiles, &ulDirs, &ulBytes) == SUCCESS);
+  assert(ulFiles == 3 && ulDirs == 1 && ulBytes == 1009);
+  assert(FT_destroy() == SUCCESS);
+  assert(FT_setStorage(FT_STORE_SHARED) == SUCCESS);
+  assert(FT_init() == SUCCESS);
+  assert((psImage = tmpfile()) != NULL);
+  assert(fwrite("Thompson", 1, 9, psImage) == 9);
+  assert(fflush(psImage) == 0);
+  assert(FT_insertFileFromFd("m/t", fileno(psImage), 0, 9) ==
+         SUCCESS);
+  assert(fclose(psImage) == 0);
+  assert(FT_insertFile("m/u", "Thompson", 9) == SUCCESS);
+  assert(FT_getStats(&sStats) == SUCCESS);
+  assert(sStats.ulFileBytes == 18 && sStats.ulContentBytes == 9);
+  assert(FT_getFileContents("m/t") == FT_getFileContents("m/u"));
+  assert(FT_destroy() == SUCCESS);
+  assert(FT_setStorage(FT_STORE_CLIENT) == SUCCESS);
+
+  /* With a memory budget, the contents the FT owns that were read
+     least recently are spilled to a file, each to a place of its own
+     that is only rewritten if they may have changed, and read back
+     when needed; their lengths are known without reading them. A
+     build that never spills refuses a budget */
+  assert(FT_init() == SUCCESS);
+  assert(FT_insertFile("s/a", "AAAAAAAAA", 10) == SUCCESS);
+  assert(FT_insertFile("s/b", "BBBBBBBBB", 10) == SUCCESS);
+  assert(FT_insertFile("s/c", "CCCCCCCCC", 10) == SUCCESS);
+  assert((psImage = tmpfile()) != NULL);
+  assert(FT_save(fileno(psImage)) == SUCCESS);
+  assert(FT_destroy() == SUCCESS);
+  assert((psSpill = tmpfile()) != NULL);
+  iStatus = FT_setMemoryBudget(10, fileno(psSpill));
+  assert(iStatus == SUCCESS || iStatus == INITIALIZATION_ERROR);
+  bSpills = (boolean) (iStatus == SUCCESS);
+  assert(FT_getSpillStats(&sSpill) == INITIALIZATION_ERROR);
+  assert(FT_init() == SUCCESS);
+  assert(FT_setMemoryBudget(0, -1) == INITIALIZATION_ERROR);
+  Alloc_getSiteStats(ALLOC_CONTENTS_LOADED, &sAlloc);
+  ulLive = sAlloc.ulLiveBytes;
+  assert(FT_load(fileno(psImage)) == SUCCESS);
+  assert(fclose(psImage) == 0);
+  assert(FT_getSpillStats(&sSpill) == SUCCESS);
+  assert(!bSpills ||
+         (sSpill.ulSpills == 2 && sSpill.ulBytesWritten == 20 &&
+          sSpill.ulResidentBytes == 10 && sSpill.ulSpilledBytes == 20));
+  Alloc_getSiteStats(ALLOC_CONTENTS_LOADED, &sAlloc);
+  assert(sAlloc.ulLiveBytes - ulLive == (bSpills ? 10 : 30));
+  assert(FT_stat("s/a", &bIsFile, &l) == SUCCESS);
+  assert(bIsFile && l == 10);
+  assert(FT_getStats(&sStats) == SUCCESS);
+  assert(sStats.ulFileBytes == 30);
+  assert(sStats.ulContentBytes == (bSpills ? 10 : 30));
+  assert(FT_readFileRange("s/a", 0, 10, acRange, &l) == SUCCESS);
+  assert(l == 10 && !strcmp(acRange, "AAAAAAAAA"));
+  assert(FT_getSpillStats(&sSpill) == SUCCESS);
+  assert(!bSpills ||
+         (sSpill.ulFaults == 1 && sSpill.ulBytesRead == 10 &&
+          sSpill.ulSpilledBytes == 20));
+  /* an export reads each back in turn, leaving them unchanged */
+  assert((psImage = tmpfile()) != NULL);
+  assert(FT_exportTar(fileno(psImage)) == SUCCESS);
+  assert(lseek(fileno(psImage), 0, SEEK_END) == 9 * 512);
+  assert(fclose(psImage) == 0);
+  assert(FT_getSpillStats(&sSpill) == SUCCESS);
+  assert(!bSpills ||
+         (sSpill.ulSpills == 5 && sSpill.ulBytesWritten == 30 &&
+          sSpill.ulFaults == 4 && sSpill.ulBytesRead == 40));
+  /* contents handed to the client may change, so are written again */
+  assert(!strcmp(FT_getFileContents("s/a"), "AAAAAAAAA"));
+  assert(!strcmp(FT_getFileContents("s/c"), "CCCCCCCCC"));
+  assert(!strcmp(FT_getFileContents("s/c"), "CCCCCCCCC"));
+  assert(FT_getSpillStats(&sSpill) == SUCCESS);
+  assert(!bSpills ||
+         (sSpill.ulSpills == 7 && sSpill.ulBytesWritten == 40 &&
+          sSpill.ulFaults == 6 && sSpill.ulHits == 1 &&
+          sSpill.ulResidentBytes == 10 && sSpill.ulSpilledBytes == 20));
+  assert(lseek(fileno(psSpill), 0, SEEK_END) == (bSpills ? 30 : 0));
+  /* contents replaced stop being counted, while those changed by
+     range are counted in their chunks */
+  pcLoaded = FT_replaceFileContents("s/a", "a", 2);
+  assert(pcLoaded != NULL && !strcmp(pcLoaded, "AAAAAAAAA"));
+  free(pcLoaded);
+  assert(FT_writeFileRange("s/b", 0, "b", 1) == SUCCESS);
+  assert(FT_getSpillStats(&sSpill) == SUCCESS);
+  assert(!bSpills ||
+         (sSpill.ulResidentBytes == 10 && sSpill.ulSpilledBytes == 10));
+  assert(!strcmp(FT_getFileContents("s/b"), "bBBBBBBBB"));
+  assert(FT_rmFile("s/c") == SUCCESS);
+  assert(FT_getSpillStats(&sSpill) == SUCCESS);
+  assert(!bSpills ||
+         (sSpill.ulResidentBytes == 10 && sSpill.ulSpilledBytes == 0));
+  assert(FT_destroy() == SUCCESS);
+  Alloc_getSiteStats(ALLOC_CONTENTS_LOADED, &sAlloc);
+  assert(sAlloc.ulLiveBytes == ulLive);
+  assert(FT_setMemoryBudget(0, -1) == SUCCESS);
+  assert(FT_init() == SUCCESS);
+  assert(FT_getSpillStats(&sSpill) == SUCCESS);
+  assert(sSpill.ulHits == 0 && sSpill.ulSpills == 0);
+  assert(FT_destroy() == SUCCESS);
+
+  /* Contents that files share are counted and spilled once, however
+     many files share them, and chunks are counted by the memory they
+     take up, coming back contiguous */
+  assert(FT_setMemoryBudget(bSpills ? 10 : 0, fileno(psSpill)) ==
+         SUCCESS);
+  assert(FT_setStorage(FT_STORE_SHARED) == SUCCESS);
+  assert(FT_init() == SUCCESS);
+  assert(FT_insertFile("s/a", "AAAAAAAAA", 10) == SUCCESS);
+  assert(FT_insertFile("s/b", "AAAAAAAAA", 10) == SUCCESS);
+  assert(FT_insertFile("s/c", "CCCCCCCCC", 10) == SUCCESS);
+  assert(FT_getSpillStats(&sSpill) == SUCCESS);
+  assert(!bSpills ||
+         (sSpill.ulSpills == 1 && sSpill.ulBytesWritten == 10 &&
+          sSpill.ulResidentBytes == 10 && sSpill.ulSpilledBytes == 10));
+  assert(FT_readFileRange("s/b", 0, 10, acRange, &l) == SUCCESS);
+  assert(l == 10 && !strcmp(acRange, "AAAAAAAAA"));
+  temp = FT_getFileContents("s/b");
+  assert(temp != NULL && !strcmp(temp, "AAAAAAAAA"));
+  assert(FT_getFileContents("s/a") == temp);
+  assert(FT_getSpillStats(&sSpill) == SUCCESS);
+  assert(!bSpills ||
+         (sSpill.ulSpills == 2 && sSpill.ulBytesWritten == 20 &&
+          sSpill.ulFaults == 2 && sSpill.ulBytesRead == 20 &&
+          sSpill.ulResidentBytes == 10 && sSpill.ulSpilledBytes == 10));
+  assert(FT_rmFile("s/a") == SUCCESS);
+  assert(FT_rmFile("s/b") == SUCCESS);
+  assert(FT_getSpillStats(&sSpill) == SUCCESS);
+  assert(!bSpills ||
+         (sSpill.ulResidentBytes == 0 && sSpill.ulSpilledBytes == 10));
+  assert(FT_insertFile("s/d", NULL, 0) == SUCCESS);
+  assert(FT_writeFileRange("s/d", 0, "d", 1) == SUCCESS);
+  assert(FT_getSpillStats(&sSpill) == SUCCESS);
+  assert(!bSpills || sSpill.ulResidentBytes == 4096);
+  assert(!strcmp(FT_getFileContents("s/c"), "CCCCCCCCC"));
+  Alloc_getSiteStats(ALLOC_CONTENTS_CHUNK, &sAlloc);
+  assert(!bSpills || sAlloc.ulLiveBytes == 0);
+  assert(FT_readFileRange("s/d", 0, 1, acRange, &l) == SUCCESS);
+  assert(l == 1 && acRange[0] == 'd');
+  assert(*(char *) FT_getFileContents("s/d") == 'd');
+  assert(FT_getSpillStats(&sSpill) == SUCCESS);
+  assert(!bSpills ||
+         (sSpill.ulSpills == 4 && sSpill.ulBytesWritten == 21 &&
+          sSpill.ulResidentBytes == 1 && sSpill.ulSpilledBytes == 10));
+  assert(FT_destroy() == SUCCESS);
+  assert(FT_setStorage(FT_STORE_CLIENT) == SUCCESS);
+  assert(FT_setMemoryBudget(0, -1) == SUCCESS);
+  assert(fclose(psSpill) == 0);
+
+  /* An FT that shares contents keeps one copy of each, which files
+     with the same bytes share and which outlives the client's buffer;
+     old contents are handed back as the client's own, and loading
+     an image shares its contents too */
+  assert(FT_init() == SUCCESS);
+  assert(FT_setStorage(FT_STORE_SHARED) == INITIALIZATION_ERROR);
+  assert(FT_destroy() == SUCCESS);
+  assert(FT_setStorage(FT_STORE_SHARED) == SUCCESS);
+  assert(FT_init() == SUCCESS);
+  strcpy(arr, "Aho");
+  assert(FT_insertFile("m/a", arr, 4) == SUCCESS);
+  assert(FT_insertFile("m/b", "Aho", 4) == SUCCESS);
+  assert(FT_insertFile("m/c", "Ullman", 7) == SUCCESS);
+  assert(FT_insertFile("m/d", NULL, 3) == SUCCESS);
+  assert(FT_insertFile("m/c", "Aho", 4) == ALREADY_IN_TREE);
+  arr[0] = '\0';
+  assert((pcLoaded = FT_getFileContents("m/a")) != NULL);
+  assert(pcLoaded != arr && !strcmp(pcLoaded, "Aho"));
+  assert(FT_getFileContents("m/b") == pcLoaded);
+  assert(FT_getFileContents("m/d") == NULL);
+  assert(FT_stat("m/d", &bIsFile, &l) == SUCCESS && l == 0);
+  assert(FT_getStats(&sStats) == SUCCESS);
+  assert(sStats.ulFileBytes == 15 && sStats.ulContentBytes == 11);
+  Alloc_getSiteStats(ALLOC_CONTENTS_SHARED, &sAlloc);
+  assert(sAlloc.ulLiveBytes == 11);
+
+  pcLoaded = FT_replaceFileContents("m/a", "Ullman", 7);
+  assert(pcLoaded != NULL && !strcmp(pcLoaded, "Aho"));
+  assert(pcLoaded != FT_getFileContents("m/b"));
+  free(pcLoaded);
+  assert(FT_getFileContents("m/a") == FT_getFileContents("m/c"));
+  pcLoaded = FT_replaceFileContents("m/b", NULL, 0);
+  assert(pcLoaded != NULL && !strcmp(pcLoaded, "Aho"));
+  free(pcLoaded);
+  assert(FT_getStats(&sStats) == SUCCESS);
+  assert(sStats.ulFileBytes == 14 && sStats.ulContentBytes == 7);
+
+  assert((psImage = tmpfile()) != NULL);
+  assert(FT_save(fileno(psImage)) == SUCCESS);
+  assert(FT_load(fileno(psImage)) == SUCCESS);
+  assert(fclose(psImage) == 0);
+  assert(FT_getFileContents("m/a") == FT_getFileContents("m/c"));
+  assert(!strcmp(FT_getFileContents("m/c"), "Ullman"));
+  assert(FT_getStats(&sStats) == SUCCESS);
+  assert(sStats.ulFileBytes == 14 && sStats.ulContentBytes == 7);
+  assert(FT_rmFile("m/a") == SUCCESS);
+  assert(!strcmp(FT_getFileContents("m/c"), "Ullman"));
+  assert(FT_destroy() == SUCCESS);
+  Alloc_getModuleStats(ALLOC_CONTENTS, &sAlloc);
+  assert(sAlloc.ulLiveBytes == 0);
+
+  /* Contents no longer than the inline threshold are kept in their
+     file's node rather than shared, and move between the node and
+     the store as replacing them changes their length */
+  assert(FT_setInlineThreshold(4) == SUCCESS);
+  assert(FT_init() == SUCCESS);
+  assert(FT_setInlineThreshold(8) == INITIALIZATION_ERROR);
+  assert(FT_insertFile("m/a", "Aho", 4) == SUCCESS);
+  assert(FT_insertFile("m/b", "Aho", 4) == SUCCESS);
+  assert(FT_insertFile("m/c", "Ullman", 7) == SUCCESS);
+  assert((pcLoaded = FT_getFileContents("m/a")) != NULL);
+  assert(!strcmp(pcLoaded, "Aho"));
+  assert(FT_getFileContents("m/b") != pcLoaded);
+  assert(FT_stat("m/a", &bIsFile, &l) == SUCCESS && bIsFile && l == 4);
+  Alloc_getSiteStats(ALLOC_CONTENTS_SHARED, &sAlloc);
+  assert(sAlloc.ulLiveBytes == 7);
+  assert(FT_getStats(&sStats) == SUCCESS);
+  assert(sStats.ulFileBytes == 15 && sStats.ulContentBytes == 7);
+
+  pcLoaded = FT_replaceFileContents("m/a", "Ullman", 7);
+  assert(pcLoaded != NULL && !strcmp(pcLoaded, "Aho"));
+  free(pcLoaded);
+  assert(FT_getFileContents("m/a") == FT_getFileContents("m/c"));
+  pcLoaded = FT_replaceFileContents("m/c", "Kay", 4);
+  assert(pcLoaded != NULL && !strcmp(pcLoaded, "Ullman"));
+  free(pcLoaded);
+  pcLoaded = FT_replaceFileContents("m/c", FT_getFileContents("m/c"),
+                                    4);
+  assert(pcLoaded != NULL && !strcmp(pcLoaded, "Kay"));
+  free(pcLoaded);
+  assert(!strcmp(FT_getFileContents("m/c"), "Kay"));
+  assert(FT_stat("m/c", &bIsFile, &l) == SUCCESS && l == 4);
+  Alloc_getSiteStats(ALLOC_CONTENTS_SHARED, &sAlloc);
+  assert(sAlloc.ulLiveBytes == 7);
+
+  assert((psImage = tmpfile()) != NULL);
+  assert(FT_save(fileno(psImage)) == SUCCESS);
+  assert(FT_load(fileno(psImage)) == SUCCESS);
+  assert(fclose(psImage) == 0);
+  assert(!strcmp(FT_getFileContents("m/a"), "Ullman"));
+  assert(!strcmp(FT_getFileContents("m/b"), "Aho"));
+  assert(!strcmp(FT_getFileContents("m/c"), "Kay"));
+  assert(FT_getStats(&sStats) == SUCCESS);
+  assert(sStats.ulFileBytes == 15 && sStats.ulContentBytes == 7);
+  /* changing a range of shared contents leaves the others sharing */
+  assert(FT_insertFile("m/e", "Ullman", 7) == SUCCESS);
+  assert(FT_getFileContents("m/e") == FT_getFileContents("m/a"));
+  assert(FT_writeFileRange("m/e", 0, "u", 1) == SUCCESS);
+  assert(!strcmp(FT_getFileContents("m/a"), "Ullman"));
+  assert(!strcmp(FT_getFileContents("m/e"), "ullman"));
+  assert(FT_getStats(&sStats) == SUCCESS);
+  assert(sStats.ulFileBytes == 22 && sStats.ulContentBytes == 14);
+  pcLoaded = FT_replaceFileContents("m/e", "Kay", 4);
+  assert(pcLoaded != NULL && !strcmp(pcLoaded, "ullman"));
+  free(pcLoaded);
+  assert(FT_destroy() == SUCCESS);
+  Alloc_getModuleStats(ALLOC_CONTENTS, &sAlloc);
+  assert(sAlloc.ulLiveBytes == 0);
+  assert(FT_setInlineThreshold(0) == SUCCESS);
+  assert(FT_setStorage(FT_STORE_CLIENT) == SUCCESS);
+
+  /* Ranges of a file are read and changed in place: the first change
+     copies the client's contents, which stay as they were, and the
+     chunks are only joined when the whole contents are asked for.
+     Writes past the end leave zeros, and the journal carries just
+     the bytes each change wrote */
+  assert(FT_init() == SUCCESS);
+  strcpy(arr, "Kernighan");
+  assert(FT_insertFile("m/r", arr, 9) == SUCCESS);
+  assert(FT_insertFile("m/big", NULL, 0) == SUCCESS);
+  assert(FT_readFileRange("m/r", 3, 4, acRange, &l) == SUCCESS);
+  assert(l == 4 && !strncmp(acRange, "nigh", 4));
+  assert(FT_readFileRange("m/r", 7, 10, acRange, &l) == SUCCESS);
+  assert(l == 2 && !strncmp(acRange, "an", 2));
+  assert(FT_readFileRange("m/r", 12, 1, acRange, &l) == SUCCESS);
+  assert(l == 0);
+  assert(FT_readFileRange("m", 0, 1, acRange, &l) == NOT_A_FILE);
+  assert(FT_writeFileRange("m", 0, "x", 1) == NOT_A_FILE);
+  assert(FT_appendFile("m/nope", "x", 1) == NO_SUCH_PATH);
+  assert(FT_truncateFile("m/r/x", 0) == NO_SUCH_PATH);
+  assert((psImage = tmpfile()) != NULL);
+  assert((psJournal = tmpfile()) != NULL);
+  assert(FT_save(fileno(psImage)) == SUCCESS);
+  assert(FT_journalStart(fileno(psJournal), 0) == SUCCESS);
+
+  assert(FT_writeFileRange("m/r", 0, "k", 1) == SUCCESS);
+  assert(!strcmp(arr, "Kernighan"));
+  assert(FT_appendFile("m/r", " & Ritchie", 11) == SUCCESS);
+  assert(FT_stat("m/r", &bIsFile, &l) == SUCCESS && l == 20);
+  for(l = 0; l < 1000; l++)
+    assert(FT_appendFile("m/big", "abcde", 5) == SUCCESS);
+  assert(FT_writeFileRange("m/big", 4094, "XYZW", 4) == SUCCESS);
+  assert(FT_readFileRange("m/big", 4093, 6, acRange, &l) == SUCCESS);
+  assert(l == 6 && !strncmp(acRange, "dXYZWd", 6));
+  assert(FT_truncateFile("m/big", 4096) == SUCCESS);
+  assert(FT_writeFileRange("m/big", 4100, "!", 1) == SUCCESS);
+  assert(FT_readFileRange("m/big", 4094, 8, acRange, &l) == SUCCESS);
+  assert(l == 7 && !memcmp(acRange, "XY\0\0\0\0!", 7));
+  assert(FT_stat("m/big", &bIsFile, &l) == SUCCESS && l == 4101);
+  assert(FT_truncateFile("m/big", 2) == SUCCESS);
+  assert(FT_journalStop() == SUCCESS);
+
+  assert(!strcmp(FT_getFileContents("m/r"), "kernighan & Ritchie"));
+  assert(!strncmp(FT_getFileContents("m/big"), "ab", 2));
+  assert(FT_stat("m/big", &bIsFile, &l) == SUCCESS && l == 2);
+  assert(FT_appendFile("m/big", "c", 1) == SUCCESS);
+  pcLoaded = FT_replaceFileContents("m/big", NULL, 0);
+  assert(pcLoaded != NULL && !strncmp(pcLoaded, "abc", 3));
+  free(pcLoaded);
+  assert(FT_destroy() == SUCCESS);
+
+  assert(FT_init() == SUCCESS);
+  assert(lseek(fileno(psJournal), 0, SEEK_SET) == 0);
+  assert(FT_recover(fileno(psImage), fileno(psJournal)) == SUCCESS);
+  assert(fclose(psJournal) == 0);
+  assert(fclose(psImage) == 0);
+  assert(!strcmp(FT_getFileContents("m/r"), "kernighan & Ritchie"));
+  assert(FT_stat("m/big", &bIsFile, &l) == SUCCESS && l == 2);
+  /* each string is counted once, then left to the client to free */
+  Alloc_getSiteStats(ALLOC_TREE_STRING, &sAlloc);
+  l = sAlloc.ulAllocs;
+  assert((temp = FT_toString()) != NULL);
+  free(temp);
+  Alloc_getSiteStats(ALLOC_TREE_STRING, &sAlloc);
+  assert(sAlloc.ulAllocs == l + 1);
+  assert(sAlloc.ulLiveBytes == 0);
+  assert(FT_destroy() == SUCCESS);
+
+  /* Once the FT is destroyed, nothing it allocated is left */
+  Alloc_getModuleStats(ALLOC_CONTENTS, &sAlloc);
+  assert(sAlloc.ulAllocs > 0 && sAlloc.ulLiveBytes == 0);
+  Alloc_getModuleStats(ALLOC_NODE, &sAlloc);
+  assert(sAlloc.ulAllocs > 0 && sAlloc.ulLiveBytes == 0);
+  Alloc_getModuleStats(ALLOC_PATH, &sAlloc);
+  assert(sAlloc.ulPeakBytes > 0 && sAlloc.ulLiveBytes == 0);
+
+  /* Metrics builds have timed every operation so far, apart for each
+     status; other builds write nothing */
+  assert((psImage = tmpfile()) != NULL);
+  FT_dumpMetrics(psImage);
+#ifdef FT_METRICS
+  assert(ftell(psImage) > 0);
+  rewind(psImage);
+  ulLines = 0;
+  while(fgets(acLine, sizeof(acLine), psImage) != NULL)
+    if(!strncmp(acLine, "FT_insertFile SUCCESS: ", 23) ||
+       !strncmp(acLine, "FT_insertDir NOT_A_DIRECTORY: ", 30) ||
+       !strncmp(acLine, "FT_rmFile NOT_A_FILE: ", 22))
+      ulLines++;
+  assert(ulLines == 3);
+
+  /* Calls longer than every bound are counted apart from those in
+     the last bucket that has one, and written as past that bound */
+  memset(aulCounts, 0, sizeof(aulCounts));
+  aulCounts[LATENCY_OVERFLOW - 1] = 1;
+  aulCounts[LATENCY_OVERFLOW] = 2;
+  rewind(psImage);
+  Latency_write(psImage, "op", SUCCESS, aulCounts);
+  rewind(psImage);
+  assert(fgets(acLine, sizeof(acLine), psImage) != NULL);
+  assert(!strncmp(acLine, "op SUCCESS: 3 calls, p50 > ", 27));
+  assert(strstr(acLine, ", max > ") != NULL);
+  assert(fgets(acLine, sizeof(acLine), psImage) != NULL);
+  assert(!strncmp(acLine, "   <= ", 6));
+  assert((pcBound = strstr(acLine, " ns: 1\n")) != NULL);
+  *pcBound = '\0';
+  assert((pcBound = malloc(strlen(acLine + 6) + 1)) != NULL);
+  strcpy(pcBound, acLine + 6);
+  assert(fgets(acLine, sizeof(acLine), psImage) != NULL);
+  assert(!strncmp(acLine, "   > ", 5));
+  assert(!strncmp(acLine + 5, pcBound, strlen(pcBound)));
+  assert(!strcmp(acLine + 5 + strlen(pcBound), " ns: 2\n"));
+  free(pcBound);
+#else
+  assert(ftell(psImage) == 0);
+#endif
+  assert(fclose(psImage) == 0);
 
   return 0;
 }
@@ -0,0 +1,286 @@
+/*--------------------------------------------------------------------*/
+/* ft_mtclient.c                                                      */
+/* Author: Christopher Moretti                                        */
+/*--------------------------------------------------------------------*/
+
+/* fileno, lseek and mkdtemp are POSIX.1 interfaces */
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "ft.h"
+
+/* The number of writer threads, each owning one top-level directory */
+enum {NUM_THREADS = 8};
+/* The number of directories each thread inserts per round */
+enum {NUM_DIRS = 200};
+/* The number of insert-then-remove rounds each thread performs */
+enum {NUM_ROUNDS = 5};
+/* The numbers of subdirectories of each top-level directory, and of
+   files in each subdirectory, of the directory on disk imported */
+enum {NUM_SUBDIRS = 10, NUM_FILES = 5};
+
+/* Inserts, removes and moves files and directories underneath
+   root/tN, where N is the thread number pointed to by pvArg, checking
+   every status. Other threads work in sibling subtrees at the same
+   time. Returns NULL. */
+static void *writeSubtree(void *pvArg) {
+  enum {BUFLEN = 64};
+  char acPath[BUFLEN];
+  char acMoved[BUFLEN];
+  int iThread = *(int *) pvArg;
+  int iRound, iDir;
+
+  for(iRound = 0; iRound < NUM_ROUNDS; iRound++) {
+    for(iDir = 0; iDir < NUM_DIRS; iDir++) {
+      sprintf(acPath, "root/t%d/d%d/leaf", iThread, iDir);
+      assert(FT_insertFile(acPath, pvArg, sizeof(int)) == SUCCESS);
+      assert(FT_insertDir(acPath) == ALREADY_IN_TREE);
+      assert(FT_containsFile(acPath) == TRUE);
+      assert(FT_getFileContents(acPath) == pvArg);
+    }
+    for(iDir = 0; iDir < NUM_DIRS; iDir += 2) {
+      sprintf(acPath, "root/t%d/d%d", iThread, iDir);
+      assert(FT_rmDir(acPath) == SUCCESS);
+      assert(FT_containsDir(acPath) == FALSE);
+    }
+    /* a move there and back leaves the other threads' paths stale
+       for them to check under their own locks */
+    sprintf(acPath, "root/t%d/d1", iThread);
+    sprintf(acMoved, "root/t%d/moved", iThread);
+    assert(FT_mv(acPath, acMoved) == SUCCESS);
+    assert(FT_mv(acPath, acMoved) == NO_SUCH_PATH);
+    assert(FT_mv(acMoved, acPath) == SUCCESS);
+    if(iRound + 1 < NUM_ROUNDS) {
+      sprintf(acPath, "root/t%d", iThread);
+      assert(FT_rmDir(acPath) == SUCCESS);
+    }
+  }
+  return NULL;
+}
+
+/* Inserts and replaces files with the same contents underneath
+   root/sN, where N is the thread number pointed to by pvArg, in an FT
+   that shares contents, while the other threads do the same. Returns
+   NULL. */
+static void *shareContents(void *pvArg) {
+  enum {BUFLEN = 64};
+  char acPath[BUFLEN];
+  int iThread = *(int *) pvArg;
+  int iDir;
+  char *pcOld;
+
+  for(iDir = 0; iDir < NUM_DIRS; iDir++) {
+    sprintf(acPath, "root/s%d/f%d", iThread, iDir);
+    assert(FT_insertFile(acPath, "shared", 7) == SUCCESS);
+    assert(!strcmp(FT_getFileContents(acPath), "shared"));
+    if(iDir % 2 == 0) {
+      pcOld = FT_replaceFileContents(acPath, "Shared", 7);
+      assert(pcOld != NULL && !strcmp(pcOld, "shared"));
+      free(pcOld);
+    }
+  }
+  return NULL;
+}
+
+/* Appends NUM_DIRS records to root/aN, where N is the thread number
+   pointed to by pvArg, reading each back by range, while the other
+   threads append to their own files. Returns NULL. */
+static void *appendRecords(void *pvArg) {
+  enum {BUFLEN = 64};
+  char acPath[BUFLEN];
+  int iThread = *(int *) pvArg;
+  int iDir;
+  int iRead;
+  size_t ulRead;
+
+  sprintf(acPath, "root/a%d", iThread);
+  assert(FT_insertFile(acPath, NULL, 0) == SUCCESS);
+  for(iDir = 0; iDir < NUM_DIRS; iDir++) {
+    assert(FT_appendFile(acPath, &iDir, sizeof(int)) == SUCCESS);
+    assert(FT_readFileRange(acPath, iDir * sizeof(int), sizeof(int),
+                            &iRead, &ulRead) == SUCCESS);
+    assert(ulRead == sizeof(int) && iRead == iDir);
+  }
+  return NULL;
+}
+
+/* Builds (if bBuild) or removes (otherwise) beneath directory pcDisk
+   on disk NUM_THREADS directories of NUM_SUBDIRS subdirectories of
+   NUM_FILES files, each holding its own pathname. */
+static void buildDiskTree(const char *pcDisk, int bBuild) {
+  enum {BUFLEN = 256};
+  char acPath[BUFLEN];
+  FILE *psFile;
+  int iDir, iSubdir, iFile;
+
+  for(iDir = 0; iDir < NUM_THREADS; iDir++) {
+    sprintf(acPath, "%s/d%d", pcDisk, iDir);
+    if(bBuild)
+      assert(mkdir(acPath, 0700) == 0);
+    for(iSubdir = 0; iSubdir < NUM_SUBDIRS; iSubdir++) {
+      sprintf(acPath, "%s/d%d/s%d", pcDisk, iDir, iSubdir);
+      if(bBuild)
+        assert(mkdir(acPath, 0700) == 0);
+      for(iFile = 0; iFile < NUM_FILES; iFile++) {
+        sprintf(acPath, "%s/d%d/s%d/f%d", pcDisk, iDir, iSubdir,
+                iFile);
+        if(!bBuild) {
+          assert(remove(acPath) == 0);
+          continue;
+        }
+        assert((psFile = fopen(acPath, "w")) != NULL);
+        assert(fputs(acPath, psFile) >= 0);
+        assert(fclose(psFile) == 0);
+      }
+      sprintf(acPath, "%s/d%d/s%d", pcDisk, iDir, iSubdir);
+      if(!bBuild)
+        assert(remove(acPath) == 0);
+    }
+    sprintf(acPath, "%s/d%d", pcDisk, iDir);
+    if(!bBuild)
+      assert(remove(acPath) == 0);
+  }
+}
+
+/* Runs NUM_THREADS writers against disjoint subtrees of one FT while
+   journaling the changes, then checks that exactly the expected
+   directories survived and that replaying the journal rebuilds them.
+   Then has them share contents in a second FT, append to files in a
+   third, and import a directory from disk into a fourth. Returns 0.
+*/
+int main(void) {
+  pthread_t aThreads[NUM_THREADS];
+  int aiIds[NUM_THREADS];
+  char *temp;
+  char *pcLine;
+  size_t ulLines = 0;
+  FILE *psImage;
+  FILE *psJournal;
+  size_t ulRecords, ulBatches, ulSyncs;
+  size_t ulFiles, ulDirs, ulBytes;
+  struct FT_Stats sStats;
+  char acDisk[] = "/tmp/ft_mtclientXXXXXX";
+  struct FT_ImportStats sImport;
+  int i;
+
+  assert(FT_init() == SUCCESS);
+  assert(FT_insertDir("root") == SUCCESS);
+  assert((psImage = tmpfile()) != NULL);
+  assert((psJournal = tmpfile()) != NULL);
+  assert(FT_save(fileno(psImage)) == SUCCESS);
+  assert(FT_journalStart(fileno(psJournal), 64) == SUCCESS);
+
+  for(i = 0; i < NUM_THREADS; i++) {
+    aiIds[i] = i;
+    assert(pthread_create(&aThreads[i], NULL, writeSubtree,
+                          &aiIds[i]) == 0);
+  }
+  for(i = 0; i < NUM_THREADS; i++)
+    assert(pthread_join(aThreads[i], NULL) == 0);
+
+  /* root, plus per thread: tN and half of the dN/leaf pairs */
+  assert((temp = FT_toString()) != NULL);
+  for(pcLine = temp; *pcLine != '\0'; pcLine++)
+    if(*pcLine == '\n')
+      ulLines++;
+  assert(ulLines == 1 + NUM_THREADS * (1 + NUM_DIRS));
+  free(temp);
+
+  assert(FT_containsFile("root/t0/d1/leaf") == TRUE);
+
+  /* the totals met at root from every thread add up */
+  assert(FT_statTree("root", &ulFiles, &ulDirs, &ulBytes) == SUCCESS);
+  assert(ulFiles == NUM_THREADS * NUM_DIRS / 2);
+  assert(ulDirs == 1 + NUM_THREADS * (1 + NUM_DIRS / 2));
+  assert(ulBytes == ulFiles * sizeof(int));
+  assert(FT_containsDir("root/t0/d0") == FALSE);
+
+  /* every change was journaled, in an order that replays to the same
+     hierarchy */
+  FT_getJournalStats(&ulRecords, &ulBatches, &ulSyncs);
+  assert(ulRecords == NUM_THREADS *
+         (NUM_ROUNDS * (NUM_DIRS + NUM_DIRS / 2 + 2) + NUM_ROUNDS - 1));
+  assert(ulSyncs == ulRecords / 64);
+  /* group commit wrote them in far fewer batches than records */
+  assert(ulBatches > 0 && ulBatches <= ulRecords / 64 + 1);
+  assert(FT_journalStop() == SUCCESS);
+  assert((temp = FT_toString()) != NULL);
+  assert(FT_destroy() == SUCCESS);
+  assert(FT_init() == SUCCESS);
+  assert(lseek(fileno(psJournal), 0, SEEK_SET) == 0);
+  assert(FT_recover(fileno(psImage), fileno(psJournal)) == SUCCESS);
+  assert((pcLine = FT_toString()) != NULL);
+  assert(strcmp(temp, pcLine) == 0);
+  free(pcLine);
+  free(temp);
+  assert(fclose(psJournal) == 0);
+  assert(fclose(psImage) == 0);
+  assert(FT_destroy() == SUCCESS);
+
+  /* files that threads give the same contents at once share them */
+  assert(FT_setStorage(FT_STORE_SHARED) == SUCCESS);
+  assert(FT_init() == SUCCESS);
+  assert(FT_insertDir("root") == SUCCESS);
+  for(i = 0; i < NUM_THREADS; i++)
+    assert(pthread_create(&aThreads[i], NULL, shareContents,
+                          &aiIds[i]) == 0);
+  for(i = 0; i < NUM_THREADS; i++)
+    assert(pthread_join(aThreads[i], NULL) == 0);
+  assert(FT_getStats(&sStats) == SUCCESS);
+  assert(sStats.ulFiles == NUM_THREADS * NUM_DIRS);
+  assert(sStats.ulFileBytes == NUM_THREADS * NUM_DIRS * 7);
+  assert(sStats.ulContentBytes == 14);
+  assert(FT_destroy() == SUCCESS);
+
+  /* appends to separate files by range leave each file whole */
+  assert(FT_setStorage(FT_STORE_CLIENT) == SUCCESS);
+  assert(FT_init() == SUCCESS);
+  assert(FT_insertDir("root") == SUCCESS);
+  for(i = 0; i < NUM_THREADS; i++)
+    assert(pthread_create(&aThreads[i], NULL, appendRecords,
+                          &aiIds[i]) == 0);
+  for(i = 0; i < NUM_THREADS; i++)
+    assert(pthread_join(aThreads[i], NULL) == 0);
+  assert(FT_getStats(&sStats) == SUCCESS);
+  assert(sStats.ulFiles == NUM_THREADS);
+  assert(sStats.ulFileBytes == NUM_THREADS * NUM_DIRS * sizeof(int));
+  assert(FT_statTree("root", &ulFiles, &ulDirs, &ulBytes) == SUCCESS);
+  assert(ulBytes == sStats.ulFileBytes);
+  assert(FT_destroy() == SUCCESS);
+
+  /* threads stealing each other's directories import what one thread
+     alone does */
+  assert(mkdtemp(acDisk) != NULL);
+  buildDiskTree(acDisk, 1);
+  assert(FT_init() == SUCCESS);
+  assert(FT_import("root", acDisk, NUM_THREADS, &sImport) == SUCCESS);
+  assert(sImport.ulDirs == 1 + NUM_THREADS * (1 + NUM_SUBDIRS));
+  assert(sImport.ulFiles == NUM_THREADS * NUM_SUBDIRS * NUM_FILES);
+  assert(FT_statTree("root", &ulFiles, &ulDirs, &ulBytes) == SUCCESS);
+  assert(ulFiles == sImport.ulFiles && ulDirs == sImport.ulDirs);
+  assert(ulBytes == sImport.ulBytes);
+  assert((temp = FT_toString()) != NULL);
+  assert(FT_destroy() == SUCCESS);
+  assert(FT_init() == SUCCESS);
+  assert(FT_import("root", acDisk, 1, &sImport) == SUCCESS);
+  assert((pcLine = FT_toString()) != NULL);
+  assert(strcmp(temp, pcLine) == 0);
+  free(pcLine);
+  free(temp);
+  assert(FT_destroy() == SUCCESS);
+  buildDiskTree(acDisk, 0);
+  assert(remove(acDisk) == 0);
+  fprintf(stderr, "imported %lu files in %lu microseconds\n",
+          (unsigned long) sImport.ulFiles,
+          (unsigned long) sImport.ulMicros);
+
+  fprintf(stderr, "%d threads finished consistently\n", NUM_THREADS);
+  return 0;
+}
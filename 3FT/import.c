@@ -0,0 +1,612 @@
+/*--------------------------------------------------------------------*/
+/* import.c                                                           */
+/* Author: Christopher Moretti                                        */
+/*--------------------------------------------------------------------*/
+
+/* pread, lstat and the directory functions are POSIX.1-2008
+   interfaces */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stddef.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef FT_CONCURRENT
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "dynarray.h"
+#include "path.h"
+#include "blob.h"
+#include "alloc.h"
+#include "import.h"
+
+/* The most workers that FT_import runs at once */
+enum {MAX_IMPORT_WORKERS = 64};
+
+/* A directory on disk waiting to be mirrored beneath its new node */
+struct Import_Dir {
+   /* the node mirroring the directory */
+   Node_T oNDir;
+   /* the directory's pathname on disk, and the size of its block */
+   char *pcDiskPath;
+   size_t ulDiskBytes;
+};
+
+struct Import_Run;
+
+/* One of the workers of an FT_import, and its counts */
+struct Import_Worker {
+   /* the import that the worker is part of */
+   struct Import_Run *psImport;
+   /* the Import_Dirs waiting to be read, the newest last */
+   DynArray_T oDStack;
+   /* the numbers of directories and files mirrored, of bytes of
+      contents read, of entries skipped, and of nodes built */
+   size_t ulDirs;
+   size_t ulFiles;
+   size_t ulBytes;
+   size_t ulSkipped;
+   size_t ulNodes;
+#ifdef FT_CONCURRENT
+   /* the lock guarding oDStack, which other workers steal from */
+   pthread_mutex_t sLock;
+   /* the worker's thread, and whether it was started */
+   pthread_t sThread;
+   boolean bStarted;
+#endif
+};
+
+/* An FT_import in progress */
+struct Import_Run {
+   /* the workers, psWorkers[0] being the caller itself */
+   struct Import_Worker *psWorkers;
+   size_t ulWorkers;
+   /* how the files made keep their contents */
+   const struct Import_Storage *psStorage;
+   /* the number of directories pushed but not yet fully read */
+   size_t ulPending;
+   /* SUCCESS, or the status of the first failure, after which the
+      waiting directories are only popped */
+   int iStatus;
+};
+
+#ifdef FT_CONCURRENT
+#define Import_lock(psWorker) \
+   ((void) pthread_mutex_lock(&(psWorker)->sLock))
+#define Import_unlock(psWorker) \
+   ((void) pthread_mutex_unlock(&(psWorker)->sLock))
+#define Import_add(pulCount, n) \
+   ((void) __atomic_add_fetch((pulCount), (n), __ATOMIC_RELAXED))
+#define Import_sub(pulCount, n) \
+   ((void) __atomic_sub_fetch((pulCount), (n), __ATOMIC_ACQ_REL))
+#define Import_load(piValue) \
+   __atomic_load_n((piValue), __ATOMIC_ACQUIRE)
+#define Import_yield() ((void) sched_yield())
+#else
+#define Import_lock(psWorker) ((void) 0)
+#define Import_unlock(psWorker) ((void) 0)
+#define Import_add(pulCount, n) ((void) (*(pulCount) += (n)))
+#define Import_sub(pulCount, n) ((void) (*(pulCount) -= (n)))
+#define Import_load(piValue) (*(piValue))
+#define Import_yield() ((void) 0)
+#endif
+
+/* Records iStatus as the import's failure, unless one came first. */
+static void Import_fail(struct Import_Run *psImport, int iStatus) {
+   assert(psImport != NULL);
+   assert(iStatus != SUCCESS);
+
+#ifdef FT_CONCURRENT
+   {
+      int iExpected = SUCCESS;
+      (void) __atomic_compare_exchange_n(&psImport->iStatus,
+                                         &iExpected, iStatus, 0,
+                                         __ATOMIC_RELAXED,
+                                         __ATOMIC_RELAXED);
+   }
+#else
+   if(psImport->iStatus == SUCCESS)
+      psImport->iStatus = iStatus;
+#endif
+}
+
+/*
+  Sets *ppcResult to a new block holding pcDir, a slash and the
+  ulLength bytes at pcName, and *pulBytes to the block's size.
+  Returns SUCCESS, or MEMORY_ERROR if memory could not be allocated.
+*/
+static int Import_join(const char *pcDir, const char *pcName,
+                       size_t ulLength, char **ppcResult,
+                       size_t *pulBytes) {
+   size_t ulDirLength;
+   char *pcResult;
+
+   assert(pcDir != NULL);
+   assert(pcName != NULL);
+   assert(ppcResult != NULL);
+   assert(pulBytes != NULL);
+
+   ulDirLength = strlen(pcDir);
+   *pulBytes = ulDirLength + 1 + ulLength + 1;
+   pcResult = Alloc_malloc(ALLOC_TREE_IMPORT, *pulBytes);
+   if(pcResult == NULL)
+      return MEMORY_ERROR;
+   memcpy(pcResult, pcDir, ulDirLength);
+   pcResult[ulDirLength] = '/';
+   memcpy(pcResult + ulDirLength + 1, pcName, ulLength);
+   pcResult[ulDirLength + 1 + ulLength] = '\0';
+   *ppcResult = pcResult;
+   return SUCCESS;
+}
+
+/*
+  Pushes directory pcDiskPath, a block of ulDiskBytes from
+  Import_join, onto psWorker's stack, to be mirrored beneath oNDir;
+  the block is freed with the directory once it has been read, or
+  now if SUCCESS is not returned. Returns SUCCESS, or MEMORY_ERROR if
+  memory could not be allocated.
+*/
+static int Import_push(struct Import_Worker *psWorker,
+                       Node_T oNDir, char *pcDiskPath,
+                       size_t ulDiskBytes) {
+   struct Import_Dir *psDir;
+   int iStatus = SUCCESS;
+
+   assert(psWorker != NULL);
+   assert(oNDir != NULL);
+   assert(pcDiskPath != NULL);
+
+   psDir = Alloc_malloc(ALLOC_TREE_IMPORT,
+                        sizeof(struct Import_Dir));
+   if(psDir == NULL) {
+      Alloc_free(ALLOC_TREE_IMPORT, pcDiskPath, ulDiskBytes);
+      return MEMORY_ERROR;
+   }
+   psDir->oNDir = oNDir;
+   psDir->pcDiskPath = pcDiskPath;
+   psDir->ulDiskBytes = ulDiskBytes;
+
+   /* counted as pending before it can be stolen and finished */
+   Import_add(&psWorker->psImport->ulPending, 1);
+   Import_lock(psWorker);
+   if(!DynArray_add(psWorker->oDStack, psDir))
+      iStatus = MEMORY_ERROR;
+   Import_unlock(psWorker);
+   if(iStatus != SUCCESS) {
+      Import_sub(&psWorker->psImport->ulPending, 1);
+      Alloc_free(ALLOC_TREE_IMPORT, pcDiskPath, ulDiskBytes);
+      Alloc_free(ALLOC_TREE_IMPORT, psDir,
+                 sizeof(struct Import_Dir));
+   }
+   return iStatus;
+}
+
+/*
+  Returns the newest directory waiting on psWorker's stack, or failing
+  that the oldest waiting on another worker's, removing it from the
+  stack, or returns NULL if none is waiting anywhere.
+*/
+static struct Import_Dir *Import_take(struct Import_Worker *psWorker) {
+   struct Import_Run *psImport;
+   struct Import_Dir *psDir = NULL;
+   size_t ulLength;
+   size_t ulOffset;
+
+   assert(psWorker != NULL);
+
+   Import_lock(psWorker);
+   ulLength = DynArray_getLength(psWorker->oDStack);
+   if(ulLength != 0)
+      psDir = DynArray_removeAt(psWorker->oDStack, ulLength - 1);
+   Import_unlock(psWorker);
+   if(psDir != NULL)
+      return psDir;
+
+   /* steal, starting after this worker so thieves spread out */
+   psImport = psWorker->psImport;
+   for(ulOffset = 1; ulOffset < psImport->ulWorkers; ulOffset++) {
+      struct Import_Worker *psVictim = &psImport->psWorkers[
+         ((size_t) (psWorker - psImport->psWorkers) + ulOffset) %
+         psImport->ulWorkers];
+      Import_lock(psVictim);
+      if(DynArray_getLength(psVictim->oDStack) != 0)
+         psDir = DynArray_removeAt(psVictim->oDStack, 0);
+      Import_unlock(psVictim);
+      if(psDir != NULL)
+         return psDir;
+   }
+   return NULL;
+}
+
+/*
+  Reads the whole contents of the regular file open on iFd, of
+  ulSize bytes when it was opened, into a new block from malloc at
+  *ppvContents, or sets *ppvContents to NULL if it is empty, and sets
+  *pulLength to the number of bytes read. Returns SUCCESS, IO_ERROR
+  if reading fails or MEMORY_ERROR if memory could not be allocated.
+*/
+static int Import_read(int iFd, size_t ulSize, void **ppvContents,
+                       size_t *pulLength) {
+   unsigned char *pucContents;
+   size_t ulRead = 0;
+
+   assert(ppvContents != NULL);
+   assert(pulLength != NULL);
+
+   *ppvContents = NULL;
+   *pulLength = 0;
+   if(ulSize == 0)
+      return SUCCESS;
+   pucContents = malloc(ulSize);
+   if(pucContents == NULL)
+      return MEMORY_ERROR;
+
+   /* a file that shrank meanwhile is read as far as it goes */
+   while(ulRead < ulSize) {
+      ssize_t lRead = pread(iFd, pucContents + ulRead,
+                            ulSize - ulRead, (off_t) ulRead);
+      if(lRead == 0)
+         break;
+      if(lRead < 0) {
+         if(errno == EINTR)
+            continue;
+         free(pucContents);
+         return IO_ERROR;
+      }
+      ulRead += (size_t) lRead;
+   }
+   if(ulRead == 0) {
+      free(pucContents);
+      return SUCCESS;
+   }
+   *ppvContents = pucContents;
+   *pulLength = ulRead;
+   return SUCCESS;
+}
+
+/*
+  Mirrors regular file pcDiskPath as a new file named by the
+  ulNameLength bytes at pcName in directory oNDir, counting it in
+  psWorker. Its contents are copied into memory that the new node
+  owns, or, if the import's files share contents, into the blob store
+  or the node itself. Returns SUCCESS, IO_ERROR if the file cannot be
+  read, or MEMORY_ERROR if memory could not be allocated.
+*/
+static int Import_file(struct Import_Worker *psWorker,
+                       Node_T oNDir, const char *pcName,
+                       size_t ulNameLength,
+                       const char *pcDiskPath) {
+   struct stat sStat;
+   Path_T oPPath = NULL;
+   Node_T oNNew = NULL;
+   void *pvContents = NULL;
+   Blob_T oBBlob = NULL;
+   size_t ulLength = 0;
+   const struct Import_Storage *psStorage;
+   int iFd;
+   int iStatus;
+
+   assert(psWorker != NULL);
+   assert(oNDir != NULL);
+   assert(pcName != NULL);
+   assert(pcDiskPath != NULL);
+
+   iFd = open(pcDiskPath, O_RDONLY);
+   if(iFd < 0)
+      return IO_ERROR;
+   if(fstat(iFd, &sStat) != 0) {
+      (void) close(iFd);
+      return IO_ERROR;
+   }
+   iStatus = Import_read(iFd, (size_t) sStat.st_size, &pvContents,
+                         &ulLength);
+   (void) close(iFd);
+   if(iStatus != SUCCESS)
+      return iStatus;
+
+   /* shared contents go in the store, found or made before the
+      node, unless they fit in the node itself */
+   psStorage = psWorker->psImport->psStorage;
+   if(psStorage->bShare && ulLength > psStorage->ulRoom &&
+      Blob_intern(pvContents, ulLength, &oBBlob) != SUCCESS) {
+      free(pvContents);
+      return MEMORY_ERROR;
+   }
+
+   /* the new path extends the directory's, so none is parsed */
+   iStatus = Path_newChild(Node_getPath(oNDir), pcName, ulNameLength,
+                           &oPPath);
+   if(iStatus == SUCCESS) {
+      iStatus = Node_new(oPPath, oNDir, TRUE,
+                         psStorage->bShare ? NULL : pvContents,
+                         psStorage->bShare ? 0 : ulLength,
+                         psStorage->ulRoom, &oNNew);
+      Path_free(oPPath);
+   }
+   if(iStatus != SUCCESS) {
+      if(oBBlob != NULL)
+         Blob_release(oBBlob);
+      free(pvContents);
+      return iStatus == BAD_PATH ? IO_ERROR : iStatus;
+   }
+
+   if(oBBlob != NULL)
+      (void) Node_shareContents(oNNew, oBBlob);
+   else if(psStorage->bShare && pvContents != NULL)
+      (void) Node_inlineContents(oNNew, pvContents, ulLength);
+   else if(pvContents != NULL) {
+      Node_ownContents(oNNew);
+      pvContents = NULL;
+   }
+   free(pvContents);
+
+   psWorker->ulFiles++;
+   psWorker->ulBytes += ulLength;
+   psWorker->ulNodes++;
+   return SUCCESS;
+}
+
+/*
+  Mirrors the entries of directory psDir beneath its node, in the
+  order of their names, counting them in psWorker: regular files
+  with their contents, and subdirectories as new empty directories
+  pushed onto psWorker's stack to be read in turn. Other entries,
+  such as symbolic links, are skipped. Returns SUCCESS, IO_ERROR if
+  the directory or one of its files cannot be read, or MEMORY_ERROR
+  if memory could not be allocated.
+*/
+static int Import_entries(struct Import_Worker *psWorker,
+                          struct Import_Dir *psDir) {
+   DIR *psStream;
+   struct dirent *psEntry;
+   DynArray_T oDNames;
+   struct stat sStat;
+   char *pcName;
+   char *pcDiskPath;
+   size_t ulDiskBytes;
+   size_t ulIndex;
+   size_t ulLength;
+   int iStatus = SUCCESS;
+
+   assert(psWorker != NULL);
+   assert(psDir != NULL);
+
+   oDNames = DynArray_new(0);
+   if(oDNames == NULL)
+      return MEMORY_ERROR;
+   psStream = opendir(psDir->pcDiskPath);
+   if(psStream == NULL) {
+      DynArray_free(oDNames);
+      return IO_ERROR;
+   }
+
+   /* gather and sort the names first, so each child is added after
+      its siblings, without moving them */
+   for(;;) {
+      errno = 0;
+      psEntry = readdir(psStream);
+      if(psEntry == NULL) {
+         if(errno != 0)
+            iStatus = IO_ERROR;
+         break;
+      }
+      if(!strcmp(psEntry->d_name, ".") ||
+         !strcmp(psEntry->d_name, ".."))
+         continue;
+      ulLength = strlen(psEntry->d_name);
+      pcName = Alloc_malloc(ALLOC_TREE_IMPORT, ulLength + 1);
+      if(pcName == NULL) {
+         iStatus = MEMORY_ERROR;
+         break;
+      }
+      memcpy(pcName, psEntry->d_name, ulLength + 1);
+      if(!DynArray_add(oDNames, pcName)) {
+         Alloc_free(ALLOC_TREE_IMPORT, pcName, ulLength + 1);
+         iStatus = MEMORY_ERROR;
+         break;
+      }
+   }
+   (void) closedir(psStream);
+   if(iStatus == SUCCESS)
+      DynArray_sort(oDNames,
+                    (int (*)(const void *, const void *)) strcmp);
+
+   for(ulIndex = 0; ulIndex < DynArray_getLength(oDNames); ulIndex++) {
+      pcName = DynArray_get(oDNames, ulIndex);
+      ulLength = strlen(pcName);
+      if(iStatus != SUCCESS ||
+         Import_load(&psWorker->psImport->iStatus) != SUCCESS) {
+         Alloc_free(ALLOC_TREE_IMPORT, pcName, ulLength + 1);
+         continue;
+      }
+
+      iStatus = Import_join(psDir->pcDiskPath, pcName, ulLength,
+                            &pcDiskPath, &ulDiskBytes);
+      if(iStatus != SUCCESS) {
+         Alloc_free(ALLOC_TREE_IMPORT, pcName, ulLength + 1);
+         continue;
+      }
+      if(lstat(pcDiskPath, &sStat) != 0)
+         iStatus = IO_ERROR;
+      else if(S_ISREG(sStat.st_mode))
+         iStatus = Import_file(psWorker, psDir->oNDir, pcName,
+                               ulLength, pcDiskPath);
+      else if(S_ISDIR(sStat.st_mode)) {
+         Path_T oPPath = NULL;
+         Node_T oNNew = NULL;
+
+         iStatus = Path_newChild(Node_getPath(psDir->oNDir), pcName,
+                                 ulLength, &oPPath);
+         if(iStatus == SUCCESS) {
+            iStatus = Node_new(oPPath, psDir->oNDir, FALSE, NULL, 0,
+                               0, &oNNew);
+            Path_free(oPPath);
+         }
+         if(iStatus == SUCCESS) {
+            psWorker->ulDirs++;
+            psWorker->ulNodes++;
+            /* the pushed directory takes its pathname along */
+            iStatus = Import_push(psWorker, oNNew, pcDiskPath,
+                                  ulDiskBytes);
+            pcDiskPath = NULL;
+         }
+         else if(iStatus == BAD_PATH)
+            iStatus = IO_ERROR;
+      }
+      else
+         psWorker->ulSkipped++;
+      if(pcDiskPath != NULL)
+         Alloc_free(ALLOC_TREE_IMPORT, pcDiskPath, ulDiskBytes);
+      Alloc_free(ALLOC_TREE_IMPORT, pcName, ulLength + 1);
+   }
+   DynArray_free(oDNames);
+   return iStatus;
+}
+
+/*
+  Takes and reads waiting directories as psWorker, pointed to by
+  pvWorker, until none is left waiting or being read by any worker.
+  After a failure the directories are taken but not read. Returns
+  NULL.
+*/
+static void *Import_work(void *pvWorker) {
+   struct Import_Worker *psWorker = pvWorker;
+   struct Import_Run *psImport;
+   struct Import_Dir *psDir;
+   int iStatus;
+
+   assert(psWorker != NULL);
+
+   psImport = psWorker->psImport;
+   for(;;) {
+      psDir = Import_take(psWorker);
+      if(psDir == NULL) {
+         /* another worker may yet push the directories it reads */
+         if(Import_load(&psImport->ulPending) == 0)
+            break;
+         Import_yield();
+         continue;
+      }
+      if(Import_load(&psImport->iStatus) == SUCCESS) {
+         iStatus = Import_entries(psWorker, psDir);
+         if(iStatus != SUCCESS)
+            Import_fail(psImport, iStatus);
+      }
+      Alloc_free(ALLOC_TREE_IMPORT, psDir->pcDiskPath,
+                 psDir->ulDiskBytes);
+      Alloc_free(ALLOC_TREE_IMPORT, psDir,
+                 sizeof(struct Import_Dir));
+      Import_sub(&psImport->ulPending, 1);
+   }
+   return NULL;
+}
+
+int Import_tree(Node_T oNDir, const char *pcDiskPath, size_t ulThreads,
+                const struct Import_Storage *psStorage,
+                struct FT_ImportStats *psStats, size_t *pulNodes) {
+   struct Import_Run sImport;
+   struct Import_Worker *psWorker;
+   char *pcTop;
+   size_t ulTopBytes;
+   size_t ulIndex;
+
+   assert(oNDir != NULL);
+   assert(pcDiskPath != NULL);
+   assert(psStorage != NULL);
+   assert(psStats != NULL);
+   assert(pulNodes != NULL);
+
+#ifdef FT_CONCURRENT
+   if(ulThreads == 0)
+      ulThreads = 1;
+   if(ulThreads > MAX_IMPORT_WORKERS)
+      ulThreads = MAX_IMPORT_WORKERS;
+#else
+   /* without locks there is only the caller to do the work */
+   ulThreads = 1;
+#endif
+
+   sImport.ulWorkers = ulThreads;
+   sImport.psStorage = psStorage;
+   sImport.ulPending = 0;
+   sImport.iStatus = SUCCESS;
+   sImport.psWorkers = Alloc_calloc(ALLOC_TREE_IMPORT, ulThreads,
+                                    sizeof(struct Import_Worker));
+   if(sImport.psWorkers == NULL)
+      return MEMORY_ERROR;
+   for(ulIndex = 0; ulIndex < ulThreads; ulIndex++) {
+      psWorker = &sImport.psWorkers[ulIndex];
+      psWorker->psImport = &sImport;
+      psWorker->oDStack = DynArray_new(0);
+#ifdef FT_CONCURRENT
+      if(psWorker->oDStack != NULL &&
+         pthread_mutex_init(&psWorker->sLock, NULL) != 0) {
+         DynArray_free(psWorker->oDStack);
+         psWorker->oDStack = NULL;
+      }
+#endif
+      if(psWorker->oDStack == NULL) {
+         sImport.ulWorkers = ulIndex;
+         break;
+      }
+   }
+
+   /* the whole tree starts on the caller's stack, to be stolen */
+   if(sImport.ulWorkers == 0)
+      sImport.iStatus = MEMORY_ERROR;
+   else {
+      ulTopBytes = strlen(pcDiskPath) + 1;
+      pcTop = Alloc_malloc(ALLOC_TREE_IMPORT, ulTopBytes);
+      if(pcTop == NULL)
+         sImport.iStatus = MEMORY_ERROR;
+      else {
+         memcpy(pcTop, pcDiskPath, ulTopBytes);
+         if(Import_push(&sImport.psWorkers[0], oNDir, pcTop,
+                        ulTopBytes) != SUCCESS)
+            sImport.iStatus = MEMORY_ERROR;
+      }
+   }
+
+   if(sImport.iStatus == SUCCESS) {
+#ifdef FT_CONCURRENT
+      /* a worker that cannot be started leaves the rest to others */
+      for(ulIndex = 1; ulIndex < sImport.ulWorkers; ulIndex++) {
+         psWorker = &sImport.psWorkers[ulIndex];
+         psWorker->bStarted = (boolean)
+            (pthread_create(&psWorker->sThread, NULL, Import_work,
+                            psWorker) == 0);
+      }
+#endif
+      (void) Import_work(&sImport.psWorkers[0]);
+   }
+
+#ifdef FT_CONCURRENT
+   /* any worker may steal from any other's stack until all stop */
+   for(ulIndex = 1; ulIndex < sImport.ulWorkers; ulIndex++)
+      if(sImport.psWorkers[ulIndex].bStarted)
+         (void) pthread_join(sImport.psWorkers[ulIndex].sThread, NULL);
+#endif
+   for(ulIndex = 0; ulIndex < sImport.ulWorkers; ulIndex++) {
+      psWorker = &sImport.psWorkers[ulIndex];
+#ifdef FT_CONCURRENT
+      (void) pthread_mutex_destroy(&psWorker->sLock);
+#endif
+      psStats->ulDirs += psWorker->ulDirs;
+      psStats->ulFiles += psWorker->ulFiles;
+      psStats->ulBytes += psWorker->ulBytes;
+      psStats->ulSkipped += psWorker->ulSkipped;
+      *pulNodes += psWorker->ulNodes;
+      DynArray_free(psWorker->oDStack);
+   }
+   Alloc_free(ALLOC_TREE_IMPORT, sImport.psWorkers,
+              ulThreads * sizeof(struct Import_Worker));
+   return sImport.iStatus;
+}
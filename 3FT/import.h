@@ -0,0 +1,54 @@
+/*--------------------------------------------------------------------*/
+/* import.h                                                           */
+/* Author: Christopher Moretti                                        */
+/*--------------------------------------------------------------------*/
+
+#ifndef IMPORT_INCLUDED
+#define IMPORT_INCLUDED
+
+#include <stddef.h>
+#include "a4def.h"
+#include "nodeFT.h"
+#include "ft.h"
+
+/*
+  The importer mirrors a directory on disk beneath a node of an FT
+  for FT_import, with a number of workers. Each worker keeps a stack
+  of directories waiting to be read, pushing the subdirectories it
+  finds onto its own and popping the newest, so it mostly works depth
+  first in memory it has just touched; a worker whose stack is empty
+  steals the oldest waiting directory from another's, which is the
+  likeliest to head a large subtree. Only the worker that reads a
+  directory adds children to its node, so the nodes need no locks of
+  their own, and each directory's entries are sorted before they are
+  added, so each goes on the end of its parent's array of children.
+  Only FT_CONCURRENT builds run more than one worker.
+*/
+
+/* How the files that an import makes keep the contents read for
+   them, as the FT that they go in was set up to */
+struct Import_Storage {
+   /* TRUE if files share contents through the blob store */
+   boolean bShare;
+   /* the bytes of room for contents that new files' nodes are made
+      with, in which shared contents that fit are kept instead */
+   size_t ulRoom;
+};
+
+/*
+  Mirrors directory pcDiskPath on disk beneath oNDir, its new node,
+  which nobody else may change meanwhile, with up to ulThreads
+  workers, the caller being the first, keeping files' contents as
+  *psStorage says. Adds what was mirrored to *psStats, all but its
+  ulMicros, and the number of nodes built to *pulNodes. Returns
+  SUCCESS, or the status of the first failure, leaving what was
+  mirrored for the caller to free:
+  * IO_ERROR if a directory or file on disk cannot be read, or an
+             entry's name cannot be a path component
+  * MEMORY_ERROR if memory could not be allocated
+*/
+int Import_tree(Node_T oNDir, const char *pcDiskPath, size_t ulThreads,
+                const struct Import_Storage *psStorage,
+                struct FT_ImportStats *psStats, size_t *pulNodes);
+
+#endif
@@ -0,0 +1 @@
+../0shared/journal.h
\ No newline at end of file
@@ -0,0 +1 @@
+../0shared/latency.h
\ No newline at end of file
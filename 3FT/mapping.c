@@ -0,0 +1,148 @@
+/*--------------------------------------------------------------------*/
+/* mapping.c                                                          */
+/* Author: Christopher Moretti                                        */
+/*--------------------------------------------------------------------*/
+
+/* mmap, fstat and sysconf are POSIX.1-2008 interfaces */
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "mapping.h"
+#include "alloc.h"
+
+/* A mapped run of a file's bytes */
+struct mapping {
+   /* the bytes of the run, and how many there are */
+   void *pvBytes;
+   size_t ulLength;
+   /* the pages mapped to hold them, and how many bytes those span */
+   void *pvMap;
+   size_t ulMapLength;
+   /* the number of references to this mapping, only ever changed
+      atomically */
+   size_t ulRefs;
+};
+
+
+/*
+  Maps the ulLength bytes from offset ulOffset of the regular file
+  open on iFd, whose size is ulSize, setting *poMResult as
+  Mapping_newRange does and returning its statuses. The mapping starts
+  at the page holding ulOffset, as mmap requires.
+*/
+static int Mapping_map(int iFd, size_t ulSize, size_t ulOffset,
+                       size_t ulLength, Mapping_T *poMResult) {
+   struct mapping *psNew;
+   void *pvMap;
+   size_t ulSkip;
+   long lPage;
+
+   assert(poMResult != NULL);
+
+   *poMResult = NULL;
+   if(ulLength == 0 || ulOffset > ulSize ||
+      ulLength > ulSize - ulOffset)
+      return IO_ERROR;
+   lPage = sysconf(_SC_PAGESIZE);
+   if(lPage <= 0)
+      return IO_ERROR;
+   ulSkip = ulOffset % (size_t) lPage;
+
+   psNew = Alloc_malloc(ALLOC_CONTENTS_MAPPING, sizeof(struct mapping));
+   if(psNew == NULL)
+      return MEMORY_ERROR;
+   /* writable, so that clients may change contents as they may their
+      own, but private, so that the changes are copies; pages are only
+      read in when first touched */
+   pvMap = mmap(NULL, ulSkip + ulLength, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE, iFd, (off_t) (ulOffset - ulSkip));
+   if(pvMap == MAP_FAILED) {
+      Alloc_free(ALLOC_CONTENTS_MAPPING, psNew, sizeof(struct mapping));
+      return IO_ERROR;
+   }
+
+   psNew->pvMap = pvMap;
+   psNew->ulMapLength = ulSkip + ulLength;
+   psNew->pvBytes = (char *) pvMap + ulSkip;
+   psNew->ulLength = ulLength;
+   psNew->ulRefs = 1;
+   *poMResult = psNew;
+   return SUCCESS;
+}
+
+/*
+  Sets *pulSize to the size of the regular file open on iFd and
+  returns SUCCESS, or returns IO_ERROR if it is not a regular file or
+  its size cannot be found.
+*/
+static int Mapping_getSize(int iFd, size_t *pulSize) {
+   struct stat sStat;
+
+   assert(pulSize != NULL);
+
+   if(fstat(iFd, &sStat) != 0 || !S_ISREG(sStat.st_mode) ||
+      sStat.st_size < 0)
+      return IO_ERROR;
+   *pulSize = (size_t) sStat.st_size;
+   return SUCCESS;
+}
+
+
+int Mapping_new(int iFd, Mapping_T *poMResult) {
+   size_t ulSize;
+
+   assert(poMResult != NULL);
+
+   *poMResult = NULL;
+   if(Mapping_getSize(iFd, &ulSize) != SUCCESS)
+      return IO_ERROR;
+   return Mapping_map(iFd, ulSize, 0, ulSize, poMResult);
+}
+
+int Mapping_newRange(int iFd, size_t ulOffset, size_t ulLength,
+                     Mapping_T *poMResult) {
+   size_t ulSize;
+
+   assert(poMResult != NULL);
+
+   *poMResult = NULL;
+   if(Mapping_getSize(iFd, &ulSize) != SUCCESS)
+      return IO_ERROR;
+   return Mapping_map(iFd, ulSize, ulOffset, ulLength, poMResult);
+}
+
+void *Mapping_getBytes(Mapping_T oMMapping) {
+   assert(oMMapping != NULL);
+
+   return oMMapping->pvBytes;
+}
+
+size_t Mapping_getLength(Mapping_T oMMapping) {
+   assert(oMMapping != NULL);
+
+   return oMMapping->ulLength;
+}
+
+Mapping_T Mapping_retain(Mapping_T oMMapping) {
+   assert(oMMapping != NULL);
+
+   (void) __atomic_add_fetch(&oMMapping->ulRefs, 1, __ATOMIC_RELAXED);
+   return oMMapping;
+}
+
+void Mapping_release(Mapping_T oMMapping) {
+   assert(oMMapping != NULL);
+
+   /* whoever drops the last reference sees every other release */
+   if(__atomic_sub_fetch(&oMMapping->ulRefs, 1, __ATOMIC_ACQ_REL) != 0)
+      return;
+   (void) munmap(oMMapping->pvMap, oMMapping->ulMapLength);
+   Alloc_free(ALLOC_CONTENTS_MAPPING, oMMapping,
+              sizeof(struct mapping));
+}
@@ -0,0 +1,57 @@
+/*--------------------------------------------------------------------*/
+/* mapping.h                                                          */
+/* Author: Christopher Moretti                                        */
+/*--------------------------------------------------------------------*/
+
+#ifndef MAPPING_INCLUDED
+#define MAPPING_INCLUDED
+
+#include <stddef.h>
+#include "a4def.h"
+
+/*
+  A mapping is a regular file, or a run of its bytes, mapped into
+  memory, so that the contents of files in an FT can be runs of its
+  bytes rather than copies of them. Pages of the file are only read
+  when first touched. Each counts the references to it, being unmapped
+  when the last is released. It is mapped privately, so bytes changed
+  through it are copied first and never reach the file; the file must
+  not be truncated while it is mapped. References may be taken and
+  released from several threads at once.
+*/
+
+/* A Mapping_T is a counted reference to a mapped file */
+typedef struct mapping *Mapping_T;
+
+/*
+  Maps the whole of the regular file open on iFd. Returns SUCCESS and
+  sets *poMResult to the mapping, with one reference for the caller.
+  Otherwise sets *poMResult to NULL and returns IO_ERROR if the file
+  is not a regular file, is empty or cannot be mapped, or
+  MEMORY_ERROR if memory could not be allocated.
+*/
+int Mapping_new(int iFd, Mapping_T *poMResult);
+
+/*
+  Maps the ulLength bytes from offset ulOffset of the regular file
+  open on iFd, as Mapping_new does the whole file. Returns its
+  statuses, IO_ERROR also if ulLength is 0 or the bytes are not all
+  within the file.
+*/
+int Mapping_newRange(int iFd, size_t ulOffset, size_t ulLength,
+                     Mapping_T *poMResult);
+
+/* Returns the bytes that oMMapping maps. */
+void *Mapping_getBytes(Mapping_T oMMapping);
+
+/* Returns the number of bytes that oMMapping maps. */
+size_t Mapping_getLength(Mapping_T oMMapping);
+
+/* Takes another reference to oMMapping, and returns it. */
+Mapping_T Mapping_retain(Mapping_T oMMapping);
+
+/* Releases a reference to oMMapping, unmapping the file if it was the
+   last. */
+void Mapping_release(Mapping_T oMMapping);
+
+#endif
@@ -0,0 +1,1205 @@
+/*--------------------------------------------------------------------*/
+/* nodeFT.c                                                           */
+/* Author: Christopher Moretti                                        */
+/*--------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#ifdef FT_CONCURRENT
+#include <pthread.h>
+#endif
+#include "dynarray.h"
+#include "nodeFT.h"
+#include "rope.h"
+#include "mapping.h"
+#include "spill.h"
+#include "alloc.h"
+
+/* A node in a FT */
+struct node {
+   /* the object corresponding to the node's absolute path */
+   Path_T oPPath;
+   /* this node's parent */
+   Node_T oNParent;
+   /* TRUE if this node is a file, FALSE if it is a directory */
+   boolean bIsFile;
+   /* the objects containing links to this node's children that are
+      files and to those that are directories, each sorted by name,
+      or NULL if this node is a file */
+   DynArray_T oDFiles;
+   DynArray_T oDDirs;
+   /* the contents of this file, or NULL if they are in oRRope or a
+      blob's, or spilled */
+   void *pvContents;
+   /* the length in bytes of pvContents */
+   size_t ulLength;
+   /* TRUE if pvContents was allocated by the FT rather than the
+      client, and so is freed along with this node */
+   boolean bOwnsContents;
+   /* the blob whose bytes are this file's contents, if this node
+      holds a reference to one, or NULL */
+   Blob_T oBBlob;
+   /* the mapped file among whose bytes pvContents is, if this node
+      holds a reference to one, or NULL */
+   Mapping_T oMMapping;
+   /* the number of bytes of room for contents that follow this struct
+      in the same block, always 0 for a directory */
+   size_t ulRoom;
+   /* the rope holding this file's contents since they were last
+      changed by range, or NULL if they are contiguous */
+   Rope_T oRRope;
+   /* this file's own contents, contiguous or in oRRope, as counted
+      against the spill budget; pvContents is NULL while they are
+      spilled */
+   struct Spill_Unit sUnit;
+   /* the numbers of files and directories below this directory, and
+      the total length of those files' contents, always 0 for a file;
+      every change below updates them along its ancestors */
+   size_t ulTreeFiles;
+   size_t ulTreeDirs;
+   size_t ulTreeBytes;
+   /* the number of times oPPath has been rewritten for a move */
+   size_t ulPathVersion;
+   /* the parent's ulPathVersion when oPPath was last written */
+   size_t ulParentVersion;
+   /* the value of ulMoves when oPPath was last found to be current */
+   size_t ulCheckedAt;
+#ifdef FT_CONCURRENT
+   /* the lock protecting the children and the contents */
+   pthread_mutex_t sLock;
+#endif
+};
+
+#ifdef FT_CONCURRENT
+/* Changes in sibling subtrees meet at their common ancestors' totals,
+   which are only ever changed or read atomically */
+#define Node_addTo(pulTotal, n) \
+   ((void) __atomic_add_fetch((pulTotal), (n), __ATOMIC_RELAXED))
+#define Node_subFrom(pulTotal, n) \
+   ((void) __atomic_sub_fetch((pulTotal), (n), __ATOMIC_RELAXED))
+#define Node_loadTotal(pulTotal) \
+   __atomic_load_n((pulTotal), __ATOMIC_RELAXED)
+#else
+#define Node_addTo(pulTotal, n) ((void) (*(pulTotal) += (n)))
+#define Node_subFrom(pulTotal, n) ((void) (*(pulTotal) -= (n)))
+#define Node_loadTotal(pulTotal) (*(pulTotal))
+#endif
+
+/* The number of moves so far, whose subtrees' paths are rewritten
+   lazily. A node checked since the last of them has a current path;
+   any other has one if its parent does and its parent's path has not
+   been rewritten since the node's was written. */
+static size_t ulMoves;
+
+
+/*
+  Returns the array of directory oNParent's children that are files,
+  if bIsFile, or of those that are directories otherwise.
+*/
+static DynArray_T Node_children(Node_T oNParent, boolean bIsFile) {
+   assert(oNParent != NULL);
+   assert(!oNParent->bIsFile);
+
+   return bIsFile ? oNParent->oDFiles : oNParent->oDDirs;
+}
+
+/*
+  Links new child oNChild into the array of oNParent's children of
+  its kind at index ulIndex. Returns SUCCESS if the new child was
+  added successfully, or  MEMORY_ERROR if allocation fails adding
+  oNChild to the array.
+*/
+static int Node_addChild(Node_T oNParent, Node_T oNChild,
+                         size_t ulIndex) {
+   assert(oNParent != NULL);
+   assert(oNChild != NULL);
+
+   if(DynArray_addAt(Node_children(oNParent, oNChild->bIsFile),
+                     ulIndex, oNChild))
+      return SUCCESS;
+   else
+      return MEMORY_ERROR;
+}
+
+/*
+  Returns the last component of oNNode's path, which a move of an
+  ancestor leaves unchanged even before oNNode's path is rewritten.
+*/
+static const char *Node_name(Node_T oNNode) {
+   assert(oNNode != NULL);
+
+   return Path_getComponent(oNNode->oPPath,
+                            Path_getDepth(oNNode->oPPath) - 1);
+}
+
+/*
+  Compares the last path component of oNFirst with string pcName.
+  Returns <0, 0, or >0 if oNFirst's name is "less than", "equal to",
+  or "greater than" pcName, respectively. Among siblings this orders
+  the nodes as their full paths would.
+*/
+static int Node_compareName(const Node_T oNFirst, const char *pcName) {
+   assert(oNFirst != NULL);
+   assert(pcName != NULL);
+
+   return strcmp(Node_name(oNFirst), pcName);
+}
+
+/*
+  Returns TRUE if oNParent has a child that is a file (if bIsFile) or
+  a directory (if !bIsFile) with last path component pcName, storing
+  its index in the array of children of that kind in *pulIndex, or
+  returns FALSE, storing there the index such a child would have.
+*/
+static boolean Node_findName(Node_T oNParent, const char *pcName,
+                             boolean bIsFile, size_t *pulIndex) {
+   assert(oNParent != NULL);
+   assert(pcName != NULL);
+   assert(pulIndex != NULL);
+
+   return DynArray_bsearch(Node_children(oNParent, bIsFile),
+                           (char *) pcName, pulIndex,
+            (int (*)(const void*,const void*)) Node_compareName);
+}
+
+/*
+  Adds ulFiles files, ulDirs directories and ulBytes bytes of contents
+  to the totals of directory oNDir and of each of its ancestors.
+*/
+static void Node_addTotals(Node_T oNDir, size_t ulFiles, size_t ulDirs,
+                           size_t ulBytes) {
+   for(; oNDir != NULL; oNDir = oNDir->oNParent) {
+      Node_addTo(&oNDir->ulTreeFiles, ulFiles);
+      Node_addTo(&oNDir->ulTreeDirs, ulDirs);
+      Node_addTo(&oNDir->ulTreeBytes, ulBytes);
+   }
+}
+
+/*
+  Takes ulFiles files, ulDirs directories and ulBytes bytes of
+  contents away from the totals of directory oNDir and of each of its
+  ancestors.
+*/
+static void Node_subTotals(Node_T oNDir, size_t ulFiles, size_t ulDirs,
+                           size_t ulBytes) {
+   for(; oNDir != NULL; oNDir = oNDir->oNParent) {
+      Node_subFrom(&oNDir->ulTreeFiles, ulFiles);
+      Node_subFrom(&oNDir->ulTreeDirs, ulDirs);
+      Node_subFrom(&oNDir->ulTreeBytes, ulBytes);
+   }
+}
+
+/*
+  Sets the length of file oNNode's contents to ulLength, changing the
+  totals of its ancestors by the difference.
+*/
+static void Node_setLength(Node_T oNNode, size_t ulLength) {
+   assert(oNNode != NULL);
+   assert(oNNode->bIsFile);
+
+   if(ulLength > oNNode->ulLength)
+      Node_addTotals(oNNode->oNParent, 0, 0,
+                     ulLength - oNNode->ulLength);
+   else if(ulLength < oNNode->ulLength)
+      Node_subTotals(oNNode->oNParent, 0, 0,
+                     oNNode->ulLength - ulLength);
+   oNNode->ulLength = ulLength;
+}
+
+/* Writes file oNNode's own contents, which are counted, to the spill
+   file from offset ulSlot, for Spill_evict. Returns SUCCESS, or
+   IO_ERROR if they could not all be written. */
+static int Node_writeUnit(void *pvHolder, size_t ulSlot) {
+   Node_T oNNode = pvHolder;
+   const void *pvBytes;
+   size_t ulLength;
+   size_t ulIndex;
+
+   assert(oNNode != NULL);
+
+   if(oNNode->oRRope == NULL)
+      return Spill_write(oNNode->pvContents, ulSlot,
+                         oNNode->ulLength);
+   /* a rope goes out chunk by chunk, to come back contiguous */
+   for(ulIndex = 0;
+       Rope_getChunk(oNNode->oRRope, ulIndex, &pvBytes, &ulLength);
+       ulIndex++) {
+      if(Spill_write(pvBytes, ulSlot, ulLength) != SUCCESS)
+         return IO_ERROR;
+      ulSlot += ulLength;
+   }
+   return SUCCESS;
+}
+
+/* Frees file oNNode's own contents, which are then only in the spill
+   file, for Spill_evict. */
+static void Node_dropUnit(void *pvHolder) {
+   Node_T oNNode = pvHolder;
+
+   assert(oNNode != NULL);
+
+   if(oNNode->oRRope != NULL) {
+      Rope_free(oNNode->oRRope);
+      oNNode->oRRope = NULL;
+      oNNode->bOwnsContents = TRUE;
+   }
+   else {
+      free(oNNode->pvContents);
+      Alloc_noteFree(ALLOC_CONTENTS_LOADED, oNNode->ulLength);
+   }
+   oNNode->pvContents = NULL;
+}
+
+/* What a file does for the spill file */
+static const struct Spill_Ops sNodeOps =
+   {Node_writeUnit, Node_dropUnit};
+
+/*
+  Counts file oNNode's contents against the spill budget, as the most
+  recently used, if they are its own and in memory, contiguous or in
+  a rope, and not counted yet, which may spill others'.
+*/
+static void Node_count(Node_T oNNode) {
+   assert(oNNode != NULL);
+
+   if(oNNode->oRRope != NULL)
+      Spill_count(&oNNode->sUnit, Rope_getLength(oNNode->oRRope),
+                  Rope_getCapacity(oNNode->oRRope));
+   else if(oNNode->bOwnsContents && oNNode->pvContents != NULL)
+      Spill_count(&oNNode->sUnit, oNNode->ulLength, oNNode->ulLength);
+}
+
+/*
+  Stops counting file oNNode's contents against the spill budget, in
+  memory or in the spill file, and gives up their place there, as
+  they are no longer its own or are about to change.
+*/
+static void Node_forgetContents(Node_T oNNode) {
+   assert(oNNode != NULL);
+
+   Spill_forget(&oNNode->sUnit);
+}
+
+/* Counts file oNNode's contents, which have just changed in memory,
+   against the spill budget again, as the most recently used. */
+static void Node_recount(Node_T oNNode) {
+   assert(oNNode != NULL);
+
+   Node_forgetContents(oNNode);
+   Node_count(oNNode);
+}
+
+/*
+  Unlinks oNChild from the array of oNParent's children of its kind,
+  which it must be in, storing in *pulIndex the index it had there.
+*/
+static void Node_removeChild(Node_T oNParent, Node_T oNChild,
+                             size_t *pulIndex) {
+   assert(oNParent != NULL);
+   assert(oNChild != NULL);
+   assert(pulIndex != NULL);
+
+   if(!Node_findName(oNParent, Node_name(oNChild), oNChild->bIsFile,
+                     pulIndex))
+      assert(FALSE);
+   (void) DynArray_removeAt(Node_children(oNParent, oNChild->bIsFile),
+                            *pulIndex);
+}
+
+
+int Node_new(Path_T oPPath, Node_T oNParent, boolean bIsFile,
+             void *pvContents, size_t ulLength, size_t ulRoom,
+             Node_T *poNResult) {
+   struct node *psNew;
+   size_t ulSize;
+   Path_T oPParentPath = NULL;
+   Path_T oPNewPath = NULL;
+   size_t ulParentDepth;
+   size_t ulIndex;
+   size_t ulOther;
+   int iStatus;
+
+   assert(oPPath != NULL);
+   assert(poNResult != NULL);
+
+   /* a file cannot have children */
+   if(oNParent != NULL && oNParent->bIsFile) {
+      *poNResult = NULL;
+      return NOT_A_DIRECTORY;
+   }
+
+   /* allocate space for a new node, and a file's room after it */
+   if(!bIsFile)
+      ulRoom = 0;
+   ulSize = sizeof(struct node) + ulRoom;
+   psNew = Alloc_malloc(ALLOC_NODE_STRUCT, ulSize);
+   if(psNew == NULL) {
+      *poNResult = NULL;
+      return MEMORY_ERROR;
+   }
+
+   /* set the new node's path */
+   iStatus = Path_dup(oPPath, &oPNewPath);
+   if(iStatus != SUCCESS) {
+      Alloc_free(ALLOC_NODE_STRUCT, psNew, ulSize);
+      *poNResult = NULL;
+      return iStatus;
+   }
+   psNew->oPPath = oPNewPath;
+
+   /* validate and set the new node's parent */
+   if(oNParent != NULL) {
+      size_t ulSharedDepth;
+
+      oPParentPath = Node_getPath(oNParent);
+      if(oPParentPath == NULL) {
+         Path_free(psNew->oPPath);
+         Alloc_free(ALLOC_NODE_STRUCT, psNew, ulSize);
+         *poNResult = NULL;
+         return MEMORY_ERROR;
+      }
+      ulParentDepth = Path_getDepth(oPParentPath);
+      ulSharedDepth = Path_getSharedPrefixDepth(psNew->oPPath,
+                                                oPParentPath);
+      /* parent must be an ancestor of child */
+      if(ulSharedDepth < ulParentDepth) {
+         Path_free(psNew->oPPath);
+         Alloc_free(ALLOC_NODE_STRUCT, psNew, ulSize);
+         *poNResult = NULL;
+         return CONFLICTING_PATH;
+      }
+
+      /* parent must be exactly one level up from child */
+      if(Path_getDepth(psNew->oPPath) != ulParentDepth + 1) {
+         Path_free(psNew->oPPath);
+         Alloc_free(ALLOC_NODE_STRUCT, psNew, ulSize);
+         *poNResult = NULL;
+         return NO_SUCH_PATH;
+      }
+
+      /* parent must not already have child with this path, of either
+         kind; ulIndex is where one of the new node's kind goes */
+      if(Node_findName(oNParent, Node_name(psNew), !bIsFile,
+                       &ulOther) ||
+         Node_findName(oNParent, Node_name(psNew), bIsFile,
+                       &ulIndex)) {
+         Path_free(psNew->oPPath);
+         Alloc_free(ALLOC_NODE_STRUCT, psNew, ulSize);
+         *poNResult = NULL;
+         return ALREADY_IN_TREE;
+      }
+   }
+   else {
+      /* new node must be root */
+      /* can only create one "level" at a time */
+      if(Path_getDepth(psNew->oPPath) != 1) {
+         Path_free(psNew->oPPath);
+         Alloc_free(ALLOC_NODE_STRUCT, psNew, ulSize);
+         *poNResult = NULL;
+         return NO_SUCH_PATH;
+      }
+   }
+   psNew->oNParent = oNParent;
+
+   /* initialize the new node */
+   psNew->bIsFile = bIsFile;
+   psNew->oDFiles = NULL;
+   psNew->oDDirs = NULL;
+   psNew->pvContents = NULL;
+   psNew->ulLength = 0;
+   psNew->bOwnsContents = FALSE;
+   psNew->oBBlob = NULL;
+   psNew->oMMapping = NULL;
+   psNew->ulRoom = ulRoom;
+   psNew->oRRope = NULL;
+   Spill_initUnit(&psNew->sUnit, &sNodeOps, psNew);
+   psNew->ulTreeFiles = 0;
+   psNew->ulTreeDirs = 0;
+   psNew->ulTreeBytes = 0;
+   psNew->ulPathVersion = 0;
+   psNew->ulParentVersion =
+      oNParent == NULL ? 0 : oNParent->ulPathVersion;
+   psNew->ulCheckedAt = ulMoves;
+   if(bIsFile) {
+      psNew->pvContents = pvContents;
+      psNew->ulLength = ulLength;
+   }
+   else {
+      psNew->oDFiles = DynArray_new(0);
+      psNew->oDDirs = DynArray_new(0);
+      if(psNew->oDFiles == NULL || psNew->oDDirs == NULL) {
+         if(psNew->oDFiles != NULL)
+            DynArray_free(psNew->oDFiles);
+         if(psNew->oDDirs != NULL)
+            DynArray_free(psNew->oDDirs);
+         Path_free(psNew->oPPath);
+         Alloc_free(ALLOC_NODE_STRUCT, psNew, ulSize);
+         *poNResult = NULL;
+         return MEMORY_ERROR;
+      }
+   }
+
+#ifdef FT_CONCURRENT
+   if(pthread_mutex_init(&psNew->sLock, NULL) != 0) {
+      if(!bIsFile) {
+         DynArray_free(psNew->oDFiles);
+         DynArray_free(psNew->oDDirs);
+      }
+      Path_free(psNew->oPPath);
+      Alloc_free(ALLOC_NODE_STRUCT, psNew, ulSize);
+      *poNResult = NULL;
+      return MEMORY_ERROR;
+   }
+#endif
+
+   /* Link into parent's children list */
+   if(oNParent != NULL) {
+      iStatus = Node_addChild(oNParent, psNew, ulIndex);
+      if(iStatus != SUCCESS) {
+#ifdef FT_CONCURRENT
+         (void) pthread_mutex_destroy(&psNew->sLock);
+#endif
+         if(!bIsFile) {
+            DynArray_free(psNew->oDFiles);
+            DynArray_free(psNew->oDDirs);
+         }
+         Path_free(psNew->oPPath);
+         Alloc_free(ALLOC_NODE_STRUCT, psNew, ulSize);
+         *poNResult = NULL;
+         return iStatus;
+      }
+      if(bIsFile)
+         Node_addTotals(oNParent, 1, 0, ulLength);
+      else
+         Node_addTotals(oNParent, 0, 1, 0);
+   }
+
+   *poNResult = psNew;
+   return SUCCESS;
+}
+
+/*
+  Frees oNNode, which must be locked, and which has no children, along
+  with the contents it holds, leaving its parent's children and all
+  totals as they are.
+*/
+static void Node_freeSelf(Node_T oNNode) {
+   assert(oNNode != NULL);
+   assert(Node_getNumChildren(oNNode) == 0);
+
+   if(!oNNode->bIsFile) {
+      DynArray_free(oNNode->oDFiles);
+      DynArray_free(oNNode->oDDirs);
+   }
+
+#ifdef FT_CONCURRENT
+   Node_unlock(oNNode);
+   (void) pthread_mutex_destroy(&oNNode->sLock);
+#endif
+
+   Node_forgetContents(oNNode);
+   if(oNNode->bOwnsContents && oNNode->pvContents != NULL) {
+      free(oNNode->pvContents);
+      Alloc_noteFree(ALLOC_CONTENTS_LOADED, oNNode->ulLength);
+   }
+   if(oNNode->oBBlob != NULL)
+      Blob_release(oNNode->oBBlob);
+   if(oNNode->oMMapping != NULL)
+      Mapping_release(oNNode->oMMapping);
+   if(oNNode->oRRope != NULL)
+      Rope_free(oNNode->oRRope);
+
+   /* remove path */
+   Path_free(oNNode->oPPath);
+
+   /* finally, free the struct node */
+   Alloc_free(ALLOC_NODE_STRUCT, oNNode,
+              sizeof(struct node) + oNNode->ulRoom);
+}
+
+/*
+  Frees the descendants of oNNode, which then has no children, and
+  returns how many were freed. Their totals are not taken from
+  oNNode's, nor from its ancestors'.
+*/
+static size_t Node_freeChildren(Node_T oNNode) {
+   size_t ulIndex;
+   size_t ulCount = 0;
+
+   assert(oNNode != NULL);
+
+   if(oNNode->bIsFile)
+      return 0;
+
+   while(Node_getNumChildren(oNNode) != 0) {
+      Node_T oNChild = NULL;
+      (void) Node_getChild(oNNode, 0, &oNChild);
+#ifdef FT_CONCURRENT
+      Node_lock(oNChild);
+#endif
+      Node_removeChild(oNNode, oNChild, &ulIndex);
+      ulCount += Node_freeChildren(oNChild);
+      Node_freeSelf(oNChild);
+      ulCount++;
+   }
+   return ulCount;
+}
+
+size_t Node_free(Node_T oNNode) {
+   size_t ulIndex;
+   size_t ulCount;
+
+   assert(oNNode != NULL);
+
+   /* remove from parent's list */
+   if(oNNode->oNParent != NULL)
+      Node_removeChild(oNNode->oNParent, oNNode, &ulIndex);
+
+   /* recursively remove children, each of whose locks waits out any
+      change still being made beneath it, so that the totals taken
+      from the ancestors below include it */
+   ulCount = Node_freeChildren(oNNode);
+   if(oNNode->bIsFile)
+      Node_subTotals(oNNode->oNParent, 1, 0, oNNode->ulLength);
+   else
+      Node_subTotals(oNNode->oNParent,
+                     Node_loadTotal(&oNNode->ulTreeFiles),
+                     Node_loadTotal(&oNNode->ulTreeDirs) + 1,
+                     Node_loadTotal(&oNNode->ulTreeBytes));
+
+   Node_freeSelf(oNNode);
+   ulCount++;
+   return ulCount;
+}
+
+int Node_move(Node_T oNNode, Node_T oNNewParent, Path_T oPNewPath) {
+   Node_T oNOldParent;
+   Path_T oPDupPath = NULL;
+   size_t ulOldIndex, ulNewIndex;
+   const char *pcNewName;
+   int iStatus;
+
+   assert(oNNode != NULL);
+   assert(oNNode->oNParent != NULL);
+   assert(oNNewParent != NULL);
+   assert(!oNNewParent->bIsFile);
+   assert(oPNewPath != NULL);
+
+   iStatus = Path_dup(oPNewPath, &oPDupPath);
+   if(iStatus != SUCCESS)
+      return iStatus;
+
+   /* unlink oNNode, then link it in again where it belongs; removing
+      never shrinks an array, so putting it back cannot fail */
+   oNOldParent = oNNode->oNParent;
+   Node_removeChild(oNOldParent, oNNode, &ulOldIndex);
+   pcNewName = Path_getComponent(oPNewPath,
+                                 Path_getDepth(oPNewPath) - 1);
+   if(Node_findName(oNNewParent, pcNewName, oNNode->bIsFile,
+                    &ulNewIndex))
+      assert(FALSE);
+   iStatus = Node_addChild(oNNewParent, oNNode, ulNewIndex);
+   if(iStatus != SUCCESS) {
+      (void) Node_addChild(oNOldParent, oNNode, ulOldIndex);
+      Path_free(oPDupPath);
+      return iStatus;
+   }
+   oNNode->oNParent = oNNewParent;
+   Path_free(oNNode->oPPath);
+   oNNode->oPPath = oPDupPath;
+
+   /* the subtree's totals move from the old ancestors to the new */
+   if(oNNode->bIsFile) {
+      Node_subTotals(oNOldParent, 1, 0, oNNode->ulLength);
+      Node_addTotals(oNNewParent, 1, 0, oNNode->ulLength);
+   }
+   else {
+      Node_subTotals(oNOldParent, oNNode->ulTreeFiles,
+                     oNNode->ulTreeDirs + 1, oNNode->ulTreeBytes);
+      Node_addTotals(oNNewParent, oNNode->ulTreeFiles,
+                     oNNode->ulTreeDirs + 1, oNNode->ulTreeBytes);
+   }
+
+   /* every other node is checked again when next asked for its path,
+      which only oNNode's descendents then need to rewrite */
+   oNNode->ulPathVersion++;
+   oNNode->ulParentVersion = oNNewParent->ulPathVersion;
+   ulMoves++;
+   oNNode->ulCheckedAt = ulMoves;
+   return SUCCESS;
+}
+
+int Node_settlePaths(Node_T oNNode) {
+   size_t ulIndex;
+
+   if(oNNode == NULL)
+      return SUCCESS;
+   if(Node_getPath(oNNode) == NULL)
+      return MEMORY_ERROR;
+   for(ulIndex = 0; ulIndex < Node_getNumChildren(oNNode); ulIndex++) {
+      Node_T oNChild = NULL;
+      (void) Node_getChild(oNNode, ulIndex, &oNChild);
+      if(Node_settlePaths(oNChild) != SUCCESS)
+         return MEMORY_ERROR;
+   }
+   return SUCCESS;
+}
+
+Path_T Node_getPath(Node_T oNNode) {
+   Path_T oPParentPath;
+   Path_T oPNewPath = NULL;
+   const char *pcName;
+
+   assert(oNNode != NULL);
+
+   if(oNNode->ulCheckedAt == ulMoves || oNNode->oNParent == NULL)
+      return oNNode->oPPath;
+
+   /* a move since the last check may have left the path stale, in
+      which case it is the parent's extended by this node's name */
+   oPParentPath = Node_getPath(oNNode->oNParent);
+   if(oPParentPath == NULL)
+      return NULL;
+   if(oNNode->ulParentVersion != oNNode->oNParent->ulPathVersion) {
+      pcName = Node_name(oNNode);
+      if(Path_newChild(oPParentPath, pcName, strlen(pcName),
+                       &oPNewPath) != SUCCESS)
+         return NULL;
+      Path_free(oNNode->oPPath);
+      oNNode->oPPath = oPNewPath;
+      oNNode->ulPathVersion++;
+      oNNode->ulParentVersion = oNNode->oNParent->ulPathVersion;
+   }
+   oNNode->ulCheckedAt = ulMoves;
+   return oNNode->oPPath;
+}
+
+boolean Node_isFile(Node_T oNNode) {
+   assert(oNNode != NULL);
+
+   return oNNode->bIsFile;
+}
+
+void *Node_getContents(Node_T oNNode) {
+   assert(oNNode != NULL);
+   assert(oNNode->bIsFile);
+   assert(oNNode->oRRope == NULL);
+   assert(!Node_isSpilled(oNNode));
+
+   /* the caller may change them through the pointer, so a copy in the
+      spill file can no longer be trusted; a blob's must not change */
+   if(oNNode->oBBlob != NULL)
+      return Blob_getBytes(oNNode->oBBlob);
+   Spill_dirty(&oNNode->sUnit);
+   return oNNode->pvContents;
+}
+
+size_t Node_getLength(Node_T oNNode) {
+   assert(oNNode != NULL);
+   assert(oNNode->bIsFile);
+
+   return oNNode->ulLength;
+}
+
+void *Node_replaceContents(Node_T oNNode, void *pvContents,
+                           size_t ulLength) {
+   void *pvOld;
+
+   assert(oNNode != NULL);
+   assert(oNNode->bIsFile);
+   assert(oNNode->oBBlob == NULL);
+   assert(oNNode->oMMapping == NULL);
+   assert(oNNode->oRRope == NULL);
+   assert(!Spill_isSpilled(&oNNode->sUnit));
+
+   Node_forgetContents(oNNode);
+   pvOld = oNNode->pvContents;
+   /* contents the FT owned are the client's to free from here */
+   if(oNNode->bOwnsContents && pvOld != NULL)
+      Alloc_noteFree(ALLOC_CONTENTS_LOADED, oNNode->ulLength);
+   oNNode->pvContents = pvContents;
+   Node_setLength(oNNode, ulLength);
+   oNNode->bOwnsContents = FALSE;
+   return pvOld;
+}
+
+void Node_ownContents(Node_T oNNode) {
+   assert(oNNode != NULL);
+   assert(oNNode->bIsFile);
+
+   if(!oNNode->bOwnsContents && oNNode->pvContents != NULL)
+      Alloc_noteAlloc(ALLOC_CONTENTS_LOADED, oNNode->ulLength);
+   oNNode->bOwnsContents = TRUE;
+   Node_count(oNNode);
+}
+
+Blob_T Node_shareContents(Node_T oNNode, Blob_T oBBlob) {
+   Blob_T oBOld;
+
+   assert(oNNode != NULL);
+   assert(oNNode->bIsFile);
+   assert(!oNNode->bOwnsContents || oNNode->pvContents == NULL);
+   assert(oNNode->oRRope == NULL);
+   assert(!Spill_isSpilled(&oNNode->sUnit));
+
+   /* the blob's bytes are found through it each time, as they are
+      freed whenever it is spilled */
+   oBOld = oNNode->oBBlob;
+   oNNode->oBBlob = oBBlob;
+   oNNode->bOwnsContents = FALSE;
+   oNNode->pvContents = NULL;
+   Node_setLength(oNNode, oBBlob == NULL ? 0 : Blob_getLength(oBBlob));
+   return oBOld;
+}
+
+Blob_T Node_inlineContents(Node_T oNNode, const void *pvContents,
+                           size_t ulLength) {
+   Blob_T oBOld;
+   char *pcRoom;
+
+   assert(oNNode != NULL);
+   assert(oNNode->bIsFile);
+   assert(!oNNode->bOwnsContents || oNNode->pvContents == NULL);
+   assert(pvContents != NULL || ulLength == 0);
+   assert(ulLength <= oNNode->ulRoom);
+   assert(oNNode->oRRope == NULL);
+   assert(!Spill_isSpilled(&oNNode->sUnit));
+
+   oBOld = oNNode->oBBlob;
+   oNNode->oBBlob = NULL;
+   oNNode->bOwnsContents = FALSE;
+   if(ulLength == 0) {
+      oNNode->pvContents = NULL;
+      Node_setLength(oNNode, 0);
+      return oBOld;
+   }
+
+   /* the room starts where the struct ends, in the same block; the
+      bytes may already be there, so they are moved rather than
+      copied */
+   pcRoom = (char *) oNNode + sizeof(struct node);
+   memmove(pcRoom, pvContents, ulLength);
+   oNNode->pvContents = pcRoom;
+   Node_setLength(oNNode, ulLength);
+   return oBOld;
+}
+
+void Node_mapContents(Node_T oNNode, Mapping_T oMMapping,
+                      size_t ulOffset, size_t ulLength) {
+   assert(oNNode != NULL);
+   assert(oNNode->bIsFile);
+   assert(oNNode->pvContents == NULL && oNNode->oRRope == NULL);
+   assert(!Spill_isSpilled(&oNNode->sUnit));
+   assert(oMMapping != NULL);
+   assert(ulLength > 0);
+   assert(ulOffset <= Mapping_getLength(oMMapping) &&
+          ulLength <= Mapping_getLength(oMMapping) - ulOffset);
+
+   oNNode->oMMapping = oMMapping;
+   oNNode->pvContents = (char *) Mapping_getBytes(oMMapping) + ulOffset;
+   Node_setLength(oNNode, ulLength);
+}
+
+int Node_unmapContents(Node_T oNNode) {
+   void *pvCopy;
+
+   assert(oNNode != NULL);
+   assert(oNNode->bIsFile);
+
+   if(oNNode->oMMapping == NULL)
+      return SUCCESS;
+   pvCopy = malloc(oNNode->ulLength);
+   if(pvCopy == NULL)
+      return MEMORY_ERROR;
+   memcpy(pvCopy, oNNode->pvContents, oNNode->ulLength);
+   Mapping_release(oNNode->oMMapping);
+   oNNode->oMMapping = NULL;
+   oNNode->pvContents = pvCopy;
+   Node_ownContents(oNNode);
+   return SUCCESS;
+}
+
+Blob_T Node_getBlob(Node_T oNNode) {
+   assert(oNNode != NULL);
+   assert(oNNode->bIsFile);
+
+   return oNNode->oBBlob;
+}
+
+boolean Node_isInline(Node_T oNNode) {
+   assert(oNNode != NULL);
+   assert(oNNode->bIsFile);
+
+   return (boolean) (oNNode->pvContents != NULL &&
+                     oNNode->pvContents ==
+                        (char *) oNNode + sizeof(struct node));
+}
+
+int Node_readContents(Node_T oNNode, size_t ulOffset,
+                      size_t ulLength, void *pvBuffer,
+                      size_t *pulRead) {
+   assert(oNNode != NULL);
+   assert(oNNode->bIsFile);
+   assert(pvBuffer != NULL || ulLength == 0);
+   assert(pulRead != NULL);
+
+   *pulRead = 0;
+   if(ulOffset >= oNNode->ulLength)
+      return SUCCESS;
+   if(ulLength > oNNode->ulLength - ulOffset)
+      ulLength = oNNode->ulLength - ulOffset;
+
+   /* spilled contents are read where they are, not brought back */
+   if(oNNode->oBBlob != NULL) {
+      if(Blob_read(oNNode->oBBlob, ulOffset, ulLength, pvBuffer) !=
+         SUCCESS)
+         return IO_ERROR;
+   }
+   else if(Spill_isSpilled(&oNNode->sUnit)) {
+      if(Spill_read(&oNNode->sUnit, ulOffset, ulLength, pvBuffer) !=
+         SUCCESS)
+         return IO_ERROR;
+   }
+   else {
+      Spill_use(&oNNode->sUnit);
+      if(oNNode->oRRope != NULL)
+         Rope_read(oNNode->oRRope, ulOffset, ulLength, pvBuffer);
+      else
+         memcpy(pvBuffer, (char *) oNNode->pvContents + ulOffset,
+                ulLength);
+   }
+   *pulRead = ulLength;
+   return SUCCESS;
+}
+
+boolean Node_getPiece(Node_T oNNode, size_t ulIndex,
+                      const void **ppvBytes, size_t *pulLength) {
+   assert(oNNode != NULL);
+   assert(oNNode->bIsFile);
+   assert(ppvBytes != NULL);
+   assert(pulLength != NULL);
+   assert(!Node_isSpilled(oNNode));
+
+   if(oNNode->oRRope != NULL)
+      return Rope_getChunk(oNNode->oRRope, ulIndex, ppvBytes,
+                           pulLength);
+   if(ulIndex != 0 || oNNode->ulLength == 0)
+      return FALSE;
+   if(oNNode->oBBlob != NULL)
+      *ppvBytes = Blob_getBytes(oNNode->oBBlob);
+   else
+      *ppvBytes = oNNode->pvContents;
+   *pulLength = oNNode->ulLength;
+   return TRUE;
+}
+
+/*
+  Moves the contents of file oNNode into a rope of its own, if they
+  are not in one already: those oNNode owns are taken over as they
+  are, and any others are copied. Returns SUCCESS, or MEMORY_ERROR if
+  memory could not be allocated, in which case the contents are
+  unchanged, though a blob's may have become oNNode's own.
+*/
+static int Node_toRope(Node_T oNNode) {
+   void *pvBytes = NULL;
+   Rope_T oRRope = NULL;
+
+   assert(oNNode != NULL);
+   assert(oNNode->bIsFile);
+   assert(!Spill_isSpilled(&oNNode->sUnit));
+
+   if(oNNode->oRRope != NULL)
+      return SUCCESS;
+
+   /* the rope is built around a block from malloc of oNNode's own */
+   if(oNNode->oBBlob != NULL) {
+      if(Blob_take(oNNode->oBBlob, &pvBytes) != SUCCESS)
+         return MEMORY_ERROR;
+      oNNode->oBBlob = NULL;
+      oNNode->pvContents = pvBytes;
+      oNNode->bOwnsContents = TRUE;
+      Alloc_noteAlloc(ALLOC_CONTENTS_LOADED, oNNode->ulLength);
+   }
+   else if(oNNode->bOwnsContents || oNNode->ulLength == 0)
+      pvBytes = oNNode->pvContents;
+   else {
+      pvBytes = malloc(oNNode->ulLength);
+      if(pvBytes == NULL)
+         return MEMORY_ERROR;
+      memcpy(pvBytes, oNNode->pvContents, oNNode->ulLength);
+   }
+
+   if(Rope_new(oNNode->ulLength == 0 ? NULL : pvBytes,
+               oNNode->ulLength, &oRRope) != SUCCESS) {
+      if(pvBytes != oNNode->pvContents)
+         free(pvBytes);
+      /* a blob's bytes taken over are counted as oNNode's own */
+      Node_count(oNNode);
+      return MEMORY_ERROR;
+   }
+   Node_forgetContents(oNNode);
+   if(oNNode->bOwnsContents && oNNode->pvContents != NULL)
+      Alloc_noteFree(ALLOC_CONTENTS_LOADED, oNNode->ulLength);
+   if(oNNode->oMMapping != NULL)
+      Mapping_release(oNNode->oMMapping);
+   oNNode->oMMapping = NULL;
+   oNNode->oRRope = oRRope;
+   oNNode->pvContents = NULL;
+   oNNode->bOwnsContents = FALSE;
+   Node_count(oNNode);
+   return SUCCESS;
+}
+
+int Node_writeContents(Node_T oNNode, size_t ulOffset,
+                       const void *pvBytes, size_t ulLength) {
+   assert(oNNode != NULL);
+   assert(oNNode->bIsFile);
+   assert(pvBytes != NULL || ulLength == 0);
+
+   if(ulLength == 0)
+      return SUCCESS;
+   if(Node_toRope(oNNode) != SUCCESS ||
+      Rope_write(oNNode->oRRope, ulOffset, pvBytes, ulLength) !=
+         SUCCESS)
+      return MEMORY_ERROR;
+   Node_setLength(oNNode, Rope_getLength(oNNode->oRRope));
+   Node_recount(oNNode);
+   return SUCCESS;
+}
+
+int Node_truncateContents(Node_T oNNode, size_t ulLength) {
+   assert(oNNode != NULL);
+   assert(oNNode->bIsFile);
+
+   if(ulLength == oNNode->ulLength)
+      return SUCCESS;
+   if(Node_toRope(oNNode) != SUCCESS ||
+      Rope_truncate(oNNode->oRRope, ulLength) != SUCCESS)
+      return MEMORY_ERROR;
+   Node_setLength(oNNode, ulLength);
+   Node_recount(oNNode);
+   return SUCCESS;
+}
+
+int Node_flattenContents(Node_T oNNode) {
+   void *pvBytes;
+
+   assert(oNNode != NULL);
+   assert(oNNode->bIsFile);
+
+   if(oNNode->oRRope == NULL)
+      return Node_loadContents(oNNode);
+   if(Rope_take(oNNode->oRRope, &pvBytes) != SUCCESS)
+      return MEMORY_ERROR;
+   oNNode->oRRope = NULL;
+   Node_forgetContents(oNNode);
+   oNNode->pvContents = pvBytes;
+   oNNode->bOwnsContents = FALSE;
+   Node_ownContents(oNNode);
+   return SUCCESS;
+}
+
+int Node_loadContents(Node_T oNNode) {
+   void *pvBytes;
+
+   assert(oNNode != NULL);
+   assert(oNNode->bIsFile);
+
+   if(oNNode->oBBlob != NULL)
+      return Blob_load(oNNode->oBBlob);
+   if(!Spill_isSpilled(&oNNode->sUnit)) {
+      Spill_use(&oNNode->sUnit);
+      return SUCCESS;
+   }
+
+   pvBytes = malloc(oNNode->ulLength);
+   if(pvBytes == NULL)
+      return MEMORY_ERROR;
+   if(Spill_load(&oNNode->sUnit, pvBytes) != SUCCESS) {
+      free(pvBytes);
+      return IO_ERROR;
+   }
+   Alloc_noteAlloc(ALLOC_CONTENTS_LOADED, oNNode->ulLength);
+   oNNode->pvContents = pvBytes;
+   return SUCCESS;
+}
+
+boolean Node_isSpilled(Node_T oNNode) {
+   assert(oNNode != NULL);
+   assert(oNNode->bIsFile);
+
+   if(oNNode->oBBlob != NULL)
+      return Blob_isSpilled(oNNode->oBBlob);
+   return Spill_isSpilled(&oNNode->sUnit);
+}
+
+boolean Node_hasChild(Node_T oNParent, Path_T oPPath,
+                         size_t *pulChildID) {
+   size_t ulDirID;
+
+   assert(oNParent != NULL);
+   assert(oPPath != NULL);
+   assert(pulChildID != NULL);
+
+   /* paths mostly pass through directories, so look there first */
+   if(Node_hasChildOfKind(oNParent, oPPath, FALSE, &ulDirID)) {
+      *pulChildID = ulDirID;
+      return TRUE;
+   }
+   if(Node_hasChildOfKind(oNParent, oPPath, TRUE, pulChildID))
+      return TRUE;
+   *pulChildID = ulDirID;
+   return FALSE;
+}
+
+boolean Node_hasChildOfKind(Node_T oNParent, Path_T oPPath,
+                            boolean bIsFile, size_t *pulChildID) {
+   boolean bFound;
+
+   assert(oNParent != NULL);
+   assert(oPPath != NULL);
+   assert(pulChildID != NULL);
+
+   if(oNParent->bIsFile) {
+      *pulChildID = 0;
+      return FALSE;
+   }
+
+   /* files have the first identifiers, then directories follow */
+   bFound = Node_findName(oNParent,
+               Path_getComponent(oPPath, Path_getDepth(oPPath) - 1),
+               bIsFile, pulChildID);
+   if(!bIsFile)
+      *pulChildID += DynArray_getLength(oNParent->oDFiles);
+   return bFound;
+}
+
+size_t Node_getNumChildren(Node_T oNParent) {
+   assert(oNParent != NULL);
+
+   if(oNParent->bIsFile)
+      return 0;
+
+   return DynArray_getLength(oNParent->oDFiles) +
+          DynArray_getLength(oNParent->oDDirs);
+}
+
+size_t Node_getNumFiles(Node_T oNParent) {
+   assert(oNParent != NULL);
+
+   if(oNParent->bIsFile)
+      return 0;
+
+   return DynArray_getLength(oNParent->oDFiles);
+}
+
+int  Node_getChild(Node_T oNParent, size_t ulChildID,
+                   Node_T *poNResult) {
+   size_t ulFiles;
+
+   assert(oNParent != NULL);
+   assert(poNResult != NULL);
+
+   /* ulChildID indexes the files, then the directories after them */
+   if(ulChildID >= Node_getNumChildren(oNParent)) {
+      *poNResult = NULL;
+      return NO_SUCH_PATH;
+   }
+   ulFiles = DynArray_getLength(oNParent->oDFiles);
+   if(ulChildID < ulFiles)
+      *poNResult = DynArray_get(oNParent->oDFiles, ulChildID);
+   else
+      *poNResult = DynArray_get(oNParent->oDDirs, ulChildID - ulFiles);
+   return SUCCESS;
+}
+
+void Node_getFootprint(Node_T oNNode, size_t *pulNodeBytes,
+                       size_t *pulPathBytes, size_t *pulChildBytes,
+                       size_t *pulSlack) {
+   size_t ulSlots = 0;
+
+   assert(oNNode != NULL);
+   assert(pulNodeBytes != NULL);
+   assert(pulPathBytes != NULL);
+   assert(pulChildBytes != NULL);
+   assert(pulSlack != NULL);
+
+   *pulNodeBytes = sizeof(struct node) + oNNode->ulRoom;
+   *pulPathBytes = Path_getBytes(oNNode->oPPath);
+   *pulSlack = 0;
+   if(!oNNode->bIsFile) {
+      ulSlots = DynArray_getPhysLength(oNNode->oDFiles) +
+                DynArray_getPhysLength(oNNode->oDDirs);
+      *pulSlack = ulSlots - Node_getNumChildren(oNNode);
+   }
+   *pulChildBytes = ulSlots * sizeof(void *);
+}
+
+void Node_getTotals(Node_T oNNode, size_t *pulFiles, size_t *pulDirs,
+                    size_t *pulBytes) {
+   assert(oNNode != NULL);
+   assert(pulFiles != NULL);
+   assert(pulDirs != NULL);
+   assert(pulBytes != NULL);
+
+   if(oNNode->bIsFile) {
+      *pulFiles = 1;
+      *pulDirs = 0;
+      *pulBytes = oNNode->ulLength;
+      return;
+   }
+   *pulFiles = Node_loadTotal(&oNNode->ulTreeFiles);
+   *pulDirs = Node_loadTotal(&oNNode->ulTreeDirs) + 1;
+   *pulBytes = Node_loadTotal(&oNNode->ulTreeBytes);
+}
+
+Node_T Node_getParent(Node_T oNNode) {
+   assert(oNNode != NULL);
+
+   return oNNode->oNParent;
+}
+
+int Node_compare(Node_T oNFirst, Node_T oNSecond) {
+   assert(oNFirst != NULL);
+   assert(oNSecond != NULL);
+
+   /* siblings are ordered by name alone, which needs no rewriting */
+   if(oNFirst->oNParent == oNSecond->oNParent)
+      return Node_compareName(oNFirst, Node_name(oNSecond));
+   return Path_comparePath(Node_getPath(oNFirst),
+                           Node_getPath(oNSecond));
+}
+
+char *Node_toString(Node_T oNNode) {
+   Path_T oPPath;
+   char *copyPath;
+
+   assert(oNNode != NULL);
+
+   oPPath = Node_getPath(oNNode);
+   if(oPPath == NULL)
+      return NULL;
+   copyPath = malloc(Path_getStrLength(oPPath)+1);
+   if(copyPath == NULL)
+      return NULL;
+   Alloc_noteAlloc(ALLOC_NODE_STRING, Path_getStrLength(oPPath)+1);
+   strcpy(copyPath, Path_getPathname(oPPath));
+   /* the string is the caller's to free from here */
+   Alloc_noteFree(ALLOC_NODE_STRING, Path_getStrLength(oPPath)+1);
+   return copyPath;
+}
+
+#ifdef FT_CONCURRENT
+void Node_lock(Node_T oNNode) {
+   assert(oNNode != NULL);
+
+   (void) pthread_mutex_lock(&oNNode->sLock);
+}
+
+void Node_unlock(Node_T oNNode) {
+   assert(oNNode != NULL);
+
+   (void) pthread_mutex_unlock(&oNNode->sLock);
+}
+#endif
@@ -0,0 +1,336 @@
+/*--------------------------------------------------------------------*/
+/* nodeFT.h                                                           */
+/* Author: Christopher Moretti                                        */
+/*--------------------------------------------------------------------*/
+
+#ifndef NODE_INCLUDED
+#define NODE_INCLUDED
+
+#include <stddef.h>
+#include "a4def.h"
+#include "path.h"
+#include "blob.h"
+#include "mapping.h"
+
+
+/* A Node_T is a node in a File Tree: a directory or a file */
+typedef struct node *Node_T;
+
+/*
+  Creates a new node in the File Tree, with path oPPath and parent
+  oNParent. The node is a file with contents pvContents of ulLength
+  bytes, and room for ulRoom bytes of contents kept in the node itself
+  (see Node_inlineContents), if bIsFile, and a directory (ignoring
+  pvContents, ulLength and ulRoom) otherwise. Returns an int SUCCESS
+  status and sets *poNResult to be the new node if successful.
+  Otherwise, sets *poNResult to NULL and returns status:
+  * MEMORY_ERROR if memory could not be allocated to complete request
+  * CONFLICTING_PATH if oNParent's path is not an ancestor of oPPath
+  * NO_SUCH_PATH if oPPath is of depth 0
+                 or oNParent's path is not oPPath's direct parent
+                 or oNParent is NULL but oPPath is not of depth 1
+  * NOT_A_DIRECTORY if oNParent is a file
+  * ALREADY_IN_TREE if oNParent already has a child with this path
+*/
+int Node_new(Path_T oPPath, Node_T oNParent, boolean bIsFile,
+             void *pvContents, size_t ulLength, size_t ulRoom,
+             Node_T *poNResult);
+
+/*
+  Destroys and frees all memory allocated for the subtree rooted at
+  oNNode, i.e., deletes this node and all its descendents. File
+  contents are owned by the client and are not freed, except those
+  handed to Node_ownContents or in a rope, and the references held to
+  blobs and mappings are released. Returns the number of nodes
+  deleted.
+
+  In FT_CONCURRENT builds the caller must hold the locks of oNNode and
+  of its parent (if any). Each descendent is locked before it is
+  freed, so this waits for other threads to leave the subtree.
+*/
+size_t Node_free(Node_T oNNode);
+
+/*
+  Moves oNNode, which must not be the root, from its parent to
+  directory oNNewParent, which must be neither oNNode nor a descendent
+  of it, and gives it path oPNewPath, which must be that of a child
+  that oNNewParent does not have yet. The paths of oNNode's
+  descendents are rewritten only when Node_getPath next asks for each
+  of them, so the move takes time proportional to the depth of the
+  paths rather than to the size of the subtree. Returns SUCCESS, or
+  MEMORY_ERROR if memory could not be allocated, in which case the
+  hierarchy is unchanged.
+
+  In FT_CONCURRENT builds the caller must hold the FT exclusively.
+*/
+int Node_move(Node_T oNNode, Node_T oNNewParent, Path_T oPNewPath);
+
+/*
+  Rewrites every path in the subtree rooted at oNNode, which may be
+  NULL, that has been left to be rewritten lazily by Node_move, so
+  that walking the subtree afterwards cannot fail. Returns SUCCESS, or
+  MEMORY_ERROR if memory could not be allocated.
+*/
+int Node_settlePaths(Node_T oNNode);
+
+/*
+  Returns the path object representing oNNode's absolute path.
+  The path of a node with an ancestor moved by Node_move is rebuilt
+  the first time it is asked for afterwards, and NULL is returned if
+  memory could not be allocated to do so. In FT_CONCURRENT builds the
+  caller must then hold the lock of oNNode's parent, if not the FT
+  exclusively.
+*/
+Path_T Node_getPath(Node_T oNNode);
+
+/* Returns TRUE if oNNode is a file and FALSE if it is a directory. */
+boolean Node_isFile(Node_T oNNode);
+
+/* Returns the contents of file oNNode, which must be contiguous (see
+   Node_flattenContents) and in memory (see Node_loadContents). */
+void *Node_getContents(Node_T oNNode);
+
+/* Returns the length in bytes of the contents of file oNNode. */
+size_t Node_getLength(Node_T oNNode);
+
+/*
+  Replaces the contents of file oNNode with pvContents of ulLength
+  bytes, which the client owns. Returns the old contents, which the
+  client then owns even if oNNode did. oNNode must not hold a blob
+  from Node_shareContents or a mapping from Node_mapContents, and its
+  contents must be contiguous and in memory.
+*/
+void *Node_replaceContents(Node_T oNNode, void *pvContents,
+                           size_t ulLength);
+
+/*
+  Hands ownership of file oNNode's contents, which must have been
+  allocated with malloc, to oNNode, so they are freed with it. They
+  are then counted against the spill budget as the most recently
+  used, which may spill other contents (see spill.h).
+*/
+void Node_ownContents(Node_T oNNode);
+
+/*
+  Replaces the contents of file oNNode with the bytes of blob oBBlob,
+  handing oNNode the caller's reference to it, or with NULL contents
+  of length 0 if oBBlob is NULL. oNNode's contents must not be its own
+  from Node_ownContents. The blob is counted against the spill budget
+  once, however many files share it, and spilled for all of them at
+  once. Returns the blob that oNNode held a reference to before, which
+  the caller then holds, or NULL if it held none.
+*/
+Blob_T Node_shareContents(Node_T oNNode, Blob_T oBBlob);
+
+/*
+  Replaces the contents of file oNNode with a copy of the ulLength
+  bytes at pvContents, kept in the room that oNNode was made with,
+  which must hold them, or with NULL contents if ulLength is 0. The
+  bytes may be oNNode's current contents. oNNode's contents must not
+  be its own from Node_ownContents. Returns the blob that oNNode held
+  a reference to before, which the caller then holds, or NULL if it
+  held none.
+*/
+Blob_T Node_inlineContents(Node_T oNNode, const void *pvContents,
+                           size_t ulLength);
+
+/*
+  Makes the contents of file oNNode, which must have none, the
+  ulLength bytes from offset ulOffset in mapped file oMMapping, which
+  must all be within it, handing oNNode the caller's reference to
+  oMMapping. ulLength must not be 0.
+*/
+void Node_mapContents(Node_T oNNode, Mapping_T oMMapping,
+                      size_t ulOffset, size_t ulLength);
+
+/*
+  Copies the contents of file oNNode, if they are in a mapped file
+  from Node_mapContents, into a block that oNNode owns, releasing its
+  reference to the mapping. Returns SUCCESS, or MEMORY_ERROR if
+  memory could not be allocated, in which case oNNode is unchanged.
+*/
+int Node_unmapContents(Node_T oNNode);
+
+/* Returns the blob whose bytes are file oNNode's contents, or NULL if
+   they are not a blob's. */
+Blob_T Node_getBlob(Node_T oNNode);
+
+/* Returns TRUE if file oNNode's contents are kept in the node itself,
+   from Node_inlineContents, and FALSE otherwise. */
+boolean Node_isInline(Node_T oNNode);
+
+/*
+  Copies into pvBuffer the bytes of file oNNode's contents from offset
+  ulOffset, up to ulLength of them, storing in *pulRead the number
+  copied: fewer than ulLength if the contents end first, and none if
+  they end at or before ulOffset. Spilled contents are read from the
+  spill file, and stay spilled. Returns SUCCESS, or IO_ERROR if they
+  could not be, in which case *pulRead is 0.
+*/
+int Node_readContents(Node_T oNNode, size_t ulOffset,
+                      size_t ulLength, void *pvBuffer,
+                      size_t *pulRead);
+
+/*
+  Sets *ppvBytes and *pulLength to the piece with index ulIndex of the
+  pieces in which file oNNode's contents are kept, numbered from 0 in
+  order, and returns TRUE, or returns FALSE if there is no such piece.
+  Contiguous contents are one piece, and those in a rope one per
+  chunk; empty contents have none, and no piece is empty. The bytes
+  are oNNode's, valid until its contents next change or are spilled,
+  so they can be written out without being copied. The contents must
+  be in memory (see Node_loadContents).
+*/
+boolean Node_getPiece(Node_T oNNode, size_t ulIndex,
+                      const void **ppvBytes, size_t *pulLength);
+
+/*
+  Writes the ulLength bytes at pvBytes over file oNNode's contents
+  from offset ulOffset, extending them as needed and filling any gap
+  between their end and ulOffset with zeros. The first such change
+  moves the contents into a rope of oNNode's own, taking over those it
+  owns and copying any others, which stop being its contents: a
+  client's stay the client's, and a blob is released. The rope's
+  chunks are counted against the spill budget as oNNode's own, and
+  come back contiguous if they are spilled. The contents must be in
+  memory (see Node_loadContents). Returns SUCCESS, or
+  MEMORY_ERROR if memory could not be allocated, in which case the
+  contents are unchanged.
+*/
+int Node_writeContents(Node_T oNNode, size_t ulOffset,
+                       const void *pvBytes, size_t ulLength);
+
+/*
+  Makes file oNNode's contents ulLength bytes long, dropping those
+  past ulLength or adding zeros to their end, and moving them into a
+  rope as Node_writeContents does, so they must be in memory. Returns
+  SUCCESS, or MEMORY_ERROR if memory could not be allocated, in which
+  case the contents are unchanged.
+*/
+int Node_truncateContents(Node_T oNNode, size_t ulLength);
+
+/*
+  Makes file oNNode's contents, if they are in a rope, contiguous
+  again, in a block of oNNode's own as from Node_ownContents, or reads
+  them back if they were spilled, as Node_loadContents does. Returns
+  SUCCESS, or MEMORY_ERROR if memory could not be allocated, in which
+  case they stay in the rope, or the statuses of Node_loadContents.
+*/
+int Node_flattenContents(Node_T oNNode);
+
+/*
+  Reads file oNNode's contents back from the spill file into memory,
+  of its own or its blob's, if they were spilled, which may spill
+  other contents, and marks them as the most recently used. Returns
+  SUCCESS, or MEMORY_ERROR if memory could not be allocated or
+  IO_ERROR if they could not be read, in which case they stay
+  spilled.
+*/
+int Node_loadContents(Node_T oNNode);
+
+/* Returns TRUE if file oNNode's contents, its own or its blob's, are
+   only in the spill file, and FALSE otherwise. */
+boolean Node_isSpilled(Node_T oNNode);
+
+/*
+  Returns TRUE if oNParent has a child, file or directory, with path
+  oPPath. Returns FALSE if it does not.
+
+  If oNParent has such a child, stores in *pulChildID the child's
+  identifier (as used in Node_getChild). If oNParent does not have
+  such a child, stores in *pulChildID the identifier that such a
+  child _would_ have if inserted as a directory.
+*/
+boolean Node_hasChild(Node_T oNParent, Path_T oPPath,
+                         size_t *pulChildID);
+
+/*
+  Returns TRUE if oNParent has a child with path oPPath that is a
+  file, if bIsFile, or a directory, if not, searching only the
+  children of that kind. Returns FALSE if it does not. Stores in
+  *pulChildID the child's identifier, or the identifier that such a
+  child would have if inserted, as Node_hasChild does.
+*/
+boolean Node_hasChildOfKind(Node_T oNParent, Path_T oPPath,
+                            boolean bIsFile, size_t *pulChildID);
+
+/* Returns the number of children that oNParent has. */
+size_t Node_getNumChildren(Node_T oNParent);
+
+/* Returns the number of children of oNParent that are files. */
+size_t Node_getNumFiles(Node_T oNParent);
+
+/*
+  Returns an int SUCCESS status and sets *poNResult to be the child
+  node of oNParent with identifier ulChildID, if one exists. A
+  directory keeps its files apart from its subdirectories, each
+  sorted by name, so the files have identifiers from 0 up to
+  Node_getNumFiles(oNParent), and the subdirectories the rest; a walk
+  through the identifiers in order visits the children as FT_toString
+  lists them.
+  Otherwise, sets *poNResult to NULL and returns status:
+  * NO_SUCH_PATH if ulChildID is not a valid child for oNParent
+*/
+int Node_getChild(Node_T oNParent, size_t ulChildID,
+                  Node_T *poNResult);
+
+/*
+  Stores in *pulNodeBytes the bytes of memory that oNNode itself
+  occupies, in *pulPathBytes those that its path occupies, and in
+  *pulChildBytes those that its arrays of children occupy, with
+  *pulSlack set to the number of slots in those arrays holding no
+  child. A file has no such arrays, and its contents are not counted
+  unless kept in the node itself, whose room is counted with it.
+  Paths left stale by Node_move are measured as they are.
+*/
+void Node_getFootprint(Node_T oNNode, size_t *pulNodeBytes,
+                       size_t *pulPathBytes, size_t *pulChildBytes,
+                       size_t *pulSlack);
+
+/*
+  Stores in *pulFiles and *pulDirs the numbers of files and
+  directories in the subtree rooted at oNNode, counting oNNode itself,
+  and in *pulBytes the total length of those files' contents. Every
+  node keeps the totals of its subtree as it changes, so this takes
+  constant time. In FT_CONCURRENT builds each total is read
+  atomically, but changes being made in the subtree at the same time
+  may have reached some of them and not yet others.
+*/
+void Node_getTotals(Node_T oNNode, size_t *pulFiles, size_t *pulDirs,
+                    size_t *pulBytes);
+
+/*
+  Returns a the parent node of oNNode.
+  Returns NULL if oNNode is the root and thus has no parent.
+*/
+Node_T Node_getParent(Node_T oNNode);
+
+/*
+  Compares oNFirst and oNSecond lexicographically based on their paths.
+  Returns <0, 0, or >0 if onFirst is "less than", "equal to", or
+  "greater than" oNSecond, respectively.
+*/
+int Node_compare(Node_T oNFirst, Node_T oNSecond);
+
+/*
+  Returns a string representation for oNNode, or NULL if
+  there is an allocation error.
+
+  Allocates memory for the returned string, which is then owned by
+  the caller!
+*/
+char *Node_toString(Node_T oNNode);
+
+#ifdef FT_CONCURRENT
+/*
+  Acquires the lock of oNNode, blocking until it is available.
+  Locks are taken hand-over-hand from the root downwards, so a thread
+  holding a node's lock may then lock any of that node's children.
+*/
+void Node_lock(Node_T oNNode);
+
+/* Releases the lock of oNNode, which the caller must hold. */
+void Node_unlock(Node_T oNNode);
+#endif
+
+#endif
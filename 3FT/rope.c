@@ -0,0 +1,403 @@
+/*--------------------------------------------------------------------*/
+/* rope.c                                                             */
+/* Author: Christopher Moretti                                        */
+/*--------------------------------------------------------------------*/
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rope.h"
+#include "dynarray.h"
+#include "alloc.h"
+
+/* The fewest bytes a new chunk has room for, so that many small
+   appends share a chunk */
+enum {MIN_CHUNK_BYTES = 4096};
+
+/* A run of a rope's bytes */
+struct chunk {
+   /* the offset in the rope of the chunk's first byte */
+   size_t ulOffset;
+   /* the number of bytes in the chunk, and the number it has room
+      for */
+   size_t ulLength;
+   size_t ulCapacity;
+   /* the bytes, from malloc */
+   unsigned char *pucBytes;
+};
+
+/* A run of bytes kept in chunks */
+struct rope {
+   /* the chunks, in order of offset, each holding at least one byte
+      and starting where the one before it ends */
+   DynArray_T oDChunks;
+   /* the number of bytes in the rope */
+   size_t ulLength;
+};
+
+
+/*
+  Returns a new chunk at offset ulOffset with room for ulCapacity
+  bytes, which are pucBytes, a block from malloc that the chunk then
+  owns, or new ones if pucBytes is NULL. The chunk holds no bytes
+  yet. Returns NULL if memory could not be allocated.
+*/
+static struct chunk *Rope_newChunk(size_t ulOffset, size_t ulCapacity,
+                                   unsigned char *pucBytes) {
+   struct chunk *psChunk;
+
+   assert(ulCapacity > 0);
+
+   psChunk = Alloc_malloc(ALLOC_CONTENTS_ROPE, sizeof(struct chunk));
+   if(psChunk == NULL)
+      return NULL;
+   if(pucBytes == NULL) {
+      /* the bytes may be handed to the client, so come from malloc */
+      pucBytes = malloc(ulCapacity);
+      if(pucBytes == NULL) {
+         Alloc_free(ALLOC_CONTENTS_ROPE, psChunk, sizeof(struct chunk));
+         return NULL;
+      }
+   }
+   Alloc_noteAlloc(ALLOC_CONTENTS_CHUNK, ulCapacity);
+   psChunk->ulOffset = ulOffset;
+   psChunk->ulLength = 0;
+   psChunk->ulCapacity = ulCapacity;
+   psChunk->pucBytes = pucBytes;
+   return psChunk;
+}
+
+/* Frees psChunk and its bytes, unless they have been handed over. */
+static void Rope_freeChunk(struct chunk *psChunk) {
+   assert(psChunk != NULL);
+
+   if(psChunk->pucBytes != NULL) {
+      free(psChunk->pucBytes);
+      Alloc_noteFree(ALLOC_CONTENTS_CHUNK, psChunk->ulCapacity);
+   }
+   Alloc_free(ALLOC_CONTENTS_ROPE, psChunk, sizeof(struct chunk));
+}
+
+/*
+  Compares the bytes of psChunk with offset *pulOffset. Returns <0 if
+  they all come before it, >0 if they all come after it, and 0 if one
+  of them is at it.
+*/
+static int Rope_compareOffset(const struct chunk *psChunk,
+                              const size_t *pulOffset) {
+   assert(psChunk != NULL);
+   assert(pulOffset != NULL);
+
+   if(psChunk->ulOffset + psChunk->ulLength <= *pulOffset)
+      return -1;
+   if(psChunk->ulOffset > *pulOffset)
+      return 1;
+   return 0;
+}
+
+/* Returns the index of the chunk of oRRope holding the byte at
+   ulOffset, which must be within oRRope. */
+static size_t Rope_find(Rope_T oRRope, size_t ulOffset) {
+   size_t ulIndex;
+
+   assert(oRRope != NULL);
+   assert(ulOffset < oRRope->ulLength);
+
+   if(!DynArray_bsearch(oRRope->oDChunks, &ulOffset, &ulIndex,
+            (int (*)(const void*,const void*)) Rope_compareOffset))
+      assert(FALSE);
+   return ulIndex;
+}
+
+/*
+  Makes room in oRRope for bytes up to ulLength, which must be more
+  than it holds, adding at most one chunk after the last. Returns
+  SUCCESS, or MEMORY_ERROR if memory could not be allocated, in which
+  case oRRope is unchanged.
+*/
+static int Rope_reserve(Rope_T oRRope, size_t ulLength) {
+   struct chunk *psLast = NULL;
+   struct chunk *psNew;
+   size_t ulChunks;
+   size_t ulEnd = 0;
+
+   assert(oRRope != NULL);
+   assert(ulLength > oRRope->ulLength);
+
+   /* the last chunk's spare room is used up first */
+   ulChunks = DynArray_getLength(oRRope->oDChunks);
+   if(ulChunks > 0) {
+      psLast = DynArray_get(oRRope->oDChunks, ulChunks - 1);
+      ulEnd = psLast->ulOffset + psLast->ulCapacity;
+   }
+   if(ulEnd >= ulLength)
+      return SUCCESS;
+
+   psNew = Rope_newChunk(ulEnd, ulLength - ulEnd < MIN_CHUNK_BYTES ?
+                         MIN_CHUNK_BYTES : ulLength - ulEnd, NULL);
+   if(psNew == NULL)
+      return MEMORY_ERROR;
+   if(!DynArray_add(oRRope->oDChunks, psNew)) {
+      Rope_freeChunk(psNew);
+      return MEMORY_ERROR;
+   }
+   return SUCCESS;
+}
+
+/*
+  Appends to oRRope the ulLength bytes at pucBytes, or that many zeros
+  if pucBytes is NULL, into room that Rope_reserve has made for them.
+*/
+static void Rope_fill(Rope_T oRRope, const unsigned char *pucBytes,
+                      size_t ulLength) {
+   size_t ulIndex = 0;
+
+   assert(oRRope != NULL);
+
+   /* the bytes go after the last, in the chunk holding it if it has
+      room, and then in the chunk reserved after it */
+   if(oRRope->ulLength > 0)
+      ulIndex = Rope_find(oRRope, oRRope->ulLength - 1);
+   while(ulLength > 0) {
+      struct chunk *psChunk = DynArray_get(oRRope->oDChunks, ulIndex);
+      size_t ulCopy = psChunk->ulCapacity - psChunk->ulLength;
+
+      if(ulCopy > ulLength)
+         ulCopy = ulLength;
+      if(pucBytes == NULL)
+         memset(psChunk->pucBytes + psChunk->ulLength, 0, ulCopy);
+      else {
+         memcpy(psChunk->pucBytes + psChunk->ulLength, pucBytes,
+                ulCopy);
+         pucBytes += ulCopy;
+      }
+      psChunk->ulLength += ulCopy;
+      oRRope->ulLength += ulCopy;
+      ulLength -= ulCopy;
+      ulIndex++;
+   }
+}
+
+
+int Rope_new(void *pvBytes, size_t ulLength, Rope_T *poRResult) {
+   struct rope *psRope;
+   struct chunk *psChunk;
+
+   assert(pvBytes != NULL || ulLength == 0);
+   assert(poRResult != NULL);
+
+   *poRResult = NULL;
+   psRope = Alloc_malloc(ALLOC_CONTENTS_ROPE, sizeof(struct rope));
+   if(psRope == NULL)
+      return MEMORY_ERROR;
+   psRope->ulLength = 0;
+   psRope->oDChunks = DynArray_new(0);
+   if(psRope->oDChunks == NULL) {
+      Alloc_free(ALLOC_CONTENTS_ROPE, psRope, sizeof(struct rope));
+      return MEMORY_ERROR;
+   }
+   if(ulLength == 0) {
+      *poRResult = psRope;
+      return SUCCESS;
+   }
+
+   /* the block becomes the first chunk, just as it is */
+   psChunk = Rope_newChunk(0, ulLength, pvBytes);
+   if(psChunk == NULL || !DynArray_add(psRope->oDChunks, psChunk)) {
+      if(psChunk != NULL) {
+         /* the block goes back to the caller, not to free */
+         Alloc_noteFree(ALLOC_CONTENTS_CHUNK, ulLength);
+         psChunk->pucBytes = NULL;
+         Rope_freeChunk(psChunk);
+      }
+      DynArray_free(psRope->oDChunks);
+      Alloc_free(ALLOC_CONTENTS_ROPE, psRope, sizeof(struct rope));
+      return MEMORY_ERROR;
+   }
+   psChunk->ulLength = ulLength;
+   psRope->ulLength = ulLength;
+   *poRResult = psRope;
+   return SUCCESS;
+}
+
+void Rope_free(Rope_T oRRope) {
+   size_t ulIndex;
+
+   assert(oRRope != NULL);
+
+   for(ulIndex = 0; ulIndex < DynArray_getLength(oRRope->oDChunks);
+       ulIndex++)
+      Rope_freeChunk(DynArray_get(oRRope->oDChunks, ulIndex));
+   DynArray_free(oRRope->oDChunks);
+   Alloc_free(ALLOC_CONTENTS_ROPE, oRRope, sizeof(struct rope));
+}
+
+size_t Rope_getLength(Rope_T oRRope) {
+   assert(oRRope != NULL);
+
+   return oRRope->ulLength;
+}
+
+size_t Rope_getCapacity(Rope_T oRRope) {
+   struct chunk *psLast;
+   size_t ulChunks;
+
+   assert(oRRope != NULL);
+
+   /* every chunk but the last is full */
+   ulChunks = DynArray_getLength(oRRope->oDChunks);
+   if(ulChunks == 0)
+      return 0;
+   psLast = DynArray_get(oRRope->oDChunks, ulChunks - 1);
+   return psLast->ulOffset + psLast->ulCapacity;
+}
+
+void Rope_read(Rope_T oRRope, size_t ulOffset, size_t ulLength,
+               void *pvBuffer) {
+   unsigned char *pucBuffer = pvBuffer;
+   size_t ulIndex;
+
+   assert(oRRope != NULL);
+   assert(pvBuffer != NULL || ulLength == 0);
+   assert(ulOffset <= oRRope->ulLength);
+   assert(ulLength <= oRRope->ulLength - ulOffset);
+
+   if(ulLength == 0)
+      return;
+   for(ulIndex = Rope_find(oRRope, ulOffset); ulLength > 0;
+       ulIndex++) {
+      struct chunk *psChunk = DynArray_get(oRRope->oDChunks, ulIndex);
+      size_t ulStart = ulOffset - psChunk->ulOffset;
+      size_t ulCopy = psChunk->ulLength - ulStart;
+
+      if(ulCopy > ulLength)
+         ulCopy = ulLength;
+      memcpy(pucBuffer, psChunk->pucBytes + ulStart, ulCopy);
+      pucBuffer += ulCopy;
+      ulOffset += ulCopy;
+      ulLength -= ulCopy;
+   }
+}
+
+boolean Rope_getChunk(Rope_T oRRope, size_t ulIndex,
+                      const void **ppvBytes, size_t *pulLength) {
+   struct chunk *psChunk;
+
+   assert(oRRope != NULL);
+   assert(ppvBytes != NULL);
+   assert(pulLength != NULL);
+
+   if(ulIndex >= DynArray_getLength(oRRope->oDChunks))
+      return FALSE;
+   psChunk = DynArray_get(oRRope->oDChunks, ulIndex);
+   *ppvBytes = psChunk->pucBytes;
+   *pulLength = psChunk->ulLength;
+   return TRUE;
+}
+
+int Rope_write(Rope_T oRRope, size_t ulOffset, const void *pvBytes,
+               size_t ulLength) {
+   const unsigned char *pucBytes = pvBytes;
+   size_t ulEnd = ulOffset + ulLength;
+   size_t ulOver = 0;
+   size_t ulIndex;
+
+   assert(oRRope != NULL);
+   assert(pvBytes != NULL || ulLength == 0);
+
+   if(ulLength == 0)
+      return SUCCESS;
+   /* no rope could hold bytes past the largest offset */
+   if(ulEnd < ulOffset)
+      return MEMORY_ERROR;
+   if(ulEnd > oRRope->ulLength &&
+      Rope_reserve(oRRope, ulEnd) != SUCCESS)
+      return MEMORY_ERROR;
+
+   /* the bytes over those already in the rope are copied in place,
+      touching only the chunks that hold them */
+   if(ulOffset < oRRope->ulLength) {
+      ulOver = (ulEnd < oRRope->ulLength ? ulEnd : oRRope->ulLength) -
+               ulOffset;
+      for(ulIndex = Rope_find(oRRope, ulOffset); ulOffset < ulEnd &&
+          ulOffset < oRRope->ulLength; ulIndex++) {
+         struct chunk *psChunk = DynArray_get(oRRope->oDChunks,
+                                              ulIndex);
+         size_t ulStart = ulOffset - psChunk->ulOffset;
+         size_t ulCopy = psChunk->ulLength - ulStart;
+
+         if(ulCopy > ulEnd - ulOffset)
+            ulCopy = ulEnd - ulOffset;
+         memcpy(psChunk->pucBytes + ulStart, pucBytes, ulCopy);
+         pucBytes += ulCopy;
+         ulOffset += ulCopy;
+      }
+   }
+   /* and the rest extend it, after any gap */
+   if(ulOffset > oRRope->ulLength)
+      Rope_fill(oRRope, NULL, ulOffset - oRRope->ulLength);
+   Rope_fill(oRRope, pucBytes, ulLength - ulOver);
+   return SUCCESS;
+}
+
+int Rope_truncate(Rope_T oRRope, size_t ulLength) {
+   size_t ulChunks;
+
+   assert(oRRope != NULL);
+
+   if(ulLength > oRRope->ulLength) {
+      if(Rope_reserve(oRRope, ulLength) != SUCCESS)
+         return MEMORY_ERROR;
+      Rope_fill(oRRope, NULL, ulLength - oRRope->ulLength);
+      return SUCCESS;
+   }
+
+   /* the chunks past the new end go, and the one it falls in keeps
+      its room for bytes appended later */
+   ulChunks = DynArray_getLength(oRRope->oDChunks);
+   while(ulChunks > 0) {
+      struct chunk *psLast = DynArray_get(oRRope->oDChunks,
+                                          ulChunks - 1);
+      if(psLast->ulOffset < ulLength) {
+         psLast->ulLength = ulLength - psLast->ulOffset;
+         break;
+      }
+      (void) DynArray_removeAt(oRRope->oDChunks, ulChunks - 1);
+      Rope_freeChunk(psLast);
+      ulChunks--;
+   }
+   oRRope->ulLength = ulLength;
+   return SUCCESS;
+}
+
+int Rope_take(Rope_T oRRope, void **ppvBytes) {
+   struct chunk *psChunk;
+   void *pvResized;
+
+   assert(oRRope != NULL);
+   assert(ppvBytes != NULL);
+
+   *ppvBytes = NULL;
+   if(DynArray_getLength(oRRope->oDChunks) == 1) {
+      /* the one chunk is handed over, given back any spare room */
+      psChunk = DynArray_get(oRRope->oDChunks, 0);
+      *ppvBytes = psChunk->pucBytes;
+      if(psChunk->ulLength < psChunk->ulCapacity) {
+         pvResized = realloc(psChunk->pucBytes, psChunk->ulLength);
+         if(pvResized != NULL)
+            *ppvBytes = pvResized;
+      }
+      Alloc_noteFree(ALLOC_CONTENTS_CHUNK, psChunk->ulCapacity);
+      psChunk->pucBytes = NULL;
+   }
+   else if(oRRope->ulLength > 0) {
+      *ppvBytes = malloc(oRRope->ulLength);
+      if(*ppvBytes == NULL)
+         return MEMORY_ERROR;
+      Rope_read(oRRope, 0, oRRope->ulLength, *ppvBytes);
+   }
+
+   Rope_free(oRRope);
+   return SUCCESS;
+}
@@ -0,0 +1,86 @@
+/*--------------------------------------------------------------------*/
+/* rope.h                                                             */
+/* Author: Christopher Moretti                                        */
+/*--------------------------------------------------------------------*/
+
+#ifndef ROPE_INCLUDED
+#define ROPE_INCLUDED
+
+#include <stddef.h>
+#include "a4def.h"
+
+/*
+  A rope holds the contents of a file that have been changed by range:
+  a run of bytes kept in chunks, in order, so that changing some of
+  the bytes copies only those, and reading from an offset finds the
+  chunk holding it by binary search. Only the last chunk ever changes
+  length, so no chunk moves once made.
+*/
+
+/* A Rope_T is a run of bytes kept in chunks */
+typedef struct rope *Rope_T;
+
+/*
+  Creates a new rope holding the ulLength bytes at pvBytes, a block
+  from malloc that the rope then owns, without copying them, or an
+  empty rope if ulLength is 0, when pvBytes must be NULL. Returns
+  SUCCESS and sets *poRResult to the rope, or sets *poRResult to NULL
+  and returns MEMORY_ERROR if memory could not be allocated, in which
+  case the block is still the caller's.
+*/
+int Rope_new(void *pvBytes, size_t ulLength, Rope_T *poRResult);
+
+/* Frees oRRope and all the bytes it holds. */
+void Rope_free(Rope_T oRRope);
+
+/* Returns the number of bytes that oRRope holds. */
+size_t Rope_getLength(Rope_T oRRope);
+
+/* Returns the number of bytes of memory that oRRope's chunks take up,
+   counting the room left in the last for bytes appended later. */
+size_t Rope_getCapacity(Rope_T oRRope);
+
+/*
+  Copies the ulLength bytes of oRRope from offset ulOffset into
+  pvBuffer. They must all be within oRRope.
+*/
+void Rope_read(Rope_T oRRope, size_t ulOffset, size_t ulLength,
+               void *pvBuffer);
+
+/*
+  Sets *ppvBytes and *pulLength to the bytes of the chunk of oRRope
+  with index ulIndex, the chunks being numbered from 0 in order, and
+  returns TRUE, or returns FALSE if oRRope has no such chunk. Every
+  chunk holds at least one byte. The bytes are valid until oRRope is
+  next changed.
+*/
+boolean Rope_getChunk(Rope_T oRRope, size_t ulIndex,
+                      const void **ppvBytes, size_t *pulLength);
+
+/*
+  Writes the ulLength bytes at pvBytes over those of oRRope from
+  offset ulOffset, extending oRRope as needed, and filling any gap
+  between its end and ulOffset with zeros. Returns SUCCESS, or
+  MEMORY_ERROR if memory could not be allocated, in which case oRRope
+  is unchanged.
+*/
+int Rope_write(Rope_T oRRope, size_t ulOffset, const void *pvBytes,
+               size_t ulLength);
+
+/*
+  Makes oRRope ulLength bytes long, dropping the bytes past ulLength,
+  or adding zeros to its end. Returns SUCCESS, or MEMORY_ERROR if
+  memory could not be allocated, in which case oRRope is unchanged.
+*/
+int Rope_truncate(Rope_T oRRope, size_t ulLength);
+
+/*
+  Frees oRRope, setting *ppvBytes to a block from malloc holding its
+  bytes, which the caller then owns, or to NULL if it held none. A
+  rope of one chunk hands that chunk over, so nothing is copied.
+  Returns SUCCESS, or MEMORY_ERROR if memory could not be allocated,
+  in which case *ppvBytes is NULL and oRRope is not freed.
+*/
+int Rope_take(Rope_T oRRope, void **ppvBytes);
+
+#endif
@@ -0,0 +1,287 @@
+/*--------------------------------------------------------------------*/
+/* spill.c                                                            */
+/* Author: Christopher Moretti                                        */
+/*--------------------------------------------------------------------*/
+
+/* pread and pwrite are POSIX.1-2008 interfaces */
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#include "spill.h"
+
+/*
+  The spill file is an abstract object with 5 state variables:
+*/
+
+/* 1. the spill file's descriptor, and the budget in bytes, 0 if
+      nothing is ever spilled */
+static int iSpillFd = -1;
+static size_t ulBudget;
+/* 2. the number of bytes of the spill file set aside so far */
+static size_t ulEnd;
+/* 3. the counted units, from the most recently used to the least */
+static struct Spill_Unit *psWarmest;
+static struct Spill_Unit *psColdest;
+/* 4. the bytes of memory those in memory take up, and the bytes of
+      those only in the file */
+static size_t ulResident;
+static size_t ulSpilled;
+/* 5. the counts that Spill_getStats reports */
+static size_t ulHits;
+static size_t ulFaults;
+static size_t ulSpills;
+static size_t ulBytesWritten;
+static size_t ulBytesRead;
+
+
+/* Links psUnit, which is not linked, in as the most recently used. */
+static void Spill_linkWarmest(struct Spill_Unit *psUnit) {
+   assert(psUnit != NULL);
+
+   psUnit->psWarmer = NULL;
+   psUnit->psColder = psWarmest;
+   if(psWarmest != NULL)
+      psWarmest->psWarmer = psUnit;
+   else
+      psColdest = psUnit;
+   psWarmest = psUnit;
+}
+
+/* Unlinks psUnit, which is counted, from the others. */
+static void Spill_unlink(struct Spill_Unit *psUnit) {
+   assert(psUnit != NULL);
+   assert(psUnit->bIsCounted);
+
+   if(psUnit->psWarmer != NULL)
+      psUnit->psWarmer->psColder = psUnit->psColder;
+   else
+      psWarmest = psUnit->psColder;
+   if(psUnit->psColder != NULL)
+      psUnit->psColder->psWarmer = psUnit->psWarmer;
+   else
+      psColdest = psUnit->psWarmer;
+   psUnit->psWarmer = NULL;
+   psUnit->psColder = NULL;
+}
+
+/*
+  Has the holder of counted unit psUnit write its bytes to their place
+  in the spill file, unless they are there already, and free them.
+  Returns SUCCESS, or IO_ERROR if they could not be written, in which
+  case they stay in memory.
+*/
+static int Spill_evict(struct Spill_Unit *psUnit) {
+   size_t ulSlot;
+
+   assert(psUnit != NULL);
+   assert(psUnit->bIsCounted);
+
+   if(!psUnit->bHasSlot || !psUnit->bIsClean) {
+      ulSlot = psUnit->bHasSlot ? psUnit->ulSlot : ulEnd;
+      if(psUnit->psOps->pfWrite(psUnit->pvHolder, ulSlot) != SUCCESS)
+         return IO_ERROR;
+      if(!psUnit->bHasSlot)
+         ulEnd += psUnit->ulLength;
+      psUnit->ulSlot = ulSlot;
+      psUnit->bHasSlot = TRUE;
+      psUnit->bIsClean = TRUE;
+   }
+
+   Spill_unlink(psUnit);
+   psUnit->bIsCounted = FALSE;
+   ulResident -= psUnit->ulMemory;
+   psUnit->psOps->pfDrop(psUnit->pvHolder);
+   psUnit->bIsSpilled = TRUE;
+   ulSpilled += psUnit->ulLength;
+   ulSpills++;
+   return SUCCESS;
+}
+
+/*
+  Reads ulLength bytes from the spill file from offset ulOffset into
+  pvBuffer, counting them as read back. Returns SUCCESS, or IO_ERROR
+  if they could not all be read.
+*/
+static int Spill_pread(void *pvBuffer, size_t ulOffset,
+                       size_t ulLength) {
+   char *pcNext = pvBuffer;
+   ssize_t lRead;
+
+   ulFaults++;
+   while(ulLength > 0) {
+      lRead = pread(iSpillFd, pcNext, ulLength, (off_t) ulOffset);
+      if(lRead < 0 && errno == EINTR)
+         continue;
+      if(lRead <= 0)
+         return IO_ERROR;
+      pcNext += lRead;
+      ulOffset += (size_t) lRead;
+      ulLength -= (size_t) lRead;
+      ulBytesRead += (size_t) lRead;
+   }
+   return SUCCESS;
+}
+
+
+void Spill_setBudget(int iFd, size_t ulNewBudget) {
+   assert(psWarmest == NULL && ulSpilled == 0);
+   assert(iFd >= 0 || ulNewBudget == 0);
+
+   iSpillFd = iFd;
+   ulBudget = ulNewBudget;
+   ulEnd = 0;
+   ulResident = 0;
+   ulHits = 0;
+   ulFaults = 0;
+   ulSpills = 0;
+   ulBytesWritten = 0;
+   ulBytesRead = 0;
+}
+
+void Spill_getStats(size_t *pulHits, size_t *pulFaults,
+                    size_t *pulSpills, size_t *pulBytesWritten,
+                    size_t *pulBytesRead, size_t *pulResident,
+                    size_t *pulSpilled) {
+   assert(pulHits != NULL);
+   assert(pulFaults != NULL);
+   assert(pulSpills != NULL);
+   assert(pulBytesWritten != NULL);
+   assert(pulBytesRead != NULL);
+   assert(pulResident != NULL);
+   assert(pulSpilled != NULL);
+
+   *pulHits = ulHits;
+   *pulFaults = ulFaults;
+   *pulSpills = ulSpills;
+   *pulBytesWritten = ulBytesWritten;
+   *pulBytesRead = ulBytesRead;
+   *pulResident = ulResident;
+   *pulSpilled = ulSpilled;
+}
+
+void Spill_initUnit(struct Spill_Unit *psUnit,
+                    const struct Spill_Ops *psOps, void *pvHolder) {
+   assert(psUnit != NULL);
+   assert(psOps != NULL);
+
+   psUnit->psOps = psOps;
+   psUnit->pvHolder = pvHolder;
+   psUnit->bIsCounted = FALSE;
+   psUnit->psWarmer = NULL;
+   psUnit->psColder = NULL;
+   psUnit->ulLength = 0;
+   psUnit->ulMemory = 0;
+   psUnit->bIsSpilled = FALSE;
+   psUnit->bHasSlot = FALSE;
+   psUnit->bIsClean = FALSE;
+   psUnit->ulSlot = 0;
+}
+
+void Spill_count(struct Spill_Unit *psUnit, size_t ulLength,
+                 size_t ulMemory) {
+   assert(psUnit != NULL);
+   assert(!psUnit->bIsSpilled);
+
+   if(ulBudget == 0 || ulMemory == 0 || psUnit->bIsCounted)
+      return;
+   /* a place set aside for bytes of another length cannot hold them */
+   if(psUnit->bHasSlot && psUnit->ulLength != ulLength)
+      psUnit->bHasSlot = FALSE;
+   psUnit->ulLength = ulLength;
+   psUnit->ulMemory = ulMemory;
+   Spill_linkWarmest(psUnit);
+   psUnit->bIsCounted = TRUE;
+   ulResident += ulMemory;
+
+   while(ulResident > ulBudget && psColdest != psUnit)
+      if(Spill_evict(psColdest) != SUCCESS)
+         return;
+}
+
+void Spill_use(struct Spill_Unit *psUnit) {
+   assert(psUnit != NULL);
+
+   if(!psUnit->bIsCounted)
+      return;
+   ulHits++;
+   Spill_unlink(psUnit);
+   Spill_linkWarmest(psUnit);
+}
+
+void Spill_forget(struct Spill_Unit *psUnit) {
+   assert(psUnit != NULL);
+
+   if(psUnit->bIsCounted) {
+      Spill_unlink(psUnit);
+      psUnit->bIsCounted = FALSE;
+      ulResident -= psUnit->ulMemory;
+   }
+   if(psUnit->bIsSpilled) {
+      psUnit->bIsSpilled = FALSE;
+      ulSpilled -= psUnit->ulLength;
+   }
+   psUnit->bHasSlot = FALSE;
+}
+
+void Spill_dirty(struct Spill_Unit *psUnit) {
+   assert(psUnit != NULL);
+
+   psUnit->bIsClean = FALSE;
+}
+
+boolean Spill_isSpilled(struct Spill_Unit *psUnit) {
+   assert(psUnit != NULL);
+
+   return psUnit->bIsSpilled;
+}
+
+int Spill_read(struct Spill_Unit *psUnit, size_t ulOffset,
+               size_t ulLength, void *pvBuffer) {
+   assert(psUnit != NULL);
+   assert(psUnit->bIsSpilled);
+   assert(ulOffset <= psUnit->ulLength &&
+          ulLength <= psUnit->ulLength - ulOffset);
+   assert(pvBuffer != NULL || ulLength == 0);
+
+   return Spill_pread(pvBuffer, psUnit->ulSlot + ulOffset, ulLength);
+}
+
+int Spill_load(struct Spill_Unit *psUnit, void *pvBuffer) {
+   assert(psUnit != NULL);
+   assert(psUnit->bIsSpilled);
+
+   if(Spill_pread(pvBuffer, psUnit->ulSlot, psUnit->ulLength) !=
+      SUCCESS)
+      return IO_ERROR;
+   psUnit->bIsSpilled = FALSE;
+   ulSpilled -= psUnit->ulLength;
+   psUnit->bIsClean = TRUE;
+   /* the bytes come back contiguous, whatever held them before */
+   Spill_count(psUnit, psUnit->ulLength, psUnit->ulLength);
+   return SUCCESS;
+}
+
+int Spill_write(const void *pvBytes, size_t ulOffset,
+                size_t ulLength) {
+   const char *pcNext = pvBytes;
+   ssize_t lWritten;
+
+   assert(pvBytes != NULL || ulLength == 0);
+
+   while(ulLength > 0) {
+      lWritten = pwrite(iSpillFd, pcNext, ulLength, (off_t) ulOffset);
+      if(lWritten < 0 && errno == EINTR)
+         continue;
+      if(lWritten <= 0)
+         return IO_ERROR;
+      pcNext += lWritten;
+      ulOffset += (size_t) lWritten;
+      ulLength -= (size_t) lWritten;
+      ulBytesWritten += (size_t) lWritten;
+   }
+   return SUCCESS;
+}
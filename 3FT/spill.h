@@ -0,0 +1,140 @@
+/*--------------------------------------------------------------------*/
+/* spill.h                                                            */
+/* Author: Christopher Moretti                                        */
+/*--------------------------------------------------------------------*/
+
+#ifndef SPILL_INCLUDED
+#define SPILL_INCLUDED
+
+#include <stddef.h>
+#include "a4def.h"
+
+/*
+  The spill file keeps the contents that an FT holds in memory of its
+  own within a budget. Each run of those bytes is a unit, embedded in
+  whatever holds them: a file's own contents, contiguous or in a
+  rope, or a blob, which is one unit however many files share it.
+  Units are kept in the order they were last used, and whenever those
+  in memory come to more than the budget, the least recently used are
+  written to places of their own in the spill file and freed by their
+  holders. The spill file is an abstract object; FT_CONCURRENT builds
+  never give it a budget, so never change it.
+*/
+
+/* What the holder of a unit does for the spill file */
+struct Spill_Ops {
+   /* writes the holder pvHolder's bytes to the spill file from offset
+      ulSlot, with Spill_write, returning SUCCESS or IO_ERROR */
+   int (*pfWrite)(void *pvHolder, size_t ulSlot);
+   /* frees the holder pvHolder's bytes, now only in the spill file */
+   void (*pfDrop)(void *pvHolder);
+};
+
+/* A run of bytes that its holder embeds and sets up with
+   Spill_initUnit, whose fields only spill.c uses */
+struct Spill_Unit {
+   /* the holder and what it does */
+   const struct Spill_Ops *psOps;
+   void *pvHolder;
+   /* TRUE if the bytes are in memory and counted against the budget,
+      linked between the units used more recently, psWarmer, and
+      less, psColder */
+   boolean bIsCounted;
+   struct Spill_Unit *psWarmer;
+   struct Spill_Unit *psColder;
+   /* the number of bytes, and of bytes of memory they take up */
+   size_t ulLength;
+   size_t ulMemory;
+   /* TRUE if the bytes are only in the spill file */
+   boolean bIsSpilled;
+   /* TRUE if the place at offset ulSlot in the spill file is set
+      aside for the bytes, and bIsClean if they are there as they are
+      in memory */
+   boolean bHasSlot;
+   boolean bIsClean;
+   size_t ulSlot;
+};
+
+/*
+  Makes ulBudget the most bytes of memory that units in memory take
+  up, with those beyond it written to the spill file open on iFd and
+  freed; a budget of 0 counts nothing and ignores iFd. There must be
+  no units counted or spilled, and the counts that Spill_getStats
+  reports start again from 0.
+*/
+void Spill_setBudget(int iFd, size_t ulBudget);
+
+/*
+  Stores in *pulHits and *pulFaults the number of uses of counted
+  units that found them in memory and that read them from the spill
+  file, in *pulSpills the number of times units were spilled, in
+  *pulBytesWritten and *pulBytesRead the bytes written to and read
+  from the spill file, and in *pulResident and *pulSpilled the bytes
+  of memory that counted units now take up and the bytes of those
+  now only in the spill file.
+*/
+void Spill_getStats(size_t *pulHits, size_t *pulFaults,
+                    size_t *pulSpills, size_t *pulBytesWritten,
+                    size_t *pulBytesRead, size_t *pulResident,
+                    size_t *pulSpilled);
+
+/* Sets up psUnit, uncounted and in memory, for holder pvHolder, which
+   does as psOps says. */
+void Spill_initUnit(struct Spill_Unit *psUnit,
+                    const struct Spill_Ops *psOps, void *pvHolder);
+
+/*
+  Counts psUnit's ulLength bytes, which take up ulMemory bytes of
+  memory, against the budget as the most recently used, if there is a
+  budget and ulMemory is not 0 and psUnit is not counted yet, then
+  spills the least recently used others until those counted fit the
+  budget again. Spilling stops early, leaving them over the budget,
+  if the spill file cannot be written.
+*/
+void Spill_count(struct Spill_Unit *psUnit, size_t ulLength,
+                 size_t ulMemory);
+
+/* Marks psUnit, if it is counted, as the most recently used. */
+void Spill_use(struct Spill_Unit *psUnit);
+
+/*
+  Stops counting psUnit against the budget, in memory or in the spill
+  file, and gives up its place there, as its bytes are no longer its
+  holder's or are about to change.
+*/
+void Spill_forget(struct Spill_Unit *psUnit);
+
+/* Notes that psUnit's bytes in memory may have been changed, so must
+   be written again if it is spilled. */
+void Spill_dirty(struct Spill_Unit *psUnit);
+
+/* Returns TRUE if psUnit's bytes are only in the spill file, and
+   FALSE otherwise. */
+boolean Spill_isSpilled(struct Spill_Unit *psUnit);
+
+/*
+  Copies the ulLength bytes of spilled unit psUnit from offset
+  ulOffset, which must all be within it, from the spill file into
+  pvBuffer, leaving it spilled. Returns SUCCESS, or IO_ERROR if they
+  could not all be read.
+*/
+int Spill_read(struct Spill_Unit *psUnit, size_t ulOffset,
+               size_t ulLength, void *pvBuffer);
+
+/*
+  Reads all the bytes of spilled unit psUnit back from the spill file
+  into pvBuffer, which its holder then keeps them in, and counts them
+  as Spill_count does, which may spill others. Returns SUCCESS, or
+  IO_ERROR if they could not all be read, in which case psUnit stays
+  spilled.
+*/
+int Spill_load(struct Spill_Unit *psUnit, void *pvBuffer);
+
+/*
+  Writes the ulLength bytes at pvBytes to the spill file from offset
+  ulOffset, for a holder's pfWrite. Returns SUCCESS, or IO_ERROR if
+  they could not all be written.
+*/
+int Spill_write(const void *pvBytes, size_t ulOffset, size_t ulLength);
+
+#endif
@@ -0,0 +1,852 @@
+/*--------------------------------------------------------------------*/
+/* tar.c                                                              */
+/* Author: Christopher Moretti                                        */
+/*--------------------------------------------------------------------*/
+
+/* read and ssize_t are POSIX.1-2008 interfaces */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stddef.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#include "dynarray.h"
+#include "path.h"
+#include "blob.h"
+#include "mapping.h"
+#include "alloc.h"
+#include "tar.h"
+
+/* The zeros that end an archive */
+static const unsigned char aucZeros[TAR_BLOCK];
+
+/* Locks oNNode, which FT_CONCURRENT builds do before Node_free */
+#ifdef FT_CONCURRENT
+#define Tar_lock(oNNode) Node_lock(oNNode)
+#else
+#define Tar_lock(oNNode) ((void) 0)
+#endif
+
+/* The largest size an entry may have, so that with its padding it
+   still fits a size_t */
+#define TAR_MAX_SIZE ((size_t) -1 - TAR_BLOCK)
+
+/* The bytes of room that a block for a body read as it comes starts
+   with, before it doubles */
+enum {TAR_FIRST_ROOM = 16 * TAR_BLOCK};
+
+/* An archive being read into an FT by Tar_import */
+struct Tar_In {
+   /* the FT's root, or NULL, and how its new files keep contents */
+   Node_T *poNRoot;
+   const struct Import_Storage *psStorage;
+   /* the file descriptor the archive is read from if not mapped */
+   int iFd;
+   /* the mapped archive, or NULL, and how far into it has been read */
+   Mapping_T oMMapping;
+   size_t ulOffset;
+   /* the block read last if the archive is not mapped */
+   unsigned char aucBlock[TAR_BLOCK];
+   /* the pathname that a pax or GNU header gave for the next entry,
+      in a block of ulLongBytes bytes from Alloc_malloc, or NULL */
+   char *pcLong;
+   size_t ulLongBytes;
+   /* the size that a pax header gave for the next entry, if
+      bHasSize */
+   size_t ulSize;
+   boolean bHasSize;
+   /* the directory that the last entry went in or was, or NULL */
+   Node_T oNLast;
+   /* the nodes made so far, in the order they were made, so that a
+      failed import can free them all */
+   DynArray_T oDMade;
+};
+
+/* Returns the number of bytes of padding after an entry's body of
+   ulLength bytes, which fill out the block it ends in. */
+static size_t Tar_pad(size_t ulLength) {
+   return (TAR_BLOCK - ulLength % TAR_BLOCK) % TAR_BLOCK;
+}
+
+/*
+  Sets *ppucBytes to the next ulLength bytes of archive psIn: those in
+  the mapping, if it is mapped, or otherwise those read into
+  pucBuffer, which must have room for them. Sets *pbEnd, if pbEnd is
+  not NULL, to whether the archive ended before them. Returns
+  SUCCESS, BAD_FORMAT if the archive ends partway through them, or
+  IO_ERROR if reading fails.
+*/
+static int Tar_read(struct Tar_In *psIn, size_t ulLength,
+                    unsigned char *pucBuffer,
+                    const unsigned char **ppucBytes,
+                    boolean *pbEnd) {
+   size_t ulRead = 0;
+
+   assert(psIn != NULL);
+   assert(ppucBytes != NULL);
+
+   if(pbEnd != NULL)
+      *pbEnd = FALSE;
+   if(psIn->oMMapping != NULL) {
+      size_t ulLeft = Mapping_getLength(psIn->oMMapping) -
+                      psIn->ulOffset;
+      if(ulLeft == 0 && pbEnd != NULL) {
+         *pbEnd = TRUE;
+         return SUCCESS;
+      }
+      if(ulLength > ulLeft)
+         return BAD_FORMAT;
+      *ppucBytes = (unsigned char *) Mapping_getBytes(psIn->oMMapping) +
+                   psIn->ulOffset;
+      psIn->ulOffset += ulLength;
+      return SUCCESS;
+   }
+
+   assert(pucBuffer != NULL || ulLength == 0);
+   while(ulRead < ulLength) {
+      ssize_t lRead = read(psIn->iFd, pucBuffer + ulRead,
+                           ulLength - ulRead);
+      if(lRead < 0 && errno == EINTR)
+         continue;
+      if(lRead < 0)
+         return IO_ERROR;
+      if(lRead == 0) {
+         if(ulRead == 0 && pbEnd != NULL) {
+            *pbEnd = TRUE;
+            return SUCCESS;
+         }
+         return BAD_FORMAT;
+      }
+      ulRead += (size_t) lRead;
+   }
+   *ppucBytes = pucBuffer;
+   return SUCCESS;
+}
+
+/* Passes over the next ulLength bytes of archive psIn. Returns as
+   Tar_read does. */
+static int Tar_skip(struct Tar_In *psIn, size_t ulLength) {
+   const unsigned char *pucBytes;
+   size_t ulChunk;
+   int iStatus;
+
+   assert(psIn != NULL);
+
+   if(psIn->oMMapping != NULL)
+      return Tar_read(psIn, ulLength, NULL, &pucBytes, NULL);
+   for(; ulLength > 0; ulLength -= ulChunk) {
+      ulChunk = ulLength < TAR_BLOCK ? ulLength : TAR_BLOCK;
+      iStatus = Tar_read(psIn, ulChunk, psIn->aucBlock, &pucBytes,
+                         NULL);
+      if(iStatus != SUCCESS)
+         return iStatus;
+   }
+   return SUCCESS;
+}
+
+/*
+  Reads the next ulLength bytes of archive psIn, which is not mapped,
+  into a new block of ulLength + ulExtra bytes at *ppucBlock, from
+  Alloc_malloc if bCounted and from malloc otherwise, or NULL if that
+  is 0. The size that a header gives is not trusted: the block starts
+  small and doubles as the bytes arrive, so an archive that ends
+  early fails before it takes much more memory than it holds. Returns
+  SUCCESS, MEMORY_ERROR if memory could not be allocated, or as
+  Tar_read does, in which cases *ppucBlock is NULL.
+*/
+static int Tar_stream(struct Tar_In *psIn, size_t ulLength,
+                      size_t ulExtra, boolean bCounted,
+                      unsigned char **ppucBlock) {
+   const unsigned char *pucBytes;
+   unsigned char *pucBlock = NULL;
+   unsigned char *pucNew;
+   size_t ulRoom = 0;
+   size_t ulNewRoom;
+   size_t ulRead = 0;
+   int iStatus = SUCCESS;
+
+   assert(psIn != NULL);
+   assert(psIn->oMMapping == NULL);
+   assert(ulLength <= TAR_MAX_SIZE && ulExtra <= TAR_BLOCK);
+   assert(ppucBlock != NULL);
+
+   *ppucBlock = NULL;
+   if(ulLength + ulExtra == 0)
+      return SUCCESS;
+   do {
+      if(ulRead == ulRoom) {
+         if(ulRoom == 0)
+            ulNewRoom = ulLength < TAR_FIRST_ROOM ?
+                        ulLength : TAR_FIRST_ROOM;
+         else
+            ulNewRoom = ulLength - ulRoom < ulRoom ?
+                        ulLength : 2 * ulRoom;
+         pucNew = bCounted ?
+                  Alloc_realloc(ALLOC_TREE_IMPORT, pucBlock,
+                                pucBlock == NULL ? 0 : ulRoom + ulExtra,
+                                ulNewRoom + ulExtra) :
+                  realloc(pucBlock, ulNewRoom + ulExtra);
+         if(pucNew == NULL) {
+            iStatus = MEMORY_ERROR;
+            break;
+         }
+         pucBlock = pucNew;
+         ulRoom = ulNewRoom;
+      }
+      iStatus = Tar_read(psIn, ulRoom - ulRead, pucBlock + ulRead,
+                         &pucBytes, NULL);
+      ulRead = ulRoom;
+   } while(iStatus == SUCCESS && ulRead < ulLength);
+
+   if(iStatus != SUCCESS) {
+      if(bCounted)
+         Alloc_free(ALLOC_TREE_IMPORT, pucBlock,
+                    pucBlock == NULL ? 0 : ulRoom + ulExtra);
+      else
+         free(pucBlock);
+      return iStatus;
+   }
+   *ppucBlock = pucBlock;
+   return SUCCESS;
+}
+
+/*
+  Reads the body of ulLength bytes of the entry next in archive psIn,
+  and its padding, into a new block of ulLength + 1 bytes from
+  Alloc_malloc at *ppcBody, with a '\0' after them. The body must be
+  in the archive before the block is allocated, or, if the archive is
+  read as it comes, as it grows. Returns SUCCESS, MEMORY_ERROR if
+  memory could not be allocated, or as Tar_read does, in which cases
+  *ppcBody is NULL.
+*/
+static int Tar_body(struct Tar_In *psIn, size_t ulLength,
+                    char **ppcBody) {
+   const unsigned char *pucBytes = NULL;
+   unsigned char *pucBody = NULL;
+   int iStatus;
+
+   assert(psIn != NULL);
+   assert(ulLength <= TAR_MAX_SIZE);
+   assert(ppcBody != NULL);
+
+   *ppcBody = NULL;
+   if(psIn->oMMapping != NULL)
+      iStatus = Tar_read(psIn, ulLength, NULL, &pucBytes, NULL);
+   else
+      iStatus = Tar_stream(psIn, ulLength, 1, TRUE, &pucBody);
+   if(iStatus == SUCCESS)
+      iStatus = Tar_skip(psIn, Tar_pad(ulLength));
+   if(iStatus == SUCCESS && pucBody == NULL) {
+      pucBody = Alloc_malloc(ALLOC_TREE_IMPORT, ulLength + 1);
+      if(pucBody == NULL)
+         return MEMORY_ERROR;
+      memcpy(pucBody, pucBytes, ulLength);
+   }
+   if(iStatus != SUCCESS) {
+      Alloc_free(ALLOC_TREE_IMPORT, pucBody, ulLength + 1);
+      return iStatus;
+   }
+   pucBody[ulLength] = '\0';
+   *ppcBody = (char *) pucBody;
+   return SUCCESS;
+}
+
+/* Forgets the pathname and size that pax or GNU headers gave archive
+   psIn for its next entry. */
+static void Tar_forget(struct Tar_In *psIn) {
+   assert(psIn != NULL);
+
+   Alloc_free(ALLOC_TREE_IMPORT, psIn->pcLong, psIn->ulLongBytes);
+   psIn->pcLong = NULL;
+   psIn->ulLongBytes = 0;
+   psIn->bHasSize = FALSE;
+}
+
+/*
+  Reads into *pulValue the number in the ulWidth bytes of tar header
+  field pucField: octal digits, perhaps after spaces and ended by a
+  space or '\0', or, if the field's first byte has its high bit set,
+  a binary number in the rest of it, as GNU tar writes large sizes.
+  Returns FALSE if the field holds no such number, or one larger than
+  TAR_MAX_SIZE.
+*/
+static boolean Tar_number(const unsigned char *pucField,
+                          size_t ulWidth, size_t *pulValue) {
+   size_t ulValue = 0;
+   size_t i = 0;
+
+   assert(pucField != NULL);
+   assert(pulValue != NULL);
+
+   if(pucField[0] & 0x80) {
+      for(i = 1; i < ulWidth; i++) {
+         if(ulValue > TAR_MAX_SIZE >> 8)
+            return FALSE;
+         ulValue = (ulValue << 8) | pucField[i];
+      }
+   }
+   else {
+      while(i < ulWidth && pucField[i] == ' ')
+         i++;
+      if(i == ulWidth || pucField[i] < '0' || pucField[i] > '7')
+         return FALSE;
+      for(; i < ulWidth && pucField[i] >= '0' && pucField[i] <= '7';
+          i++) {
+         if(ulValue > TAR_MAX_SIZE >> 3)
+            return FALSE;
+         ulValue = (ulValue << 3) | (size_t) (pucField[i] - '0');
+      }
+      if(i < ulWidth && pucField[i] != ' ' && pucField[i] != '\0')
+         return FALSE;
+   }
+   if(ulValue > TAR_MAX_SIZE)
+      return FALSE;
+   *pulValue = ulValue;
+   return TRUE;
+}
+
+/*
+  Returns TRUE if pucHeader is a ustar header, as POSIX or GNU tar
+  writes one, whose checksum is right, and FALSE otherwise.
+*/
+static boolean Tar_isHeader(const unsigned char *pucHeader) {
+   size_t ulSum = 0;
+   size_t ulChecksum;
+   size_t i;
+
+   assert(pucHeader != NULL);
+
+   if(memcmp(pucHeader + TAR_MAGIC, "ustar", 5) != 0 ||
+      !Tar_number(pucHeader + TAR_CHKSUM, 8, &ulChecksum))
+      return FALSE;
+   /* the checksum is summed as if its own field were spaces */
+   for(i = 0; i < TAR_BLOCK; i++)
+      ulSum += (i >= TAR_CHKSUM && i < TAR_CHKSUM + 8) ?
+               (size_t) ' ' : pucHeader[i];
+   return (boolean) (ulSum == ulChecksum);
+}
+
+/*
+  Keeps, for the next entry of archive psIn, the pathname and size in
+  the ulLength bytes of pax extended header records at pcRecords,
+  ignoring other keys. Returns SUCCESS, BAD_FORMAT if the records are
+  malformed, or MEMORY_ERROR if memory could not be allocated.
+*/
+static int Tar_pax(struct Tar_In *psIn, const char *pcRecords,
+                   size_t ulLength) {
+   const char *pcEnd = pcRecords + ulLength;
+   const char *pcRecord;
+   const char *pcKey;
+   const char *pcValue;
+   size_t ulRecord;
+   size_t ulValue;
+
+   assert(psIn != NULL);
+   assert(pcRecords != NULL);
+
+   /* each record is its length in decimal, counting itself, a space,
+      the key, '=', the value and a newline */
+   for(pcRecord = pcRecords; pcRecord < pcEnd; pcRecord += ulRecord) {
+      ulRecord = 0;
+      for(pcKey = pcRecord; pcKey < pcEnd && *pcKey >= '0' &&
+                            *pcKey <= '9'; pcKey++) {
+         if(ulRecord > ulLength)
+            return BAD_FORMAT;
+         ulRecord = 10 * ulRecord + (size_t) (*pcKey - '0');
+      }
+      if(pcKey == pcRecord || pcKey == pcEnd || *pcKey != ' ' ||
+         ulRecord < (size_t) (pcKey - pcRecord) + 3 ||
+         ulRecord > (size_t) (pcEnd - pcRecord) ||
+         pcRecord[ulRecord - 1] != '\n')
+         return BAD_FORMAT;
+      pcKey++;
+      for(pcValue = pcKey; pcValue < pcRecord + ulRecord - 1 &&
+                           *pcValue != '='; pcValue++)
+         ;
+      if(pcValue == pcRecord + ulRecord - 1)
+         return BAD_FORMAT;
+      ulValue = (size_t) (pcRecord + ulRecord - 1 - ++pcValue);
+
+      if(pcValue - pcKey == 5 && !strncmp(pcKey, "path=", 5)) {
+         Alloc_free(ALLOC_TREE_IMPORT, psIn->pcLong, psIn->ulLongBytes);
+         psIn->ulLongBytes = 0;
+         psIn->pcLong = Alloc_malloc(ALLOC_TREE_IMPORT, ulValue + 1);
+         if(psIn->pcLong == NULL)
+            return MEMORY_ERROR;
+         psIn->ulLongBytes = ulValue + 1;
+         memcpy(psIn->pcLong, pcValue, ulValue);
+         psIn->pcLong[ulValue] = '\0';
+      }
+      else if(pcValue - pcKey == 5 && !strncmp(pcKey, "size=", 5)) {
+         size_t i;
+         psIn->ulSize = 0;
+         for(i = 0; i < ulValue; i++) {
+            if(pcValue[i] < '0' || pcValue[i] > '9' ||
+               psIn->ulSize > (TAR_MAX_SIZE - 9) / 10)
+               return BAD_FORMAT;
+            psIn->ulSize = 10 * psIn->ulSize +
+                           (size_t) (pcValue[i] - '0');
+         }
+         psIn->bHasSize = (boolean) (ulValue > 0);
+      }
+   }
+   return SUCCESS;
+}
+
+/*
+  Makes a new directory, or file with no contents if bIsFile, with
+  path oPPath beneath oNParent, or as the root if oNParent is NULL,
+  for archive psIn, counting it in *psStats. Returns SUCCESS and sets
+  *poNResult to it, or returns MEMORY_ERROR if memory could not be
+  allocated.
+*/
+static int Tar_make(struct Tar_In *psIn, Path_T oPPath,
+                    Node_T oNParent, boolean bIsFile,
+                    struct FT_ImportStats *psStats,
+                    Node_T *poNResult) {
+   Node_T oNNew = NULL;
+   int iStatus;
+
+   assert(psIn != NULL);
+   assert(oPPath != NULL);
+   assert(psStats != NULL);
+   assert(poNResult != NULL);
+
+   iStatus = Node_new(oPPath, oNParent, bIsFile, NULL, 0,
+                      psIn->psStorage->ulRoom, &oNNew);
+   if(iStatus != SUCCESS)
+      return iStatus;
+   if(!DynArray_add(psIn->oDMade, oNNew)) {
+      Tar_lock(oNNew);
+      (void) Node_free(oNNew);
+      return MEMORY_ERROR;
+   }
+   if(oNParent == NULL)
+      *psIn->poNRoot = oNNew;
+   if(bIsFile)
+      psStats->ulFiles++;
+   else
+      psStats->ulDirs++;
+   *poNResult = oNNew;
+   return SUCCESS;
+}
+
+/*
+  Finds the directory that is to be the parent of the node with path
+  oPPath, of depth at least 2, for archive psIn, making it and any of
+  its ancestors that are missing as Tar_make does. The directory
+  the last entry went in is tried first; otherwise the FT is walked
+  down from the root. Returns SUCCESS and sets *poNResult to the
+  parent, or returns:
+  * CONFLICTING_PATH if the root is not a prefix of oPPath
+  * NOT_A_DIRECTORY if a proper prefix of oPPath is a file
+  * MEMORY_ERROR if memory could not be allocated
+*/
+static int Tar_parent(struct Tar_In *psIn, Path_T oPPath,
+                      struct FT_ImportStats *psStats,
+                      Node_T *poNResult) {
+   Node_T oNRoot;
+   Path_T oPPrefix = NULL;
+   Path_T oPLast;
+   Node_T oNCurr;
+   Node_T oNChild = NULL;
+   size_t ulDepth;
+   size_t ulChildID;
+   size_t i;
+   int iStatus = SUCCESS;
+
+   assert(psIn != NULL);
+   assert(oPPath != NULL);
+   assert(poNResult != NULL);
+
+   oNRoot = *psIn->poNRoot;
+   ulDepth = Path_getDepth(oPPath);
+   assert(ulDepth > 1);
+   if(psIn->oNLast != NULL) {
+      oPLast = Node_getPath(psIn->oNLast);
+      if(oPLast == NULL)
+         return MEMORY_ERROR;
+      if(Path_getDepth(oPLast) == ulDepth - 1 &&
+         Path_getSharedPrefixDepth(oPLast, oPPath) == ulDepth - 1) {
+         *poNResult = psIn->oNLast;
+         return SUCCESS;
+      }
+   }
+
+   /* the root is made, or checked, like any other level */
+   oNCurr = NULL;
+   for(i = 1; i < ulDepth && iStatus == SUCCESS; i++) {
+      iStatus = Path_prefix(oPPath, i, &oPPrefix);
+      if(iStatus != SUCCESS)
+         break;
+      if(oNCurr == NULL && oNRoot != NULL) {
+         if(Path_comparePath(Node_getPath(oNRoot), oPPrefix))
+            iStatus = CONFLICTING_PATH;
+         oNCurr = oNRoot;
+      }
+      else if(oNCurr != NULL &&
+              Node_hasChild(oNCurr, oPPrefix, &ulChildID)) {
+         iStatus = Node_getChild(oNCurr, ulChildID, &oNChild);
+         if(iStatus == SUCCESS && Node_getPath(oNChild) == NULL)
+            iStatus = MEMORY_ERROR;
+         else if(iStatus == SUCCESS && Node_isFile(oNChild))
+            iStatus = NOT_A_DIRECTORY;
+         oNCurr = oNChild;
+      }
+      else
+         iStatus = Tar_make(psIn, oPPrefix, oNCurr, FALSE, psStats,
+                            &oNCurr);
+      Path_free(oPPrefix);
+   }
+   if(iStatus != SUCCESS)
+      return iStatus;
+   *poNResult = oNCurr;
+   return SUCCESS;
+}
+
+/*
+  Adds the contents of the file entry next in archive psIn, ulLength
+  bytes, and the padding after them, to new file oNFile, counting
+  them in *psStats. In a mapped archive the file is given a run of the
+  mapping, or, if the FT shares contents, its store's copy, or a copy
+  in the node itself; otherwise they are read into a block that the
+  file owns, or copied from it likewise. Returns SUCCESS,
+  MEMORY_ERROR if memory could not be allocated, or as Tar_read
+  does.
+*/
+static int Tar_contents(struct Tar_In *psIn, Node_T oNFile,
+                        size_t ulLength,
+                        struct FT_ImportStats *psStats) {
+   const unsigned char *pucBytes = NULL;
+   unsigned char *pucOwned = NULL;
+   size_t ulOffset;
+   const struct Import_Storage *psStorage;
+   Blob_T oBBlob = NULL;
+   int iStatus;
+
+   assert(psIn != NULL);
+   assert(oNFile != NULL);
+   assert(psStats != NULL);
+
+   if(ulLength == 0)
+      return SUCCESS;
+   ulOffset = psIn->ulOffset;
+   if(psIn->oMMapping != NULL)
+      iStatus = Tar_read(psIn, ulLength, NULL, &pucBytes, NULL);
+   else {
+      iStatus = Tar_stream(psIn, ulLength, 0, FALSE, &pucOwned);
+      pucBytes = pucOwned;
+   }
+   if(iStatus == SUCCESS)
+      iStatus = Tar_skip(psIn, Tar_pad(ulLength));
+   /* shared contents go in the store, unless they fit in the node
+      itself */
+   psStorage = psIn->psStorage;
+   if(iStatus == SUCCESS && psStorage->bShare &&
+      ulLength > psStorage->ulRoom &&
+      Blob_intern(pucBytes, ulLength, &oBBlob) != SUCCESS)
+      iStatus = MEMORY_ERROR;
+   if(iStatus != SUCCESS) {
+      free(pucOwned);
+      return iStatus;
+   }
+
+   if(oBBlob != NULL)
+      (void) Node_shareContents(oNFile, oBBlob);
+   else if(psStorage->bShare)
+      (void) Node_inlineContents(oNFile, pucBytes, ulLength);
+   else if(pucOwned != NULL) {
+      (void) Node_replaceContents(oNFile, pucOwned, ulLength);
+      Node_ownContents(oNFile);
+      pucOwned = NULL;
+   }
+   else
+      Node_mapContents(oNFile, Mapping_retain(psIn->oMMapping),
+                       ulOffset, ulLength);
+   free(pucOwned);
+   psStats->ulBytes += ulLength;
+   return SUCCESS;
+}
+
+/*
+  Returns TRUE if no component of pathname pcPath is empty, "." or
+  "..", and FALSE otherwise.
+*/
+static boolean Tar_isPlain(const char *pcPath) {
+   const char *pcEnd;
+   size_t ulComponent;
+
+   assert(pcPath != NULL);
+
+   for(;;) {
+      pcEnd = strchr(pcPath, '/');
+      ulComponent = pcEnd == NULL ? strlen(pcPath) :
+                    (size_t) (pcEnd - pcPath);
+      if(ulComponent == 0 ||
+         (ulComponent == 1 && pcPath[0] == '.') ||
+         (ulComponent == 2 && pcPath[0] == '.' && pcPath[1] == '.'))
+         return FALSE;
+      if(pcEnd == NULL)
+         return TRUE;
+      pcPath = pcEnd + 1;
+   }
+}
+
+/*
+  Adds the directory, or file if bIsFile, with the ulLength bytes of
+  contents that follow in archive psIn, whose pathname pcPath is as
+  the archive gives it, to the FT, making any of its ancestors that
+  are missing, and counting them in *psStats. Leading slashes and
+  "./", and trailing slashes, are dropped from pcPath, whose bytes
+  may be changed; any other "." or ".." component, which GNU tar
+  would drop, is refused, as an FT that kept it could not be exported
+  safely. A directory that is already in the FT is kept as it is.
+  Returns SUCCESS, or:
+  * BAD_FORMAT if pcPath is not a well-formatted path, or has an
+               empty, "." or ".." component
+  * CONFLICTING_PATH if the root is not a prefix of pcPath, or pcPath
+                     is a file's and would be the root's
+  * NOT_A_DIRECTORY if a proper prefix of pcPath is a file
+  * ALREADY_IN_TREE if pcPath is a file's and already in the FT, or a
+                    directory's and a file's in the FT
+  * MEMORY_ERROR if memory could not be allocated
+  * or as Tar_read does
+*/
+static int Tar_add(struct Tar_In *psIn, char *pcPath,
+                   boolean bIsFile, size_t ulLength,
+                   struct FT_ImportStats *psStats) {
+   Node_T oNRoot;
+   Path_T oPPath = NULL;
+   Node_T oNParent = NULL;
+   Node_T oNNode = NULL;
+   size_t ulChildID;
+   size_t ulEnd;
+   int iStatus;
+
+   assert(psIn != NULL);
+   assert(pcPath != NULL);
+   assert(psStats != NULL);
+
+   for(;;) {
+      if(*pcPath == '/')
+         pcPath++;
+      else if(pcPath[0] == '.' && pcPath[1] == '/')
+         pcPath += 2;
+      else
+         break;
+   }
+   for(ulEnd = strlen(pcPath); ulEnd > 0 && pcPath[ulEnd - 1] == '/';
+       ulEnd--)
+      pcPath[ulEnd - 1] = '\0';
+   /* an entry for the archive's own directory, ".", adds nothing */
+   if(!strcmp(pcPath, ".") || *pcPath == '\0')
+      return Tar_skip(psIn, ulLength + Tar_pad(ulLength));
+   if(!Tar_isPlain(pcPath))
+      return BAD_FORMAT;
+
+   iStatus = Path_new(pcPath, &oPPath);
+   if(iStatus != SUCCESS)
+      return iStatus == BAD_PATH ? BAD_FORMAT : iStatus;
+
+   oNRoot = *psIn->poNRoot;
+   if(Path_getDepth(oPPath) > 1)
+      iStatus = Tar_parent(psIn, oPPath, psStats, &oNParent);
+   else if(oNRoot != NULL &&
+           Path_comparePath(Node_getPath(oNRoot), oPPath))
+      iStatus = CONFLICTING_PATH;
+   else if(oNRoot != NULL)
+      oNNode = oNRoot;
+   else if(bIsFile)
+      iStatus = CONFLICTING_PATH;
+
+   if(iStatus == SUCCESS && oNParent != NULL &&
+      Node_hasChild(oNParent, oPPath, &ulChildID))
+      iStatus = Node_getChild(oNParent, ulChildID, &oNNode);
+   if(iStatus == SUCCESS && oNNode != NULL) {
+      /* a directory listed again, or after its entries, is kept */
+      if(bIsFile || Node_isFile(oNNode))
+         iStatus = ALREADY_IN_TREE;
+   }
+   else if(iStatus == SUCCESS)
+      iStatus = Tar_make(psIn, oPPath, oNParent, bIsFile, psStats,
+                         &oNNode);
+   Path_free(oPPath);
+   if(iStatus != SUCCESS)
+      return iStatus;
+
+   if(!bIsFile) {
+      psIn->oNLast = oNNode;
+      return Tar_skip(psIn, ulLength + Tar_pad(ulLength));
+   }
+   psIn->oNLast = oNParent;
+   return Tar_contents(psIn, oNNode, ulLength, psStats);
+}
+
+/*
+  Reads the entry next in archive psIn, with any pax or GNU headers
+  before it, into the FT, counting what it adds or skips in
+  *psStats. Sets *pbEnd to TRUE if instead the archive ended, with a
+  block of zeros or at the end of its file. Returns SUCCESS, or
+  BAD_FORMAT if a header is not a valid ustar header, or as
+  Tar_add does.
+*/
+static int Tar_entry(struct Tar_In *psIn,
+                     struct FT_ImportStats *psStats,
+                     boolean *pbEnd) {
+   const unsigned char *pucHeader = NULL;
+   char acPath[TAR_PATH_BYTES + 1];
+   char *pcBody = NULL;
+   char cType;
+   size_t ulSize;
+   size_t ulPrefix;
+   int iStatus;
+
+   assert(psIn != NULL);
+   assert(psStats != NULL);
+   assert(pbEnd != NULL);
+
+   iStatus = Tar_read(psIn, TAR_BLOCK, psIn->aucBlock, &pucHeader,
+                      pbEnd);
+   if(iStatus != SUCCESS || *pbEnd)
+      return iStatus;
+   if(pucHeader[0] == '\0' && !memcmp(pucHeader, aucZeros, TAR_BLOCK)) {
+      *pbEnd = TRUE;
+      return SUCCESS;
+   }
+   if(!Tar_isHeader(pucHeader) ||
+      !Tar_number(pucHeader + TAR_SIZE, TAR_SIZE_BYTES, &ulSize))
+      return BAD_FORMAT;
+
+   /* reading on may reuse the header's block */
+   cType = (char) pucHeader[TAR_TYPE];
+   switch(cType) {
+      case 'x':
+      case 'L':
+         /* a pax header, or GNU tar's for a long name, is kept for
+            the entry that follows it */
+         iStatus = Tar_body(psIn, ulSize, &pcBody);
+         if(iStatus != SUCCESS)
+            return iStatus;
+         if(cType == 'x')
+            iStatus = Tar_pax(psIn, pcBody, ulSize);
+         else {
+            Alloc_free(ALLOC_TREE_IMPORT, psIn->pcLong,
+                       psIn->ulLongBytes);
+            psIn->pcLong = pcBody;
+            psIn->ulLongBytes = ulSize + 1;
+            pcBody = NULL;
+         }
+         Alloc_free(ALLOC_TREE_IMPORT, pcBody, ulSize + 1);
+         return iStatus;
+      case 'g':
+      case 'K':
+         /* global pax headers and GNU tar's long link names say
+            nothing that the FT keeps */
+         return Tar_skip(psIn, ulSize + Tar_pad(ulSize));
+      default:
+         break;
+   }
+
+   if(psIn->bHasSize)
+      ulSize = psIn->ulSize;
+   switch(cType) {
+      case '0':
+      case '\0':
+      case '7':
+      case '5':
+         if(psIn->pcLong == NULL) {
+            /* a pathname split between the fields is joined again;
+               GNU tar keeps times where POSIX keeps the prefix */
+            acPath[0] = '\0';
+            if(!memcmp(pucHeader + TAR_MAGIC, "ustar", 6)) {
+               memcpy(acPath, pucHeader + TAR_PREFIX,
+                      TAR_PREFIX_BYTES);
+               acPath[TAR_PREFIX_BYTES] = '\0';
+            }
+            ulPrefix = strlen(acPath);
+            if(ulPrefix > 0)
+               acPath[ulPrefix++] = '/';
+            memcpy(acPath + ulPrefix, pucHeader, TAR_NAME_BYTES);
+            acPath[ulPrefix + TAR_NAME_BYTES] = '\0';
+         }
+         iStatus = Tar_add(psIn, psIn->pcLong != NULL ?
+                                 psIn->pcLong : acPath,
+                           (boolean) (cType != '5'),
+                           ulSize, psStats);
+         break;
+      default:
+         /* links, devices and the like have no place in an FT */
+         psStats->ulSkipped++;
+         iStatus = Tar_skip(psIn, ulSize + Tar_pad(ulSize));
+         break;
+   }
+   Tar_forget(psIn);
+   return iStatus;
+}
+
+
+int Tar_import(int iFd, Node_T *poNRoot,
+               const struct Import_Storage *psStorage,
+               struct FT_ImportStats *psStats, size_t *pulMade) {
+   struct Tar_In *psIn;
+   boolean bEnd = FALSE;
+   size_t ulMade;
+   int iStatus;
+
+   assert(poNRoot != NULL);
+   assert(psStorage != NULL);
+   assert(psStats != NULL);
+   assert(pulMade != NULL);
+
+   *pulMade = 0;
+   psIn = Alloc_malloc(ALLOC_TREE_IMPORT, sizeof(struct Tar_In));
+   if(psIn == NULL)
+      return MEMORY_ERROR;
+   psIn->poNRoot = poNRoot;
+   psIn->psStorage = psStorage;
+   psIn->iFd = iFd;
+   psIn->ulOffset = 0;
+   psIn->pcLong = NULL;
+   psIn->ulLongBytes = 0;
+   psIn->bHasSize = FALSE;
+   psIn->oNLast = NULL;
+   psIn->oDMade = DynArray_new(0);
+   /* anything that is not a regular file is read as it comes */
+   iStatus = Mapping_new(iFd, &psIn->oMMapping);
+   if(iStatus == IO_ERROR)
+      iStatus = SUCCESS;
+   if(psIn->oDMade == NULL)
+      iStatus = MEMORY_ERROR;
+
+   while(iStatus == SUCCESS && !bEnd)
+      iStatus = Tar_entry(psIn, psStats, &bEnd);
+
+   /* a failed import frees what it made, the newest first, so each
+      node has no children left when it is freed */
+   ulMade = psIn->oDMade == NULL ? 0 : DynArray_getLength(psIn->oDMade);
+   if(iStatus != SUCCESS) {
+      while(ulMade > 0) {
+         Node_T oNMade = DynArray_get(psIn->oDMade, --ulMade);
+         if(oNMade == *poNRoot)
+            *poNRoot = NULL;
+         Tar_lock(oNMade);
+         (void) Node_free(oNMade);
+      }
+      psStats->ulDirs = 0;
+      psStats->ulFiles = 0;
+      psStats->ulBytes = 0;
+      psStats->ulSkipped = 0;
+   }
+   *pulMade = ulMade;
+   Tar_forget(psIn);
+   if(psIn->oMMapping != NULL)
+      Mapping_release(psIn->oMMapping);
+   if(psIn->oDMade != NULL)
+      DynArray_free(psIn->oDMade);
+   Alloc_free(ALLOC_TREE_IMPORT, psIn, sizeof(struct Tar_In));
+   return iStatus;
+}
@@ -0,0 +1,58 @@
+/*--------------------------------------------------------------------*/
+/* tar.h                                                              */
+/* Author: Christopher Moretti                                        */
+/*--------------------------------------------------------------------*/
+
+#ifndef TAR_INCLUDED
+#define TAR_INCLUDED
+
+#include <stddef.h>
+#include "a4def.h"
+#include "nodeFT.h"
+#include "import.h"
+#include "ft.h"
+
+/*
+  The layout of the ustar archives that FT_exportTar writes and
+  FT_importTar reads: a header block for each entry, followed by its
+  contents padded to a whole number of blocks.
+
+  The reader reads an archive into an FT for FT_importTar, in a single
+  pass. An archive in a regular file is mapped, and its files'
+  contents are left where they are in the mapping; any other is read
+  as it comes, each file's contents into a block of their own. An
+  archive mostly lists a directory's entries together, so the
+  directory that the last entry went in is kept, and an entry that
+  goes in it too is added without traversing the FT.
+*/
+
+/* The size of a tar block, which a header fills and contents are
+   padded to a multiple of */
+enum {TAR_BLOCK = 512};
+
+/* The sizes of the fields of a tar header, and their offsets */
+enum {TAR_NAME_BYTES = 100, TAR_PREFIX_BYTES = 155,
+      TAR_SIZE_BYTES = 12};
+enum {TAR_MODE = 100, TAR_UID = 108, TAR_GID = 116, TAR_SIZE = 124,
+      TAR_MTIME = 136, TAR_CHKSUM = 148, TAR_TYPE = 156,
+      TAR_MAGIC = 257, TAR_VERSION = 263, TAR_PREFIX = 345};
+
+/* The most bytes that a ustar header's prefix and name make */
+enum {TAR_PATH_BYTES = TAR_PREFIX_BYTES + 1 + TAR_NAME_BYTES};
+
+/*
+  Reads the ustar archive on iFd into the FT whose root is *poNRoot,
+  or which is empty if it is NULL, as FT_importTar does, setting
+  *poNRoot to any root the archive makes. The caller must hold the FT
+  so that nobody else changes or reads it meanwhile. Files keep the
+  contents read for them as *psStorage says. Adds what was added and
+  skipped to *psStats, all but its ulMicros, and sets *pulMade to the
+  number of nodes made. Returns SUCCESS, or, having freed every node
+  it made, set those counts and *pulMade to 0, and left *poNRoot as it
+  was, a status as FT_importTar does other than INITIALIZATION_ERROR.
+*/
+int Tar_import(int iFd, Node_T *poNRoot,
+               const struct Import_Storage *psStorage,
+               struct FT_ImportStats *psStats, size_t *pulMade);
+
+#endif
@@ -0,0 +1,610 @@
+/*--------------------------------------------------------------------*/
+/* bench.c                                                            */
+/* Author: Christopher Moretti                                        */
+/*--------------------------------------------------------------------*/
+
+/* clock_gettime and getopt are POSIX.1-2001 interfaces */
+#define _POSIX_C_SOURCE 200112L
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "a4def.h"
+#include "alloc.h"
+
+/*
+  bench times the operations of one tree implementation on synthetic
+  hierarchies. It is compiled once per implementation: with -DBENCH_FT
+  against the FT, with -DBENCH_BDT against the BDT, and otherwise
+  against the DT. The Bench_* macros map its operations onto that
+  implementation. In the FT, a node without children is a file. The
+  blocks that each call allocates through the Alloc functions are
+  counted too.
+*/
+#if defined(BENCH_FT)
+#include "ft.h"
+#define BENCH_NAME "FT"
+#define BENCH_MAX_FANOUT 0
+#define Bench_init() FT_init()
+#define Bench_destroy() FT_destroy()
+#define Bench_toString() FT_toString()
+#define Bench_insert(pcPath, bIsLeaf) \
+  ((bIsLeaf) ? FT_insertFile((pcPath), NULL, 0) : FT_insertDir(pcPath))
+#define Bench_contains(pcPath, bIsLeaf) \
+  ((bIsLeaf) ? FT_containsFile(pcPath) : FT_containsDir(pcPath))
+#define Bench_rm(pcPath, bIsLeaf) \
+  ((bIsLeaf) ? FT_rmFile(pcPath) : FT_rmDir(pcPath))
+#elif defined(BENCH_BDT)
+#include "bdt.h"
+#define BENCH_NAME "BDT"
+#define BENCH_MAX_FANOUT 2
+#define Bench_init() BDT_init()
+#define Bench_destroy() BDT_destroy()
+#define Bench_toString() BDT_toString()
+#define Bench_insert(pcPath, bIsLeaf) BDT_insert(pcPath)
+#define Bench_contains(pcPath, bIsLeaf) BDT_contains(pcPath)
+#define Bench_rm(pcPath, bIsLeaf) BDT_rm(pcPath)
+#else
+#include "dt.h"
+#define BENCH_NAME "DT"
+#define BENCH_MAX_FANOUT 0
+#define Bench_init() DT_init()
+#define Bench_destroy() DT_destroy()
+#define Bench_toString() DT_toString()
+#define Bench_insert(pcPath, bIsLeaf) DT_insert(pcPath)
+#define Bench_contains(pcPath, bIsLeaf) DT_contains(pcPath)
+#define Bench_rm(pcPath, bIsLeaf) DT_rm(pcPath)
+#endif
+
+/* The shapes of hierarchy that can be generated */
+enum Shape {SHAPE_CHAIN, SHAPE_WIDE, SHAPE_BALANCED, SHAPE_ZIPF,
+            NUM_SHAPES};
+static const char *apcShapeNames[NUM_SHAPES] =
+  {"chain", "wide", "balanced", "zipf"};
+
+/* The operations that are timed */
+enum Op {OP_INSERT, OP_CONTAINS, OP_RM, OP_TOSTRING, OP_DESTROY,
+         NUM_OPS};
+static const char *apcOpNames[NUM_OPS] =
+  {"insert", "contains", "rm", "toString", "destroy"};
+
+/* The names given to directories in Zipfian hierarchies, most
+   popular first */
+static const char *apcWords[] =
+  {"src", "lib", "include", "test", "doc", "bin", "build", "util",
+   "data", "tmp", "config", "scripts", "assets", "vendor", "core",
+   "common", "api", "internal", "examples", "tools", "images", "log",
+   "cache", "share", "man", "etc", "local", "old", "backup", "misc"};
+enum {NUM_WORDS = sizeof(apcWords) / sizeof(apcWords[0])};
+
+/* A generated hierarchy: its paths, each after its parent's */
+struct Tree {
+  /* the number of paths */
+  size_t ulCount;
+  /* the paths, and whether each one's node has no children */
+  char **ppcPaths;
+  boolean *pbIsLeaf;
+  /* the greatest number of children that any node has */
+  size_t ulMaxFanout;
+};
+
+/* The latencies of the timed calls to one operation */
+struct Sample {
+  /* the number of calls timed, and room for how many */
+  size_t ulCount;
+  size_t ulCapacity;
+  /* the latency of each call in nanoseconds */
+  unsigned long *pulNs;
+  /* the sum of the latencies */
+  double dTotalNs;
+  /* the number of blocks the calls allocated */
+  size_t ulAllocs;
+};
+
+/* The state of the pseudo-random number generator, which is seeded
+   with -S so that every run generates the same hierarchies */
+static unsigned long ulRandom = 2463534242UL;
+
+/* The output format chosen with -o, and whether a row has been
+   written yet */
+static boolean bJson = FALSE;
+static boolean bWroteRow = FALSE;
+
+/*--------------------------------------------------------------------*/
+
+/* Exits with a message that memory could not be allocated. */
+static void outOfMemory(void) {
+  fprintf(stderr, "bench: out of memory\n");
+  exit(EXIT_FAILURE);
+}
+
+/* Returns a pseudo-random number in [0, 1), from a 32-bit xorshift
+   generator. */
+static double nextRandom(void) {
+  ulRandom ^= (ulRandom << 13) & 0xFFFFFFFFUL;
+  ulRandom ^= ulRandom >> 17;
+  ulRandom ^= (ulRandom << 5) & 0xFFFFFFFFUL;
+  return (double) ulRandom / 4294967296.0;
+}
+
+/* Returns a pseudo-random rank in [0, ulRange), where rank k is drawn
+   with probability roughly proportional to 1 / (k + 1). */
+static size_t nextZipf(size_t ulRange) {
+  size_t ulRank;
+
+  assert(ulRange > 0);
+
+  ulRank = (size_t) exp(nextRandom() * log((double) ulRange + 1.0));
+  if(ulRank == 0)
+    ulRank = 1;
+  if(ulRank > ulRange)
+    ulRank = ulRange;
+  return ulRank - 1;
+}
+
+/* Returns the current time in nanoseconds from an arbitrary start. */
+static unsigned long now(void) {
+  struct timespec sTime;
+
+  (void) clock_gettime(CLOCK_MONOTONIC, &sTime);
+  return (unsigned long) sTime.tv_sec * 1000000000UL +
+         (unsigned long) sTime.tv_nsec;
+}
+
+/* Returns the number of blocks allocated through the Alloc functions
+   so far. */
+static size_t allocsSoFar(void) {
+  struct Alloc_Stats sStats;
+  size_t ulModule;
+  size_t ulAllocs = 0;
+
+  for(ulModule = 0; ulModule < ALLOC_MODULES; ulModule++) {
+    Alloc_getModuleStats((enum Alloc_Module) ulModule, &sStats);
+    ulAllocs += sStats.ulAllocs;
+  }
+  return ulAllocs;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Sets psTree to hold room for ulCount paths. */
+static void Tree_alloc(struct Tree *psTree, size_t ulCount) {
+  assert(psTree != NULL);
+
+  psTree->ulCount = ulCount;
+  psTree->ppcPaths = calloc(ulCount, sizeof(char *));
+  psTree->pbIsLeaf = calloc(ulCount, sizeof(boolean));
+  psTree->ulMaxFanout = 0;
+  if(psTree->ppcPaths == NULL || psTree->pbIsLeaf == NULL)
+    outOfMemory();
+}
+
+/* Frees the paths of psTree. */
+static void Tree_free(struct Tree *psTree) {
+  size_t ulIndex;
+
+  assert(psTree != NULL);
+
+  for(ulIndex = 0; ulIndex < psTree->ulCount; ulIndex++)
+    free(psTree->ppcPaths[ulIndex]);
+  free(psTree->ppcPaths);
+  free(psTree->pbIsLeaf);
+}
+
+/*
+  Sets path ulIndex of psTree to the child named pcName (and
+  ulSuffix, if not 0) of path ulParent, or to pcName alone if
+  ulIndex is 0.
+*/
+static void Tree_setPath(struct Tree *psTree, size_t ulIndex,
+                         size_t ulParent, const char *pcName,
+                         size_t ulSuffix) {
+  enum {SUFFIX_LEN = 24};
+  size_t ulLength = strlen(pcName) + SUFFIX_LEN;
+  char *pcPath;
+
+  assert(psTree != NULL);
+  assert(ulIndex < psTree->ulCount);
+  assert(ulParent < ulIndex || ulIndex == 0);
+
+  if(ulIndex != 0)
+    ulLength += strlen(psTree->ppcPaths[ulParent]) + 1;
+  pcPath = malloc(ulLength);
+  if(pcPath == NULL)
+    outOfMemory();
+
+  if(ulIndex == 0)
+    strcpy(pcPath, pcName);
+  else
+    sprintf(pcPath, "%s/%s", psTree->ppcPaths[ulParent], pcName);
+  if(ulSuffix != 0)
+    sprintf(pcPath + strlen(pcPath), "%lu", (unsigned long) ulSuffix);
+  psTree->ppcPaths[ulIndex] = pcPath;
+}
+
+/*
+  Generates in psTree a hierarchy of shape eShape with ulCount nodes.
+  A chain nests each directory in the last; a wide hierarchy puts all
+  but the root directly under the root; a balanced one gives every
+  directory ulFanout children, breadth first; and a Zipfian one adds
+  each directory under an earlier one picked with Zipfian popularity,
+  named with a Zipfian pick from apcWords.
+*/
+static void Tree_generate(struct Tree *psTree, enum Shape eShape,
+                          size_t ulCount, size_t ulFanout) {
+  size_t *pulChildren;
+  size_t ulIndex;
+
+  assert(psTree != NULL);
+  assert(ulCount > 0);
+  assert(ulFanout > 0);
+
+  Tree_alloc(psTree, ulCount);
+  pulChildren = calloc(ulCount, sizeof(size_t));
+  if(pulChildren == NULL)
+    outOfMemory();
+
+  Tree_setPath(psTree, 0, 0, "r", 0);
+  for(ulIndex = 1; ulIndex < ulCount; ulIndex++) {
+    size_t ulParent;
+    switch(eShape) {
+    case SHAPE_CHAIN:
+      ulParent = ulIndex - 1;
+      Tree_setPath(psTree, ulIndex, ulParent, "d", 0);
+      break;
+    case SHAPE_WIDE:
+      ulParent = 0;
+      Tree_setPath(psTree, ulIndex, ulParent, "f", ulIndex);
+      break;
+    case SHAPE_BALANCED:
+      ulParent = (ulIndex - 1) / ulFanout;
+      Tree_setPath(psTree, ulIndex, ulParent, "n",
+                   pulChildren[ulParent] + 1);
+      break;
+    default:
+      /* a suffix keeps the names of siblings distinct */
+      ulParent = nextZipf(ulIndex);
+      Tree_setPath(psTree, ulIndex, ulParent,
+                   apcWords[nextZipf(NUM_WORDS)],
+                   pulChildren[ulParent]);
+      break;
+    }
+    pulChildren[ulParent]++;
+    if(pulChildren[ulParent] > psTree->ulMaxFanout)
+      psTree->ulMaxFanout = pulChildren[ulParent];
+  }
+
+  for(ulIndex = 0; ulIndex < ulCount; ulIndex++)
+    psTree->pbIsLeaf[ulIndex] = (boolean) (pulChildren[ulIndex] == 0);
+  free(pulChildren);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Sets psSample to hold room for ulCapacity latencies. */
+static void Sample_alloc(struct Sample *psSample, size_t ulCapacity) {
+  assert(psSample != NULL);
+
+  psSample->ulCount = 0;
+  psSample->ulCapacity = ulCapacity;
+  psSample->dTotalNs = 0.0;
+  psSample->ulAllocs = 0;
+  psSample->pulNs = malloc(ulCapacity * sizeof(unsigned long));
+  if(psSample->pulNs == NULL)
+    outOfMemory();
+}
+
+/* Adds a call that started at time ulStart, when allocsSoFar returned
+   ulAllocs, and has just returned to psSample. */
+static void Sample_add(struct Sample *psSample, unsigned long ulStart,
+                       size_t ulAllocs) {
+  unsigned long ulNs = now() - ulStart;
+
+  assert(psSample != NULL);
+  assert(psSample->ulCount < psSample->ulCapacity);
+
+  psSample->pulNs[psSample->ulCount++] = ulNs;
+  psSample->dTotalNs += (double) ulNs;
+  psSample->ulAllocs += allocsSoFar() - ulAllocs;
+}
+
+/* Compares the latencies pointed to by pvFirst and pvSecond, for
+   qsort. */
+static int Sample_compare(const void *pvFirst, const void *pvSecond) {
+  unsigned long ulFirst = *(const unsigned long *) pvFirst;
+  unsigned long ulSecond = *(const unsigned long *) pvSecond;
+
+  if(ulFirst < ulSecond)
+    return -1;
+  return ulFirst > ulSecond;
+}
+
+/* Returns the latency below which fraction dFraction of the calls in
+   psSample fall, which must have been sorted. */
+static unsigned long Sample_percentile(struct Sample *psSample,
+                                       double dFraction) {
+  size_t ulRank;
+
+  assert(psSample != NULL);
+  assert(psSample->ulCount > 0);
+
+  ulRank = (size_t) ceil(dFraction * (double) psSample->ulCount);
+  if(ulRank == 0)
+    ulRank = 1;
+  return psSample->pulNs[ulRank - 1];
+}
+
+/*
+  Writes a row of results for operation eOp on a hierarchy of shape
+  eShape with ulNodes nodes, from psSample, as CSV or as an element of
+  a JSON array.
+*/
+static void Sample_write(struct Sample *psSample, enum Shape eShape,
+                         size_t ulNodes, enum Op eOp) {
+  double dOpsPerSec, dAllocsPerOp;
+  unsigned long ulP50, ulP99;
+
+  assert(psSample != NULL);
+
+  if(psSample->ulCount == 0)
+    return;
+  qsort(psSample->pulNs, psSample->ulCount, sizeof(unsigned long),
+        Sample_compare);
+  dOpsPerSec = psSample->dTotalNs == 0.0 ? 0.0 :
+               (double) psSample->ulCount * 1e9 / psSample->dTotalNs;
+  dAllocsPerOp = (double) psSample->ulAllocs /
+                 (double) psSample->ulCount;
+  ulP50 = Sample_percentile(psSample, 0.50);
+  ulP99 = Sample_percentile(psSample, 0.99);
+
+  if(bJson)
+    printf("%s  {\"structure\": \"%s\", \"shape\": \"%s\", "
+           "\"nodes\": %lu, \"op\": \"%s\", \"count\": %lu, "
+           "\"ops_per_sec\": %.1f, \"p50_ns\": %lu, \"p99_ns\": %lu, "
+           "\"allocs_per_op\": %.2f}",
+           bWroteRow ? ",\n" : "", BENCH_NAME, apcShapeNames[eShape],
+           (unsigned long) ulNodes, apcOpNames[eOp],
+           (unsigned long) psSample->ulCount, dOpsPerSec, ulP50, ulP99,
+           dAllocsPerOp);
+  else
+    printf("%s,%s,%lu,%s,%lu,%.1f,%lu,%lu,%.2f\n", BENCH_NAME,
+           apcShapeNames[eShape], (unsigned long) ulNodes,
+           apcOpNames[eOp], (unsigned long) psSample->ulCount,
+           dOpsPerSec, ulP50, ulP99, dAllocsPerOp);
+  bWroteRow = TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Exits with a message that operation pcOp on pcPath returned iStatus
+   rather than succeeding. */
+static void failed(const char *pcOp, const char *pcPath, int iStatus) {
+  fprintf(stderr, "bench: %s %s returned %d\n", pcOp, pcPath, iStatus);
+  exit(EXIT_FAILURE);
+}
+
+/*
+  Times ulReps rounds of operations on the hierarchy psTree, adding
+  the latencies to asSamples. Each round inserts every path, checks
+  every path in a shuffled order, writes the whole tree as a string
+  and destroys it, then builds it again untimed and removes every
+  path, deepest first.
+*/
+static void runRounds(struct Tree *psTree, size_t ulReps,
+                      struct Sample asSamples[NUM_OPS]) {
+  size_t *pulOrder;
+  size_t ulRep, ulIndex;
+  unsigned long ulStart;
+  size_t ulAllocs;
+  int iStatus;
+  char *pcString;
+
+  assert(psTree != NULL);
+  assert(asSamples != NULL);
+
+  pulOrder = malloc(psTree->ulCount * sizeof(size_t));
+  if(pulOrder == NULL)
+    outOfMemory();
+  for(ulIndex = 0; ulIndex < psTree->ulCount; ulIndex++)
+    pulOrder[ulIndex] = ulIndex;
+
+  for(ulRep = 0; ulRep < ulReps; ulRep++) {
+    if((iStatus = Bench_init()) != SUCCESS)
+      failed("init", "", iStatus);
+    for(ulIndex = 0; ulIndex < psTree->ulCount; ulIndex++) {
+      ulAllocs = allocsSoFar();
+      ulStart = now();
+      iStatus = Bench_insert(psTree->ppcPaths[ulIndex],
+                             psTree->pbIsLeaf[ulIndex]);
+      Sample_add(&asSamples[OP_INSERT], ulStart, ulAllocs);
+      if(iStatus != SUCCESS)
+        failed("insert", psTree->ppcPaths[ulIndex], iStatus);
+    }
+
+    for(ulIndex = psTree->ulCount; ulIndex > 1; ulIndex--) {
+      size_t ulOther = (size_t) (nextRandom() * (double) ulIndex);
+      size_t ulSwap = pulOrder[ulIndex - 1];
+      pulOrder[ulIndex - 1] = pulOrder[ulOther];
+      pulOrder[ulOther] = ulSwap;
+    }
+    for(ulIndex = 0; ulIndex < psTree->ulCount; ulIndex++) {
+      size_t ulPath = pulOrder[ulIndex];
+      boolean bFound;
+      ulAllocs = allocsSoFar();
+      ulStart = now();
+      bFound = Bench_contains(psTree->ppcPaths[ulPath],
+                              psTree->pbIsLeaf[ulPath]);
+      Sample_add(&asSamples[OP_CONTAINS], ulStart, ulAllocs);
+      if(!bFound)
+        failed("contains", psTree->ppcPaths[ulPath], FALSE);
+    }
+
+    ulAllocs = allocsSoFar();
+
+    ulStart = now();
+    pcString = Bench_toString();
+    Sample_add(&asSamples[OP_TOSTRING], ulStart, ulAllocs);
+    if(pcString == NULL)
+      outOfMemory();
+    free(pcString);
+
+    ulAllocs = allocsSoFar();
+
+    ulStart = now();
+    iStatus = Bench_destroy();
+    Sample_add(&asSamples[OP_DESTROY], ulStart, ulAllocs);
+    if(iStatus != SUCCESS)
+      failed("destroy", "", iStatus);
+
+    if((iStatus = Bench_init()) != SUCCESS)
+      failed("init", "", iStatus);
+    for(ulIndex = 0; ulIndex < psTree->ulCount; ulIndex++)
+      if((iStatus = Bench_insert(psTree->ppcPaths[ulIndex],
+                                 psTree->pbIsLeaf[ulIndex])) != SUCCESS)
+        failed("insert", psTree->ppcPaths[ulIndex], iStatus);
+    /* every path's descendents come after it, so are already gone */
+    for(ulIndex = psTree->ulCount; ulIndex > 0; ulIndex--) {
+      ulAllocs = allocsSoFar();
+      ulStart = now();
+      iStatus = Bench_rm(psTree->ppcPaths[ulIndex - 1],
+                         psTree->pbIsLeaf[ulIndex - 1]);
+      Sample_add(&asSamples[OP_RM], ulStart, ulAllocs);
+      if(iStatus != SUCCESS)
+        failed("rm", psTree->ppcPaths[ulIndex - 1], iStatus);
+    }
+    if((iStatus = Bench_destroy()) != SUCCESS)
+      failed("destroy", "", iStatus);
+  }
+
+  free(pulOrder);
+}
+
+/*
+  Generates a hierarchy of shape eShape, of ulNodes nodes (ulDepth
+  for a chain) and fan-out ulFanout, times ulReps rounds of operations
+  on it and writes a row of results for each operation. A hierarchy
+  with more children under a node than the implementation allows is
+  skipped.
+*/
+static void benchShape(enum Shape eShape, size_t ulNodes,
+                       size_t ulDepth, size_t ulFanout, size_t ulReps) {
+  struct Tree sTree;
+  struct Sample asSamples[NUM_OPS];
+  size_t ulCount = eShape == SHAPE_CHAIN ? ulDepth : ulNodes;
+  int iOp;
+
+  Tree_generate(&sTree, eShape, ulCount, ulFanout);
+  if(BENCH_MAX_FANOUT != 0 && sTree.ulMaxFanout > BENCH_MAX_FANOUT) {
+    fprintf(stderr, "bench: skipping %s, which has a node with %lu "
+            "children\n", apcShapeNames[eShape],
+            (unsigned long) sTree.ulMaxFanout);
+    Tree_free(&sTree);
+    return;
+  }
+
+  for(iOp = 0; iOp < NUM_OPS; iOp++)
+    Sample_alloc(&asSamples[iOp],
+                 iOp == OP_TOSTRING || iOp == OP_DESTROY ?
+                 ulReps : ulReps * ulCount);
+  runRounds(&sTree, ulReps, asSamples);
+  for(iOp = 0; iOp < NUM_OPS; iOp++) {
+    Sample_write(&asSamples[iOp], eShape, ulCount, (enum Op) iOp);
+    free(asSamples[iOp].pulNs);
+  }
+  Tree_free(&sTree);
+}
+
+/* Writes how to run bench to stderr and exits. */
+static void usage(void) {
+  fprintf(stderr,
+          "usage: bench [-n nodes] [-d chain depth] [-k fan-out]\n"
+          "             [-r rounds] [-s shape] [-S seed] "
+          "[-o csv|json]\n"
+          "shapes: chain, wide, balanced, zipf (default all)\n");
+  exit(EXIT_FAILURE);
+}
+
+/* Returns the positive number in pcArg, exiting with usage if it is
+   not one. */
+static size_t parseCount(const char *pcArg) {
+  char *pcEnd;
+  unsigned long ulValue = strtoul(pcArg, &pcEnd, 10);
+
+  if(*pcArg == '\0' || *pcEnd != '\0' || ulValue == 0)
+    usage();
+  return (size_t) ulValue;
+}
+
+/*
+  Runs the benchmarks chosen by the command-line options in argv,
+  writing results to stdout as CSV (with a header) or as a JSON
+  array. Returns 0, or exits with EXIT_FAILURE if an operation fails.
+*/
+int main(int argc, char *argv[]) {
+  size_t ulNodes = 10000;
+  size_t ulDepth = 1000;
+  size_t ulFanout = 8;
+  size_t ulReps = 3;
+  int iShape = NUM_SHAPES;
+  int iOption;
+
+  while((iOption = getopt(argc, argv, "n:d:k:r:s:S:o:")) != -1) {
+    switch(iOption) {
+    case 'n':
+      ulNodes = parseCount(optarg);
+      break;
+    case 'd':
+      ulDepth = parseCount(optarg);
+      break;
+    case 'k':
+      ulFanout = parseCount(optarg);
+      break;
+    case 'r':
+      ulReps = parseCount(optarg);
+      break;
+    case 'S':
+      ulRandom = (unsigned long) parseCount(optarg) & 0xFFFFFFFFUL;
+      if(ulRandom == 0)
+        usage();
+      break;
+    case 's':
+      for(iShape = 0; iShape < NUM_SHAPES; iShape++)
+        if(!strcmp(optarg, apcShapeNames[iShape]))
+          break;
+      if(iShape == NUM_SHAPES)
+        usage();
+      break;
+    case 'o':
+      if(!strcmp(optarg, "json"))
+        bJson = TRUE;
+      else if(strcmp(optarg, "csv"))
+        usage();
+      break;
+    default:
+      usage();
+    }
+  }
+  if(optind != argc)
+    usage();
+
+  if(bJson)
+    printf("[\n");
+  else
+    printf("structure,shape,nodes,op,count,ops_per_sec,p50_ns,p99_ns,"
+           "allocs_per_op\n");
+  if(iShape == NUM_SHAPES)
+    for(iShape = 0; iShape < NUM_SHAPES; iShape++)
+      benchShape((enum Shape) iShape, ulNodes, ulDepth, ulFanout,
+                 ulReps);
+  else
+    benchShape((enum Shape) iShape, ulNodes, ulDepth, ulFanout, ulReps);
+  if(bJson)
+    printf("%s]\n", bWroteRow ? "\n" : "");
+
+  return 0;
+}
@@ -0,0 +1,522 @@
+/*--------------------------------------------------------------------*/
+/* pathbench.c                                                        */
+/* Author: Christopher Moretti                                        */
+/*--------------------------------------------------------------------*/
+
+/* clock_gettime and getopt are POSIX.1-2001 interfaces */
+#define _POSIX_C_SOURCE 200112L
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "a4def.h"
+#include "dynarray.h"
+#include "path.h"
+
+/*
+  pathbench times the Path and DynArray functions that every tree
+  operation is built on, reporting the time, the allocations and the
+  bytes allocated per call. It must be linked with
+  -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc so that the
+  allocations made by path.o and dynarray.o are counted.
+*/
+
+/* The number of calls timed together, between untimed frees of what
+   they allocated */
+enum {BATCH = 1000};
+/* The depth and component length of the paths that Path_prefix,
+   Path_getSharedPrefixDepth and Path_comparePath are timed on */
+enum {BASE_DEPTH = 32, BASE_LENGTH = 8};
+/* The greatest depth and component length of the varied paths that
+   Path_new is timed on */
+enum {MIX_DEPTH = 32, MIX_LENGTH = 16};
+
+/* The number of allocations made, and the bytes they asked for */
+static size_t ulAllocs = 0;
+static size_t ulAllocBytes = 0;
+
+/* The time, allocations and bytes summed over the timed sections of
+   the benchmark being run, and when and at what counts the current
+   section started */
+static unsigned long ulTimedNs;
+static size_t ulTimedAllocs;
+static size_t ulTimedBytes;
+static unsigned long ulSectionStart;
+static size_t ulSectionAllocs;
+static size_t ulSectionBytes;
+
+/* The state of the pseudo-random number generator, which is seeded
+   with -S so that every run does the same calls */
+static unsigned long ulRandom = 2463534242UL;
+
+/* Where results that are otherwise unused are stored, so that the
+   calls producing them cannot be optimized away */
+static volatile size_t ulSink;
+
+/* The output format chosen with -o, and whether a row has been
+   written yet */
+static boolean bJson = FALSE;
+static boolean bWroteRow = FALSE;
+
+/* The allocators that the wrappers below stand in front of */
+void *__real_malloc(size_t ulSize);
+void *__real_calloc(size_t ulCount, size_t ulSize);
+void *__real_realloc(void *pvOld, size_t ulSize);
+
+/*--------------------------------------------------------------------*/
+
+/* Counts an allocation of ulSize bytes, then makes it with malloc. */
+void *__wrap_malloc(size_t ulSize) {
+  ulAllocs++;
+  ulAllocBytes += ulSize;
+  return __real_malloc(ulSize);
+}
+
+/* Counts an allocation of ulCount elements of ulSize bytes, then
+   makes it with calloc. */
+void *__wrap_calloc(size_t ulCount, size_t ulSize) {
+  ulAllocs++;
+  ulAllocBytes += ulCount * ulSize;
+  return __real_calloc(ulCount, ulSize);
+}
+
+/* Counts a reallocation to ulSize bytes as an allocation, then makes
+   it with realloc. */
+void *__wrap_realloc(void *pvOld, size_t ulSize) {
+  ulAllocs++;
+  ulAllocBytes += ulSize;
+  return __real_realloc(pvOld, ulSize);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Exits with a message that memory could not be allocated. */
+static void outOfMemory(void) {
+  fprintf(stderr, "pathbench: out of memory\n");
+  exit(EXIT_FAILURE);
+}
+
+/* Returns a pseudo-random number in [0, ulRange), from a 32-bit
+   xorshift generator. */
+static size_t nextRandom(size_t ulRange) {
+  assert(ulRange > 0);
+
+  ulRandom ^= (ulRandom << 13) & 0xFFFFFFFFUL;
+  ulRandom ^= ulRandom >> 17;
+  ulRandom ^= (ulRandom << 5) & 0xFFFFFFFFUL;
+  return (size_t) ((double) ulRandom / 4294967296.0 * (double) ulRange);
+}
+
+/* Returns the current time in nanoseconds from an arbitrary start. */
+static unsigned long now(void) {
+  struct timespec sTime;
+
+  (void) clock_gettime(CLOCK_MONOTONIC, &sTime);
+  return (unsigned long) sTime.tv_sec * 1000000000UL +
+         (unsigned long) sTime.tv_nsec;
+}
+
+/* Starts a timed section of the benchmark being run. */
+static void startSection(void) {
+  ulSectionAllocs = ulAllocs;
+  ulSectionBytes = ulAllocBytes;
+  ulSectionStart = now();
+}
+
+/* Ends the timed section that startSection started, adding its time
+   and allocations to those of the benchmark. */
+static void endSection(void) {
+  ulTimedNs += now() - ulSectionStart;
+  ulTimedAllocs += ulAllocs - ulSectionAllocs;
+  ulTimedBytes += ulAllocBytes - ulSectionBytes;
+}
+
+/*
+  Writes a row of results for benchmark pcBench with parameters
+  pcParam, which made ulOps calls in its timed sections, as CSV or as
+  an element of a JSON array. Then clears the sums for the next
+  benchmark.
+*/
+static void report(const char *pcBench, const char *pcParam,
+                   size_t ulOps) {
+  double dOps = (double) ulOps;
+
+  assert(pcBench != NULL);
+  assert(pcParam != NULL);
+  assert(ulOps > 0);
+
+  if(bJson)
+    printf("%s  {\"benchmark\": \"%s\", \"param\": \"%s\", "
+           "\"ops\": %lu, \"ns_per_op\": %.2f, "
+           "\"allocs_per_op\": %.3f, \"bytes_per_op\": %.1f}",
+           bWroteRow ? ",\n" : "", pcBench, pcParam,
+           (unsigned long) ulOps, (double) ulTimedNs / dOps,
+           (double) ulTimedAllocs / dOps, (double) ulTimedBytes / dOps);
+  else
+    printf("%s,%s,%lu,%.2f,%.3f,%.1f\n", pcBench, pcParam,
+           (unsigned long) ulOps, (double) ulTimedNs / dOps,
+           (double) ulTimedAllocs / dOps, (double) ulTimedBytes / dOps);
+  bWroteRow = TRUE;
+
+  ulTimedNs = 0;
+  ulTimedAllocs = 0;
+  ulTimedBytes = 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/*
+  Returns a new pathname of ulDepth components of ulLength random
+  lowercase letters each, or of random depths and lengths up to
+  MIX_DEPTH and MIX_LENGTH if ulDepth is 0. The caller owns it.
+*/
+static char *newPathname(size_t ulDepth, size_t ulLength) {
+  char *pcPath;
+  char *pcNext;
+  size_t ulLevel, ulChar;
+  boolean bMixed = (boolean) (ulDepth == 0);
+
+  if(bMixed) {
+    ulDepth = 1 + nextRandom(MIX_DEPTH);
+    ulLength = MIX_LENGTH;
+  }
+  pcPath = malloc(ulDepth * (ulLength + 1));
+  if(pcPath == NULL)
+    outOfMemory();
+
+  pcNext = pcPath;
+  for(ulLevel = 0; ulLevel < ulDepth; ulLevel++) {
+    size_t ulThisLength = bMixed ? 1 + nextRandom(ulLength) : ulLength;
+    if(ulLevel != 0)
+      *pcNext++ = '/';
+    for(ulChar = 0; ulChar < ulThisLength; ulChar++)
+      *pcNext++ = (char) ('a' + nextRandom(26));
+  }
+  *pcNext = '\0';
+  return pcPath;
+}
+
+/* Returns a new path for pcPath, exiting if it cannot be made. */
+static Path_T newPath(const char *pcPath) {
+  Path_T oPPath;
+
+  if(Path_new(pcPath, &oPPath) != SUCCESS)
+    outOfMemory();
+  return oPPath;
+}
+
+/*
+  Returns a new path of depth BASE_DEPTH that shares its first
+  ulShared components with oPPath, which is also of depth BASE_DEPTH,
+  and differs from it in the last letter of the rest.
+*/
+static Path_T newDivergingPath(Path_T oPPath, size_t ulShared) {
+  char *pcPath;
+  char *pcNext;
+  Path_T oPResult;
+  size_t ulLevel;
+
+  assert(oPPath != NULL);
+  assert(Path_getDepth(oPPath) == BASE_DEPTH);
+  assert(ulShared <= BASE_DEPTH);
+
+  pcPath = malloc(Path_getStrLength(oPPath) + 1);
+  if(pcPath == NULL)
+    outOfMemory();
+  strcpy(pcPath, Path_getPathname(oPPath));
+
+  pcNext = pcPath;
+  for(ulLevel = 0; ulLevel < BASE_DEPTH; ulLevel++) {
+    pcNext += BASE_LENGTH;
+    if(ulLevel >= ulShared)
+      pcNext[-1] = (char) (pcNext[-1] == 'z' ? 'a' : pcNext[-1] + 1);
+    pcNext++;
+  }
+  oPResult = newPath(pcPath);
+  free(pcPath);
+  return oPResult;
+}
+
+/*--------------------------------------------------------------------*/
+
+/*
+  Times ulOps calls to Path_new on pathnames of ulDepth components of
+  ulLength letters, or on BATCH pathnames of varied depths and
+  lengths if ulDepth is 0.
+*/
+static void benchPathNew(size_t ulDepth, size_t ulLength,
+                         size_t ulOps) {
+  enum {PARAM_LEN = 64};
+  char acParam[PARAM_LEN];
+  char *apcPaths[BATCH];
+  Path_T aoPPaths[BATCH];
+  size_t ulNumPaths = ulDepth == 0 ? BATCH : 1;
+  size_t ulDone, ulIndex;
+
+  for(ulIndex = 0; ulIndex < ulNumPaths; ulIndex++)
+    apcPaths[ulIndex] = newPathname(ulDepth, ulLength);
+
+  for(ulDone = 0; ulDone < ulOps; ulDone += BATCH) {
+    size_t ulBatch = ulOps - ulDone < BATCH ? ulOps - ulDone : BATCH;
+    startSection();
+    for(ulIndex = 0; ulIndex < ulBatch; ulIndex++)
+      if(Path_new(apcPaths[ulIndex % ulNumPaths], &aoPPaths[ulIndex])
+         != SUCCESS)
+        outOfMemory();
+    endSection();
+    for(ulIndex = 0; ulIndex < ulBatch; ulIndex++)
+      Path_free(aoPPaths[ulIndex]);
+  }
+
+  if(ulDepth == 0)
+    sprintf(acParam, "mixed");
+  else
+    sprintf(acParam, "depth=%lu;length=%lu", (unsigned long) ulDepth,
+            (unsigned long) ulLength);
+  report("Path_new", acParam, ulOps);
+
+  for(ulIndex = 0; ulIndex < ulNumPaths; ulIndex++)
+    free(apcPaths[ulIndex]);
+}
+
+/* Times ulOps calls to Path_prefix at each depth of a path of depth
+   BASE_DEPTH. */
+static void benchPathPrefix(size_t ulOps) {
+  enum {PARAM_LEN = 32};
+  char acParam[PARAM_LEN];
+  Path_T aoPPrefixes[BATCH];
+  char *pcPath = newPathname(BASE_DEPTH, BASE_LENGTH);
+  Path_T oPPath = newPath(pcPath);
+  size_t ulDepth, ulDone, ulIndex;
+
+  for(ulDepth = 1; ulDepth <= BASE_DEPTH; ulDepth++) {
+    for(ulDone = 0; ulDone < ulOps; ulDone += BATCH) {
+      size_t ulBatch = ulOps - ulDone < BATCH ? ulOps - ulDone : BATCH;
+      startSection();
+      for(ulIndex = 0; ulIndex < ulBatch; ulIndex++)
+        if(Path_prefix(oPPath, ulDepth, &aoPPrefixes[ulIndex])
+           != SUCCESS)
+          outOfMemory();
+      endSection();
+      for(ulIndex = 0; ulIndex < ulBatch; ulIndex++)
+        Path_free(aoPPrefixes[ulIndex]);
+    }
+    sprintf(acParam, "depth=%lu", (unsigned long) ulDepth);
+    report("Path_prefix", acParam, ulOps);
+  }
+
+  Path_free(oPPath);
+  free(pcPath);
+}
+
+/*
+  Times ulOps calls each to Path_getSharedPrefixDepth and to
+  Path_comparePath on pairs of paths of depth BASE_DEPTH that share
+  some of their first components.
+*/
+static void benchPathCompare(size_t ulOps) {
+  static const size_t aulShared[] = {0, 1, 8, 16, 31, BASE_DEPTH};
+  enum {NUM_SHARED = sizeof(aulShared) / sizeof(aulShared[0])};
+  enum {PARAM_LEN = 32};
+  char acParam[PARAM_LEN];
+  char *pcPath = newPathname(BASE_DEPTH, BASE_LENGTH);
+  Path_T oPPath = newPath(pcPath);
+  size_t ulCase, ulIndex;
+  size_t ulSum = 0;
+
+  for(ulCase = 0; ulCase < NUM_SHARED; ulCase++) {
+    Path_T oPOther = newDivergingPath(oPPath, aulShared[ulCase]);
+    sprintf(acParam, "shared=%lu", (unsigned long) aulShared[ulCase]);
+
+    startSection();
+    for(ulIndex = 0; ulIndex < ulOps; ulIndex++)
+      ulSum += Path_getSharedPrefixDepth(oPPath, oPOther);
+    endSection();
+    report("Path_getSharedPrefixDepth", acParam, ulOps);
+
+    startSection();
+    for(ulIndex = 0; ulIndex < ulOps; ulIndex++)
+      ulSum += (size_t) Path_comparePath(oPPath, oPOther);
+    endSection();
+    report("Path_comparePath", acParam, ulOps);
+
+    Path_free(oPOther);
+  }
+
+  Path_free(oPPath);
+  free(pcPath);
+  ulSink = ulSum;
+}
+
+/* Compares the keys pointed to by pvFirst and pvSecond, for
+   DynArray_bsearch. */
+static int compareKeys(const void *pvFirst, const void *pvSecond) {
+  size_t ulFirst = *(const size_t *) pvFirst;
+  size_t ulSecond = *(const size_t *) pvSecond;
+
+  if(ulFirst < ulSecond)
+    return -1;
+  return ulFirst > ulSecond;
+}
+
+/*
+  Times ulOps calls to DynArray_bsearch on a sorted array of ulLength
+  keys, half of them for keys that are present.
+*/
+static void benchBsearch(size_t ulLength, size_t ulOps) {
+  enum {PARAM_LEN = 32};
+  char acParam[PARAM_LEN];
+  DynArray_T oDArray;
+  size_t *pulKeys;
+  size_t *pulSought;
+  size_t ulIndex, ulFound;
+  size_t ulSum = 0;
+
+  pulKeys = malloc(ulLength * sizeof(size_t));
+  pulSought = malloc(BATCH * sizeof(size_t));
+  oDArray = DynArray_new(0);
+  if(pulKeys == NULL || pulSought == NULL || oDArray == NULL)
+    outOfMemory();
+  /* the keys are even, so the odd ones sought are missing */
+  for(ulIndex = 0; ulIndex < ulLength; ulIndex++) {
+    pulKeys[ulIndex] = 2 * ulIndex;
+    if(!DynArray_add(oDArray, &pulKeys[ulIndex]))
+      outOfMemory();
+  }
+  for(ulIndex = 0; ulIndex < BATCH; ulIndex++)
+    pulSought[ulIndex] = nextRandom(2 * ulLength);
+
+  startSection();
+  for(ulIndex = 0; ulIndex < ulOps; ulIndex++)
+    ulSum += (size_t) DynArray_bsearch(oDArray,
+                                       &pulSought[ulIndex % BATCH],
+                                       &ulFound, compareKeys);
+  endSection();
+  sprintf(acParam, "n=%lu", (unsigned long) ulLength);
+  report("DynArray_bsearch", acParam, ulOps);
+
+  DynArray_free(oDArray);
+  free(pulSought);
+  free(pulKeys);
+  ulSink = ulSum;
+}
+
+/*
+  Times at least ulOps calls to DynArray_addAt at random positions,
+  growing arrays from empty to ulLength elements.
+*/
+static void benchAddAt(size_t ulLength, size_t ulOps) {
+  enum {PARAM_LEN = 32};
+  char acParam[PARAM_LEN];
+  size_t *pulPositions;
+  size_t ulDone, ulIndex;
+
+  pulPositions = malloc(ulLength * sizeof(size_t));
+  if(pulPositions == NULL)
+    outOfMemory();
+  for(ulIndex = 0; ulIndex < ulLength; ulIndex++)
+    pulPositions[ulIndex] = nextRandom(ulIndex + 1);
+
+  for(ulDone = 0; ulDone < ulOps; ulDone += ulLength) {
+    DynArray_T oDArray = DynArray_new(0);
+    if(oDArray == NULL)
+      outOfMemory();
+    startSection();
+    for(ulIndex = 0; ulIndex < ulLength; ulIndex++)
+      if(!DynArray_addAt(oDArray, pulPositions[ulIndex], pulPositions))
+        outOfMemory();
+    endSection();
+    DynArray_free(oDArray);
+  }
+  sprintf(acParam, "n=%lu", (unsigned long) ulLength);
+  report("DynArray_addAt", acParam, ulDone);
+
+  free(pulPositions);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Writes how to run pathbench to stderr and exits. */
+static void usage(void) {
+  fprintf(stderr, "usage: pathbench [-i calls] [-S seed] "
+          "[-o csv|json]\n");
+  exit(EXIT_FAILURE);
+}
+
+/* Returns the positive number in pcArg, exiting with usage if it is
+   not one. */
+static size_t parseCount(const char *pcArg) {
+  char *pcEnd;
+  unsigned long ulValue = strtoul(pcArg, &pcEnd, 10);
+
+  if(*pcArg == '\0' || *pcEnd != '\0' || ulValue == 0)
+    usage();
+  return (size_t) ulValue;
+}
+
+/*
+  Runs every benchmark with the number of calls chosen by the
+  command-line options in argv, writing results to stdout as CSV
+  (with a header) or as a JSON array. Returns 0.
+*/
+int main(int argc, char *argv[]) {
+  static const size_t aulDepths[] = {1, 4, 16, 64};
+  static const size_t aulLengths[] = {1, 8, 32};
+  static const size_t aulSearchLengths[] = {16, 256, 4096, 65536};
+  static const size_t aulAddLengths[] = {256, 4096, 16384};
+  size_t ulOps = 200000;
+  size_t ulDepth, ulLength;
+  int iOption;
+
+  while((iOption = getopt(argc, argv, "i:S:o:")) != -1) {
+    switch(iOption) {
+    case 'i':
+      ulOps = parseCount(optarg);
+      break;
+    case 'S':
+      ulRandom = (unsigned long) parseCount(optarg) & 0xFFFFFFFFUL;
+      if(ulRandom == 0)
+        usage();
+      break;
+    case 'o':
+      if(!strcmp(optarg, "json"))
+        bJson = TRUE;
+      else if(strcmp(optarg, "csv"))
+        usage();
+      break;
+    default:
+      usage();
+    }
+  }
+  if(optind != argc)
+    usage();
+
+  if(bJson)
+    printf("[\n");
+  else
+    printf("benchmark,param,ops,ns_per_op,allocs_per_op,bytes_per_op\n");
+
+  for(ulDepth = 0; ulDepth < sizeof(aulDepths) / sizeof(size_t);
+      ulDepth++)
+    for(ulLength = 0; ulLength < sizeof(aulLengths) / sizeof(size_t);
+        ulLength++)
+      benchPathNew(aulDepths[ulDepth], aulLengths[ulLength], ulOps);
+  benchPathNew(0, 0, ulOps);
+  benchPathPrefix(ulOps);
+  benchPathCompare(ulOps);
+  for(ulLength = 0;
+      ulLength < sizeof(aulSearchLengths) / sizeof(size_t); ulLength++)
+    benchBsearch(aulSearchLengths[ulLength], ulOps);
+  for(ulLength = 0; ulLength < sizeof(aulAddLengths) / sizeof(size_t);
+      ulLength++)
+    benchAddAt(aulAddLengths[ulLength], ulOps);
+
+  if(bJson)
+    printf("%s]\n", bWroteRow ? "\n" : "");
+
+  return 0;
+}